@@ -0,0 +1,265 @@
+#include "AddressSet.h"
+#include "FirewallManager.h"
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+/**
+ * @brief 地址集合性能测试
+ *
+ * 对不同大小的集合（单个地址为主，另有1%的网段）测量批量添加和查找的耗时，
+ * 查找耗时应与集合大小基本无关；用逐个成员比较的朴素实现核对查找结果。
+ * 之后用FirewallManager建一个N个地址（默认5万）的封禁集合，只需一条规则，
+ * 测量提交和更新集合的耗时，更新集合时不下发任何规则。最后在它前面插入一条
+ * 源、目的都引用集合（封禁集合和1000个地址的服务器集合）的放行规则，检查分类
+ * 结果，并测量重建分类器的耗时（只展开较小的集合，不展开两个集合的笛卡尔积）。
+ * 再插入一条不限端口的两集合规则，在末尾加一条与它重叠的目的地址规则，检查集合
+ * 检查不通过时落到后面的规则。最后删除一个集合，检查ipset命令失败时提交返回失败，
+ * 下次提交重放删除。
+ *
+ * 用法: address_set_bench [封禁地址数]
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t QUERY_POOL = 1 << 20;
+const size_t QUERIES = 10000000;
+// 朴素实现核对时比较的总次数上限
+const size_t CHECK_BUDGET = 200000000;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * @brief 生成count个不重复的成员
+ */
+std::vector<std::pair<uint32_t, int>> makeMembers(std::mt19937_64& rng, size_t count) {
+    std::set<std::pair<uint32_t, int>> unique;
+    while (unique.size() < count) {
+        int length = rng() % 100 == 0 ? 8 + static_cast<int>(rng() % 23) : 32;
+        uint32_t address = static_cast<uint32_t>(rng());
+        if (length < 32) {
+            address &= 0xffffffffu << (32 - length);
+        }
+        unique.insert(std::make_pair(address, length));
+    }
+    std::vector<std::pair<uint32_t, int>> members(unique.begin(), unique.end());
+    std::shuffle(members.begin(), members.end(), rng);
+    return members;
+}
+
+bool referenceContains(const std::vector<std::pair<uint32_t, int>>& members, uint32_t address) {
+    for (const auto& member : members) {
+        int length = member.second;
+        if (length == 0 || (address >> (32 - length)) == (member.first >> (32 - length))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief 一种集合大小的测试
+ * @return 核对通过返回true
+ */
+bool benchSize(size_t count, std::mt19937_64& rng) {
+    std::vector<std::pair<uint32_t, int>> members = makeMembers(rng, count);
+
+    AddressSet address_set;
+    auto start = Clock::now();
+    address_set.reserve(count);
+    for (const auto& member : members) {
+        address_set.add(member.first, member.second);
+    }
+    double added = secondsSince(start);
+
+    // 一半取自成员，一半随机
+    std::vector<uint32_t> queries(QUERY_POOL);
+    for (size_t i = 0; i < QUERY_POOL; ++i) {
+        const auto& member = members[rng() % count];
+        uint32_t host_bits = member.second == 32 ? 0 : 0xffffffffu >> member.second;
+        queries[i] = i % 2 == 0 ? member.first | (static_cast<uint32_t>(rng()) & host_bits)
+                                : static_cast<uint32_t>(rng());
+    }
+
+    start = Clock::now();
+    size_t hits = 0;
+    for (size_t i = 0; i < QUERIES; ++i) {
+        hits += address_set.contains(queries[i & (QUERY_POOL - 1)]);
+    }
+    double elapsed = secondsSince(start);
+
+    size_t checks = std::min<size_t>(2000, CHECK_BUDGET / count);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < checks; ++i) {
+        uint32_t address = queries[(i * 7919) & (QUERY_POOL - 1)];
+        mismatches += address_set.contains(address) != referenceContains(members, address);
+    }
+
+    start = Clock::now();
+    size_t removed = count / 10;
+    for (size_t i = 0; i < removed; ++i) {
+        address_set.remove(members[i].first, members[i].second);
+    }
+    double remove_time = secondsSince(start);
+    std::vector<std::pair<uint32_t, int>> rest(members.begin() + removed, members.end());
+    for (size_t i = 0; i < checks; ++i) {
+        uint32_t address = queries[(i * 7919) & (QUERY_POOL - 1)];
+        mismatches += address_set.contains(address) != referenceContains(rest, address);
+    }
+
+    std::cout << "  " << count << " 个成员: 添加 " << added * 1e9 / count << " ns/个, 查找 "
+              << elapsed * 1e9 / QUERIES << " ns/次 (命中 " << hits * 100 / QUERIES << "%), 删除 "
+              << remove_time * 1e9 / removed << " ns/个, " << address_set.memoryUsage() / 1024
+              << " KB, 不一致 " << mismatches << std::endl;
+    return mismatches == 0;
+}
+
+/**
+ * @brief 用集合封禁count个地址
+ * @return 提交成功且分类结果正确返回true
+ */
+bool benchFirewall(size_t count, std::mt19937_64& rng) {
+    FirewallManager manager;
+    manager.setRestoreCommand("cat > /dev/null");
+    manager.setIpsetCommand("cat > /dev/null");
+    manager.setAutoCommit(false);
+    manager.createAddressSet("blocklist");
+
+    std::vector<std::string> entries(count);
+    for (auto& entry : entries) {
+        entry = AddressSet::format(static_cast<uint32_t>(rng()), 32);
+    }
+    auto start = Clock::now();
+    manager.addToAddressSet("blocklist", entries);
+    double staged = secondsSince(start);
+
+    FirewallRule rule;
+    rule.table = IptablesTable::FILTER;
+    rule.chain = IptablesChain::INPUT;
+    rule.operation = IptablesOperation::APPEND;
+    rule.src_set = "blocklist";
+    rule.action = "DROP";
+    rule.enabled = true;
+    manager.addFirewallRule(rule);
+    std::string payload = manager.pendingRestorePayload();
+
+    start = Clock::now();
+    bool ok = manager.commit();
+    double committed = secondsSince(start);
+    std::cout << "  " << count << " 个地址的集合 + 1 条规则 (iptables载荷 " << payload.size() << " 字节): 记入 "
+              << staged * 1000 << " ms, 提交 " << committed * 1000 << " ms" << std::endl;
+
+    // 更新集合：换掉1000个地址
+    std::vector<std::string> removed(entries.begin(), entries.begin() + 1000);
+    std::vector<std::string> added(1000);
+    for (auto& entry : added) {
+        entry = AddressSet::format(static_cast<uint32_t>(rng()), 32);
+    }
+    start = Clock::now();
+    manager.removeFromAddressSet("blocklist", removed);
+    manager.addToAddressSet("blocklist", added);
+    bool no_rules = manager.pendingRestorePayload().empty();
+    ok = manager.commit() && ok;
+    double updated = secondsSince(start);
+    std::cout << "  换掉1000个地址: " << updated * 1000 << " ms, "
+              << (no_rules ? "没有规则变化" : "有规则变化") << std::endl;
+
+    PacketTuple packet;
+    PacketTuple::parse(added[0], "192.0.2.1", "tcp", 40000, 443, &packet);
+    const FirewallRule* hit = manager.classifyPacket(IptablesTable::FILTER, IptablesChain::INPUT, packet);
+    PacketTuple::parse(removed[0], "192.0.2.1", "tcp", 40000, 443, &packet);
+    const FirewallRule* miss = manager.classifyPacket(IptablesTable::FILTER, IptablesChain::INPUT, packet);
+    bool classified = hit != nullptr && miss == nullptr;
+    std::cout << "  分类: " << (classified ? "新地址命中，删除的地址不命中" : "结果错误") << std::endl;
+
+    // 源、目的都引用集合的规则
+    std::vector<std::string> servers(1000);
+    for (auto& entry : servers) {
+        entry = AddressSet::format(static_cast<uint32_t>(rng()), 32);
+    }
+    manager.createAddressSet("servers");
+    manager.addToAddressSet("servers", servers);
+    FirewallRule allow = rule;
+    allow.operation = IptablesOperation::INSERT;
+    allow.protocol = "tcp";
+    allow.dst_port = "443";
+    allow.dst_set = "servers";
+    allow.action = "ACCEPT";
+    manager.addFirewallRule(allow);
+    ok = manager.commit() && ok;
+
+    start = Clock::now();
+    PacketTuple::parse(added[1], servers[0], "tcp", 40000, 443, &packet);
+    const FirewallRule* both = manager.classifyPacket(IptablesTable::FILTER, IptablesChain::INPUT, packet);
+    double rebuilt = secondsSince(start);
+    PacketTuple::parse(added[1], "192.0.2.1", "tcp", 40000, 443, &packet);
+    const FirewallRule* src_only = manager.classifyPacket(IptablesTable::FILTER, IptablesChain::INPUT, packet);
+    PacketTuple::parse(removed[1], servers[0], "tcp", 40000, 443, &packet);
+    const FirewallRule* dst_only = manager.classifyPacket(IptablesTable::FILTER, IptablesChain::INPUT, packet);
+    bool pairs = both != nullptr && both->action == "ACCEPT" && src_only != nullptr && src_only->action == "DROP" &&
+                 dst_only == nullptr;
+    std::cout << "  两个集合的规则: 重建分类器 " << rebuilt * 1000 << " ms, "
+              << (pairs ? "都属于时放行，只有源属于时落到封禁规则" : "结果错误") << std::endl;
+
+    // 不限端口的两集合规则展开后与末尾的目的地址规则在同一个键上，集合检查不通过时
+    // 要落到后者，不能把后者当作被遮住而丢掉
+    FirewallRule any_port = allow;
+    any_port.protocol.clear();
+    any_port.dst_port.clear();
+    manager.addFirewallRule(any_port);
+    FirewallRule reject = rule;
+    reject.src_set.clear();
+    reject.dst_ip = servers[0];
+    reject.action = "REJECT";
+    manager.addFirewallRule(reject);
+    ok = manager.commit() && ok;
+    PacketTuple::parse(added[1], servers[0], "udp", 40000, 53, &packet);
+    const FirewallRule* member = manager.classifyPacket(IptablesTable::FILTER, IptablesChain::INPUT, packet);
+    PacketTuple::parse(removed[1], servers[0], "udp", 40000, 53, &packet);
+    const FirewallRule* fallthrough = manager.classifyPacket(IptablesTable::FILTER, IptablesChain::INPUT, packet);
+    bool overlapping = member != nullptr && member->action == "ACCEPT" && fallthrough != nullptr &&
+                       fallthrough->action == "REJECT";
+    std::cout << "  重叠的规则: "
+              << (overlapping ? "集合检查通过时放行，不通过时落到后面的规则" : "结果错误") << std::endl;
+
+    // 删除集合经ipset命令执行，失败时留到下次提交重放
+    manager.createAddressSet("scratch");
+    ok = manager.commit() && ok;
+    manager.destroyAddressSet("scratch");
+    manager.setIpsetCommand("cat > /dev/null; false");
+    bool destroy_failed = !manager.commit();
+    manager.setIpsetCommand("grep -x 'destroy scratch' > /dev/null");
+    bool destroyed = destroy_failed && manager.commit();
+    manager.setIpsetCommand("cat > /dev/null");
+    std::cout << "  删除集合: " << (destroyed ? "失败时提交返回失败，下次提交重放" : "结果错误") << std::endl;
+    return ok && no_rules && classified && pairs && overlapping && destroyed;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 50000;
+    if (count < 1000) {
+        std::cerr << "用法: " << argv[0] << " [封禁地址数(至少1000)]" << std::endl;
+        return 1;
+    }
+
+    std::mt19937_64 rng(1);
+    bool ok = true;
+    std::cout << "AddressSet:" << std::endl;
+    for (size_t size = 1000; size <= 1000000; size *= 10) {
+        ok = benchSize(size, rng) && ok;
+    }
+    std::cout << "FirewallManager:" << std::endl;
+    ok = benchFirewall(count, rng) && ok;
+    return ok ? 0 : 1;
+}
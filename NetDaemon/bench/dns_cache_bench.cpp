@@ -0,0 +1,275 @@
+#include "DNSCache.h"
+#include "TimerWheel.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+/**
+ * @brief DNS缓存性能测试
+ *
+ * 先用随机的添加、取消、修改和推进核对时间轮与朴素实现（按到期时间排序的
+ * multimap）的结果。之后向缓存插入N条记录（默认100万，TTL在1秒到1小时之间，
+ * 其中10%是否定应答），测量插入、单线程和多线程查找的耗时；按秒推进一小时，
+ * 测量每秒清理到期条目的耗时并核对剩余条数，与整表扫描的耗时对比。最后检查
+ * 预取和否定缓存的行为。
+ *
+ * 用法: dns_cache_bench [条目数]
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const uint64_t START_MS = 1000000;
+const int MAX_TTL = 3600;
+const size_t LOOKUPS = 4000000;
+const int THREADS = 4;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+std::string hostName(size_t i) {
+    return "host" + std::to_string(i) + ".example.test";
+}
+
+/**
+ * @brief 随机操作时间轮，与multimap核对
+ * @return 到期的定时器和时间都一致返回true
+ */
+bool checkTimerWheel(std::mt19937_64& rng) {
+    TimerWheel wheel(5);
+    std::multimap<uint64_t, uint64_t> reference;
+    std::vector<uint32_t> timers;            // 按数据编号
+    std::vector<std::multimap<uint64_t, uint64_t>::iterator> positions;
+    std::vector<bool> active;
+    std::vector<uint64_t> expired;
+    uint64_t now = 5;
+    size_t mismatches = 0;
+    size_t fired = 0;
+
+    for (int round = 0; round < 200000; ++round) {
+        int op = static_cast<int>(rng() % 10);
+        // 到期时间分布在不同的级上，偶尔超出一次能放下的范围
+        uint64_t delay = rng() % 4 == 0 ? rng() % 64 : (rng() % 100 == 0 ? rng() % (1ull << 26) : rng() % 300000);
+        if (op < 5) {
+            uint64_t data = timers.size();
+            timers.push_back(wheel.schedule(now + delay, data));
+            positions.push_back(reference.insert(std::make_pair(now + delay, data)));
+            active.push_back(true);
+        } else if (op < 7 && !timers.empty()) {
+            size_t data = rng() % timers.size();
+            if (active[data]) {
+                wheel.cancel(timers[data]);
+                reference.erase(positions[data]);
+                active[data] = false;
+            }
+        } else if (op < 8 && !timers.empty()) {
+            size_t data = rng() % timers.size();
+            if (active[data]) {
+                wheel.reschedule(timers[data], now + delay);
+                reference.erase(positions[data]);
+                positions[data] = reference.insert(std::make_pair(now + delay, data));
+            }
+        } else {
+            now += 1 + rng() % 5000;
+            expired.clear();
+            wheel.advance(now, &expired);
+            std::vector<uint64_t> want;
+            while (!reference.empty() && reference.begin()->first <= now) {
+                want.push_back(reference.begin()->second);
+                active[reference.begin()->second] = false;
+                reference.erase(reference.begin());
+            }
+            std::sort(expired.begin(), expired.end());
+            std::sort(want.begin(), want.end());
+            mismatches += expired != want;
+            fired += want.size();
+        }
+    }
+    mismatches += wheel.size() != reference.size();
+    std::cout << "时间轮: 到期 " << fired << " 个, 未到期 " << reference.size() << " 个, 不一致 " << mismatches
+              << std::endl;
+    return mismatches == 0;
+}
+
+DNSResolution makeResult(size_t i, int ttl, bool negative) {
+    DNSResolution result;
+    result.hostname = hostName(i);
+    result.ttl = ttl;
+    result.success = !negative;
+    result.rcode = negative ? 3 : 0;
+    if (!negative) {
+        result.ip_addresses.push_back("10." + std::to_string((i >> 16) & 0xff) + "." +
+                                      std::to_string((i >> 8) & 0xff) + "." + std::to_string(i & 0xff));
+    } else {
+        result.error_message = "Domain not found: " + result.hostname;
+    }
+    return result;
+}
+
+/**
+ * @brief 插入、查找和按秒清理
+ * @return 剩余条数与预期一致返回true
+ */
+bool benchCache(size_t count, std::mt19937_64& rng) {
+    DNSCache cache;
+    cache.setLimits(MAX_TTL, 300);
+    std::vector<std::string> names(count);
+    std::vector<int> ttls(count);
+    for (size_t i = 0; i < count; ++i) {
+        names[i] = hostName(i);
+    }
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        bool negative = i % 10 == 0;
+        int ttl = 1 + static_cast<int>(rng() % MAX_TTL);
+        ttls[i] = negative ? 300 : ttl;
+        cache.insert(names[i], DNSQueryType::A, makeResult(i, ttl, negative), START_MS);
+    }
+    double inserted = secondsSince(start);
+
+    std::vector<uint32_t> queries(LOOKUPS);
+    for (auto& query : queries) {
+        query = static_cast<uint32_t>(rng() % count);
+    }
+    uint64_t now = START_MS + 500;
+    start = Clock::now();
+    size_t hits = 0;
+    DNSResolution result;
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        hits += cache.lookup(names[queries[i]], DNSQueryType::A, now, &result) != DNSCache::Status::MISS;
+    }
+    double single = secondsSince(start);
+
+    std::atomic<size_t> threaded_hits(0);
+    std::vector<std::thread> threads;
+    start = Clock::now();
+    for (int t = 0; t < THREADS; ++t) {
+        threads.push_back(std::thread([&, t] {
+            DNSResolution local;
+            size_t local_hits = 0;
+            for (size_t i = t; i < LOOKUPS; i += THREADS) {
+                local_hits += cache.lookup(names[queries[i]], DNSQueryType::A, now, &local) != DNSCache::Status::MISS;
+            }
+            threaded_hits += local_hits;
+        }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double threaded = secondsSince(start);
+
+    std::cout << "DNSCache (" << count << " 条): 插入 " << inserted * 1e9 / count << " ns/条, 查找 "
+              << single * 1e9 / LOOKUPS << " ns/次, " << THREADS << " 线程查找 " << threaded * 1e9 / LOOKUPS
+              << " ns/次, 命中 " << hits * 100 / LOOKUPS << "%/" << threaded_hits * 100 / LOOKUPS << "%" << std::endl;
+
+    // 按秒推进，每秒清理一次
+    std::vector<size_t> expiring(MAX_TTL + 2, 0);
+    for (int ttl : ttls) {
+        expiring[ttl]++;
+    }
+    size_t remaining = count;
+    size_t mismatches = 0;
+    double worst = 0;
+    start = Clock::now();
+    for (int second = 1; second <= MAX_TTL; ++second) {
+        auto step = Clock::now();
+        cache.expire(START_MS + static_cast<uint64_t>(second) * 1000);
+        worst = std::max(worst, secondsSince(step));
+        remaining -= expiring[second];
+        if (second % 600 == 0 || second == 1) {
+            mismatches += cache.size() != remaining;
+        }
+    }
+    double expired = secondsSince(start);
+    mismatches += cache.size() != 0;
+
+    // 对比：原来每次解析都要扫描整个缓存
+    std::map<std::string, DNSCacheEntry> scanned;
+    for (size_t i = 0; i < count; ++i) {
+        DNSCacheEntry entry;
+        entry.hostname = names[i];
+        entry.timestamp = 0;
+        entry.ttl = ttls[i];
+        scanned[names[i]] = entry;
+    }
+    start = Clock::now();
+    size_t live = 0;
+    for (const auto& pair : scanned) {
+        live += pair.second.ttl > 1;
+    }
+    double scan = secondsSince(start);
+
+    std::cout << "  按秒清理1小时: 共 " << expired * 1000 << " ms, 平均 " << expired * 1e6 / MAX_TTL
+              << " µs/秒, 最长 " << worst * 1e6 << " µs; 整表扫描一次 " << scan * 1000 << " ms (" << live
+              << " 条未到期), 剩余条数不一致 " << mismatches << std::endl;
+    return mismatches == 0;
+}
+
+/**
+ * @brief 预取和否定缓存
+ */
+bool checkBehaviour() {
+    DNSCache cache;
+    cache.setLimits(MAX_TTL, 30);
+    DNSResolution result;
+    bool ok = true;
+
+    // TTL 100秒：最后10秒内的第一次命中返回PREFETCH，只返回一次
+    cache.insert("hot.example.test", DNSQueryType::A, makeResult(1, 100, false), START_MS);
+    ok = cache.lookup("hot.example.test", DNSQueryType::A, START_MS + 1000, &result) == DNSCache::Status::HIT && ok;
+    ok = cache.lookup("HOT.example.test.", DNSQueryType::A, START_MS + 50000, &result) == DNSCache::Status::HIT && ok;
+    ok = result.ttl == 50 && ok;
+    ok = cache.lookup("hot.example.test", DNSQueryType::A, START_MS + 91000, &result) == DNSCache::Status::PREFETCH && ok;
+    ok = cache.lookup("hot.example.test", DNSQueryType::A, START_MS + 92000, &result) == DNSCache::Status::HIT && ok;
+    ok = cache.lookup("hot.example.test", DNSQueryType::AAAA, START_MS + 92000, &result) == DNSCache::Status::MISS && ok;
+    cache.insert("hot.example.test", DNSQueryType::A, makeResult(1, 100, false), START_MS + 93000);
+    ok = cache.lookup("hot.example.test", DNSQueryType::A, START_MS + 150000, &result) == DNSCache::Status::HIT && ok;
+    ok = result.ttl == 43 && ok;
+
+    // 否定应答按否定缓存TTL缓存，超时和截断不缓存
+    cache.insert("nx.example.test", DNSQueryType::A, makeResult(2, 3600, true), START_MS);
+    ok = cache.lookup("nx.example.test", DNSQueryType::A, START_MS + 29000, &result) == DNSCache::Status::HIT && ok;
+    ok = !result.success && result.rcode == 3 && ok;
+    ok = cache.lookup("nx.example.test", DNSQueryType::A, START_MS + 30000, &result) == DNSCache::Status::MISS && ok;
+    DNSResolution timeout = makeResult(3, 0, true);
+    timeout.rcode = -1;
+    ok = !cache.insert("slow.example.test", DNSQueryType::A, timeout, START_MS) && ok;
+    DNSResolution truncated = makeResult(4, 0, true);
+    truncated.rcode = -1;
+    truncated.error_message = "Truncated response for big.example.test";
+    ok = !cache.insert("big.example.test", DNSQueryType::A, truncated, START_MS) && ok;
+    ok = cache.lookup("big.example.test", DNSQueryType::A, START_MS, &result) == DNSCache::Status::MISS && ok;
+    DNSResolution nodata = makeResult(5, 0, true);
+    nodata.rcode = 0;
+    nodata.error_message = "No records found for " + nodata.hostname;
+    ok = cache.insert("nodata.example.test", DNSQueryType::AAAA, nodata, START_MS) && ok;
+
+    std::cout << "预取和否定缓存: " << (ok ? "符合预期" : "不符合预期") << std::endl;
+    return ok;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    if (count == 0) {
+        std::cerr << "用法: " << argv[0] << " [条目数]" << std::endl;
+        return 1;
+    }
+
+    std::mt19937_64 rng(1);
+    bool ok = checkTimerWheel(rng);
+    ok = benchCache(count, rng) && ok;
+    ok = checkBehaviour() && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,415 @@
+#include "DNSForwarder.h"
+#include "DNSResolver.h"
+#include "DNSManager.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/**
+ * @brief 本地DNS转发器性能测试
+ *
+ * 在127.0.0.1上启动一个桩上游服务器（hN.example.test的A和TXT记录，many.example.test
+ * 有60条A记录，tc.example.test只返回截断的应答且没有TCP，其他域名NXDOMAIN），
+ * DNSManager以它为上游在127.0.0.1的随机端口上启动转发器。先核对应答（NXDOMAIN、
+ * 原样转发的MX和TXT、FORMERR、截断、上游截断时的SERVFAIL），再由多个客户端线程
+ * 各用一个套接字保持一定数量的查询在途，用sendmmsg()/recvmmsg()批量收发：第一轮
+ * 每个域名查询一次（全部转发到上游），第二轮反复查询这些域名（全部由缓存应答），
+ * 测量每秒查询数并统计上游实际收到的查询数。
+ *
+ * 用法: dns_forwarder_bench [查询数] [客户端线程数]
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const unsigned int BATCH = 32;
+const unsigned long WINDOW = 256;        // 每个客户端在途的查询数
+const int MANY_RECORDS = 60;
+const uint16_t TYPE_A = 1;
+const uint16_t TYPE_MX = 15;
+const uint16_t TYPE_TXT = 16;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+uint16_t read16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+void write16(uint8_t* p, uint16_t value) {
+    p[0] = static_cast<uint8_t>(value >> 8);
+    p[1] = static_cast<uint8_t>(value);
+}
+
+std::string hostName(unsigned long n) {
+    return "h" + std::to_string(n) + ".example.test";
+}
+
+in_addr expectedAddress(unsigned long n) {
+    in_addr addr;
+    addr.s_addr = htonl(0x0a000000u | (n & 0xffffff));
+    return addr;
+}
+
+/**
+ * @brief 桩上游服务器，在自己的线程中逐个应答
+ */
+class StubServer {
+public:
+    StubServer() : fd_(-1), port_(0), running_(false), received_(0) {}
+
+    ~StubServer() { stop(); }
+
+    bool start() {
+        fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (fd_ < 0 || bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+            getsockname(fd_, reinterpret_cast<sockaddr*>(&addr), &len) < 0) {
+            std::cerr << "桩服务器启动失败: " << strerror(errno) << std::endl;
+            return false;
+        }
+        port_ = ntohs(addr.sin_port);
+        running_ = true;
+        thread_ = std::thread(&StubServer::loop, this);
+        return true;
+    }
+
+    void stop() {
+        running_ = false;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    uint16_t port() const { return port_; }
+    unsigned long received() const { return received_; }
+
+private:
+    int fd_;
+    uint16_t port_;
+    std::atomic<bool> running_;
+    std::atomic<unsigned long> received_;
+    std::thread thread_;
+
+    void loop() {
+        uint8_t query[512];
+        uint8_t reply[1500];
+        while (running_) {
+            struct pollfd pfd;
+            pfd.fd = fd_;
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, 50) <= 0) {
+                continue;
+            }
+            sockaddr_storage from;
+            socklen_t from_len = sizeof(from);
+            ssize_t n = recvfrom(fd_, query, sizeof(query), 0, reinterpret_cast<sockaddr*>(&from), &from_len);
+            size_t offset = 12;
+            std::string name;
+            if (n < 12 || !DNSResolver::readName(query, n, &offset, &name) || offset + 4 > static_cast<size_t>(n)) {
+                continue;
+            }
+            // 解析器随机了域名的大小写，按小写匹配，问题段原样返回
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            received_++;
+            size_t length = answer(query, offset + 4, name, read16(query + offset), reply, sizeof(reply));
+            sendto(fd_, reply, length, 0, reinterpret_cast<sockaddr*>(&from), from_len);
+        }
+    }
+
+    /**
+     * @brief 复制问题段并追加A记录，不带OPT
+     */
+    static size_t answer(const uint8_t* query, size_t question_end, const std::string& name, uint16_t qtype,
+                         uint8_t* reply, size_t size) {
+        memcpy(reply, query, question_end);
+        write16(reply + 2, 0x8180);
+        write16(reply + 6, 0);
+        write16(reply + 8, 0);
+        write16(reply + 10, 0);
+        std::vector<in_addr> addresses;
+        unsigned long n = 0;
+        if (name == "tc.example.test") {
+            write16(reply + 2, 0x8380);
+            return question_end;
+        } else if (name == "many.example.test") {
+            for (int i = 0; i < MANY_RECORDS; ++i) {
+                in_addr addr;
+                addr.s_addr = htonl(0x0a010000u | i);
+                addresses.push_back(addr);
+            }
+        } else if (sscanf(name.c_str(), "h%lu.example.test", &n) == 1 && name == hostName(n)) {
+            addresses.push_back(expectedAddress(n));
+        } else {
+            write16(reply + 2, 0x8183);
+            return question_end;
+        }
+        if (qtype == TYPE_TXT && question_end + 20 <= size) {
+            // 一条TXT记录"v=bench"
+            static const char TEXT[] = "v=bench";
+            write16(reply + question_end, 0xc00c);
+            write16(reply + question_end + 2, TYPE_TXT);
+            write16(reply + question_end + 4, 1);
+            write16(reply + question_end + 6, 0);
+            write16(reply + question_end + 8, 300);
+            write16(reply + question_end + 10, sizeof(TEXT));
+            reply[question_end + 12] = sizeof(TEXT) - 1;
+            memcpy(reply + question_end + 13, TEXT, sizeof(TEXT) - 1);
+            write16(reply + 6, 1);
+            return question_end + 12 + sizeof(TEXT);
+        }
+        if (qtype != TYPE_A) {
+            return question_end;
+        }
+
+        size_t pos = question_end;
+        for (const auto& addr : addresses) {
+            if (pos + 16 > size) {
+                break;
+            }
+            write16(reply + pos, 0xc00c);
+            write16(reply + pos + 2, TYPE_A);
+            write16(reply + pos + 4, 1);
+            write16(reply + pos + 6, 0);
+            write16(reply + pos + 8, 300);
+            write16(reply + pos + 10, 4);
+            memcpy(reply + pos + 12, &addr, 4);
+            pos += 16;
+        }
+        write16(reply + 6, static_cast<uint16_t>((pos - question_end) / 16));
+        return pos;
+    }
+};
+
+int connectTo(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int size = 1 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    return fd;
+}
+
+/**
+ * @brief 发送一个查询并等待应答
+ * @return 应答，超时为空
+ */
+std::vector<uint8_t> exchange(uint16_t port, const uint8_t* packet, size_t length) {
+    std::vector<uint8_t> reply(1500);
+    int fd = connectTo(port);
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if (fd < 0 || send(fd, packet, length, 0) < 0 || poll(&pfd, 1, 2000) <= 0) {
+        reply.clear();
+    } else {
+        ssize_t n = recv(fd, reply.data(), reply.size(), 0);
+        reply.resize(n > 0 ? n : 0);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return reply;
+}
+
+/**
+ * @brief 核对一个查询的应答码、回答数和TC，应答的查询ID和问题段须与查询的一致
+ */
+bool check(uint16_t port, const char* label, const std::string& name, uint16_t qtype, bool edns, int rcode,
+           int answers, bool truncated) {
+    uint8_t packet[512];
+    size_t length = 12;
+    if (name.empty()) {
+        // 格式错误：声明一个问题但只有头部
+        memset(packet, 0, 12);
+        write16(packet, 0x1234);
+        write16(packet + 4, 1);
+    } else {
+        length = DNSResolver::encodeQuery(name, qtype, 0x1234, packet, sizeof(packet));
+        if (!edns) {
+            length -= 11;
+            write16(packet + 10, 0);
+        }
+    }
+    std::vector<uint8_t> reply = exchange(port, packet, length);
+    size_t question = name.empty() ? 0 : length - 12 - (edns ? 11 : 0);
+    bool ok = reply.size() >= 12 + question && memcmp(reply.data() + 12, packet + 12, question) == 0 &&
+              read16(reply.data()) == 0x1234 && (reply[3] & 0x0f) == rcode &&
+              read16(reply.data() + 6) == answers && ((reply[2] & 0x02) != 0) == truncated;
+    std::cout << "  " << label << ": " << (reply.empty() ? "无应答" : "应答码 " + std::to_string(reply.size() >= 4 ? reply[3] & 0x0f : -1))
+              << ", 回答 " << (reply.size() >= 12 ? read16(reply.data() + 6) : 0) << ", " << reply.size() << " 字节"
+              << ((reply.size() >= 4 && (reply[2] & 0x02)) ? ", TC" : "") << (ok ? "" : "  <- 不符合预期")
+              << std::endl;
+    return ok;
+}
+
+/**
+ * @brief 一个客户端：保持WINDOW个查询在途，批量收发并核对地址
+ */
+void runClient(uint16_t port, unsigned long first, unsigned long count, unsigned long names,
+               std::atomic<unsigned long>* failed) {
+    int fd = connectTo(port);
+    if (fd < 0) {
+        *failed += count;
+        return;
+    }
+    std::vector<std::vector<uint8_t>> packets(BATCH, std::vector<uint8_t>(512));
+    std::vector<uint8_t> replies(BATCH * 1500);
+    std::vector<unsigned long> expected(65536);
+    mmsghdr msgs[BATCH];
+    iovec iovs[BATCH];
+    unsigned long sent = 0;
+    unsigned long received = 0;
+
+    while (received < count) {
+        unsigned int batch = 0;
+        while (batch < BATCH && sent < count && sent - received < WINDOW) {
+            unsigned long n = (first + sent) % names;
+            uint16_t id = static_cast<uint16_t>(sent);
+            expected[id] = n;
+            size_t length = DNSResolver::encodeQuery(hostName(n), TYPE_A, id, packets[batch].data(), 512);
+            iovs[batch].iov_base = packets[batch].data();
+            iovs[batch].iov_len = length;
+            memset(&msgs[batch], 0, sizeof(msgs[batch]));
+            msgs[batch].msg_hdr.msg_iov = &iovs[batch];
+            msgs[batch].msg_hdr.msg_iovlen = 1;
+            batch++;
+            sent++;
+        }
+        if (batch > 0 && sendmmsg(fd, msgs, batch, 0) != static_cast<int>(batch)) {
+            *failed += count - received;
+            break;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, 2000) <= 0) {
+            // 应答丢失，不再等待
+            *failed += sent - received;
+            break;
+        }
+        for (unsigned int i = 0; i < BATCH; ++i) {
+            iovs[i].iov_base = replies.data() + i * 1500;
+            iovs[i].iov_len = 1500;
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int got = recvmmsg(fd, msgs, BATCH, MSG_DONTWAIT, nullptr);
+        for (int i = 0; i < got; ++i) {
+            const uint8_t* reply = static_cast<const uint8_t*>(iovs[i].iov_base);
+            size_t length = msgs[i].msg_len;
+            // 应答最后是OPT记录，前面4字节是唯一一条A记录的地址
+            in_addr want = expectedAddress(expected[read16(reply)]);
+            if (length < 12 + 4 + 11 || (reply[3] & 0x0f) != 0 || read16(reply + 6) != 1 ||
+                memcmp(reply + length - 11 - 4, &want, 4) != 0) {
+                (*failed)++;
+            }
+        }
+        received += got > 0 ? got : 0;
+    }
+    close(fd);
+}
+
+/**
+ * @brief 多个客户端同时查询
+ */
+bool runLoad(uint16_t port, const StubServer& stub, const char* label, unsigned long count, unsigned long names,
+             int clients) {
+    std::atomic<unsigned long> failed(0);
+    unsigned long before = stub.received();
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    unsigned long per_client = count / clients;
+    for (int c = 0; c < clients; ++c) {
+        threads.push_back(std::thread(runClient, port, c * per_client, per_client, names, &failed));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double elapsed = secondsSince(start);
+    unsigned long total = per_client * clients;
+    std::cout << "  " << label << ": " << total << " 个查询, " << elapsed * 1000 << " ms (" << total / elapsed
+              << " 次/秒), 上游收到 " << stub.received() - before << " 个, 失败 " << failed << std::endl;
+    return failed == 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    unsigned long count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+    int clients = argc > 2 ? atoi(argv[2]) : 2;
+    if (count < 1000 || clients <= 0) {
+        std::cerr << "用法: " << argv[0] << " [查询数(至少1000)] [客户端线程数]" << std::endl;
+        return 1;
+    }
+
+    StubServer stub;
+    if (!stub.start()) {
+        return 1;
+    }
+    DNSManager manager;
+    DNSServer server;
+    server.ip_address = "127.0.0.1";
+    server.priority = 1;
+    manager.addDNSServer(server);
+    manager.setServerPort(stub.port());
+    if (!manager.startForwarder("127.0.0.1", 0)) {
+        return 1;
+    }
+    uint16_t port = manager.getForwarderPort();
+
+    bool ok = true;
+    std::cout << "应答:" << std::endl;
+    ok = check(port, "A", hostName(1), TYPE_A, true, 0, 1, false) && ok;
+    ok = check(port, "NXDOMAIN", "nx.example.test", TYPE_A, true, 3, 0, false) && ok;
+    ok = check(port, "MX（原样转发，没有记录）", hostName(1), TYPE_MX, true, 0, 0, false) && ok;
+    ok = check(port, "TXT（原样转发）", hostName(2), TYPE_TXT, false, 0, 1, false) && ok;
+    ok = check(port, "上游截断且没有TCP", "tc.example.test", TYPE_A, true, 2, 0, false) && ok;
+    ok = check(port, "格式错误", "", TYPE_A, false, 1, 0, false) && ok;
+    ok = check(port, "60条记录，无EDNS", "many.example.test", TYPE_A, false, 0, 29, true) && ok;
+    ok = check(port, "60条记录，EDNS", "many.example.test", TYPE_A, true, 0, MANY_RECORDS, false) && ok;
+
+    // 未命中的每个域名只查询一次，命中的反复查询同一组域名
+    unsigned long names = std::max(count / 10, static_cast<unsigned long>(clients));
+    std::cout << "吞吐量（" << clients << " 个客户端，各 " << WINDOW << " 个在途）:" << std::endl;
+    ok = runLoad(port, stub, "未命中，转发上游", names, names, clients) && ok;
+    ok = runLoad(port, stub, "命中缓存", count, names, clients) && ok;
+
+    DNSManager::DNSStats stats = manager.getStats();
+    std::cout << "DNSManager: 查询 " << stats.total_queries << ", 缓存命中 " << stats.cache_hits << ", 发出 "
+              << stats.upstream_queries << ", 合并等待 " << stats.coalesced_queries << std::endl;
+    manager.stopForwarder();
+    return ok ? 0 : 1;
+}
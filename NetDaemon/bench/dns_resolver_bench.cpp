@@ -0,0 +1,684 @@
+#include "DNSResolver.h"
+#include "DNSManager.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <set>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/**
+ * @brief 异步DNS解析性能测试
+ *
+ * 在127.0.0.1上启动一个桩DNS服务器，按域名生成应答（A、AAAA、CNAME、PTR、SRV、
+ * NXDOMAIN、SERVFAIL，UDP上截断、TCP上完整的大应答），可以按比例丢弃查询，或者
+ * 在每个应答之前先发一个问题段大小写不同的伪造应答。先核对各类型的解析结果、
+ * 截断后改用TCP、伪造的应答被丢弃，再从一个
+ * 线程一次提交N个查询（默认10万），测量提交耗时、吞吐量和延迟分布，统计查询
+ * 来自多少个源端口，之后测试
+ * 1%丢包时的重试、首选服务器无应答或变慢时的切换和竞速，最后通过DNSManager解析一次，并模拟
+ * 热门域名同时到期（关闭缓存，多个线程反复解析同一组域名），统计实际发出的查询数。
+ *
+ * 用法: dns_resolver_bench [查询数]
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * @brief hN.example.test的A记录
+ */
+std::string expectedAddress(unsigned long n) {
+    return "10." + std::to_string((n >> 16) & 0xff) + "." + std::to_string((n >> 8) & 0xff) + "." +
+           std::to_string(n & 0xff);
+}
+
+/**
+ * @brief 桩DNS服务器，在自己的线程中逐个应答
+ */
+class StubServer {
+public:
+    StubServer()
+        : fd_(-1), tcp_fd_(-1), port_(0), running_(false), drop_every_(0), delay_ms_(0), forge_(false),
+          received_(0), tcp_received_(0) {}
+
+    ~StubServer() { stop(); }
+
+    /**
+     * @param address 监听地址，可以是127.0.0.0/8中的任意地址
+     * @param port 监听端口，0为由系统分配
+     */
+    bool start(const char* address = "127.0.0.1", uint16_t port = 0) {
+        fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, address, &addr.sin_addr);
+        socklen_t len = sizeof(addr);
+        int size = 4 << 20;
+        setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        if (fd_ < 0 || bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+            getsockname(fd_, reinterpret_cast<sockaddr*>(&addr), &len) < 0) {
+            std::cerr << "桩服务器启动失败: " << strerror(errno) << std::endl;
+            return false;
+        }
+        port_ = ntohs(addr.sin_port);
+
+        // 同一个端口上的TCP，应答截断后解析器改用它
+        tcp_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int one = 1;
+        setsockopt(tcp_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (tcp_fd_ < 0 || bind(tcp_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+            listen(tcp_fd_, 16) < 0) {
+            std::cerr << "桩服务器启动失败: " << strerror(errno) << std::endl;
+            return false;
+        }
+        running_ = true;
+        thread_ = std::thread(&StubServer::loop, this);
+        return true;
+    }
+
+    void stop() {
+        running_ = false;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+        if (tcp_fd_ >= 0) {
+            close(tcp_fd_);
+            tcp_fd_ = -1;
+        }
+    }
+
+    uint16_t port() const { return port_; }
+
+    /**
+     * @brief 每n个查询丢弃一个，0为不丢弃
+     */
+    void setDropEvery(unsigned long n) { drop_every_ = n; }
+
+    /**
+     * @brief 每个应答延迟ms毫秒发出（不影响接收后续查询）
+     */
+    void setDelay(int ms) { delay_ms_ = ms; }
+
+    /**
+     * @brief 每个应答之前先发一个伪造的：问题段字母的大小写相反，地址为10.66.66.66
+     */
+    void setForge(bool forge) { forge_ = forge; }
+
+    unsigned long received() const { return received_; }
+
+    unsigned long tcpReceived() const { return tcp_received_; }
+
+    /**
+     * @brief UDP查询来自的不同源端口数
+     */
+    size_t sourcePorts() const {
+        std::lock_guard<std::mutex> lock(ports_mutex_);
+        return ports_.size();
+    }
+
+private:
+    int fd_;
+    int tcp_fd_;
+    uint16_t port_;
+    std::atomic<bool> running_;
+    std::atomic<unsigned long> drop_every_;
+    std::atomic<int> delay_ms_;
+    std::atomic<bool> forge_;
+    std::atomic<unsigned long> received_;
+    std::atomic<unsigned long> tcp_received_;
+    std::thread thread_;
+    mutable std::mutex ports_mutex_;
+    std::set<uint16_t> ports_;
+
+    /**
+     * @brief 延迟发出的应答
+     */
+    struct Delayed {
+        Clock::time_point due;
+        sockaddr_in to;
+        std::vector<uint8_t> data;
+    };
+
+    void loop() {
+        uint8_t query[512];
+        uint8_t response[4096];
+        std::deque<Delayed> delayed;
+        while (running_) {
+            while (!delayed.empty() && delayed.front().due <= Clock::now()) {
+                const Delayed& reply = delayed.front();
+                sendto(fd_, reply.data.data(), reply.data.size(), 0, reinterpret_cast<const sockaddr*>(&reply.to),
+                       sizeof(reply.to));
+                delayed.pop_front();
+            }
+            int timeout = 50;
+            if (!delayed.empty()) {
+                timeout = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                    delayed.front().due - Clock::now()).count()) + 1;
+            }
+            pollfd pfds[2] = {{fd_, POLLIN, 0}, {tcp_fd_, POLLIN, 0}};
+            if (poll(pfds, 2, timeout) <= 0) {
+                continue;
+            }
+            if (pfds[1].revents & POLLIN) {
+                serveTcp();
+            }
+            if (!(pfds[0].revents & POLLIN)) {
+                continue;
+            }
+            sockaddr_in from;
+            socklen_t from_len = sizeof(from);
+            ssize_t len = recvfrom(fd_, query, sizeof(query), 0, reinterpret_cast<sockaddr*>(&from), &from_len);
+            if (len < 12) {
+                continue;
+            }
+            unsigned long count = ++received_;
+            {
+                std::lock_guard<std::mutex> lock(ports_mutex_);
+                ports_.insert(ntohs(from.sin_port));
+            }
+            if (drop_every_ != 0 && count % drop_every_ == 0) {
+                continue;
+            }
+            size_t size = answer(query, static_cast<size_t>(len), response, false);
+            if (size > 0 && forge_) {
+                std::vector<uint8_t> forged(response, response + size);
+                forgeAnswer(forged);
+                sendto(fd_, forged.data(), forged.size(), 0, reinterpret_cast<sockaddr*>(&from), from_len);
+            }
+            if (size > 0 && delay_ms_ > 0) {
+                Delayed reply;
+                reply.due = Clock::now() + std::chrono::milliseconds(delay_ms_);
+                reply.to = from;
+                reply.data.assign(response, response + size);
+                delayed.push_back(reply);
+            } else if (size > 0) {
+                sendto(fd_, response, size, 0, reinterpret_cast<sockaddr*>(&from), from_len);
+            }
+        }
+    }
+
+    /**
+     * @brief 应答一个TCP连接上的一个查询（阻塞，最多等1秒）
+     */
+    void serveTcp() {
+        int fd = accept4(tcp_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        tcp_received_++;
+        timeval timeout = {1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        uint8_t query[514];
+        uint8_t response[2 + 4096];
+        size_t got = 0;
+        size_t need = 2;
+        while (got < need) {
+            ssize_t n = recv(fd, query + got, need - got, 0);
+            if (n <= 0) {
+                break;
+            }
+            got += static_cast<size_t>(n);
+            if (got == 2) {
+                need = std::min<size_t>(sizeof(query), 2 + ((query[0] << 8) | query[1]));
+            }
+        }
+        size_t size = got == need && need > 2 ? answer(query + 2, need - 2, response + 2, true) : 0;
+        if (size > 0) {
+            put16(response, static_cast<uint16_t>(size));
+            ssize_t sent = send(fd, response, size + 2, MSG_NOSIGNAL);
+            (void)sent;
+        }
+        close(fd);
+    }
+
+    /**
+     * @brief 把应答改成伪造的：问题段字母的大小写相反，A记录为10.66.66.66
+     */
+    static void forgeAnswer(std::vector<uint8_t>& data) {
+        size_t pos = 12;
+        while (pos < data.size() && data[pos] != 0) {
+            size_t end = pos + 1 + data[pos];
+            for (size_t i = pos + 1; i < end && i < data.size(); ++i) {
+                char c = static_cast<char>(data[i]);
+                data[i] = static_cast<uint8_t>(islower(c) ? toupper(c) : tolower(c));
+            }
+            pos = end;
+        }
+        if (data.size() >= 4 && ((data[6] << 8) | data[7]) != 0) {
+            uint8_t forged[] = {10, 66, 66, 66};
+            memcpy(data.data() + data.size() - 4, forged, 4);
+        }
+    }
+
+    static void put16(uint8_t* p, uint16_t value) {
+        p[0] = static_cast<uint8_t>(value >> 8);
+        p[1] = static_cast<uint8_t>(value);
+    }
+
+    static size_t putName(uint8_t* p, const std::string& name) {
+        size_t pos = 0;
+        size_t start = 0;
+        while (start < name.size()) {
+            size_t dot = std::min(name.find('.', start), name.size());
+            p[pos++] = static_cast<uint8_t>(dot - start);
+            memcpy(p + pos, name.data() + start, dot - start);
+            pos += dot - start;
+            start = dot + 1;
+        }
+        p[pos++] = 0;
+        return pos;
+    }
+
+    /**
+     * @brief 写一条记录的头部，owner为空时用指向问题段域名的压缩指针
+     * @return 数据长度字段的位置，之后是数据
+     */
+    static size_t putRecord(uint8_t* p, const std::string& owner, uint16_t type, uint32_t ttl) {
+        size_t pos = 0;
+        if (owner.empty()) {
+            p[pos++] = 0xc0;
+            p[pos++] = 12;
+        } else {
+            pos += putName(p, owner);
+        }
+        put16(p + pos, type);
+        put16(p + pos + 2, 1);
+        put16(p + pos + 4, static_cast<uint16_t>(ttl >> 16));
+        put16(p + pos + 6, static_cast<uint16_t>(ttl));
+        return pos + 8;
+    }
+
+    /**
+     * @param tcp 通过TCP查询，big和bigfail两个域名在UDP上只返回截断的应答
+     * @return 应答长度，0为不应答
+     */
+    static size_t answer(const uint8_t* query, size_t len, uint8_t* out, bool tcp) {
+        size_t pos = 12;
+        std::string name;
+        if (!DNSResolver::readName(query, len, &pos, &name) || pos + 4 > len) {
+            return 0;
+        }
+        // 解析器随机了域名的大小写，按小写匹配，问题段原样返回
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        uint16_t qtype = static_cast<uint16_t>((query[pos] << 8) | query[pos + 1]);
+        pos += 4;
+
+        // 头部和问题段照抄，不带OPT记录
+        memcpy(out, query, pos);
+        put16(out + 2, 0x8180);
+        put16(out + 6, 0);
+        put16(out + 8, 0);
+        put16(out + 10, 0);
+        uint16_t answers = 0;
+        int rcode = 0;
+        std::string host = name;
+        unsigned long n = 0;
+
+        if (name == "alias.example.test") {
+            // CNAME指向h7，两条记录的TTL取小的
+            host = "h7.example.test";
+            size_t rdata = pos + putRecord(out + pos, "", 5, 60);
+            size_t rdlength = putName(out + rdata + 2, host);
+            put16(out + rdata, static_cast<uint16_t>(rdlength));
+            pos = rdata + 2 + rdlength;
+            answers++;
+        } else if (name == "fail.example.test") {
+            rcode = 2;
+        } else if ((name == "big.example.test" || name == "bigfail.example.test") && !tcp) {
+            out[2] |= 0x02;
+            return pos;
+        } else if (name == "bigfail.example.test") {
+            return 0;
+        } else if (name == "big.example.test" && qtype == 1) {
+            // 100条A记录，超过UDP的1232字节
+            for (int i = 0; i < 100; ++i) {
+                size_t rdata = pos + putRecord(out + pos, "", 1, 300);
+                put16(out + rdata, 4);
+                uint8_t address[] = {10, 1, 0, static_cast<uint8_t>(i)};
+                memcpy(out + rdata + 2, address, 4);
+                pos = rdata + 6;
+                answers++;
+            }
+        }
+
+        if (rcode == 0 && host.size() > 14 && host.compare(0, 1, "h") == 0 &&
+            host.compare(host.size() - 13, 13, ".example.test") == 0 && (qtype == 1 || qtype == 28)) {
+            n = strtoul(host.c_str() + 1, nullptr, 10);
+            std::string owner = host == name ? "" : host;
+            size_t rdata = pos + putRecord(out + pos, owner, qtype, 300);
+            if (qtype == 1) {
+                put16(out + rdata, 4);
+                inet_pton(AF_INET, expectedAddress(n).c_str(), out + rdata + 2);
+                pos = rdata + 6;
+            } else {
+                put16(out + rdata, 16);
+                inet_pton(AF_INET6, ("fd00::" + std::to_string(n)).c_str(), out + rdata + 2);
+                pos = rdata + 18;
+            }
+            answers++;
+        } else if (rcode == 0 && qtype == 12 && name.size() > 13 &&
+                   name.compare(name.size() - 13, 13, ".in-addr.arpa") == 0) {
+            // d.c.b.a.in-addr.arpa -> host-a-b-c-d.example.test
+            std::string octets[4];
+            size_t start = 0;
+            for (int i = 3; i >= 0; --i) {
+                size_t dot = name.find('.', start);
+                octets[i] = name.substr(start, dot - start);
+                start = dot + 1;
+            }
+            std::string target = "host-" + octets[0] + "-" + octets[1] + "-" + octets[2] + "-" + octets[3] +
+                                 ".example.test";
+            size_t rdata = pos + putRecord(out + pos, "", 12, 3600);
+            size_t rdlength = putName(out + rdata + 2, target);
+            put16(out + rdata, static_cast<uint16_t>(rdlength));
+            pos = rdata + 2 + rdlength;
+            answers++;
+        } else if (rcode == 0 && qtype == 33 && name == "_sip._udp.example.test") {
+            const char* targets[] = {"sip1.example.test", "sip2.example.test"};
+            for (int i = 0; i < 2; ++i) {
+                size_t rdata = pos + putRecord(out + pos, "", 33, 600);
+                put16(out + rdata + 2, static_cast<uint16_t>(10 * (i + 1)));
+                put16(out + rdata + 4, static_cast<uint16_t>(60 - 20 * i));
+                put16(out + rdata + 6, 5060);
+                size_t rdlength = 6 + putName(out + rdata + 8, targets[i]);
+                put16(out + rdata, static_cast<uint16_t>(rdlength));
+                pos = rdata + 2 + rdlength;
+                answers++;
+            }
+        } else if (rcode == 0 && answers == 0) {
+            rcode = 3;
+        }
+
+        out[3] = static_cast<uint8_t>(out[3] | rcode);
+        put16(out + 6, answers);
+        return pos;
+    }
+};
+
+/**
+ * @brief 核对一个查询的结果
+ * @param ttl 期望的TTL，-1为不检查
+ * @param rcode 期望的应答码，-2为不检查
+ * @param records 期望的记录数，0为不检查
+ */
+bool check(DNSResolver& resolver, const std::string& name, DNSQueryType type, bool success,
+           const std::string& first, int ttl, int rcode = -2, size_t records = 0) {
+    DNSResolution result = resolver.resolve(name, type).get();
+    bool ok = result.success == success &&
+              (first.empty() || (!result.ip_addresses.empty() && result.ip_addresses[0] == first)) &&
+              (ttl < 0 || result.ttl == ttl) && (rcode == -2 || result.rcode == rcode) &&
+              (records == 0 || result.ip_addresses.size() == records);
+    std::cout << "  " << name << ": ";
+    if (result.success && result.ip_addresses.size() > 4) {
+        std::cout << result.ip_addresses[0] << " 等 " << result.ip_addresses.size() << " 条 (TTL " << result.ttl
+                  << ")";
+    } else if (result.success) {
+        for (size_t i = 0; i < result.ip_addresses.size(); ++i) {
+            std::cout << (i ? ", " : "") << result.ip_addresses[i];
+        }
+        std::cout << " (TTL " << result.ttl << ")";
+    } else {
+        std::cout << result.error_message;
+    }
+    std::cout << (ok ? "" : "  <- 不符合预期") << std::endl;
+    return ok;
+}
+
+/**
+ * @brief 一次提交count个A查询，等待全部完成
+ * @return 全部成功且地址正确返回true
+ */
+bool runBatch(DNSResolver& resolver, unsigned long count, const char* label, bool race = false) {
+    std::vector<double> latency(count);
+    std::vector<Clock::time_point> submitted(count);
+    std::atomic<unsigned long> done(0);
+    std::atomic<unsigned long> failed(0);
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    auto start = Clock::now();
+    for (unsigned long i = 0; i < count; ++i) {
+        submitted[i] = Clock::now();
+        std::string expected = expectedAddress(i);
+        resolver.resolveAsync("h" + std::to_string(i) + ".example.test", DNSQueryType::A,
+            [&, i, expected](const DNSResolution& result) {
+                latency[i] = secondsSince(submitted[i]);
+                if (!result.success || result.ip_addresses.size() != 1 || result.ip_addresses[0] != expected) {
+                    failed++;
+                }
+                if (++done == count) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    finished.notify_one();
+                }
+            }, race);
+    }
+    double submit = secondsSince(start);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&] { return done == count; });
+    }
+    double elapsed = secondsSince(start);
+
+    std::sort(latency.begin(), latency.end());
+    std::cout << "  " << label << ": " << count << " 个查询, 提交 " << submit * 1e9 / count << " ns/个, 完成 "
+              << elapsed * 1000 << " ms (" << count / elapsed << " 次/秒), 延迟 p50 "
+              << latency[count / 2] * 1000 << " ms, p99 " << latency[count * 99 / 100] * 1000 << " ms, 最大 "
+              << latency[count - 1] * 1000 << " ms, 失败 " << failed << std::endl;
+    return failed == 0;
+}
+
+/**
+ * @brief 关闭缓存后多个线程同步解析、一个线程异步提交同一组热门域名
+ * @return 结果都正确，且相同的在途查询被合并返回true
+ */
+bool runHerd(DNSManager& manager, const StubServer& stub, unsigned long count) {
+    const int threads = 8;
+    const unsigned long names = 16;
+    manager.setCacheEnabled(false);
+    unsigned long before = stub.received();
+    std::atomic<unsigned long> failed(0);
+
+    auto start = Clock::now();
+    std::vector<std::thread> workers;
+    unsigned long per_thread = std::min(count, 20000ul) / threads;
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(std::thread([&, t] {
+            for (unsigned long i = 0; i < per_thread; ++i) {
+                unsigned long n = (i + t) % names;
+                DNSResolution result = manager.resolve("h" + std::to_string(n) + ".example.test");
+                if (!result.success || result.ip_addresses[0] != expectedAddress(n)) {
+                    failed++;
+                }
+            }
+        }));
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double sync_elapsed = secondsSince(start);
+    unsigned long sync_sent = stub.received() - before;
+
+    std::atomic<unsigned long> done(0);
+    std::mutex mutex;
+    std::condition_variable finished;
+    before = stub.received();
+    start = Clock::now();
+    for (unsigned long i = 0; i < count; ++i) {
+        unsigned long n = i % names;
+        std::string expected = expectedAddress(n);
+        manager.resolveAsync("h" + std::to_string(n) + ".example.test", DNSQueryType::A,
+            [&, expected](const DNSResolution& result) {
+                if (!result.success || result.ip_addresses[0] != expected) {
+                    failed++;
+                }
+                if (++done == count) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    finished.notify_one();
+                }
+            });
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&] { return done == count; });
+    }
+    double async_elapsed = secondsSince(start);
+    unsigned long async_sent = stub.received() - before;
+    manager.setCacheEnabled(true);
+
+    DNSManager::DNSStats stats = manager.getStats();
+    bool ok = failed == 0 && stats.waiting_queries == 0 && sync_sent < per_thread * threads &&
+              async_sent < count / 10;
+    std::cout << "  同时到期: " << threads << " 线程同步解析 " << per_thread * threads << " 次 ("
+              << sync_elapsed * 1000 << " ms), 发出 " << sync_sent << " 个查询; 异步提交 " << count << " 次 ("
+              << async_elapsed * 1000 << " ms), 发出 " << async_sent << " 个查询; 合并等待 "
+              << stats.coalesced_queries << " 次, 失败 " << failed << (ok ? "" : "  <- 不符合预期") << std::endl;
+    return ok;
+}
+
+void printServers(const DNSResolver& resolver) {
+    for (const auto& stats : resolver.getServerStats()) {
+        std::cout << "    " << stats.ip_address << ": RTT " << stats.srtt_ms << " ms, 失败率 " << stats.failure_rate
+                  << ", 发出 " << stats.queries << ", 失败 " << stats.failures
+                  << (stats.healthy ? "" : ", 不健康") << std::endl;
+    }
+}
+
+DNSServer makeServer(const std::string& address, int priority) {
+    DNSServer server;
+    server.ip_address = address;
+    server.priority = priority;
+    return server;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    unsigned long count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    if (count < 100) {
+        std::cerr << "用法: " << argv[0] << " [查询数(至少100)]" << std::endl;
+        return 1;
+    }
+
+    StubServer stub;
+    if (!stub.start()) {
+        return 1;
+    }
+    DNSResolver resolver;
+    resolver.setServers(std::vector<DNSServer>(1, makeServer("127.0.0.1", 1)));
+    resolver.setPort(stub.port());
+    resolver.setTimeout(200, 2);
+    resolver.start();
+
+    bool ok = true;
+    std::cout << "解析结果:" << std::endl;
+    ok = check(resolver, "h1.example.test", DNSQueryType::A, true, "10.0.0.1", 300) && ok;
+    ok = check(resolver, "h1.example.test", DNSQueryType::AAAA, true, "fd00::1", 300) && ok;
+    ok = check(resolver, "alias.example.test", DNSQueryType::A, true, "10.0.0.7", 60) && ok;
+    ok = check(resolver, DNSResolver::reverseName("192.0.2.10"), DNSQueryType::PTR, true,
+               "host-192-0-2-10.example.test", 3600) && ok;
+    ok = check(resolver, "_sip._udp.example.test", DNSQueryType::SRV, true, "10 60 5060 sip1.example.test", 600) && ok;
+    ok = check(resolver, "nx.example.test", DNSQueryType::A, false, "", -1) && ok;
+    ok = check(resolver, "fail.example.test", DNSQueryType::A, false, "", -1) && ok;
+    // UDP上截断：改用TCP取完整的应答；TCP也失败时rcode为-1，不能当作没有记录
+    ok = check(resolver, "big.example.test", DNSQueryType::A, true, "10.1.0.0", 300, 0, 100) && ok;
+    ok = check(resolver, "bigfail.example.test", DNSQueryType::A, false, "", -1, -1) && ok;
+    // 问题段大小写不同的伪造应答先到，应被丢弃
+    stub.setForge(true);
+    ok = check(resolver, "h5.example.test", DNSQueryType::A, true, "10.0.0.5", 300) && ok;
+    ok = check(resolver, "alias.example.test", DNSQueryType::A, true, "10.0.0.7", 60) && ok;
+    stub.setForge(false);
+    bool tcp_ok = stub.tcpReceived() == 2;
+    std::cout << "  TCP连接 " << stub.tcpReceived() << " 个" << (tcp_ok ? "" : "  <- 不符合预期") << std::endl;
+    ok = tcp_ok && ok;
+
+    std::cout << "吞吐量:" << std::endl;
+    ok = runBatch(resolver, count, "无丢包") && ok;
+    // 每个地址族16个套接字，每个发出256个查询后换新端口
+    size_t expected_ports = std::min<size_t>(8 + count / 512, 64);
+    bool ports_ok = stub.sourcePorts() >= expected_ports;
+    std::cout << "  源端口: " << stub.sourcePorts() << " 个" << (ports_ok ? "" : "  <- 不符合预期") << std::endl;
+    ok = ports_ok && ok;
+
+    stub.setDropEvery(100);
+    resolver.setTimeout(50, 3);
+    ok = runBatch(resolver, std::min(count, 10000ul), "丢弃1%") && ok;
+    stub.setDropEvery(0);
+
+    // 127.0.0.2上没有服务器，每个查询等待一次超时后换到127.0.0.1
+    std::vector<DNSServer> servers;
+    servers.push_back(makeServer("127.0.0.2", 1));
+    servers.push_back(makeServer("127.0.0.1", 2));
+    resolver.setServers(servers);
+    resolver.setTimeout(100, 2);
+    ok = runBatch(resolver, 1000, "首选服务器无应答") && ok;
+    ok = runBatch(resolver, 1000, "首选服务器无应答（已测得）") && ok;
+    printServers(resolver);
+    resolver.stop();
+
+    // 127.0.0.3上的首选服务器每个应答慢30ms：第一批全部发给它（各服务器先探测一次），
+    // 测到RTT后换到快的；竞速的查询同时发给两个服务器，不必先测
+    StubServer slow;
+    if (!slow.start("127.0.0.3", stub.port())) {
+        return 1;
+    }
+    slow.setDelay(30);
+    servers.clear();
+    servers.push_back(makeServer("127.0.0.3", 1));
+    servers.push_back(makeServer("127.0.0.1", 2));
+    for (int race = 0; race < 2; ++race) {
+        DNSResolver adaptive;
+        adaptive.setServers(servers);
+        adaptive.setPort(stub.port());
+        adaptive.start();
+        ok = runBatch(adaptive, 1000, race ? "首选服务器慢，竞速" : "首选服务器慢（第1批）", race != 0) && ok;
+        if (!race) {
+            ok = runBatch(adaptive, 1000, "首选服务器慢（第2批）") && ok;
+        }
+        printServers(adaptive);
+    }
+
+    std::cout << "DNSManager:" << std::endl;
+    DNSManager manager;
+    manager.addDNSServer(makeServer("127.0.0.1", 1));
+    manager.setServerPort(stub.port());
+    DNSResolution first = manager.resolve("h42.example.test");
+    DNSResolution second = manager.resolve("h42.example.test");
+    DNSResolution reverse = manager.reverseLookup("10.0.0.42");
+    DNSManager::DNSStats stats = manager.getStats();
+    bool manager_ok = first.success && second.success && second.ip_addresses == first.ip_addresses &&
+                      stats.cache_hits == 1 && reverse.success &&
+                      reverse.ip_addresses[0] == "host-10-0-0-42.example.test";
+    std::cout << "  解析 " << (first.success ? first.ip_addresses[0] : first.error_message) << ", 缓存命中 "
+              << stats.cache_hits << ", 反向 " << (reverse.success ? reverse.ip_addresses[0] : reverse.error_message)
+              << (manager_ok ? "" : "  <- 不符合预期") << std::endl;
+    ok = manager_ok && ok;
+    ok = runHerd(manager, stub, count) && ok;
+
+    std::cout << "桩服务器共收到 " << stub.received() << " 个查询" << std::endl;
+    return ok ? 0 : 1;
+}
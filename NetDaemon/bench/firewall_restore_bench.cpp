@@ -0,0 +1,277 @@
+#include "FirewallManager.h"
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+/**
+ * @brief 防火墙批量下发性能测试
+ *
+ * 关闭自动提交后加入N条封禁规则（默认2万条，另有少量INSERT的放行规则），测量
+ * 生成iptables-restore载荷和一次提交的耗时；之后删除、添加、禁用、重新启用
+ * 少量规则，测量增量提交。每次提交前把载荷应用到一个模拟的链上，与逐条执行
+ * iptables命令（APPEND追加、INSERT插到最前）得到的规则顺序核对。最后模拟一次
+ * iptables-restore失败，检查下次提交会整链重写并恢复一致。
+ *
+ * 载荷交给"cat > /dev/null"，测量的是本进程的开销，不含内核处理规则的时间。
+ * 作为对比，测量启动一个进程的耗时（逐条执行iptables命令时每条规则至少一次）。
+ *
+ * 用法: firewall_restore_bench [规则条数]
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t ALLOW_RULES = 20;
+const size_t CHURN = 100;
+const int SPAWN_SAMPLES = 200;
+
+double msSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+std::string blockedAddress(size_t i) {
+    return "10." + std::to_string((i >> 16) & 0xff) + "." + std::to_string((i >> 8) & 0xff) + "." +
+           std::to_string(i & 0xff);
+}
+
+FirewallRule makeRule(const std::string& id, IptablesOperation operation, const std::string& src,
+                      const std::string& port, const std::string& action) {
+    FirewallRule rule;
+    rule.id = id;
+    rule.table = IptablesTable::FILTER;
+    rule.chain = IptablesChain::INPUT;
+    rule.operation = operation;
+    rule.src_ip = src;
+    rule.protocol = port.empty() ? "" : "tcp";
+    rule.dst_port = port;
+    rule.action = action;
+    rule.enabled = true;
+    return rule;
+}
+
+/**
+ * @brief 由规则得到与FirewallManager相同的匹配条件，用于核对
+ */
+std::string ruleSpec(const FirewallRule& rule) {
+    std::string spec;
+    if (!rule.protocol.empty()) spec += "-p " + rule.protocol + " ";
+    if (!rule.src_ip.empty()) spec += "-s " + rule.src_ip + " ";
+    if (!rule.dst_port.empty()) spec += "--dport " + rule.dst_port + " ";
+    return spec + "-j " + rule.action;
+}
+
+/**
+ * @brief 逐条执行iptables命令时链中的规则顺序
+ */
+class SequentialModel {
+public:
+    void add(const FirewallRule& rule) {
+        if (rule.operation == IptablesOperation::INSERT) {
+            chain_.push_front(ruleSpec(rule));
+        } else {
+            chain_.push_back(ruleSpec(rule));
+        }
+    }
+
+    void remove(const FirewallRule& rule) {
+        auto it = std::find(chain_.begin(), chain_.end(), ruleSpec(rule));
+        if (it != chain_.end()) {
+            chain_.erase(it);
+        }
+    }
+
+    std::vector<std::string> rules() const {
+        return std::vector<std::string>(chain_.begin(), chain_.end());
+    }
+
+    /**
+     * @return INPUT跳转到fw_INPUT的次数
+     */
+    int hooks() const {
+        return hooks_;
+    }
+
+private:
+    std::deque<std::string> chain_;
+    int hooks_ = 0;
+};
+
+/**
+ * @brief 模拟的fw_INPUT链，按iptables-restore --noflush的语义应用载荷
+ */
+class RestoreModel {
+public:
+    /**
+     * @return 载荷中的规则行数，格式不认识返回-1
+     */
+    long apply(const std::string& payload) {
+        std::istringstream in(payload);
+        std::string line;
+        long rules = 0;
+        const std::string chain = "fw_INPUT ";
+        while (std::getline(in, line)) {
+            if (line == "*filter" || line == "COMMIT") {
+                continue;
+            }
+            if (line == ":fw_INPUT - [0:0]") {
+                chain_.clear();
+            } else if (line == "-I INPUT -j fw_INPUT") {
+                hooks_++;
+                continue;
+            } else if (line.compare(0, 3 + chain.size(), "-A " + chain) == 0) {
+                chain_.push_back(line.substr(3 + chain.size()));
+            } else if (line.compare(0, 5 + chain.size(), "-I " + chain + "1 ") == 0) {
+                chain_.push_front(line.substr(5 + chain.size()));
+            } else if (line.compare(0, 3 + chain.size(), "-D " + chain) == 0) {
+                auto it = std::find(chain_.begin(), chain_.end(), line.substr(3 + chain.size()));
+                if (it == chain_.end()) {
+                    return -1;
+                }
+                chain_.erase(it);
+            } else {
+                return -1;
+            }
+            rules++;
+        }
+        return rules;
+    }
+
+    std::vector<std::string> rules() const {
+        return std::vector<std::string>(chain_.begin(), chain_.end());
+    }
+
+    /**
+     * @return INPUT跳转到fw_INPUT的次数
+     */
+    int hooks() const {
+        return hooks_;
+    }
+
+private:
+    std::deque<std::string> chain_;
+    int hooks_ = 0;
+};
+
+/**
+ * @brief 核对并提交一次
+ * @return 提交成功且规则顺序一致返回true
+ */
+bool commitAndCheck(const std::string& label, FirewallManager& manager, RestoreModel& restored,
+                    const SequentialModel& expected) {
+    auto start = Clock::now();
+    std::string payload = manager.pendingRestorePayload();
+    double plan = msSince(start);
+
+    start = Clock::now();
+    bool committed = manager.commit();
+    double elapsed = msSince(start);
+
+    long lines = restored.apply(payload);
+    bool same = committed && lines >= 0 && restored.rules() == expected.rules();
+    std::cout << "  " << label << ": 载荷 " << lines << " 条规则 " << payload.size() / 1024 << " KB, 生成 "
+              << plan << " ms, 提交 " << elapsed << " ms, 核对" << (same ? "一致" : "不一致") << std::endl;
+    return same;
+}
+
+double spawnCost() {
+    auto start = Clock::now();
+    for (int i = 0; i < SPAWN_SAMPLES; ++i) {
+        if (std::system("true") != 0) {
+            return 0;
+        }
+    }
+    return msSince(start) / SPAWN_SAMPLES;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+    if (count < CHURN * 2 || count > (1u << 24)) {
+        std::cerr << "用法: " << argv[0] << " [规则条数(" << CHURN * 2 << "-16777216)]" << std::endl;
+        return 1;
+    }
+
+    FirewallManager manager;
+    manager.setAutoCommit(false);
+    manager.setRestoreCommand("cat > /dev/null");
+    SequentialModel expected;
+    RestoreModel restored;
+    std::map<std::string, FirewallRule> rules;
+
+    // 封禁列表和穿插其中的放行规则
+    std::vector<FirewallRule> batch;
+    for (size_t i = 0; i < count; ++i) {
+        batch.push_back(makeRule("block_" + std::to_string(i), IptablesOperation::APPEND, blockedAddress(i), "", "DROP"));
+        if (i % (count / ALLOW_RULES) == 0) {
+            batch.push_back(makeRule("allow_" + std::to_string(i), IptablesOperation::INSERT, "",
+                                     std::to_string(1000 + i % 60000), "ACCEPT"));
+        }
+    }
+    auto start = Clock::now();
+    manager.addFirewallRules(batch);
+    std::cout << count << " 条封禁规则 + " << batch.size() - count << " 条放行规则, 记入期望状态 "
+              << msSince(start) << " ms" << std::endl;
+    for (const auto& rule : batch) {
+        expected.add(rule);
+        rules[rule.id] = rule;
+    }
+    bool ok = commitAndCheck("首次提交", manager, restored, expected);
+
+    // 增量：删除、添加、禁用
+    for (size_t i = 0; i < CHURN; ++i) {
+        const FirewallRule& rule = rules["block_" + std::to_string(i * 7)];
+        manager.deleteFirewallRule(rule.id);
+        expected.remove(rule);
+    }
+    for (size_t i = 0; i < CHURN; ++i) {
+        FirewallRule rule = makeRule("extra_" + std::to_string(i), i % 10 == 0 ? IptablesOperation::INSERT :
+                                     IptablesOperation::APPEND, blockedAddress(count + i), "", "DROP");
+        manager.addFirewallRule(rule);
+        expected.add(rule);
+        rules[rule.id] = rule;
+    }
+    for (size_t i = 0; i < CHURN / 2; ++i) {
+        const FirewallRule& rule = rules["block_" + std::to_string(i * 7 + 3)];
+        manager.disableFirewallRule(rule.id);
+        expected.remove(rule);
+    }
+    ok = commitAndCheck("增量提交 (删" + std::to_string(CHURN) + " 加" + std::to_string(CHURN) +
+                        " 禁用" + std::to_string(CHURN / 2) + ")", manager, restored, expected) && ok;
+
+    // 重新启用的规则按新加入处理
+    for (size_t i = 0; i < CHURN / 2; ++i) {
+        const FirewallRule& rule = rules["block_" + std::to_string(i * 7 + 3)];
+        manager.enableFirewallRule(rule.id);
+        expected.add(rule);
+    }
+    ok = commitAndCheck("重新启用", manager, restored, expected) && ok;
+
+    // iptables-restore失败：链的内容未知，下次整链重写
+    manager.setRestoreCommand("cat > /dev/null; false");
+    FirewallRule rule = makeRule("after_failure", IptablesOperation::APPEND, blockedAddress(count + CHURN), "", "DROP");
+    manager.addFirewallRule(rule);
+    expected.add(rule);
+    bool failed = !manager.commit();
+    manager.setRestoreCommand("cat > /dev/null");
+    std::cout << "  模拟iptables-restore失败: " << (failed ? "提交返回失败" : "未报告失败") << std::endl;
+    ok = failed && commitAndCheck("失败后重写", manager, restored, expected) && ok;
+
+    // 跳转随载荷下发，只插入一次
+    std::cout << "  INPUT -> fw_INPUT 跳转: " << restored.hooks() << " 条"
+              << (restored.hooks() == 1 ? "" : "  <- 不符合预期") << std::endl;
+    ok = restored.hooks() == 1 && ok;
+
+    double spawn = spawnCost();
+    std::cout << "对比: 启动一个进程 " << spawn << " ms, 逐条执行 " << count << " 条规则仅进程启动就需约 "
+              << spawn * count / 1000 << " 秒" << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,309 @@
+#include "NetworkMonitor.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+// <linux/if.h>里定义，但它与<net/if.h>不能同时包含
+#ifndef IFF_LOWER_UP
+#define IFF_LOWER_UP 0x10000
+#endif
+
+/**
+ * @brief 网络监控器netlink处理测试
+ *
+ * 不打开netlink套接字，把构造的RTM_NEWLINK/NEWADDR/NEWROUTE等消息直接传给
+ * handleNetlinkBuffer()，用flushPendingEvents()产生事件，逐个场景核对事件的
+ * 类型和新旧值：接口上线、抖动后恢复原状（不产生事件）、换地址、失去载波、
+ * 接口删除和格式错误的消息。
+ *
+ * 然后在两个线程不停查询连接信息的同时处理N批抖动消息（默认10万批，每批
+ * link down/up和地址删除/添加共4条），测量每秒处理的消息数，结束后不应产生事件。
+ *
+ * 用法: netlink_monitor_bench [消息批数]
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const int ETH0 = 2;
+const int WLAN0 = 3;
+const unsigned int UP = IFF_UP | IFF_RUNNING | IFF_LOWER_UP;
+const int READERS = 2;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * @brief 按内核的格式拼接netlink消息
+ */
+class NetlinkBuffer {
+public:
+    void link(uint16_t type, int index, const std::string& name, unsigned int flags) {
+        struct ifinfomsg ifi;
+        memset(&ifi, 0, sizeof(ifi));
+        ifi.ifi_family = AF_UNSPEC;
+        ifi.ifi_index = index;
+        ifi.ifi_flags = flags;
+        begin(type, &ifi, sizeof(ifi));
+        attr(IFLA_IFNAME, name.c_str(), name.size() + 1);
+        end();
+    }
+
+    void addr(uint16_t type, int index, const char* address) {
+        struct ifaddrmsg ifa;
+        memset(&ifa, 0, sizeof(ifa));
+        ifa.ifa_family = AF_INET;
+        ifa.ifa_prefixlen = 24;
+        ifa.ifa_scope = RT_SCOPE_UNIVERSE;
+        ifa.ifa_index = index;
+        struct in_addr in;
+        inet_pton(AF_INET, address, &in);
+        begin(type, &ifa, sizeof(ifa));
+        attr(IFA_LOCAL, &in, sizeof(in));
+        attr(IFA_ADDRESS, &in, sizeof(in));
+        end();
+    }
+
+    void defaultRoute(uint16_t type, int index, const char* gateway) {
+        struct rtmsg rtm;
+        memset(&rtm, 0, sizeof(rtm));
+        rtm.rtm_family = AF_INET;
+        rtm.rtm_table = RT_TABLE_MAIN;
+        rtm.rtm_protocol = RTPROT_BOOT;
+        rtm.rtm_scope = RT_SCOPE_UNIVERSE;
+        rtm.rtm_type = RTN_UNICAST;
+        struct in_addr in;
+        inet_pton(AF_INET, gateway, &in);
+        begin(type, &rtm, sizeof(rtm));
+        attr(RTA_OIF, &index, sizeof(index));
+        attr(RTA_GATEWAY, &in, sizeof(in));
+        end();
+    }
+
+    const void* data() const { return buf_.data(); }
+    size_t size() const { return buf_.size(); }
+    size_t messages() const { return messages_; }
+
+    void clear() {
+        buf_.clear();
+        messages_ = 0;
+    }
+
+private:
+    std::string buf_;
+    size_t start_ = 0;
+    size_t messages_ = 0;
+
+    void append(const void* data, size_t len) {
+        buf_.append(static_cast<const char*>(data), len);
+        buf_.resize(start_ + NLMSG_ALIGN(buf_.size() - start_), '\0');
+    }
+
+    void begin(uint16_t type, const void* body, size_t len) {
+        start_ = buf_.size();
+        struct nlmsghdr nlh;
+        memset(&nlh, 0, sizeof(nlh));
+        nlh.nlmsg_type = type;
+        append(&nlh, sizeof(nlh));
+        append(body, len);
+    }
+
+    void attr(uint16_t type, const void* data, size_t len) {
+        struct rtattr rta;
+        rta.rta_len = static_cast<unsigned short>(RTA_LENGTH(len));
+        rta.rta_type = type;
+        append(&rta, sizeof(rta));
+        append(data, len);
+    }
+
+    void end() {
+        uint32_t len = static_cast<uint32_t>(buf_.size() - start_);
+        memcpy(&buf_[start_] + offsetof(struct nlmsghdr, nlmsg_len), &len, sizeof(len));
+        messages_++;
+    }
+};
+
+struct Expected {
+    NetworkEventType type;
+    const char* network_id;
+    const char* old_state;
+    const char* new_state;
+};
+
+/**
+ * @brief 处理一批消息并核对产生的事件
+ */
+bool runCase(NetworkMonitor& monitor, std::vector<NetworkEvent>& events, const char* label,
+             const NetlinkBuffer& buf, const std::vector<Expected>& expected) {
+    events.clear();
+    int handled = monitor.handleNetlinkBuffer(buf.data(), buf.size());
+    int flushed = monitor.flushPendingEvents();
+    bool ok = handled == static_cast<int>(buf.messages()) && flushed == static_cast<int>(expected.size()) &&
+              events.size() == expected.size();
+    for (size_t i = 0; ok && i < expected.size(); ++i) {
+        ok = events[i].type == expected[i].type && events[i].network_id == expected[i].network_id &&
+             events[i].old_state == expected[i].old_state && events[i].new_state == expected[i].new_state;
+    }
+    std::cout << "  " << label << ": " << handled << " 条消息, " << events.size() << " 个事件"
+              << (ok ? "" : "  <-- 与预期不符") << std::endl;
+    return ok;
+}
+
+bool checkScenarios(NetworkMonitor& monitor, std::vector<NetworkEvent>& events) {
+    std::cout << "\n场景:" << std::endl;
+    bool ok = true;
+    NetlinkBuffer buf;
+
+    buf.link(RTM_NEWLINK, ETH0, "eth0", UP);
+    buf.addr(RTM_NEWADDR, ETH0, "192.168.1.10");
+    buf.defaultRoute(RTM_NEWROUTE, ETH0, "192.168.1.1");
+    buf.link(RTM_NEWLINK, WLAN0, "wlan0", IFF_UP);
+    ok = runCase(monitor, events, "接口上线", buf, {
+        {NetworkEventType::STATE_CHANGED, "eth0", "UNKNOWN", "CONNECTED"},
+        {NetworkEventType::CONNECTION_ESTABLISHED, "eth0", "UNKNOWN", "CONNECTED"},
+        {NetworkEventType::IP_CHANGED, "eth0", "", "192.168.1.10"},
+        {NetworkEventType::ROUTE_CHANGED, "eth0", "", "192.168.1.1"},
+        {NetworkEventType::STATE_CHANGED, "wlan0", "UNKNOWN", "CONNECTING"},
+    }) && ok;
+
+    NetworkConnection conn;
+    bool found = monitor.getConnectionByInterface("eth0", &conn) && conn.type == NetworkType::ETHERNET &&
+                 conn.state == NetworkState::CONNECTED && conn.ip_address == "192.168.1.10" &&
+                 conn.gateway == "192.168.1.1";
+    found = monitor.getActiveConnection(&conn) && conn.interface == "eth0" && found;
+    found = monitor.getConnection("wlan0", &conn) && conn.type == NetworkType::WIFI && found;
+    std::cout << "  查询连接: " << (found ? "正常" : "失败") << std::endl;
+    ok = found && ok;
+
+    buf.clear();
+    buf.link(RTM_NEWLINK, ETH0, "eth0", IFF_UP);
+    buf.addr(RTM_DELADDR, ETH0, "192.168.1.10");
+    buf.link(RTM_NEWLINK, ETH0, "eth0", UP);
+    buf.addr(RTM_NEWADDR, ETH0, "192.168.1.10");
+    ok = runCase(monitor, events, "抖动后恢复", buf, {}) && ok;
+
+    buf.clear();
+    buf.addr(RTM_DELADDR, ETH0, "192.168.1.10");
+    buf.addr(RTM_NEWADDR, ETH0, "192.168.1.20");
+    ok = runCase(monitor, events, "换地址", buf, {
+        {NetworkEventType::IP_CHANGED, "eth0", "192.168.1.10", "192.168.1.20"},
+    }) && ok;
+
+    buf.clear();
+    buf.link(RTM_NEWLINK, ETH0, "eth0", IFF_UP | IFF_RUNNING);
+    buf.defaultRoute(RTM_DELROUTE, ETH0, "192.168.1.1");
+    ok = runCase(monitor, events, "失去载波", buf, {
+        {NetworkEventType::STATE_CHANGED, "eth0", "CONNECTED", "CONNECTING"},
+        {NetworkEventType::CONNECTION_LOST, "eth0", "CONNECTED", "CONNECTING"},
+        {NetworkEventType::ROUTE_CHANGED, "eth0", "192.168.1.1", ""},
+    }) && ok;
+
+    buf.clear();
+    buf.link(RTM_DELLINK, WLAN0, "wlan0", 0);
+    ok = runCase(monitor, events, "接口删除", buf, {
+        {NetworkEventType::CONNECTION_LOST, "wlan0", "CONNECTING", "DISCONNECTED"},
+    }) && ok;
+    bool removed = !monitor.getConnection("wlan0", &conn) && !monitor.getActiveConnection(&conn);
+    std::cout << "  删除后查询: " << (removed ? "正常" : "失败") << std::endl;
+    ok = removed && ok;
+
+    // 长度超出缓冲区的消息
+    buf.clear();
+    buf.link(RTM_NEWLINK, ETH0, "eth0", UP);
+    bool rejected = monitor.handleNetlinkBuffer(buf.data(), buf.size() - 4) == -1;
+    std::cout << "  格式错误: " << (rejected ? "拒绝" : "未拒绝") << std::endl;
+    ok = rejected && ok;
+    monitor.flushPendingEvents();
+    return ok;
+}
+
+/**
+ * @brief 读线程查询连接信息时处理抖动消息
+ */
+bool benchThroughput(NetworkMonitor& monitor, std::vector<NetworkEvent>& events, size_t batches) {
+    NetlinkBuffer buf;
+    buf.link(RTM_NEWLINK, ETH0, "eth0", UP);
+    buf.addr(RTM_NEWADDR, ETH0, "192.168.1.30");
+    monitor.handleNetlinkBuffer(buf.data(), buf.size());
+    monitor.flushPendingEvents();
+
+    // 与接收缓冲区一样，一次处理约32KB
+    buf.clear();
+    while (buf.size() < 32 * 1024 - 256) {
+        buf.link(RTM_NEWLINK, ETH0, "eth0", IFF_UP);
+        buf.addr(RTM_DELADDR, ETH0, "192.168.1.30");
+        buf.link(RTM_NEWLINK, ETH0, "eth0", UP);
+        buf.addr(RTM_NEWADDR, ETH0, "192.168.1.30");
+    }
+    size_t per_buffer = buf.messages() / 4;
+
+    std::atomic<bool> done(false);
+    std::atomic<unsigned long> queries(0);
+    std::atomic<unsigned long> wrong(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < READERS; ++t) {
+        readers.push_back(std::thread([&]() {
+            unsigned long count = 0;
+            unsigned long bad = 0;
+            NetworkConnection conn;
+            while (!done.load(std::memory_order_relaxed)) {
+                bad += !monitor.getConnectionByInterface("eth0", &conn) || conn.ip_address != "192.168.1.30";
+                monitor.getSignalStrength("eth0");
+                count++;
+            }
+            queries += count;
+            wrong += bad;
+        }));
+    }
+
+    events.clear();
+    size_t messages = 0;
+    auto start = Clock::now();
+    for (size_t done_batches = 0; done_batches < batches; done_batches += per_buffer) {
+        int handled = monitor.handleNetlinkBuffer(buf.data(), buf.size());
+        messages += handled > 0 ? handled : 0;
+        monitor.flushPendingEvents();
+    }
+    double elapsed = secondsSince(start);
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    bool ok = events.empty() && wrong == 0;
+    std::cout << "\n抖动消息: " << messages << " 条, " << messages / elapsed / 1e6 << " 百万条/秒 ("
+              << elapsed * 1e9 / messages << " ns/条); " << READERS << " 个读线程查询 " << queries
+              << " 次, 不一致 " << wrong << ", 事件 " << events.size() << (ok ? "" : "  <-- 与预期不符")
+              << std::endl;
+    return ok;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t batches = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    if (batches == 0) {
+        std::cerr << "用法: " << argv[0] << " [消息批数]" << std::endl;
+        return 1;
+    }
+
+    NetworkMonitor monitor;
+    std::vector<NetworkEvent> events;
+    monitor.registerStateChangeCallback([&events](const NetworkEvent& event) { events.push_back(event); });
+
+    bool ok = checkScenarios(monitor, events);
+    ok = benchThroughput(monitor, events, batches) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+#include "FirewallManager.h"
+#include <iostream>
+#include <chrono>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+/**
+ * @brief 数据包分类性能测试
+ *
+ * 生成N条规则（默认10万条）：大部分是封禁单个地址或网段，另有按目的端口、
+ * 端口范围、协议放行的规则，其中一部分用INSERT插到链前。测量编译分类器和
+ * 查找（默认1000万次）的耗时，并用逐条比较的朴素实现核对第一条命中的规则。
+ *
+ * 用法: packet_classify_bench [规则条数] [查找次数]
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t PACKET_POOL = 1 << 20;
+const size_t CHECKS = 5000;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+std::string formatIpv4(uint32_t address) {
+    return std::to_string(address >> 24) + "." + std::to_string((address >> 16) & 0xff) + "." +
+           std::to_string((address >> 8) & 0xff) + "." + std::to_string(address & 0xff);
+}
+
+const char* randomProtocol(std::mt19937_64& rng) {
+    return rng() % 2 ? "tcp" : "udp";
+}
+
+FirewallRule makeRule(std::mt19937_64& rng, size_t i) {
+    FirewallRule rule;
+    rule.id = "rule_" + std::to_string(i);
+    rule.table = IptablesTable::FILTER;
+    rule.chain = IptablesChain::INPUT;
+    rule.operation = rng() % 50 == 0 ? IptablesOperation::INSERT : IptablesOperation::APPEND;
+    rule.enabled = true;
+
+    // 地址都在10.0.0.0/8内，随机数据包才有机会命中
+    uint32_t address = 0x0a000000u | static_cast<uint32_t>(rng() & 0xffffff);
+    int r = static_cast<int>(rng() % 100);
+    if (r < 85) {
+        rule.src_ip = formatIpv4(address);
+        rule.action = "DROP";
+    } else if (r < 94) {
+        int length = rng() % 100 == 0 ? 16 : 24;
+        rule.src_ip = formatIpv4(address & (0xffffffffu << (32 - length))) + "/" + std::to_string(length);
+        rule.action = "DROP";
+    } else if (r < 98) {
+        rule.protocol = randomProtocol(rng);
+        rule.dst_ip = formatIpv4(address);
+        rule.dst_port = std::to_string(rng() % 65536);
+        rule.action = "ACCEPT";
+    } else if (r < 99) {
+        uint32_t low = static_cast<uint32_t>(rng() % 65536);
+        uint32_t high = std::min<uint32_t>(65535, low + static_cast<uint32_t>(rng() % 1024));
+        rule.protocol = randomProtocol(rng);
+        rule.src_ip = formatIpv4(address & 0xff000000u) + "/8";
+        rule.dst_port = std::to_string(low) + ":" + std::to_string(high);
+        rule.src_port = rng() % 4 == 0 ? "1024:" : "";
+        rule.action = "ACCEPT";
+    } else {
+        rule.protocol = rng() % 2 ? "icmp" : "gre";
+        rule.action = rng() % 2 ? "ACCEPT" : "DROP";
+    }
+    return rule;
+}
+
+/**
+ * @brief 朴素实现：按链中的顺序逐条比较
+ */
+class ReferenceChain {
+public:
+    void add(const FirewallRule& rule) {
+        Item item;
+        item.rule = &rule;
+        if (!ClassifierRule::parse(rule.protocol, rule.src_ip, rule.dst_ip, rule.src_port, rule.dst_port,
+                                   &item.match)) {
+            return;
+        }
+        if (rule.operation == IptablesOperation::INSERT) {
+            items_.push_front(item);
+        } else {
+            items_.push_back(item);
+        }
+    }
+
+    const FirewallRule* classify(const PacketTuple& packet) const {
+        for (const auto& item : items_) {
+            const ClassifierRule& m = item.match;
+            if (prefixMatch(packet.src_ip, m.src_ip, m.src_len) && prefixMatch(packet.dst_ip, m.dst_ip, m.dst_len) &&
+                (m.protocol < 0 || m.protocol == packet.protocol) &&
+                packet.src_port >= m.src_port_min && packet.src_port <= m.src_port_max &&
+                packet.dst_port >= m.dst_port_min && packet.dst_port <= m.dst_port_max) {
+                return item.rule;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    struct Item {
+        const FirewallRule* rule;
+        ClassifierRule match;
+    };
+    std::deque<Item> items_;
+
+    static bool prefixMatch(uint32_t address, uint32_t prefix, int length) {
+        return length == 0 || (address >> (32 - length)) == (prefix >> (32 - length));
+    }
+};
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t rule_count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    size_t lookup_count = argc > 2 ? strtoul(argv[2], nullptr, 10) : 10000000;
+    if (rule_count == 0) {
+        std::cerr << "用法: " << argv[0] << " [规则条数] [查找次数]" << std::endl;
+        return 1;
+    }
+
+    std::mt19937_64 rng(1);
+    std::vector<FirewallRule> rules;
+    rules.reserve(rule_count);
+    for (size_t i = 0; i < rule_count; ++i) {
+        rules.push_back(makeRule(rng, i));
+    }
+
+    FirewallManager manager;
+    manager.setAutoCommit(false);
+    manager.addFirewallRules(rules);
+
+    // 查找的数据包先生成好：一半的源地址取自规则，一半随机
+    std::vector<PacketTuple> packets(PACKET_POOL);
+    const uint8_t PROTOCOLS[] = {6, 17, 6, 17, 1, 47};
+    for (size_t i = 0; i < PACKET_POOL; ++i) {
+        PacketTuple& packet = packets[i];
+        const FirewallRule& rule = rules[rng() % rule_count];
+        if (i % 2 == 0 && !rule.src_ip.empty()) {
+            size_t slash = rule.src_ip.find('/');
+            PacketTuple::parse(rule.src_ip.substr(0, slash), "10.0.0.1", "tcp", 0, 0, &packet);
+            if (slash != std::string::npos) {
+                packet.src_ip |= static_cast<uint32_t>(rng() & 0xff);
+            }
+        } else {
+            packet.src_ip = 0x0a000000u | static_cast<uint32_t>(rng() & 0xffffff);
+        }
+        packet.dst_ip = 0x0a000000u | static_cast<uint32_t>(rng() & 0xffffff);
+        packet.protocol = PROTOCOLS[rng() % sizeof(PROTOCOLS)];
+        packet.src_port = static_cast<uint16_t>(rng());
+        packet.dst_port = static_cast<uint16_t>(rng());
+    }
+
+    auto start = Clock::now();
+    manager.classifyPacket(IptablesTable::FILTER, IptablesChain::INPUT, packets[0]);
+    double build = secondsSince(start);
+    std::cout << rule_count << " 条规则编译分类器 " << build * 1000 << " ms" << std::endl;
+
+    start = Clock::now();
+    uint64_t dropped = 0;
+    for (size_t i = 0; i < lookup_count; ++i) {
+        const FirewallRule* rule = manager.classifyPacket(IptablesTable::FILTER, IptablesChain::INPUT,
+                                                          packets[i & (PACKET_POOL - 1)]);
+        dropped += rule != nullptr && rule->action[0] == 'D';
+    }
+    double elapsed = secondsSince(start);
+    std::cout << lookup_count << " 次查找 " << elapsed << " 秒, " << lookup_count / elapsed / 1e6
+              << " M次/秒 (" << elapsed * 1e9 / lookup_count << " ns/次), 丢弃 " << dropped << std::endl;
+
+    ReferenceChain reference;
+    for (const auto& rule : rules) {
+        reference.add(rule);
+    }
+    size_t mismatches = 0;
+    size_t matched = 0;
+    size_t accepted = 0;
+    for (size_t i = 0; i < CHECKS; ++i) {
+        const PacketTuple& packet = packets[(i * 7919) & (PACKET_POOL - 1)];
+        const FirewallRule* got = manager.classifyPacket(IptablesTable::FILTER, IptablesChain::INPUT, packet);
+        const FirewallRule* want = reference.classify(packet);
+        matched += want != nullptr;
+        accepted += want != nullptr && want->action == "ACCEPT";
+        bool same = (got == nullptr && want == nullptr) || (got != nullptr && want != nullptr && got->id == want->id);
+        if (!same && ++mismatches <= 5) {
+            std::cout << "  不一致: " << formatIpv4(packet.src_ip) << " -> " << formatIpv4(packet.dst_ip) << ":"
+                      << packet.dst_port << " 得到 " << (got ? got->id : "-") << " 期望 "
+                      << (want ? want->id : "-") << std::endl;
+        }
+    }
+    std::cout << "核对 " << CHECKS << " 个数据包（命中 " << matched << "，其中放行 " << accepted << "）, 不一致 "
+              << mismatches << std::endl;
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,293 @@
+#include "NetworkPolicyManager.h"
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+
+/**
+ * @brief 应用网络策略决定表性能测试
+ *
+ * 建立32个网络（部分禁止、受限或优先级NEVER）和N个应用（默认2万个，每100个有
+ * 一对共享UID），每个应用在3个随机网络上有策略（部分未启用），批量提交一次，
+ * 测量编译决定表的耗时。用按包名逐个查找的参考实现核对所有（UID, 网络）
+ * 的决定，然后测量decide()和原来按字符串键查map、逐条扫描网络策略的耗时。
+ *
+ * 最后在两个读线程不停decide()的同时，写线程分批修改应用策略并替换决定表，
+ * 测量替换的耗时和读线程的吞吐量，结束后再核对一次。
+ *
+ * 用法: policy_decision_bench [应用数]
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t NETWORKS = 32;
+const size_t RULES_PER_APP = 3;
+const uint32_t FIRST_UID = 10000;
+const size_t DECISIONS = 20000000;
+const size_t NAIVE_DECISIONS = 1000000;
+const int UPDATE_BATCHES = 20;
+const size_t UPDATE_BATCH_SIZE = 100;
+const int READERS = 2;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+std::string networkName(size_t i) {
+    return "net_" + std::to_string(i);
+}
+
+std::string packageName(size_t i) {
+    return "com.example.app" + std::to_string(i);
+}
+
+// 每100个应用中第0个和第1个共享UID
+uint32_t uidOf(size_t app) {
+    return FIRST_UID + static_cast<uint32_t>(app % 100 == 1 ? app - 1 : app);
+}
+
+NetworkUsagePolicy randomPolicy(std::mt19937_64& rng) {
+    switch (rng() % 3) {
+        case 0: return NetworkUsagePolicy::ALLOWED;
+        case 1: return NetworkUsagePolicy::RESTRICTED;
+        default: return NetworkUsagePolicy::BLOCKED;
+    }
+}
+
+int severity(NetworkUsagePolicy policy) {
+    return policy == NetworkUsagePolicy::BLOCKED ? 2 : (policy == NetworkUsagePolicy::RESTRICTED ? 1 : 0);
+}
+
+/**
+ * @brief 参考实现：按包名和网络名查策略
+ */
+struct Reference {
+    std::map<std::string, NetworkPolicy> networks;       // 与NetworkPolicyManager一样按策略ID
+    std::map<std::string, AppNetworkPolicy> apps;        // 键为"包名:网络ID"
+    std::map<uint32_t, std::vector<std::string>> packages;  // UID → 包名
+
+    PolicyDecision network(const std::string& network_id) const {
+        for (const auto& pair : networks) {
+            const NetworkPolicy& policy = pair.second;
+            if (policy.network_id == network_id && policy.enabled) {
+                return PolicyDecision{policy.usage_policy, policy.priority, policy.metered, policy.bandwidth_limit};
+            }
+        }
+        return PolicyDecision{NetworkUsagePolicy::ALLOWED, NetworkPriority::DEFAULT, false, 0};
+    }
+
+    PolicyDecision decide(uint32_t uid, const std::string& network_id) const {
+        PolicyDecision result = network(network_id);
+        if (result.usage == NetworkUsagePolicy::BLOCKED || result.priority == NetworkPriority::NEVER) {
+            result.usage = NetworkUsagePolicy::BLOCKED;
+            return result;
+        }
+        auto it = packages.find(uid);
+        if (it == packages.end()) {
+            return result;
+        }
+        int best = -1;
+        for (const auto& package : it->second) {
+            auto rule = apps.find(package + ":" + network_id);
+            if (rule != apps.end() && rule->second.enabled) {
+                best = std::max(best, severity(rule->second.policy));
+            }
+        }
+        if (best >= 0) {
+            result.usage = best == 2 ? NetworkUsagePolicy::BLOCKED
+                                     : (best == 1 ? NetworkUsagePolicy::RESTRICTED : NetworkUsagePolicy::ALLOWED);
+        }
+        return result;
+    }
+
+    /**
+     * @brief 原来的做法：按字符串键查应用策略，逐条扫描网络策略
+     */
+    NetworkUsagePolicy naive(const std::string& package, const std::string& network_id) const {
+        NetworkUsagePolicy usage = NetworkUsagePolicy::ALLOWED;
+        for (const auto& pair : networks) {
+            if (pair.second.network_id == network_id && pair.second.enabled) {
+                usage = pair.second.usage_policy;
+                break;
+            }
+        }
+        auto rule = apps.find(package + ":" + network_id);
+        if (usage != NetworkUsagePolicy::BLOCKED && rule != apps.end() && rule->second.enabled) {
+            usage = rule->second.policy;
+        }
+        return usage;
+    }
+};
+
+bool sameDecision(const PolicyDecision& a, const PolicyDecision& b) {
+    return a.usage == b.usage && a.priority == b.priority && a.metered == b.metered &&
+           a.bandwidth_limit == b.bandwidth_limit;
+}
+
+/**
+ * @brief 核对所有应用和网络的决定
+ * @return 不一致的个数
+ */
+size_t verify(NetworkPolicyManager& manager, const Reference& reference, size_t apps,
+              const std::vector<uint32_t>& network_ids) {
+    size_t mismatches = 0;
+    for (size_t app = 0; app < apps; ++app) {
+        uint32_t uid = uidOf(app);
+        for (size_t n = 0; n < NETWORKS; ++n) {
+            mismatches += !sameDecision(manager.decide(uid, network_ids[n]), reference.decide(uid, networkName(n)));
+        }
+    }
+    // 没有应用策略的UID和没有策略的网络
+    mismatches += !sameDecision(manager.decide(1000, network_ids[0]), reference.decide(1000, networkName(0)));
+    PolicyDecision unknown = manager.decide(FIRST_UID, manager.internNetwork("unknown_network"));
+    mismatches += unknown.usage != NetworkUsagePolicy::ALLOWED || unknown.priority != NetworkPriority::DEFAULT;
+    return mismatches;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t apps = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    if (apps < 2) {
+        std::cerr << "用法: " << argv[0] << " [应用数(至少2)]" << std::endl;
+        return 1;
+    }
+    std::mt19937_64 rng(7);
+
+    NetworkPolicyManager manager;
+    Reference reference;
+    manager.beginUpdate();
+    for (size_t n = 0; n < NETWORKS; ++n) {
+        NetworkPolicy policy;
+        policy.id = "np_" + std::to_string(n);
+        policy.network_id = networkName(n);
+        policy.priority = n == 7 ? NetworkPriority::NEVER : (n % 3 == 0 ? NetworkPriority::HIGH : NetworkPriority::LOW);
+        policy.usage_policy = n % 8 == 3 ? NetworkUsagePolicy::BLOCKED
+                              : (n % 8 == 5 ? NetworkUsagePolicy::RESTRICTED : NetworkUsagePolicy::ALLOWED);
+        policy.metered = n % 2 == 1;
+        policy.bandwidth_limit = 0;
+        policy.enabled = n != 11;
+        manager.addNetworkPolicy(policy);
+        reference.networks[policy.id] = policy;
+    }
+
+    std::vector<AppNetworkPolicy> policies;
+    for (size_t app = 0; app < apps; ++app) {
+        std::string package = packageName(app);
+        manager.setAppUid(package, uidOf(app));
+        reference.packages[uidOf(app)].push_back(package);
+        for (size_t r = 0; r < RULES_PER_APP; ++r) {
+            AppNetworkPolicy policy;
+            policy.package_name = package;
+            policy.network_id = networkName(rng() % NETWORKS);
+            policy.policy = randomPolicy(rng);
+            policy.enabled = rng() % 10 != 0;
+            policies.push_back(policy);
+            reference.apps[package + ":" + policy.network_id] = policy;
+        }
+    }
+    manager.addAppNetworkPolicies(policies);
+
+    auto start = Clock::now();
+    manager.commitUpdate();
+    double compiled = secondsSince(start);
+
+    std::vector<uint32_t> network_ids;
+    for (size_t n = 0; n < NETWORKS; ++n) {
+        network_ids.push_back(manager.internNetwork(networkName(n)));
+    }
+    size_t mismatches = verify(manager, reference, apps, network_ids);
+    std::cout << "\n" << apps << " 个应用, " << NETWORKS << " 个网络, " << policies.size() << " 条应用策略: 编译 "
+              << compiled * 1e3 << " ms, 不一致 " << mismatches << std::endl;
+
+    // 随机的（UID, 网络）对，避免每次都命中同一行
+    const size_t PAIRS = 1 << 16;
+    std::vector<uint32_t> uids(PAIRS);
+    std::vector<uint32_t> networks(PAIRS);
+    std::vector<std::string> packages(PAIRS);
+    std::vector<std::string> network_names(PAIRS);
+    for (size_t i = 0; i < PAIRS; ++i) {
+        size_t app = rng() % apps;
+        size_t n = rng() % NETWORKS;
+        uids[i] = uidOf(app);
+        networks[i] = network_ids[n];
+        packages[i] = packageName(app);
+        network_names[i] = networkName(n);
+    }
+
+    start = Clock::now();
+    unsigned long blocked = 0;
+    for (size_t i = 0; i < DECISIONS; ++i) {
+        blocked += manager.decide(uids[i % PAIRS], networks[i % PAIRS]).usage == NetworkUsagePolicy::BLOCKED;
+    }
+    double elapsed = secondsSince(start);
+    std::cout << "decide(): " << DECISIONS << " 次, " << elapsed * 1e9 / DECISIONS << " ns/次 (禁止 " << blocked
+              << ")" << std::endl;
+
+    start = Clock::now();
+    blocked = 0;
+    for (size_t i = 0; i < NAIVE_DECISIONS; ++i) {
+        blocked += reference.naive(packages[i % PAIRS], network_names[i % PAIRS]) == NetworkUsagePolicy::BLOCKED;
+    }
+    elapsed = secondsSince(start);
+    std::cout << "按字符串查map: " << NAIVE_DECISIONS << " 次, " << elapsed * 1e9 / NAIVE_DECISIONS << " ns/次 (禁止 "
+              << blocked << ")" << std::endl;
+
+    // 读线程不停查询，写线程分批修改并替换决定表
+    std::atomic<bool> done(false);
+    std::vector<unsigned long> counts(READERS, 0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < READERS; ++t) {
+        readers.push_back(std::thread([&, t]() {
+            unsigned long count = 0;
+            size_t i = static_cast<size_t>(t) * 7919;
+            while (!done.load(std::memory_order_relaxed)) {
+                for (int k = 0; k < 1024; ++k, ++i) {
+                    manager.decide(uids[i % PAIRS], networks[i % PAIRS]);
+                }
+                count += 1024;
+            }
+            counts[t] = count;
+        }));
+    }
+
+    start = Clock::now();
+    double slowest = 0;
+    for (int batch = 0; batch < UPDATE_BATCHES; ++batch) {
+        std::vector<AppNetworkPolicy> changes;
+        for (size_t k = 0; k < UPDATE_BATCH_SIZE; ++k) {
+            AppNetworkPolicy policy;
+            policy.package_name = packageName(rng() % apps);
+            policy.network_id = networkName(rng() % NETWORKS);
+            policy.policy = randomPolicy(rng);
+            policy.enabled = true;
+            changes.push_back(policy);
+            reference.apps[policy.package_name + ":" + policy.network_id] = policy;
+        }
+        auto begin = Clock::now();
+        manager.addAppNetworkPolicies(changes);
+        slowest = std::max(slowest, secondsSince(begin));
+    }
+    double updating = secondsSince(start);
+    done = true;
+    unsigned long total = 0;
+    for (int t = 0; t < READERS; ++t) {
+        readers[t].join();
+        total += counts[t];
+    }
+    size_t after = verify(manager, reference, apps, network_ids);
+    mismatches += after;
+    std::cout << "并发: " << UPDATE_BATCHES << " 次替换, 平均 " << updating * 1e3 / UPDATE_BATCHES << " ms, 最长 "
+              << slowest * 1e3 << " ms; " << READERS << " 个读线程共 " << total / updating / 1e6
+              << " 百万次/秒; 不一致 " << after << std::endl;
+
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,240 @@
+#include "RateLimiter.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+
+/**
+ * @brief 分层令牌桶限速性能测试
+ *
+ * 先在模拟时间中测试限速和借用：100Mbps的接口（TrafficControlRule）下有一个
+ * 60Mbps的策略和一个不限速的策略（NetworkPolicy::bandwidth_limit），前者下面
+ * 两个应用（保证10/上限60、保证20/上限30 Mbps），后者下面一个应用，所有应用
+ * 不停发送1500字节的包5秒，检查接口跑满、各层的速率不超过上限、应用不低于
+ * 保证速率。
+ * 再用wait()等待时间轮唤醒发送，检查唤醒时间和达到的速率。
+ *
+ * 然后测量tryConsume()每秒的决定数：放行（三层都扣令牌）、拒绝，以及多个线程
+ * 在同一接口下各自的应用上发送。
+ *
+ * 用法: rate_limiter_bench [决定次数]
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const uint32_t PACKET = 1500;
+const uint64_t MS = 1000000;
+const uint64_t SIMULATED_NS = 5000 * MS;
+const uint64_t STEP_NS = 10000;
+const int THREADS = 2;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+double mbps(unsigned long bytes, uint64_t ns) {
+    return bytes * 8.0 * 1000.0 / ns;
+}
+
+/**
+ * @brief 检查速率在[min, max]内（允许1%的误差，max为0表示不检查上限）
+ */
+bool checkRate(const char* label, double rate, double min, double max) {
+    bool ok = rate >= min * 0.99 && (max == 0 || rate <= max * 1.01);
+    std::cout << "  " << label << ": " << rate << " Mbps" << (ok ? "" : "  <-- 超出范围") << std::endl;
+    return ok;
+}
+
+bool benchSharing() {
+    RateLimiter limiter;
+    TrafficControlRule rule;
+    rule.id = "tc_eth0";
+    rule.interface = "eth0";
+    rule.rate = 100000;
+    rule.burst = 0;
+    rule.latency = 0;
+    rule.loss = 0;
+    rule.enabled = true;
+    uint32_t interface = limiter.applyRule(rule);
+
+    NetworkPolicy video;
+    video.id = "video";
+    video.network_id = "eth0";
+    video.priority = NetworkPriority::DEFAULT;
+    video.usage_policy = NetworkUsagePolicy::ALLOWED;
+    video.metered = false;
+    video.bandwidth_limit = 60000;
+    video.enabled = true;
+    NetworkPolicy bulk = video;
+    bulk.id = "bulk";
+    bulk.bandwidth_limit = 0;
+    uint32_t video_bucket = limiter.applyPolicy(video);
+    uint32_t bulk_bucket = limiter.applyPolicy(bulk);
+
+    std::vector<uint32_t> apps;
+    apps.push_back(limiter.addBucket(video_bucket, 10000, 60000, 0));
+    apps.push_back(limiter.addBucket(video_bucket, 20000, 30000, 0));
+    apps.push_back(limiter.addBucket(bulk_bucket, 0, 0, 0));
+
+    uint64_t start = 1000 * MS;
+    std::mt19937 rng(1);
+    for (uint64_t now = start; now < start + SIMULATED_NS; now += STEP_NS) {
+        // 每步从随机的应用开始，每个应用发到被拒绝为止
+        size_t first = rng() % apps.size();
+        for (size_t k = 0; k < apps.size(); ++k) {
+            uint32_t app = apps[(first + k) % apps.size()];
+            while (limiter.tryConsume(app, PACKET, now)) {
+            }
+        }
+    }
+
+    std::vector<double> rates;
+    for (uint32_t app : apps) {
+        rates.push_back(mbps(limiter.getStats(app).bytes, SIMULATED_NS));
+    }
+    std::cout << "\n分层限速（模拟" << SIMULATED_NS / MS / 1000 << "秒）:" << std::endl;
+    bool ok = true;
+    ok = checkRate("接口eth0（100）", rates[0] + rates[1] + rates[2], 100, 100) && ok;
+    ok = checkRate("策略video（60）", rates[0] + rates[1], 30, 60) && ok;
+    ok = checkRate("应用1（保证10，上限60）", rates[0], 10, 60) && ok;
+    ok = checkRate("应用2（保证20，上限30）", rates[1], 20, 30) && ok;
+    ok = checkRate("应用3（策略bulk，借用）", rates[2], 0, 70) && ok;
+    RateLimiter::BucketStats stats = limiter.getStats(apps[0]);
+    std::cout << "  应用1: 放行 " << stats.packets << " 个包, 借用 " << stats.borrowed << ", 拒绝 " << stats.denied
+              << std::endl;
+
+    // 策略改成不启用后不再限速，由接口限制
+    video.enabled = false;
+    ok = limiter.applyPolicy(video) == video_bucket && ok;
+    ok = limiter.findInterface("eth0") == interface && limiter.findPolicy("bulk") == bulk_bucket && ok;
+    return ok;
+}
+
+bool benchWaiting() {
+    RateLimiter limiter;
+    uint32_t root = limiter.addBucket(RateLimiter::INVALID, 0, 8000, 0);
+    uint32_t app = limiter.addBucket(root, 0, 0, 0);
+
+    uint64_t start = 1000 * MS;
+    uint64_t now = start;
+    uint64_t ready = 0;
+    uint64_t fired = 0;
+    bool waiting = false;
+    unsigned long sent = 0;
+    unsigned long wakeups = 0;
+    unsigned long early = 0;
+    unsigned long late = 0;
+    while (now < start + SIMULATED_NS) {
+        if (!waiting) {
+            while (limiter.tryConsume(app, PACKET, now)) {
+                sent++;
+            }
+            ready = limiter.nextSendTime(app, PACKET, now);
+            waiting = true;
+            limiter.wait(app, PACKET, now, [&]() {
+                waiting = false;
+                fired = now;
+            });
+        }
+        now += MS;
+        if (limiter.runTimers(now) > 0) {
+            wakeups++;
+            early += fired < ready;
+            late += fired >= ready + MS;
+        }
+    }
+
+    // 取消的等待不应被唤醒
+    bool cancelled_fired = false;
+    uint32_t waiter = limiter.wait(app, 100000, now, [&]() { cancelled_fired = true; });
+    bool cancelled = limiter.cancelWait(waiter);
+    limiter.runTimers(now + 1000 * MS);
+
+    double rate = mbps(sent * PACKET, SIMULATED_NS);
+    bool ok = early == 0 && late == 0 && cancelled && !cancelled_fired && rate >= 8 * 0.99 && rate <= 8 * 1.01;
+    std::cout << "时间轮唤醒（上限8Mbps）: " << rate << " Mbps, 唤醒 " << wakeups << " 次, 早于可发送时间 " << early
+              << ", 晚1ms以上 " << late << ", 取消" << (cancelled && !cancelled_fired ? "正常" : "失败") << std::endl;
+    return ok;
+}
+
+void benchDecisions(unsigned long count) {
+    RateLimiter limiter;
+    // 放行：三层都有速率但远大于发送量；拒绝：1kbps的桶已经用完
+    uint32_t root = limiter.addBucket(RateLimiter::INVALID, 0, 4000000000u, 0);
+    uint32_t policy = limiter.addBucket(root, 2000000000u, 4000000000u, 0);
+    std::vector<uint32_t> apps;
+    for (int t = 0; t < THREADS; ++t) {
+        apps.push_back(limiter.addBucket(policy, 1000000000u, 2000000000u, 0));
+    }
+    uint32_t slow = limiter.addBucket(policy, 1, 1, 0);
+
+    std::cout << "\ntryConsume():" << std::endl;
+    auto start = Clock::now();
+    uint64_t now = RateLimiter::now();
+    unsigned long passed = 0;
+    for (unsigned long i = 0; i < count; ++i) {
+        if ((i & 63) == 0) {
+            now = RateLimiter::now();
+        }
+        passed += limiter.tryConsume(apps[0], 64, now);
+    }
+    double elapsed = secondsSince(start);
+    std::cout << "  放行: " << count / elapsed / 1e6 << " 百万次/秒 (" << elapsed * 1e9 / count << " ns/次, 放行 "
+              << passed << ")" << std::endl;
+
+    start = Clock::now();
+    passed = 0;
+    for (unsigned long i = 0; i < count; ++i) {
+        if ((i & 63) == 0) {
+            now = RateLimiter::now();
+        }
+        passed += limiter.tryConsume(slow, PACKET, now);
+    }
+    elapsed = secondsSince(start);
+    std::cout << "  拒绝: " << count / elapsed / 1e6 << " 百万次/秒 (" << elapsed * 1e9 / count << " ns/次, 放行 "
+              << passed << ")" << std::endl;
+
+    std::atomic<unsigned long> total(0);
+    std::vector<std::thread> threads;
+    start = Clock::now();
+    for (int t = 0; t < THREADS; ++t) {
+        threads.push_back(std::thread([&, t]() {
+            unsigned long local = 0;
+            uint64_t thread_now = 0;
+            for (unsigned long i = 0; i < count / THREADS; ++i) {
+                if ((i & 63) == 0) {
+                    thread_now = RateLimiter::now();
+                }
+                local += limiter.tryConsume(apps[t], 64, thread_now);
+            }
+            total += local;
+        }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    elapsed = secondsSince(start);
+    std::cout << "  " << THREADS << " 个线程: " << count / elapsed / 1e6 << " 百万次/秒 (放行 " << total << ")"
+              << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    unsigned long count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000000;
+    if (count == 0) {
+        std::cerr << "用法: " << argv[0] << " [决定次数]" << std::endl;
+        return 1;
+    }
+
+    bool ok = benchSharing();
+    ok = benchWaiting() && ok;
+    benchDecisions(count);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,317 @@
+#include "RouteTableManager.h"
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+/**
+ * @brief 批量路由下发性能测试
+ *
+ * 用RouteTableManager::replaceTable()把表100中的N条路由整体换成另外N条
+ * （N条删除 + N条添加，一批下发），测量耗时，并在批次中间注入失败，检查回滚后
+ * 对端和本地路由表都与之前一致。最后传入table_id为0的路由，检查相同的路由
+ * 不重新下发，只改一条时只发一删一加两条消息。
+ *
+ * 默认对端是一个假的netlink对端（socketpair另一端的线程，按内核的规则维护路由
+ * 集合并应答ACK），不需要root权限。指定接口时改为直接修改内核路由表，应在单独的
+ * 网络命名空间中运行，例如：
+ *   unshare -n sh -c 'ip link set lo up && ./route_batch_bench 1000 lo'
+ *
+ * 用法: route_batch_bench [路由条数] [接口]
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const unsigned int TABLE_ID = 100;
+const int SWAP_ROUNDS = 10;
+
+double msSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/**
+ * @brief 假的netlink对端
+ *
+ * 只处理RTM_NEWROUTE/RTM_DELROUTE：以表、目标、网关、metric为键，添加已存在的
+ * 返回EEXIST，删除不存在的返回ESRCH，每条消息回一个ACK，一次接收的ACK一起发回。
+ */
+class FakeNetlinkPeer {
+public:
+    FakeNetlinkPeer() : fail_at_(0), fail_error_(0), messages_(0) {
+        fds_[0] = fds_[1] = -1;
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds_) == 0) {
+            thread_ = std::thread(&FakeNetlinkPeer::run, this);
+        }
+    }
+
+    ~FakeNetlinkPeer() {
+        if (fds_[1] >= 0) {
+            shutdown(fds_[1], SHUT_RDWR);
+        }
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        if (fds_[1] >= 0) {
+            close(fds_[1]);
+        }
+    }
+
+    /**
+     * @brief 交给RouteTableManager的一端，由它关闭
+     */
+    int clientFd() const { return fds_[0]; }
+
+    /**
+     * @brief 从现在起第n条消息返回error
+     */
+    void failAt(size_t n, int error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        fail_at_ = n;
+        fail_error_ = error;
+        messages_ = 0;
+    }
+
+    std::set<std::string> routes() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return routes_;
+    }
+
+private:
+    int fds_[2];
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    std::set<std::string> routes_;
+    size_t fail_at_;
+    int fail_error_;
+    size_t messages_;
+
+    static std::string routeKey(const struct nlmsghdr* nlh) {
+        const struct rtmsg* rtm = static_cast<const struct rtmsg*>(NLMSG_DATA(nlh));
+        char dst[INET6_ADDRSTRLEN] = "default";
+        char gateway[INET6_ADDRSTRLEN] = "";
+        uint32_t table = rtm->rtm_table;
+        uint32_t priority = 0;
+        int len = static_cast<int>(RTM_PAYLOAD(nlh));
+        for (const struct rtattr* rta = RTM_RTA(rtm); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+            switch (rta->rta_type) {
+                case RTA_DST:      inet_ntop(rtm->rtm_family, RTA_DATA(rta), dst, sizeof(dst)); break;
+                case RTA_GATEWAY:  inet_ntop(rtm->rtm_family, RTA_DATA(rta), gateway, sizeof(gateway)); break;
+                case RTA_TABLE:    memcpy(&table, RTA_DATA(rta), sizeof(table)); break;
+                case RTA_PRIORITY: memcpy(&priority, RTA_DATA(rta), sizeof(priority)); break;
+                default: break;
+            }
+        }
+        return std::to_string(table) + " " + dst + "/" + std::to_string(rtm->rtm_dst_len) + " via " +
+               gateway + " metric " + std::to_string(priority);
+    }
+
+    void run() {
+        std::vector<uint8_t> buf(64 * 1024);
+        std::vector<uint8_t> acks;
+        for (;;) {
+            ssize_t n = recv(fds_[1], buf.data(), buf.size(), 0);
+            if (n <= 0) {
+                break;
+            }
+            acks.clear();
+            std::lock_guard<std::mutex> lock(mutex_);
+            size_t offset = 0;
+            while (static_cast<size_t>(n) - offset >= sizeof(struct nlmsghdr)) {
+                const struct nlmsghdr* nlh = reinterpret_cast<const struct nlmsghdr*>(buf.data() + offset);
+                int error = 0;
+                std::string key = routeKey(nlh);
+                if (fail_at_ != 0 && ++messages_ == fail_at_) {
+                    error = fail_error_;
+                } else if (nlh->nlmsg_type == RTM_NEWROUTE) {
+                    error = routes_.insert(key).second ? 0 : EEXIST;
+                } else if (nlh->nlmsg_type == RTM_DELROUTE) {
+                    error = routes_.erase(key) ? 0 : ESRCH;
+                } else {
+                    error = EOPNOTSUPP;
+                }
+
+                struct {
+                    struct nlmsghdr nlh;
+                    struct nlmsgerr err;
+                } ack;
+                memset(&ack, 0, sizeof(ack));
+                ack.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct nlmsgerr));
+                ack.nlh.nlmsg_type = NLMSG_ERROR;
+                ack.nlh.nlmsg_seq = nlh->nlmsg_seq;
+                ack.err.error = -error;
+                ack.err.msg = *nlh;
+                const uint8_t* p = reinterpret_cast<const uint8_t*>(&ack);
+                acks.insert(acks.end(), p, p + NLMSG_ALIGN(ack.nlh.nlmsg_len));
+                offset += NLMSG_ALIGN(nlh->nlmsg_len);
+            }
+            if (send(fds_[1], acks.data(), acks.size(), 0) < 0) {
+                break;
+            }
+        }
+    }
+};
+
+/**
+ * @brief 生成第generation组路由：<10 + generation>.x.y.0/24，直连在interface上
+ */
+std::vector<RouteEntry> makeRoutes(size_t count, int generation, const std::string& interface) {
+    std::vector<RouteEntry> routes(count);
+    for (size_t i = 0; i < count; ++i) {
+        RouteEntry& route = routes[i];
+        route.destination = std::to_string(10 + generation) + "." + std::to_string((i >> 8) & 0xff) + "." +
+                            std::to_string(i & 0xff) + ".0/24";
+        route.gateway = "";
+        route.interface = interface;
+        route.metric = 100;
+        route.type = RouteType::UNICAST;
+        route.protocol = RouteProtocol::STATIC;
+        route.table_id = TABLE_ID;
+    }
+    return routes;
+}
+
+size_t tableSize(const RouteTableManager& manager) {
+    size_t count = 0;
+    for (const auto& route : manager.getRoutes()) {
+        count += route.table_id == TABLE_ID;
+    }
+    return count;
+}
+
+/**
+ * @brief 内核表100中的路由条数
+ */
+size_t kernelTableSize() {
+    FILE* fp = popen("ip route show table 100", "r");
+    if (!fp) {
+        return 0;
+    }
+    size_t lines = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        lines++;
+    }
+    pclose(fp);
+    return lines;
+}
+
+/**
+ * @brief 交替整体替换A、B两组路由，报告耗时
+ * @return 每次替换都成功返回true
+ */
+bool benchSwap(RouteTableManager& manager, const std::vector<RouteEntry>& a,
+               const std::vector<RouteEntry>& b) {
+    auto start = Clock::now();
+    if (!manager.replaceTable(TABLE_ID, a)) {
+        return false;
+    }
+    std::cout << "  首次下发 " << a.size() << " 条: " << msSince(start) << " ms" << std::endl;
+
+    double total = 0;
+    double best = 1e9;
+    for (int round = 0; round < SWAP_ROUNDS; ++round) {
+        start = Clock::now();
+        if (!manager.replaceTable(TABLE_ID, round % 2 == 0 ? b : a)) {
+            return false;
+        }
+        double elapsed = msSince(start);
+        total += elapsed;
+        best = std::min(best, elapsed);
+    }
+    std::cout << "  整表替换 (" << a.size() << " 删 + " << b.size() << " 加): 平均 " << total / SWAP_ROUNDS
+              << " ms, 最快 " << best << " ms" << std::endl;
+    return true;
+}
+
+bool runFake(size_t count) {
+    std::cout << "假netlink对端:" << std::endl;
+    FakeNetlinkPeer peer;
+    RouteTableManager manager;
+    if (!manager.enableNetlink(peer.clientFd())) {
+        return false;
+    }
+    std::vector<RouteEntry> a = makeRoutes(count, 0, "lo");
+    std::vector<RouteEntry> b = makeRoutes(count, 1, "lo");
+    if (!benchSwap(manager, a, b)) {
+        std::cout << "  替换失败" << std::endl;
+        return false;
+    }
+
+    // 此时表中为A，换成B时在添加到一半处失败
+    std::set<std::string> before = peer.routes();
+    peer.failAt(count + count / 2, ENETUNREACH);
+    bool replaced = manager.replaceTable(TABLE_ID, b);
+    peer.failAt(0, 0);
+    bool same = !replaced && peer.routes() == before && tableSize(manager) == count &&
+                manager.lookupRoute("10.0.0.1", TABLE_ID) != nullptr && manager.lookupRoute("11.0.0.1", TABLE_ID) == nullptr;
+    std::cout << "  注入失败后回滚: " << (same ? "对端和本地路由表不变" : "不一致") << std::endl;
+
+    // 传入的路由不填table_id：表内相同的路由不应重新下发，发出消息就会失败
+    std::vector<RouteEntry> unnumbered = a;
+    for (auto& route : unnumbered) {
+        route.table_id = 0;
+    }
+    peer.failAt(1, ENETUNREACH);
+    bool unchanged = manager.replaceTable(TABLE_ID, unnumbered);
+    // 换掉一条只有一删一加，第3条消息失败
+    unnumbered.back().destination = "12.0.0.0/24";
+    peer.failAt(3, ENETUNREACH);
+    bool one_changed = manager.replaceTable(TABLE_ID, unnumbered);
+    peer.failAt(0, 0);
+    bool diffed = unchanged && one_changed && peer.routes().size() == count && tableSize(manager) == count &&
+                  manager.lookupRoute("12.0.0.1", TABLE_ID) != nullptr;
+    std::cout << "  table_id为0的路由: " << (diffed ? "只下发变化的路由" : "整表重新下发") << std::endl;
+    return same && diffed;
+}
+
+bool runKernel(size_t count, const std::string& interface) {
+    std::cout << "内核 (接口 " << interface << "):" << std::endl;
+    RouteTableManager manager;
+    if (!manager.enableNetlink()) {
+        return false;
+    }
+    std::vector<RouteEntry> a = makeRoutes(count, 0, interface);
+    std::vector<RouteEntry> b = makeRoutes(count, 1, interface);
+    if (!benchSwap(manager, a, b)) {
+        std::cout << "  替换失败（需要root权限，接口须已启用）" << std::endl;
+        return false;
+    }
+
+    // 中间一条路由的网关不可达，内核返回ENETUNREACH
+    std::vector<RouteEntry> broken = b;
+    broken[count / 2].gateway = "203.0.113.1";
+    bool replaced = manager.replaceTable(TABLE_ID, broken);
+    bool same = !replaced && kernelTableSize() == count && tableSize(manager) == count &&
+                manager.lookupRoute("10.0.0.1", TABLE_ID) != nullptr;
+    std::cout << "  失败后回滚: " << (same ? "内核和本地路由表不变" : "不一致") << std::endl;
+
+    manager.replaceTable(TABLE_ID, std::vector<RouteEntry>());
+    return same;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000;
+    if (count == 0 || count > 65536) {
+        std::cerr << "用法: " << argv[0] << " [路由条数(1-65536)] [接口]" << std::endl;
+        return 1;
+    }
+
+    bool ok = argc > 2 ? runKernel(count, argv[2]) : runFake(count);
+    return ok ? 0 : 1;
+}
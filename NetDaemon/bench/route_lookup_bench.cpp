@@ -0,0 +1,254 @@
+#include "RouteLookupTable.h"
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <arpa/inet.h>
+
+/**
+ * @brief 路由查找性能测试
+ *
+ * 生成接近BGP全表前缀长度分布的随机IPv4路由（默认100万条），测量建表、
+ * 查找（默认1亿次）和增量删除/添加的耗时，并用逐长度哈希查找的朴素实现
+ * 核对结果。之后对IPv6做同样的测试（路由和查找次数为IPv4的1/10）。
+ *
+ * 用法: route_lookup_bench [路由条数] [查找次数]
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// BGP全表中前缀长度的大致分布
+int randomIpv4Length(std::mt19937_64& rng) {
+    int r = static_cast<int>(rng() % 100);
+    if (r < 60) return 24;
+    if (r < 80) return 22 + static_cast<int>(rng() % 2);
+    if (r < 95) return 16 + static_cast<int>(rng() % 6);
+    if (r < 96) return 8 + static_cast<int>(rng() % 8);
+    return 25 + static_cast<int>(rng() % 8);
+}
+
+int randomIpv6Length(std::mt19937_64& rng) {
+    int r = static_cast<int>(rng() % 100);
+    if (r < 50) return 48;
+    if (r < 75) return 32 + static_cast<int>(rng() % 16);
+    if (r < 90) return 49 + static_cast<int>(rng() % 15);
+    return 64 + static_cast<int>(rng() % 65);
+}
+
+std::string formatAddress(const IpAddress& address) {
+    char buf[INET6_ADDRSTRLEN];
+    inet_ntop(address.family, address.bytes, buf, sizeof(buf));
+    return buf;
+}
+
+/**
+ * @brief 朴素实现：每个前缀长度一张哈希表，从长到短逐个查
+ */
+class ReferenceTable {
+public:
+    explicit ReferenceTable(int max_length) : by_length_(max_length + 1) {}
+
+    void add(const IpPrefix& prefix, uint32_t id) {
+        by_length_[prefix.length][key(prefix.address)].push_back(id);
+    }
+
+    void remove(const IpPrefix& prefix, uint32_t id) {
+        auto& table = by_length_[prefix.length];
+        auto it = table.find(key(prefix.address));
+        for (size_t i = 0; i < it->second.size(); ++i) {
+            if (it->second[i] == id) {
+                it->second.erase(it->second.begin() + i);
+                break;
+            }
+        }
+        if (it->second.empty()) {
+            table.erase(it);
+        }
+    }
+
+    // 返回路由编号，-1表示没有匹配
+    long lookup(const IpAddress& address, const std::vector<RouteEntry>& routes) const {
+        for (int length = static_cast<int>(by_length_.size()) - 1; length >= 0; --length) {
+            IpPrefix prefix;
+            prefix.address = address;
+            prefix.length = length;
+            for (int bit = length; bit < 128; ++bit) {
+                prefix.address.bytes[bit / 8] &= static_cast<uint8_t>(~(0x80 >> (bit % 8)));
+            }
+            auto it = by_length_[length].find(key(prefix.address));
+            if (it == by_length_[length].end()) {
+                continue;
+            }
+            long best = -1;
+            for (uint32_t id : it->second) {
+                if (best < 0 || routes[id].metric < routes[best].metric) {
+                    best = id;
+                }
+            }
+            return best;
+        }
+        return -1;
+    }
+
+private:
+    std::vector<std::unordered_map<std::string, std::vector<uint32_t>>> by_length_;
+
+    static std::string key(const IpAddress& address) {
+        return std::string(reinterpret_cast<const char*>(address.bytes), 16);
+    }
+};
+
+/**
+ * @brief 对一个地址族运行测试
+ * @return 核对通过返回true
+ */
+bool runBench(int family, size_t route_count, size_t lookup_count, uint64_t seed) {
+    const char* name = family == AF_INET ? "IPv4" : "IPv6";
+    std::mt19937_64 rng(seed);
+
+    // 生成路由，网关编码路由编号，用于核对
+    std::vector<RouteEntry> routes(route_count);
+    std::vector<IpPrefix> prefixes(route_count);
+    for (size_t i = 0; i < route_count; ++i) {
+        IpPrefix& prefix = prefixes[i];
+        memset(&prefix.address, 0, sizeof(prefix.address));
+        prefix.address.family = family;
+        int bytes = family == AF_INET ? 4 : 16;
+        for (int b = 0; b < bytes; b += 8) {
+            uint64_t r = rng();
+            memcpy(prefix.address.bytes + b, &r, std::min(8, bytes - b));
+        }
+        if (family == AF_INET6) {
+            prefix.address.bytes[0] = 0x20;  // 2000::/8 之内
+        }
+        prefix.length = family == AF_INET ? randomIpv4Length(rng) : randomIpv6Length(rng);
+        std::string text = formatAddress(prefix.address) + "/" + std::to_string(prefix.length);
+        IpPrefix::parse(text, &prefix);
+
+        RouteEntry& route = routes[i];
+        route.destination = text;
+        route.gateway = std::to_string(i);
+        route.interface = "eth" + std::to_string(i % 4);
+        route.metric = static_cast<int>(rng() % 4) * 100;
+        route.type = RouteType::UNICAST;
+        route.protocol = RouteProtocol::STATIC;
+        route.table_id = 254;
+    }
+
+    RouteLookupTable table;
+    auto start = Clock::now();
+    for (const auto& route : routes) {
+        table.add(route);
+    }
+    double build = secondsSince(start);
+    std::cout << name << ": " << route_count << " 条路由建表 " << build << " 秒 ("
+              << build * 1e9 / route_count << " ns/条), 查找结构 "
+              << table.memoryUsage() / (1024 * 1024) << " MB" << std::endl;
+
+    // 查找地址先生成好，测量的只有查找
+    const size_t ADDRESS_POOL = 1 << 20;
+    std::vector<IpAddress> addresses(ADDRESS_POOL);
+    std::vector<uint32_t> ipv4(ADDRESS_POOL);
+    for (size_t i = 0; i < ADDRESS_POOL; ++i) {
+        // 一半落在已有前缀内，一半随机
+        IpAddress& address = addresses[i];
+        if (i % 2 == 0) {
+            address = prefixes[rng() % route_count].address;
+            address.bytes[family == AF_INET ? 3 : 15] ^= static_cast<uint8_t>(rng());
+        } else {
+            memset(&address, 0, sizeof(address));
+            address.family = family;
+            uint64_t r1 = rng();
+            uint64_t r2 = rng();
+            memcpy(address.bytes, &r1, 8);
+            memcpy(address.bytes + 8, &r2, 8);
+            if (family == AF_INET) {
+                memset(address.bytes + 4, 0, 12);
+            } else {
+                address.bytes[0] = 0x20;
+            }
+        }
+        ipv4[i] = (static_cast<uint32_t>(address.bytes[0]) << 24) | (static_cast<uint32_t>(address.bytes[1]) << 16) |
+                  (static_cast<uint32_t>(address.bytes[2]) << 8) | address.bytes[3];
+    }
+
+    start = Clock::now();
+    uint64_t hits = 0;
+    if (family == AF_INET) {
+        for (size_t i = 0; i < lookup_count; ++i) {
+            hits += table.lookup(ipv4[i & (ADDRESS_POOL - 1)]) != nullptr;
+        }
+    } else {
+        for (size_t i = 0; i < lookup_count; ++i) {
+            hits += table.lookup(addresses[i & (ADDRESS_POOL - 1)]) != nullptr;
+        }
+    }
+    double elapsed = secondsSince(start);
+    std::cout << name << ": " << lookup_count << " 次查找 " << elapsed << " 秒, "
+              << lookup_count / elapsed / 1e6 << " M次/秒 (" << elapsed * 1e9 / lookup_count
+              << " ns/次), 命中 " << hits << std::endl;
+
+    // 增量删除10%再加回
+    size_t churn = route_count / 10;
+    start = Clock::now();
+    for (size_t i = 0; i < churn; ++i) {
+        table.remove(routes[i].destination, routes[i].gateway);
+    }
+    double removed = secondsSince(start);
+    std::cout << name << ": 删除 " << churn << " 条 " << removed * 1e9 / churn << " ns/条" << std::endl;
+
+    // 删除状态下核对
+    ReferenceTable reference(family == AF_INET ? 32 : 128);
+    for (size_t i = churn; i < route_count; ++i) {
+        reference.add(prefixes[i], static_cast<uint32_t>(i));
+    }
+    size_t checks = std::min<size_t>(ADDRESS_POOL, 200000);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < checks; ++i) {
+        const RouteEntry* got = table.lookup(addresses[i]);
+        long want = reference.lookup(addresses[i], routes);
+        bool same = (got == nullptr && want < 0) ||
+                    (got != nullptr && want >= 0 && got->gateway == routes[want].gateway);
+        if (!same && ++mismatches <= 5) {
+            std::cout << "  不一致: " << formatAddress(addresses[i]) << " 得到 "
+                      << (got ? got->destination : "-") << " 期望 "
+                      << (want >= 0 ? routes[want].destination : "-") << std::endl;
+        }
+    }
+
+    start = Clock::now();
+    for (size_t i = 0; i < churn; ++i) {
+        table.add(routes[i]);
+    }
+    double added = secondsSince(start);
+    std::cout << name << ": 加回 " << churn << " 条 " << added * 1e9 / churn << " ns/条, 核对 "
+              << checks << " 个地址, 不一致 " << mismatches << std::endl;
+    return mismatches == 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t route_count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    size_t lookup_count = argc > 2 ? strtoul(argv[2], nullptr, 10) : 100000000;
+    if (route_count == 0) {
+        std::cerr << "用法: " << argv[0] << " [路由条数] [查找次数]" << std::endl;
+        return 1;
+    }
+
+    bool ok = runBench(AF_INET, route_count, lookup_count, 1);
+    ok = runBench(AF_INET6, std::max<size_t>(route_count / 10, 1), lookup_count / 10, 2) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,299 @@
+#include "TrafficHistory.h"
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 流量历史测试
+ *
+ * 用整秒时刻的累计计数驱动InterfaceHistory，每秒的字节数按时间变化，逐项核对：
+ * 1秒一级写满后环形覆盖，只保留最近的槽；间隔不超过10秒时平均分到中间的每一秒，
+ * 更长的间隔留空；计数器复位的那一秒记为0，不出现巨大的速率；分钟和小时两级的
+ * min/max/avg与按秒数据直接计算的一致，缺秒的分钟按实际秒数加权。
+ *
+ * 然后用256个接口（默认上限）记录N秒（默认3600秒），测量每次记录的耗时，
+ * 以及按窗口汇总和求百分位数的耗时。
+ *
+ * 用法: traffic_history_bench [记录秒数]
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const uint64_t NS_PER_SECOND = 1000000000ULL;
+const size_t INTERFACES = 256;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * @brief 第second秒内收到的字节数
+ */
+uint64_t bytesIn(int64_t second) {
+    return 1000 * static_cast<uint64_t>(second % 7 + 1) + 10 * static_cast<uint64_t>(second % 60);
+}
+
+/**
+ * @brief 单个接口的计数，记录时刻都是整秒
+ */
+class Feeder {
+public:
+    explicit Feeder(InterfaceHistory& history) : history_(history) {
+        memset(&counters_, 0, sizeof(counters_));
+    }
+
+    /**
+     * @brief 记录second时刻的计数，之前的一秒收到bytes字节
+     */
+    void add(int64_t second, uint64_t bytes) {
+        counters_.rx_bytes += bytes;
+        counters_.rx_packets += bytes / 100;
+        counters_.tx_bytes += bytes / 2;
+        counters_.tx_packets += bytes / 200;
+        history_.record(counters_, static_cast<uint64_t>(second) * NS_PER_SECOND);
+    }
+
+    /**
+     * @brief 计数器复位（例如驱动重新加载）
+     */
+    void resetCounters(int64_t second) {
+        memset(&counters_, 0, sizeof(counters_));
+        history_.record(counters_, static_cast<uint64_t>(second) * NS_PER_SECOND);
+    }
+
+private:
+    InterfaceHistory& history_;
+    InterfaceCounters counters_;
+};
+
+bool near(double value, double expected) {
+    return std::fabs(value - expected) <= std::fabs(expected) * 1e-5 + 1e-3;
+}
+
+bool report(const char* label, bool ok) {
+    std::cout << "  " << label << (ok ? "" : "  <- 不符合预期") << std::endl;
+    return ok;
+}
+
+/**
+ * @brief 1秒一级写满后覆盖最早的槽
+ */
+bool checkWrap() {
+    HistoryConfig config;
+    config.second_slots = 60;
+    InterfaceHistory history(config);
+    Feeder feeder(history);
+    feeder.add(100, 0);
+    for (int64_t s = 101; s <= 300; ++s) {
+        feeder.add(s, bytesIn(s - 1));
+    }
+
+    std::vector<HistoryPoint> points(200);
+    size_t n = history.query(HistoryMetric::RX_BPS, HistoryResolution::SECOND, 0, 1000, points.data(), points.size());
+    bool ok = history.latestSecond() == 299 && n == 60 && points[0].time == 240;
+    for (size_t i = 0; ok && i < n; ++i) {
+        ok = points[i].time == 240 + static_cast<int64_t>(i) && near(points[i].avg, bytesIn(points[i].time) * 8.0);
+    }
+    char label[128];
+    snprintf(label, sizeof(label), "环形覆盖: 记录200秒, 保留 %zu 个点 (%lld-%lld)", n,
+             n > 0 ? static_cast<long long>(points[0].time) : -1LL,
+             n > 0 ? static_cast<long long>(points[n - 1].time) : -1LL);
+    return report(label, ok);
+}
+
+/**
+ * @brief 短间隔平均分到每一秒，长间隔留空
+ */
+bool checkGaps() {
+    InterfaceHistory history{HistoryConfig()};
+    Feeder feeder(history);
+    feeder.add(1000, 0);
+    feeder.add(1001, 8000);
+    // 5秒没有记录，共收到5万字节
+    feeder.add(1006, 50000);
+    // 30秒没有记录，这段时间不知道速率
+    feeder.add(1036, 123456789);
+    feeder.add(1037, 4000);
+
+    std::vector<HistoryPoint> points(100);
+    size_t n = history.query(HistoryMetric::RX_BPS, HistoryResolution::SECOND, 1000, 1036, points.data(),
+                             points.size());
+    bool short_gap = n == 7;
+    for (size_t i = 0; short_gap && i < 6; ++i) {
+        short_gap = points[i].time == 1000 + static_cast<int64_t>(i) &&
+                    near(points[i].avg, i == 0 ? 64000.0 : 80000.0);
+    }
+    size_t inside = history.query(HistoryMetric::RX_BPS, HistoryResolution::SECOND, 1006, 1035, points.data(),
+                                  points.size());
+    bool long_gap = inside == 0 && n == 7 && points[6].time == 1036 && near(points[6].avg, 32000.0);
+    bool ok = report(short_gap ? "5秒的间隔: 平均分到每一秒" : "5秒的间隔", short_gap);
+    char label[128];
+    snprintf(label, sizeof(label), "30秒的间隔: 中间 %zu 个点, 之后从下一次记录开始", inside);
+    return report(label, long_gap) && ok;
+}
+
+/**
+ * @brief 计数器复位的那一秒记为0
+ */
+bool checkCounterReset() {
+    InterfaceHistory history{HistoryConfig()};
+    Feeder feeder(history);
+    feeder.add(2000, 0);
+    for (int64_t s = 2001; s <= 2010; ++s) {
+        feeder.add(s, 1u << 30);
+    }
+    feeder.resetCounters(2011);
+    feeder.add(2012, 1000);
+
+    HistoryPoint points[16];
+    size_t n = history.query(HistoryMetric::RX_BPS, HistoryResolution::SECOND, 2009, 2011, points, 16);
+    bool ok = n == 3 && near(points[0].avg, 8.0 * (1u << 30)) && points[1].avg == 0 && near(points[2].avg, 8000.0);
+    return report(ok ? "计数器复位: 那一秒记为0, 之后恢复" : "计数器复位", ok);
+}
+
+/**
+ * @brief 分钟、小时两级与按秒数据直接计算的一致
+ */
+bool checkDownsampling() {
+    HistoryConfig config;
+    InterfaceHistory history(config);
+    Feeder feeder(history);
+    const int64_t start = 7200;
+    const int64_t end = start + 2 * 3600 + 61;
+    // 第二个小时的第10分钟有21秒没有记录（超过10秒，留空）
+    const int64_t hole = start + 3600 + 600;
+    feeder.add(start, 0);
+    for (int64_t s = start + 1; s <= end; ++s) {
+        if (s > hole && s <= hole + 20) {
+            continue;
+        }
+        feeder.add(s, bytesIn(s - 1));
+    }
+
+    // 按秒数据直接计算
+    std::vector<double> minute_min, minute_max, minute_sum, minute_count;
+    std::vector<double> hour_sum(2), hour_count(2), hour_min(2, 1e30), hour_max(2, 0);
+    for (int64_t s = start; s < end; ++s) {
+        if (s >= hole && s <= hole + 20) {
+            continue;
+        }
+        double value = bytesIn(s) * 8.0;
+        size_t m = static_cast<size_t>((s - start) / 60);
+        if (m >= minute_sum.size()) {
+            minute_min.push_back(value);
+            minute_max.push_back(value);
+            minute_sum.push_back(0);
+            minute_count.push_back(0);
+        }
+        minute_min[m] = std::min(minute_min[m], value);
+        minute_max[m] = std::max(minute_max[m], value);
+        minute_sum[m] += value;
+        minute_count[m]++;
+        size_t h = static_cast<size_t>((s - start) / 3600);
+        if (h < 2) {
+            hour_min[h] = std::min(hour_min[h], value);
+            hour_max[h] = std::max(hour_max[h], value);
+            hour_sum[h] += value;
+            hour_count[h]++;
+        }
+    }
+
+    // 只有已经结束的分钟和小时
+    std::vector<HistoryPoint> points(200);
+    size_t minutes = history.query(HistoryMetric::RX_BPS, HistoryResolution::MINUTE, start, end, points.data(),
+                                   points.size());
+    bool minute_ok = minutes == 121;
+    size_t mismatches = 0;
+    for (size_t i = 0; minute_ok && i < minutes; ++i) {
+        size_t m = static_cast<size_t>((points[i].time - start) / 60);
+        if (m >= minute_sum.size() || !near(points[i].avg, minute_sum[m] / minute_count[m]) ||
+            !near(points[i].min, minute_min[m]) || !near(points[i].max, minute_max[m])) {
+            mismatches++;
+        }
+    }
+    minute_ok = minute_ok && mismatches == 0;
+
+    size_t hours = history.query(HistoryMetric::RX_BPS, HistoryResolution::HOUR, start, end, points.data(),
+                                 points.size());
+    bool hour_ok = hours == 2;
+    for (size_t h = 0; hour_ok && h < hours; ++h) {
+        hour_ok = points[h].time == start + static_cast<int64_t>(h) * 3600 &&
+                  near(points[h].avg, hour_sum[h] / hour_count[h]) && near(points[h].min, hour_min[h]) &&
+                  near(points[h].max, hour_max[h]);
+    }
+
+    char label[160];
+    snprintf(label, sizeof(label), "分钟: %zu 个点, 不一致 %zu", minutes, mismatches);
+    bool ok = report(label, minute_ok);
+    snprintf(label, sizeof(label), "小时: %zu 个点, 第二个小时缺21秒按 %.0f 秒加权", hours, hour_count[1]);
+    return report(label, hour_ok) && ok;
+}
+
+/**
+ * @brief 256个接口记录seconds秒
+ */
+bool benchRecord(int64_t seconds) {
+    TrafficHistory history;
+    std::vector<InterfaceCounters> counters(INTERFACES);
+    memset(counters.data(), 0, counters.size() * sizeof(InterfaceCounters));
+    std::vector<std::string> names(INTERFACES);
+    for (size_t i = 0; i < INTERFACES; ++i) {
+        names[i] = "eth" + std::to_string(i);
+    }
+
+    auto start = Clock::now();
+    for (int64_t s = 0; s <= seconds; ++s) {
+        for (size_t i = 0; i < INTERFACES; ++i) {
+            counters[i].rx_bytes += bytesIn(s + static_cast<int64_t>(i));
+            history.record(names[i].c_str(), counters[i], static_cast<uint64_t>(s) * NS_PER_SECOND);
+        }
+    }
+    double elapsed = secondsSince(start);
+    double records = static_cast<double>(seconds + 1) * INTERFACES;
+
+    const int QUERIES = 1000;
+    HistorySummary summary;
+    bool ok = history.size() == INTERFACES;
+    start = Clock::now();
+    for (int i = 0; i < QUERIES; ++i) {
+        ok = history.summarize(names[i % INTERFACES].c_str(), HistoryMetric::RX_BPS, 900, &summary) && ok;
+    }
+    double summarized = secondsSince(start);
+    double value = 0;
+    start = Clock::now();
+    for (int i = 0; i < QUERIES; ++i) {
+        ok = history.percentile(names[i % INTERFACES].c_str(), HistoryMetric::RX_BPS, 900, 95, &value) && ok;
+    }
+    double percentiled = secondsSince(start);
+
+    std::cout << INTERFACES << " 个接口记录 " << seconds << " 秒: " << elapsed * 1e9 / records << " ns/次; 最近900秒汇总 "
+              << summarized * 1e6 / QUERIES << " µs, 95百分位 " << percentiled * 1e6 / QUERIES << " µs"
+              << (ok ? "" : "  <- 不符合预期") << std::endl;
+    return ok;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    long seconds = argc > 1 ? strtol(argv[1], nullptr, 10) : 3600;
+    if (seconds < 900) {
+        std::cerr << "用法: " << argv[0] << " [记录秒数(至少900)]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "InterfaceHistory:" << std::endl;
+    bool ok = checkWrap();
+    ok = checkGaps() && ok;
+    ok = checkCounterReset() && ok;
+    ok = checkDownsampling() && ok;
+    ok = benchRecord(seconds) && ok;
+    return ok ? 0 : 1;
+}
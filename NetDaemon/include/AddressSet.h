@@ -0,0 +1,112 @@
+#ifndef ADDRESS_SET_H
+#define ADDRESS_SET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief IPv4地址集合（对应ipset的hash:net），成员为单个地址或网段
+ *
+ * 每个前缀长度一张开放寻址哈希表保存成员，键为按该长度掩码处理后的地址。
+ * 查找不逐个长度查表：长度不超过16的网段展开到一张按/16索引的位图（8KB），
+ * 17-24的展开到按/24索引的位图（2MB，第一次用到时分配），单个地址查/32的哈希表，
+ * 只有少见的25-31位网段才按长度查表。查找是两次位图访问加一次哈希，与成员数
+ * 和网段长度的种类无关。
+ *
+ * 删除网段时对它覆盖的/16或/24逐个检查是否还被其他网段覆盖，再清位图。
+ * 哈希表删除用后移法（不留删除标记），大量增删后查找不会变慢。
+ *
+ * 不是线程安全的，由调用方加锁。
+ */
+class AddressSet {
+public:
+    AddressSet();
+
+    /**
+     * @brief 解析"a.b.c.d"或"a.b.c.d/长度"
+     * @param address 输出地址（主机字节序），长度之后的位为0
+     * @param length 输出前缀长度，单个地址为32
+     * @return 成功返回true，不是IPv4地址或网段返回false
+     */
+    static bool parse(const std::string& text, uint32_t* address, int* length);
+
+    /**
+     * @brief 为批量添加预留空间，避免逐次扩容
+     * @param count 将要添加的/32地址数
+     */
+    void reserve(size_t count);
+
+    /**
+     * @brief 添加成员
+     * @return 新加入返回true，已存在返回false
+     */
+    bool add(uint32_t address, int length);
+
+    /**
+     * @brief 删除成员
+     * @return 删除成功返回true，不存在返回false
+     */
+    bool remove(uint32_t address, int length);
+
+    /**
+     * @brief 清空所有成员
+     */
+    void clear();
+
+    /**
+     * @brief 地址是否属于某个成员
+     * @param address 地址（主机字节序）
+     */
+    bool contains(uint32_t address) const;
+
+    /**
+     * @brief 成员数
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * @brief 所有成员（地址, 前缀长度），顺序不定
+     */
+    std::vector<std::pair<uint32_t, int>> members() const;
+
+    /**
+     * @brief 占用的内存（字节）
+     */
+    size_t memoryUsage() const;
+
+    /**
+     * @brief 格式化成员，/32不带长度
+     */
+    static std::string format(uint32_t address, int length);
+
+private:
+    /**
+     * @brief 一个前缀长度的哈希表，槽为地址，EMPTY表示空
+     */
+    struct Table {
+        std::vector<uint64_t> slots;     // 容量为2的幂，没有成员时为空
+        size_t used;
+    };
+
+    Table tables_[33];
+    uint64_t lengths_;                   // 第i位表示长度i有成员
+    size_t size_;
+    std::vector<uint64_t> cover16_;      // /16被长度不超过16的网段覆盖
+    std::vector<uint64_t> cover24_;      // /24被长度17-24的网段覆盖，没有这类网段时为空
+
+    bool tableContains(int length, uint32_t address) const;
+
+    /**
+     * @brief 增删网段后更新位图
+     * @param covered 增加时为true；删除时为false，逐个检查是否还被其他网段覆盖
+     */
+    void updateCover(uint32_t address, int length, bool covered);
+
+    static size_t hashAddress(uint32_t address);
+    static void rehash(Table& table, size_t capacity);
+};
+
+#endif // ADDRESS_SET_H
@@ -0,0 +1,143 @@
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "DNSManager.h"
+#include "TimerWheel.h"
+
+/**
+ * @brief 分片的DNS缓存
+ *
+ * 按（域名, 查询类型）缓存解析结果，域名不区分大小写。键的哈希决定所在的分片，
+ * 每个分片一把锁、一张开放寻址哈希表和一个时间轮（tick为1秒），不同分片上的
+ * 查找互不等待；查找时直接对传入的域名计算哈希和比较，不构造键，不分配内存
+ * （复制结果除外）。
+ *
+ * 每条记录按应答中的TTL缓存（不超过最长TTL），NXDOMAIN和没有记录的应答按
+ * 否定缓存TTL缓存，超时、截断等没有确定应答的结果（rcode为-1）不缓存。到期由时间轮在查找、插入
+ * 和expire()时以O(1)删除，不扫描整个缓存；查到时剩余TTL按经过的时间减少。
+ *
+ * 预取：命中次数达到阈值的记录在TTL只剩最后10%时，第一次命中返回PREFETCH，
+ * 由调用方在后台重新解析并insert()，热门域名不会因为到期而集中未命中。
+ *
+ * 时间由调用方传入（毫秒，单调时钟），便于测试。公开方法可以在任意线程调用。
+ */
+class DNSCache {
+public:
+    /**
+     * @brief 查找结果
+     */
+    enum class Status {
+        MISS,
+        HIT,
+        PREFETCH                         // 命中，调用方应在后台刷新
+    };
+
+    /**
+     * @param shards 分片数，取不小于它的2的幂
+     */
+    explicit DNSCache(size_t shards = 16);
+
+    /**
+     * @brief 设置TTL上限和否定缓存的TTL（秒）
+     */
+    void setLimits(int max_ttl, int negative_ttl);
+
+    /**
+     * @brief 设置预取阈值
+     * @param min_hits 插入后命中多少次才预取，0为不预取
+     */
+    void setPrefetchHits(unsigned int min_hits);
+
+    /**
+     * @brief 查找
+     * @param result 命中时输出结果，ttl为剩余的秒数
+     */
+    Status lookup(const std::string& name, DNSQueryType type, uint64_t now_ms, DNSResolution* result);
+
+    /**
+     * @brief 按结果的应答码和TTL缓存，不能缓存的结果只清除预取标记
+     * @return 已缓存返回true
+     */
+    bool insert(const std::string& name, DNSQueryType type, const DNSResolution& result, uint64_t now_ms);
+
+    /**
+     * @brief 删除到期的条目
+     * @return 删除的条目数
+     */
+    size_t expire(uint64_t now_ms);
+
+    void clear();
+
+    size_t size() const;
+
+    /**
+     * @brief 所有未到期的条目
+     */
+    std::vector<DNSCacheEntry> entries(uint64_t now_ms) const;
+
+private:
+    struct Entry {
+        std::string name;                // 小写，不带末尾的点
+        uint32_t hash;                   // 键哈希的高32位
+        DNSQueryType type;
+        DNSResolution resolution;
+        uint64_t expires_ms;
+        time_t timestamp;                // 插入时的系统时间
+        int ttl;
+        uint32_t timer;
+        uint32_t hits;
+        bool prefetch_eligible;          // TTL足够长，值得预取
+        bool prefetching;
+    };
+
+    /**
+     * @brief 哈希表的槽，index为INVALID表示空
+     */
+    struct Slot {
+        uint32_t hash;
+        uint32_t index;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::vector<Slot> slots;         // 容量为2的幂，负载不超过一半
+        size_t used;
+        std::vector<Entry> entries;      // 按下标引用，删除的放入free
+        std::vector<uint32_t> free;
+        TimerWheel wheel;
+        std::vector<uint64_t> expired;   // advance()的输出，复用
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    size_t shard_mask_;
+    std::atomic<int> max_ttl_;
+    std::atomic<int> negative_ttl_;
+    std::atomic<unsigned int> prefetch_hits_;
+
+    /**
+     * @brief 键的哈希，低位选分片，高32位在分片内使用
+     * @param length 输出去掉末尾的点后的域名长度
+     */
+    static uint64_t hashKey(const std::string& name, DNSQueryType type, size_t* length);
+
+    // 以下方法的调用方持有分片的锁
+    static uint32_t find(const Shard& shard, uint32_t hash, const std::string& name, size_t length,
+                         DNSQueryType type);
+    static void insertSlot(Shard& shard, uint32_t hash, uint32_t index);
+    // 从哈希表删除并释放条目，定时器由调用方取消或已经到期
+    static void removeEntry(Shard& shard, uint32_t index);
+
+    /**
+     * @brief 推进分片的时间轮并删除到期的条目
+     */
+    static size_t expireShard(Shard& shard, uint64_t now_ms);
+};
+
+#endif // DNS_CACHE_H
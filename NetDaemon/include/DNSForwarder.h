@@ -0,0 +1,169 @@
+#ifndef DNS_FORWARDER_H
+#define DNS_FORWARDER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include "DNSManager.h"
+
+/**
+ * @brief 本地缓存DNS转发器
+ *
+ * 在127.0.0.x的UDP端口上接收本机进程的查询，通过DNSManager::resolveAsync()应答：
+ * 缓存命中时在转发线程中直接应答，未命中的经异步解析器转发给上游服务器（相同的
+ * 在途查询合并），结果加入DNSManager的缓存，本机所有进程共用。一个线程在epoll上
+ * 用recvmmsg()批量接收、sendmmsg()批量发送；解析线程中完成的应答放入发送队列，
+ * 通过eventfd唤醒转发线程。
+ *
+ * IN类的A、AAAA、PTR、SRV查询经缓存应答，以问题中的域名为所有者（不保留CNAME
+ * 链），TTL为缓存中剩余的TTL。IN类的其他类型（MX、TXT、NS、SOA、HTTPS等）经
+ * DNSManager::relayAsync()原样转发给上游，不缓存，上游的应答换回客户端的查询ID
+ * 和问题段后原样返回。非IN类和非标准查询返回NOTIMP，格式错误返回FORMERR，没有
+ * 得到确定的应答（超时、上游出错、截断后TCP也失败）返回SERVFAIL。查询带EDNS0时
+ * 应答不超过其UDP大小（最多1232字节），否则不超过512字节，超出时截断并设置TC。
+ *
+ * 公开方法可以在任意线程调用，DNSManager必须比转发器存在得更久。
+ */
+class DNSForwarder {
+public:
+    /**
+     * @brief 转发器统计信息
+     */
+    struct ForwarderStats {
+        unsigned long queries;           // 收到的查询数
+        unsigned long responses;         // 发出的应答数
+        unsigned long errors;            // FORMERR、NOTIMP和SERVFAIL应答数
+        unsigned long truncated;         // 设置了TC的应答数
+        unsigned long dropped;           // 无法应答或发送失败的报文数
+        unsigned long recv_batches;      // recvmmsg()调用数
+        unsigned long send_batches;      // sendmmsg()调用数
+    };
+
+    explicit DNSForwarder(DNSManager& manager);
+    ~DNSForwarder();
+
+    /**
+     * @brief 绑定地址并启动转发线程
+     * @param address 监听地址，必须在127.0.0.0/8内
+     * @param port 监听端口，0为由系统分配
+     * @return 成功返回true，失败返回false
+     */
+    bool start(const std::string& address, uint16_t port);
+
+    /**
+     * @brief 停止转发线程，之后完成的查询不再应答
+     */
+    void stop();
+
+    bool isRunning() const { return running_; }
+
+    std::string getAddress() const;
+
+    /**
+     * @brief 实际监听的端口，未启动时为0
+     */
+    uint16_t getPort() const;
+
+    ForwarderStats getStats() const;
+
+private:
+    /**
+     * @brief 待发送的应答
+     */
+    struct Response {
+        sockaddr_storage addr;
+        socklen_t addr_len;
+        std::vector<uint8_t> data;
+    };
+
+    /**
+     * @brief 发送队列，解析线程中的回调持有它，转发器停止后回调仍可安全调用
+     */
+    struct Outbox {
+        std::mutex mutex;
+        std::vector<Response> responses;
+        bool notified;                   // 已通知或转发线程正在处理一批查询，不必再写eventfd
+        bool closed;
+        int event_fd;
+
+        Outbox();
+        ~Outbox();
+
+        void push(Response&& response);
+    };
+
+    /**
+     * @brief 生成应答所需的查询信息
+     */
+    struct Query {
+        sockaddr_storage addr;
+        socklen_t addr_len;
+        uint16_t id;
+        uint16_t flags;                  // 查询的标志位，应答中保留RD
+        std::vector<uint8_t> question;   // 问题段原样复制，为空时应答不带问题段
+        uint16_t qtype;
+        bool edns;
+        size_t limit;                    // 应答的最大长度
+    };
+
+    /**
+     * @brief 统计计数，编码应答可能在解析线程中进行
+     */
+    struct StatCounters {
+        std::atomic<unsigned long> queries;
+        std::atomic<unsigned long> responses;
+        std::atomic<unsigned long> errors;
+        std::atomic<unsigned long> truncated;
+        std::atomic<unsigned long> dropped;
+        std::atomic<unsigned long> recv_batches;
+        std::atomic<unsigned long> send_batches;
+    };
+
+    DNSManager& manager_;
+    std::atomic<bool> running_;
+    int socket_;
+    int epoll_fd_;
+    std::string address_;
+    uint16_t port_;
+    std::thread thread_;
+    std::shared_ptr<Outbox> outbox_;
+    std::shared_ptr<StatCounters> stats_;
+    std::mutex mutex_;                   // 保护启动和停止
+
+    // 以下只在转发线程中访问
+    std::vector<Response> sending_;
+
+    void loop();
+
+    /**
+     * @brief 解析一个查询，能立即应答的放入发送队列，其余交给DNSManager
+     */
+    void handleQuery(const uint8_t* msg, size_t len, const sockaddr_storage& from, socklen_t from_len);
+
+    /**
+     * @brief 批量发出发送队列中的应答
+     */
+    void flush();
+
+    /**
+     * @brief 编码应答
+     * @param rcode 应答码，result不为空时按结果确定
+     * @param result 解析结果，为空时不带回答
+     */
+    static Response encodeResponse(const Query& query, int rcode, const DNSResolution* result,
+                                   StatCounters& stats);
+
+    /**
+     * @brief 把原样转发得到的上游应答改回客户端的查询ID和问题段
+     * @param upstream 上游的应答报文，为空时返回SERVFAIL
+     */
+    static Response relayResponse(const Query& query, const std::vector<uint8_t>& upstream, StatCounters& stats);
+};
+
+#endif // DNS_FORWARDER_H
@@ -4,8 +4,16 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+class DNSResolver;
+class DNSCache;
+class DNSForwarder;
 
 /**
  * @brief DNS服务器信息结构体
@@ -16,6 +24,18 @@ struct DNSServer {
     std::string interface;  // 关联的网络接口
 };
 
+/**
+ * @brief DNS服务器的健康状况，由解析器根据应答统计
+ */
+struct DNSServerStats {
+    std::string ip_address;
+    double srtt_ms;         // 平滑RTT（毫秒），还没有测到时为-1
+    double failure_rate;    // 超时、发送失败和SERVFAIL等错误比例的指数移动平均
+    unsigned long queries;  // 发出的查询数
+    unsigned long failures;
+    bool healthy;
+};
+
 /**
  * @brief DNS查询类型枚举
  */
@@ -40,6 +60,7 @@ struct DNSResolution {
     int ttl;  // 生存时间（秒）
     bool success;
     std::string error_message;
+    int rcode;  // 应答码：0为NOERROR，3为NXDOMAIN，没有得到确定的应答（超时、出错、截断）时为-1
 };
 
 /**
@@ -47,19 +68,29 @@ struct DNSResolution {
  */
 struct DNSCacheEntry {
     std::string hostname;
+    DNSQueryType query_type;
     DNSResolution resolution;
-    time_t timestamp;
-    int ttl;
+    time_t timestamp;  // 缓存时间
+    int ttl;           // 缓存的生存时间（秒）
 };
 
 /**
  * @brief DNS管理器
  * 
  * 负责配置DNS服务器、管理DNS解析策略
+ *
+ * 查询由DNSResolver直接向配置的服务器发出（第一次解析时启动），结果按
+ * （域名, 查询类型）存入分片的DNSCache。缓存未命中时，相同（域名, 查询类型）的
+ * 查询只向服务器发出一次，同时到来的其他查询等待这次的结果（热门域名到期时
+ * 不会有大量相同的查询同时发出）。resolve()、
+ * resolveAsync()、reverseLookup()和缓存、统计相关的方法可以在多个线程中调用；
+ * 服务器、搜索域和转发器的配置方法不是线程安全的，由调用方加锁。
  */
 class DNSManager {
 public:
     using DNSCallback = std::function<void(const std::string&, const DNSResolution&)>;
+    using ResolveCallback = std::function<void(const DNSResolution&)>;
+    using RelayCallback = std::function<void(const std::vector<uint8_t>& response)>;
 
     DNSManager();
     ~DNSManager();
@@ -101,9 +132,36 @@ public:
      * @brief 解析域名
      * @param hostname 主机名
      * @param query_type 查询类型
+     * @param race 对延迟敏感：未命中时同时向最好的两个服务器查询，取先到的应答
      * @return DNS解析结果
      */
-    DNSResolution resolve(const std::string& hostname, DNSQueryType query_type = DNSQueryType::A);
+    DNSResolution resolve(const std::string& hostname, DNSQueryType query_type = DNSQueryType::A,
+                          bool race = false);
+
+    /**
+     * @brief 异步解析域名，不阻塞调用线程
+     * @param hostname 主机名
+     * @param query_type 查询类型（A、AAAA、PTR、SRV）
+     * @param callback 缓存命中时在调用线程中立即调用，否则在解析线程中调用（相同的
+     *                 在途查询完成时，依次调用其上所有等待者的回调）
+     * @param race 对延迟敏感：未命中时同时向最好的两个服务器查询，取先到的应答
+     * @return 已提交返回true，域名或类型无效、解析器无法启动时返回false，不会调用回调
+     */
+    bool resolveAsync(const std::string& hostname, DNSQueryType query_type, ResolveCallback callback,
+                      bool race = false);
+
+    /**
+     * @brief 把查询原样转发给上游服务器，不经过缓存，用于DNSResolver不解析的类型
+     * @param query 查询报文，见DNSResolver::relayAsync()
+     * @param callback 在解析线程中调用，参数为上游的应答报文，没有得到应答时为空
+     * @return 已提交返回true，报文无效或解析器无法启动时返回false，不会调用回调
+     */
+    bool relayAsync(const uint8_t* query, size_t len, RelayCallback callback);
+
+    /**
+     * @brief 各DNS服务器的平滑RTT、失败率和是否健康（解析器启动后开始统计）
+     */
+    std::vector<DNSServerStats> getServerStats() const;
 
     /**
      * @brief 反向DNS查询（IP到域名）
@@ -132,11 +190,18 @@ public:
 
     /**
      * @brief 设置DNS缓存TTL
-     * @param ttl 缓存生存时间（秒）
+     * @param ttl 缓存生存时间的上限（秒），应答中的TTL更短时按应答
      * @return 成功返回true，失败返回false
      */
     bool setCacheTTL(int ttl);
 
+    /**
+     * @brief 设置否定缓存TTL（NXDOMAIN和没有记录的应答，默认60秒）
+     * @param ttl 生存时间（秒），0为不缓存
+     * @return 成功返回true，失败返回false
+     */
+    bool setNegativeCacheTTL(int ttl);
+
     /**
      * @brief 启用/禁用DNS缓存
      * @param enabled 是否启用
@@ -145,7 +210,38 @@ public:
     bool setCacheEnabled(bool enabled);
 
     /**
-     * @brief 配置系统DNS（写入/etc/resolv.conf）
+     * @brief 设置查询DNS服务器的端口（默认53），测试时可指向本地的桩服务器
+     */
+    void setServerPort(uint16_t port);
+
+    /**
+     * @brief 设置查询超时
+     * @param timeout_ms 等待一个服务器应答的时间（毫秒）
+     * @param attempts 服务器列表尝试的轮数
+     */
+    void setQueryTimeout(int timeout_ms, int attempts);
+
+    /**
+     * @brief 启动本地缓存DNS转发器，本机进程的查询共用这里的缓存
+     * @param address 监听地址，必须在127.0.0.0/8内
+     * @param port 监听端口，0为由系统分配
+     * @return 成功返回true，失败返回false
+     */
+    bool startForwarder(const std::string& address = "127.0.0.53", uint16_t port = 53);
+
+    /**
+     * @brief 停止本地转发器
+     */
+    void stopForwarder();
+
+    /**
+     * @brief 本地转发器实际监听的端口，未启动时为0
+     */
+    uint16_t getForwarderPort() const;
+
+    /**
+     * @brief 配置系统DNS（写入/etc/resolv.conf），转发器在53端口运行时指向转发器，
+     *        否则服务器按测得的健康状况和RTT排序，没有测到的按优先级
      * @return 成功返回true，失败返回false
      */
     bool configureSystemDNS();
@@ -165,7 +261,7 @@ public:
 
     /**
      * @brief 注册DNS解析回调
-     * @param callback 回调函数
+     * @param callback 回调函数，异步解析时在解析线程中调用
      */
     void registerCallback(DNSCallback callback);
 
@@ -177,38 +273,101 @@ public:
         unsigned long cache_hits;
         unsigned long cache_misses;
         unsigned long failed_queries;
+        unsigned long prefetches;     // 快到期时在后台刷新的次数
+        unsigned long upstream_queries;   // 实际发出的查询数（含预取）
+        unsigned long coalesced_queries;  // 加入相同的在途查询等待的次数
+        unsigned long waiting_queries;    // 当前等待在途查询结果的调用数
     };
     DNSStats getStats() const;
 
 private:
+    /**
+     * @brief 统计计数，多个线程同时更新
+     */
+    struct StatCounters {
+        std::atomic<unsigned long> total_queries;
+        std::atomic<unsigned long> cache_hits;
+        std::atomic<unsigned long> cache_misses;
+        std::atomic<unsigned long> failed_queries;
+        std::atomic<unsigned long> prefetches;
+        std::atomic<unsigned long> upstream_queries;
+        std::atomic<unsigned long> coalesced_queries;
+        std::atomic<unsigned long> waiting_queries;
+    };
+
+    /**
+     * @brief 等待在途查询结果的调用
+     */
+    struct Waiter {
+        std::string hostname;            // 调用方传入的域名，可能与发出的大小写不同
+        ResolveCallback callback;
+    };
+
     std::map<std::string, DNSServer> dns_servers_;
-    std::map<std::string, DNSCacheEntry> dns_cache_;
     std::vector<std::string> search_domains_;
     DNSCallback dns_callback_;
     bool initialized_;
-    bool cache_enabled_;
+    std::atomic<bool> cache_enabled_;
     int cache_ttl_;
-    DNSStats stats_;
+    int negative_ttl_;
+    StatCounters stats_;
+    std::unique_ptr<DNSCache> cache_;
+    std::unique_ptr<DNSResolver> resolver_;
+    std::unique_ptr<DNSForwarder> forwarder_;
+    std::mutex mutex_;                   // 保护解析器的启动
+    // 在途查询，键为flightKey()，等待者可以为空（预取）
+    std::unordered_map<std::string, std::vector<Waiter>> flights_;
+    std::mutex flights_mutex_;
 
     /**
-     * @brief 执行DNS查询
+     * @brief 执行DNS查询，等待解析线程返回结果
      */
     DNSResolution performDNSQuery(const std::string& hostname, DNSQueryType query_type);
 
     /**
-     * @brief 检查缓存中是否有结果
+     * @brief 启动解析器（只在第一次调用时启动）
+     */
+    bool ensureResolver();
+
+    /**
+     * @brief 把服务器列表同步给解析器
+     */
+    void syncServers();
+
+    /**
+     * @brief 计入一次查询并查找缓存，快到期的热门条目在后台刷新
+     * @return 缓存命中返回true，结果写入result
+     */
+    bool lookupCache(const std::string& hostname, DNSQueryType query_type, DNSResolution* result);
+
+    /**
+     * @brief 加入相同的在途查询，没有时发出新的查询
+     * @param callback 完成时调用，可以为空
+     * @param race 发出新的查询时是否竞速，加入已有的查询时不改变它
+     * @return 已加入或已发出返回true；发出失败返回false，不调用callback
+     */
+    bool joinQuery(const std::string& hostname, DNSQueryType query_type, ResolveCallback callback, bool race);
+
+    /**
+     * @brief 在途查询完成：先加入缓存，再通知所有等待者
+     */
+    void completeQuery(const std::string& key, const std::string& hostname, DNSQueryType query_type,
+                       const DNSResolution& result);
+
+    /**
+     * @brief 记录一次调用的结果：失败的计入统计，然后调用注册的回调
      */
-    DNSCacheEntry* findInCache(const std::string& hostname);
+    void recordResult(const std::string& hostname, const DNSResolution& result);
 
     /**
-     * @brief 添加到缓存
+     * @brief 在途查询的键：查询类型和小写、去掉末尾点的域名
      */
-    void addToCache(const std::string& hostname, const DNSResolution& resolution);
+    static std::string flightKey(const std::string& hostname, DNSQueryType query_type);
 
     /**
-     * @brief 清理过期的缓存条目
+     * @brief 在后台重新解析，结果直接更新缓存（已有相同的在途查询时不再发出）
      */
-    void cleanupExpiredCache();
+    void prefetch(const std::string& hostname, DNSQueryType query_type);
 
     /**
      * @brief 执行DNS命令
@@ -0,0 +1,339 @@
+#ifndef DNS_RESOLVER_H
+#define DNS_RESOLVER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <chrono>
+#include <sys/socket.h>
+#include "DNSManager.h"
+
+/**
+ * @brief 非阻塞的UDP DNS解析器
+ *
+ * 查询直接按DNS报文格式编码（A、AAAA、PTR、SRV，带EDNS0），由一个线程在epoll上
+ * 收发，同时可以有上千个查询在途，调用方的线程不等待网络。应答沿CNAME链取出
+ * 记录，TTL取各记录的最小值。
+ *
+ * 防止伪造应答：每个地址族有一个套接字池（16个非阻塞UDP套接字，各绑定
+ * 在临时端口范围内的随机端口上），每次发送随机选一个，一个套接字发出256
+ * 个查询后换成新端口的套接字，旧的等迟到的应答超时后关闭。查询ID随机，域名中
+ * 字母的大小写也随机（0x20）。应答必须从这个查询用过的套接字收到，查询ID、来源
+ * 地址和问题段（包括大小写）都要一致，否则丢弃。
+ *
+ * 设置了TC的应答改用TCP向同一个服务器重新查询；TCP也失败时以rcode -1、
+ * "Truncated response"结束，与没有记录的应答区分开。
+ *
+ * 每个服务器记录平滑RTT（1/8增益）和失败率（超时、发送失败、SERVFAIL/REFUSED，
+ * 1/4增益）。每次发送选本轮还没试过的服务器中最好的：健康的（失败率低于一半）
+ * 优先，其次按"平滑RTT + 失败率 × 超时"，相同时按优先级。还没测到RTT的服务器和
+ * 30秒没有再失败的不健康服务器，用一个新查询探测（同一时间只探测一个），期间
+ * 没测到的按100ms估计；不健康的应答一次后恢复。超时、发送失败或服务器出错时
+ * 换下一个，全部试过后再重复，直到达到轮数。NXDOMAIN和没有记录是确定的应答，
+ * 不再重试。重试期间，之前的服务器迟到的应答同样接受。
+ *
+ * 对延迟敏感的查询可以同时发给最好的两个服务器，取先到的应答。其他类型的查询
+ * 可以原样转发（relayAsync()），同样选择服务器、重试和核对，应答原样返回。
+ *
+ * 结果通过回调（在解析线程中调用，不应阻塞，也不能调用stop()）或std::future返回。
+ * 公开方法可以在任意线程调用。
+ */
+class DNSResolver {
+public:
+    using Callback = std::function<void(const DNSResolution&)>;
+    using RelayCallback = DNSManager::RelayCallback;
+
+    DNSResolver();
+    ~DNSResolver();
+
+    /**
+     * @brief 创建套接字并启动解析线程
+     * @return 成功返回true，失败返回false
+     */
+    bool start();
+
+    /**
+     * @brief 停止解析线程，未完成的查询以失败结束
+     */
+    void stop();
+
+    bool isRunning() const { return running_; }
+
+    /**
+     * @brief 设置上游服务器，按priority从小到大尝试，之后发出的查询生效
+     */
+    void setServers(const std::vector<DNSServer>& servers);
+
+    /**
+     * @brief 设置服务器端口（默认53），测试时可指向本地的桩服务器
+     */
+    void setPort(uint16_t port);
+
+    /**
+     * @brief 设置每次尝试的超时和轮数
+     * @param timeout_ms 等待一个服务器应答的时间（毫秒，默认1000）
+     * @param attempts 服务器列表尝试的轮数（默认2）
+     */
+    void setTimeout(int timeout_ms, int attempts);
+
+    /**
+     * @brief 设置同时在途的查询数上限（默认1024，最大16384），超出的排队等待
+     */
+    void setMaxInflight(size_t max_inflight);
+
+    /**
+     * @brief 异步解析
+     * @param name 域名，PTR查询为reverseName()的结果
+     * @param type 查询类型，支持A、AAAA、PTR、SRV
+     * @param callback 完成时在解析线程中调用，成功时地址、域名或"优先级 权重 端口 目标"
+     *                 放在ip_addresses中
+     * @param race 第一次同时发给最好的两个服务器
+     * @return 已提交返回true；解析器未启动、域名或类型无效返回false，不会调用回调
+     */
+    bool resolveAsync(const std::string& name, DNSQueryType type, Callback callback, bool race = false);
+
+    /**
+     * @brief 异步解析，通过future取结果；提交失败时future立即就绪，success为false
+     */
+    std::future<DNSResolution> resolve(const std::string& name, DNSQueryType type, bool race = false);
+
+    /**
+     * @brief 原样转发查询（任意类型，例如MX、TXT、HTTPS）
+     * @param query 只有一个IN类问题的查询报文，可以带附加段；发出时换成随机的查询ID，
+     *              域名的大小写随机
+     * @param callback 完成时在解析线程中调用，参数为上游的应答报文（查询ID和问题段
+     *                 是发出时的，由调用方改回）；SERVFAIL、超时或截断后TCP也失败时为空
+     * @return 已提交返回true；解析器未启动或报文无效返回false，不会调用回调
+     */
+    bool relayAsync(const uint8_t* query, size_t len, RelayCallback callback);
+
+    /**
+     * @brief 各服务器的健康状况（按配置的优先级排列），解析线程每处理一批事件后更新
+     */
+    std::vector<DNSServerStats> getServerStats() const;
+
+    /**
+     * @brief 反向查询使用的域名（x.x.x.x.in-addr.arpa或ip6.arpa）
+     * @return 不是IP地址时返回空字符串
+     */
+    static std::string reverseName(const std::string& ip_address);
+
+    /**
+     * @brief 编码查询报文
+     * @return 报文长度，域名无效或缓冲区不够时返回0
+     */
+    static size_t encodeQuery(const std::string& name, uint16_t qtype, uint16_t id, uint8_t* buf, size_t size);
+
+    /**
+     * @brief 按标签编码域名（不压缩，不带末尾的点）
+     * @return 编码后的长度，域名无效或缓冲区不够时返回0
+     */
+    static size_t encodeName(const std::string& name, uint8_t* buf, size_t size);
+
+    /**
+     * @brief 从报文中读取域名（处理压缩指针）
+     * @param offset 域名开始的位置，成功时移到域名之后
+     * @return 成功返回true，格式错误返回false
+     */
+    static bool readName(const uint8_t* msg, size_t len, size_t* offset, std::string* name);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief 等待提交的查询
+     */
+    struct Request {
+        std::string name;
+        uint16_t qtype;
+        bool race;
+        Callback callback;
+        std::vector<uint8_t> relay;      // 原样转发的查询，为空时按name和qtype编码
+        RelayCallback relay_callback;
+    };
+
+    /**
+     * @brief 池中的UDP套接字
+     */
+    struct Socket {
+        int fd;
+        int family;
+        uint32_t serial;                 // 从1开始的编号，fd会被复用，编号不会
+        unsigned long sends;
+        Clock::time_point close_at;      // 退役后关闭的时间
+    };
+
+    /**
+     * @brief 一次发送，应答到达时用来计算RTT
+     */
+    struct Attempt {
+        size_t server;                   // active_servers_中的下标
+        Clock::time_point sent;
+    };
+
+    /**
+     * @brief 在途的查询，只在解析线程中访问
+     */
+    struct Query {
+        std::string name;
+        uint16_t qtype;
+        bool race;
+        Callback callback;
+        RelayCallback relay_callback;    // 原样转发时代替callback
+        std::string sent_name;           // 发出的域名，字母大小写随机
+        std::vector<uint8_t> packet;
+        std::vector<uint32_t> sockets;   // 发出过的套接字编号，应答必须从其中之一收到
+        size_t tries;                    // 已尝试的次数
+        uint64_t tried;                  // 本轮已试过的服务器（按下标的位图）
+        std::vector<Attempt> outstanding;  // 等待应答的发送
+        bool waiting;                    // 已发出，deadline有效
+        std::multimap<Clock::time_point, uint16_t>::iterator deadline;
+        std::string last_error;
+        int tcp_fd;                      // 应答截断后改用的TCP连接，没有时为-1
+        std::string tcp_server;
+        std::vector<uint8_t> tcp_buf;    // 发送时为带长度前缀的查询，之后为收到的应答
+        size_t tcp_done;                 // 已发送或已接收的字节数
+        bool tcp_sending;
+    };
+
+    struct Server {
+        std::string address;
+        sockaddr_storage addr;
+        socklen_t addr_len;
+        double srtt_ms;                  // 还没测到时为-1
+        double failure_rate;
+        unsigned long queries;
+        unsigned long failures;
+        Clock::time_point last_failure;
+        bool probing;                    // 已发出探测，等待结果
+    };
+
+    std::atomic<bool> running_;
+    int epoll_fd_;
+    int event_fd_;                       // 通知解析线程有新查询或退出
+    std::thread thread_;
+
+    mutable std::mutex mutex_;           // 保护以下配置和pending_
+    std::vector<DNSServer> servers_;
+    bool servers_changed_;
+    uint16_t port_;
+    int timeout_ms_;
+    int attempts_;
+    size_t max_inflight_;
+    std::vector<Request> pending_;
+    std::vector<DNSServerStats> server_stats_;
+
+    // 以下只在解析线程中访问
+    std::vector<Server> active_servers_;
+    int active_timeout_ms_;
+    size_t active_max_tries_;
+    size_t active_max_inflight_;
+    std::vector<Socket> sockets_;        // 在用的UDP套接字（start()和stop()也在线程外访问）
+    std::vector<Socket> retired_;        // 不再发送，等迟到的应答
+    uint32_t next_socket_;
+    uint16_t port_min_;                  // 随机端口的范围
+    uint16_t port_max_;
+    std::unordered_map<int, uint16_t> tcp_queries_;  // TCP连接 → 查询ID
+    std::deque<Request> backlog_;
+    std::unordered_map<uint16_t, Query> queries_;
+    std::multimap<Clock::time_point, uint16_t> deadlines_;
+    std::mt19937 rng_;
+    std::vector<uint8_t> recv_buf_;
+    bool stats_changed_;
+
+    void loop();
+    void startQueries();
+
+    /**
+     * @brief 把查询报文中域名字母的大小写随机化（0x20），记下发出的域名
+     */
+    void randomizeCase(Query& query);
+
+    /**
+     * @brief 向下一个服务器发送，所有尝试用完时以失败结束查询
+     */
+    void sendQuery(uint16_t id);
+    /**
+     * @brief 选本轮还没试过的服务器中最好的，都试过时开始新的一轮
+     */
+    size_t pickServer(Query& query, Clock::time_point now);
+    void recordSuccess(size_t server, Clock::duration rtt);
+    void recordFailure(size_t server, Clock::time_point now);
+
+    /**
+     * @brief 从等待应答的发送中取出发给这个服务器的
+     * @return 找到返回true
+     */
+    static bool takeAttempt(Query& query, size_t server, Attempt* attempt);
+
+    /**
+     * @brief 创建套接字，绑定随机端口并加入epoll
+     * @return 成功返回true
+     */
+    bool openSocket(int family, Socket* out);
+
+    /**
+     * @brief 随机选一个family的套接字，用过的次数到了时换新的
+     * @return 套接字在sockets_中的下标，没有时返回sockets_.size()
+     */
+    size_t pickSocket(int family);
+
+    /**
+     * @brief 关闭到时间的退役套接字
+     * @return 下一个退役套接字的关闭时间，没有时为Clock::time_point::max()
+     */
+    Clock::time_point closeRetired(Clock::time_point now);
+
+    void closeSockets();
+
+    void receive(int fd);
+    void handleResponse(const uint8_t* msg, size_t len, const sockaddr_storage& from, uint32_t socket);
+
+    /**
+     * @brief 应答被截断，改用TCP向同一个服务器查询
+     */
+    void startTcp(uint16_t id, size_t server);
+    void handleTcp(uint16_t id);
+
+    /**
+     * @brief TCP查询失败，以截断结束
+     */
+    void failTcp(uint16_t id, const std::string& reason);
+
+    void expireQueries();
+
+    /**
+     * @brief 结束查询并调用回调，关闭TCP连接
+     * @param msg 应答报文，原样转发的查询把它交给回调；为空时没有得到应答
+     */
+    void finish(uint16_t id, DNSResolution& result, const uint8_t* msg = nullptr, size_t len = 0);
+
+    /**
+     * @brief 应答的处理方式
+     */
+    enum class ResponseAction {
+        IGNORE,                          // 不是这个查询的应答
+        RETRY,                           // 服务器出错，换下一个服务器
+        DONE                             // 确定的应答（成功、NXDOMAIN或没有记录）
+    };
+
+    /**
+     * @brief 核对问题段（域名的大小写须与发出的一致）并解析应答的资源记录
+     */
+    static ResponseAction parseResponse(const uint8_t* msg, size_t len, const Query& query, DNSResolution* result);
+
+    static bool buildServer(const DNSServer& server, uint16_t port, Server* out);
+    static int createSocket(int family);
+};
+
+#endif // DNS_RESOLVER_H
@@ -4,7 +4,12 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <utility>
+#include <cstdint>
 #include <functional>
+#include "PacketClassifier.h"
+#include "AddressSet.h"
 
 /**
  * @brief iptables操作类型
@@ -53,6 +58,8 @@ struct FirewallRule {
     std::string protocol;
     std::string action;  // ACCEPT, DROP, REJECT, etc.
     std::string extra_params;
+    std::string src_set;  // 源地址集合名，非空时匹配集合中的地址（-m set --match-set）
+    std::string dst_set;  // 目的地址集合名
     bool enabled;
 };
 
@@ -73,6 +80,15 @@ struct TrafficControlRule {
  * @brief 防火墙和流量控制管理器
  * 
  * 负责管理iptables规则和流量控制，实现数据包过滤和转发
+ *
+ * 防火墙规则维护一份期望状态，commit()时与已应用的状态比较，差异生成
+ * iptables-restore --noflush载荷，每个表一次执行，表内原子生效。规则放在自己的链
+ * （fw_INPUT等，由对应的内置链跳转）中：链第一次使用或上次执行失败时整链重写，
+ * 之后只下发变化的规则（-D/-A/-I）。规则在链中的顺序与逐条执行iptables命令时
+ * 相同：APPEND追加到末尾，INSERT插到最前，重新启用的规则按新加入处理。
+ *
+ * 地址集合对应内核中的ipset（hash:net），规则通过src_set/dst_set引用，集合成员
+ * 变化只通过ipset restore下发add/del，不改动规则。提交时先下发集合再下发规则。
  */
 class FirewallManager {
 public:
@@ -100,6 +116,13 @@ public:
      */
     bool addFirewallRule(const FirewallRule& rule);
 
+    /**
+     * @brief 批量添加防火墙规则，只提交一次
+     * @param rules 防火墙规则列表
+     * @return 成功返回true，失败返回false
+     */
+    bool addFirewallRules(const std::vector<FirewallRule>& rules);
+
     /**
      * @brief 删除防火墙规则
      * @param rule_id 规则ID
@@ -121,6 +144,86 @@ public:
      */
     bool disableFirewallRule(const std::string& rule_id);
 
+    /**
+     * @brief 设置规则修改后是否立即提交
+     * @param auto_commit 为false时修改只记入期望状态，由commit()一次下发
+     */
+    void setAutoCommit(bool auto_commit);
+
+    /**
+     * @brief 把期望状态与已应用状态的差异下发到iptables
+     * @return 成功返回true；失败时期望状态保留，相关的链下次整链重写
+     */
+    bool commit();
+
+    /**
+     * @brief 下一次commit()将下发的iptables-restore载荷，不执行
+     */
+    std::string pendingRestorePayload() const;
+
+    /**
+     * @brief 设置执行载荷的命令
+     * @param command 从标准输入读取载荷的命令，例如"iptables-restore --noflush -w"；
+     *                为空时只打印（模拟执行）
+     */
+    void setRestoreCommand(const std::string& command);
+
+    /**
+     * @brief 设置执行ipset载荷的命令
+     * @param command 从标准输入读取载荷的命令，例如"ipset restore"；为空时只打印（模拟执行）
+     */
+    void setIpsetCommand(const std::string& command);
+
+    /**
+     * @brief 创建地址集合
+     * @param name 集合名（ipset名），最长31个字符，只能包含字母、数字、'_'、'-'、'.'
+     * @return 成功返回true，名字无效或已存在返回false
+     */
+    bool createAddressSet(const std::string& name);
+
+    /**
+     * @brief 删除地址集合，仍有规则引用时不能删除
+     * @param name 集合名
+     * @return 成功返回true，失败返回false
+     */
+    bool destroyAddressSet(const std::string& name);
+
+    /**
+     * @brief 批量添加集合成员
+     * @param name 集合名
+     * @param entries 地址或网段，例如"192.0.2.1"、"198.51.100.0/24"
+     * @return 成功返回true；集合不存在或有成员无法解析时返回false，不做任何修改
+     */
+    bool addToAddressSet(const std::string& name, const std::vector<std::string>& entries);
+
+    /**
+     * @brief 批量删除集合成员，不存在的成员忽略
+     * @param name 集合名
+     * @param entries 地址或网段
+     * @return 成功返回true；集合不存在或有成员无法解析时返回false，不做任何修改
+     */
+    bool removeFromAddressSet(const std::string& name, const std::vector<std::string>& entries);
+
+    /**
+     * @brief 获取地址集合
+     * @return 集合，不存在返回nullptr
+     */
+    const AddressSet* getAddressSet(const std::string& name) const;
+
+    /**
+     * @brief 按期望状态查找数据包在链中命中的第一条规则，不经过内核
+     *
+     * 启用的规则按链中的顺序编译为PacketClassifier，规则修改后第一次查找时重建。
+     * 只比较协议、地址（含地址集合）和端口，extra_params中的条件不参与匹配；
+     * PacketClassifier不支持的写法（取反、主机名等）的规则跳过。
+     * @param table 表类型
+     * @param chain 链类型
+     * @param packet 数据包五元组
+     * @return 命中的规则，其action为处理结果；没有命中返回nullptr（由链的默认策略
+     *         处理）。指针在下一次修改规则前有效
+     */
+    const FirewallRule* classifyPacket(IptablesTable table, IptablesChain chain, const PacketTuple& packet);
+
     /**
      * @brief 清空指定链的规则
      * @param table 表类型
@@ -199,16 +302,128 @@ public:
     void registerCallback(FirewallCallback callback);
 
 private:
-    std::map<std::string, FirewallRule> firewall_rules_;
+    using ChainKey = std::pair<IptablesTable, IptablesChain>;
+
+    /**
+     * @brief 已下发到iptables的规则
+     */
+    struct AppliedRule {
+        ChainKey chain;
+        std::string spec;
+        int64_t position;
+    };
+
+    /**
+     * @brief 一次提交的内容
+     */
+    struct CommitPlan {
+        std::map<IptablesTable, std::string> payloads;   // 每个表的载荷
+        std::set<ChainKey> rewritten;                    // 整链重写的链
+        std::vector<std::string> removed;                // 从已应用状态删除的规则
+        std::vector<std::string> added;                  // 加入已应用状态的规则
+    };
+
+    /**
+     * @brief 一条链的分类器
+     */
+    /**
+     * @brief 源、目的都引用集合的规则只展开较小的集合，另一个在命中后检查成员
+     */
+    struct SetCheck {
+        const AddressSet* set;                    // 为nullptr时不需要检查
+        bool source;                              // 检查源地址还是目的地址
+    };
+
+    struct ChainClassifier {
+        PacketClassifier classifier;
+        std::vector<const FirewallRule*> rules;   // 分类器返回值对应的规则
+        std::vector<SetCheck> set_checks;         // 与rules一一对应
+        bool stale;
+
+        ChainClassifier() : stale(true) {}
+    };
+
+    std::map<std::string, FirewallRule> firewall_rules_;   // 期望状态
+    std::map<std::string, int64_t> rule_positions_;        // 规则在链中的位置，INSERT为负数
+    std::map<std::string, AppliedRule> applied_rules_;     // 已应用状态
+    std::set<std::string> dirty_rules_;                    // 上次提交后修改过的规则
+    std::set<ChainKey> synced_chains_;                     // 内核中内容与applied_rules_一致的链
+    std::set<ChainKey> pending_rewrites_;                  // 需要整链重写的链
+    std::set<ChainKey> hooked_chains_;                     // 已从内置链跳转的链
+    int64_t next_append_;
+    int64_t next_insert_;
+    bool auto_commit_;
+    std::string restore_command_;
+    std::map<std::string, AddressSet> address_sets_;
+    std::string ipset_pending_;                            // 未下发的ipset restore命令
+    std::set<std::string> pending_set_destroys_;           // 规则提交后删除的ipset
+    std::string ipset_command_;
+    std::map<ChainKey, ChainClassifier> classifiers_;
     std::map<std::string, TrafficControlRule> tc_rules_;
     FirewallCallback firewall_callback_;
     bool initialized_;
     int next_rule_id_;
 
     /**
-     * @brief 生成iptables命令
+     * @brief 生成规则的匹配条件和目标（-p ... -j ACTION）
+     */
+    std::string buildRuleSpec(const FirewallRule& rule) const;
+
+    /**
+     * @brief 记入期望状态，不提交
+     */
+    std::string stageRule(const FirewallRule& rule);
+
+    /**
+     * @brief 为规则分配链中的新位置
+     */
+    int64_t nextPosition(const FirewallRule& rule);
+
+    /**
+     * @brief 计算期望状态与已应用状态的差异
+     */
+    void planCommit(CommitPlan* plan) const;
+
+    /**
+     * @brief 链的规则修改后标记分类器需要重建
+     */
+    void invalidateClassifier(IptablesTable table, IptablesChain chain);
+
+    /**
+     * @brief 按期望状态重建一条链的分类器
+     */
+    void rebuildClassifier(const ChainKey& chain, ChainClassifier* classifier);
+
+    /**
+     * @brief 执行一个表的iptables-restore载荷
+     */
+    bool executeRestore(IptablesTable table, const std::string& payload);
+
+    /**
+     * @brief 通过command的标准输入执行载荷，command为空时只打印
+     * @param description 模拟执行时打印的说明
+     */
+    bool runRestore(const std::string& command, const std::string& description, const std::string& payload);
+
+    /**
+     * @brief 创建地址集合的ipset restore行，集合已存在且类型相同时不报错
+     */
+    std::string ipsetCreateLine(const std::string& name) const;
+
+    /**
+     * @brief 规则引用的地址集合都存在
+     */
+    bool checkAddressSets(const FirewallRule& rule) const;
+
+    /**
+     * @brief 集合成员变化后标记引用它的链的分类器需要重建
+     */
+    void invalidateSetUsers(const std::string& name);
+
+    /**
+     * @brief 我们的链名，例如fw_INPUT
      */
-    std::string buildIptablesCommand(const FirewallRule& rule);
+    std::string getOwnChainName(IptablesChain chain) const;
 
     /**
      * @brief 执行防火墙命令
@@ -218,17 +433,17 @@ private:
     /**
      * @brief 获取表名称字符串
      */
-    std::string getTableName(IptablesTable table);
+    std::string getTableName(IptablesTable table) const;
 
     /**
      * @brief 获取链名称字符串
      */
-    std::string getChainName(IptablesChain chain);
+    std::string getChainName(IptablesChain chain) const;
 
     /**
      * @brief 获取操作名称字符串
      */
-    std::string getOperationName(IptablesOperation operation);
+    std::string getOperationName(IptablesOperation operation) const;
 };
 
 #endif // FIREWALL_MANAGER_H
\ No newline at end of file
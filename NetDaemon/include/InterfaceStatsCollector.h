@@ -0,0 +1,144 @@
+#ifndef INTERFACE_STATS_COLLECTOR_H
+#define INTERFACE_STATS_COLLECTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief 接口计数器（/proc/net/dev中的一行）
+ */
+struct InterfaceCounters {
+    uint64_t rx_bytes;
+    uint64_t rx_packets;
+    uint64_t rx_errors;
+    uint64_t rx_dropped;
+    uint64_t tx_bytes;
+    uint64_t tx_packets;
+    uint64_t tx_errors;
+    uint64_t tx_dropped;
+};
+
+/**
+ * @brief 两次采样之间的速率
+ */
+struct InterfaceRates {
+    double rx_bps;               // 接收比特每秒
+    double tx_bps;               // 发送比特每秒
+    double rx_pps;               // 接收包每秒
+    double tx_pps;               // 发送包每秒
+};
+
+/**
+ * @brief 一个接口的采样结果
+ */
+struct InterfaceSample {
+    static const size_t NAME_SIZE = 16;  // IFNAMSIZ
+
+    char name[NAME_SIZE];
+    InterfaceCounters counters;  // 最近一次采样的计数
+    InterfaceCounters delta;     // 与上一次采样的差值
+    InterfaceRates rates;        // 按两次采样间隔算出的速率
+    uint64_t sample_ns;          // 最近一次采样时间（CLOCK_MONOTONIC）
+    int link_speed;              // sysfs中的链路速度（Mbps），-1表示未知
+    int speed_fd;                // /sys/class/net/<name>/speed
+    bool has_previous;           // 已有上一次采样，delta和rates有效
+    bool seen;                   // 本次采样中出现
+};
+
+/**
+ * @brief 接口流量统计采集器
+ *
+ * 打开/proc/net/dev后一直持有文件描述符，每次采样用pread从偏移0读入固定缓冲区，
+ * 在缓冲区上直接解析，不使用iostream也不创建std::string。接口集合不变时采样
+ * 不分配内存：/proc/net/dev中接口的顺序基本固定，按上次的顺序匹配接口名，
+ * 顺序变化时才线性查找。只有新接口出现或缓冲区不够大时才会分配。
+ *
+ * 计数器变小（接口重建或驱动复位）时本次的差值记为0。
+ * 链路速度从sysfs读取，同样持有文件描述符，由readLinkSpeeds()单独刷新，
+ * 采样频率可以比流量采样低得多。
+ *
+ * 不是线程安全的，由调用方加锁。
+ */
+class InterfaceStatsCollector {
+public:
+    InterfaceStatsCollector();
+    ~InterfaceStatsCollector();
+
+    /**
+     * @brief 打开统计文件
+     * @param path 统计文件路径，默认/proc/net/dev
+     * @return 成功返回true，失败返回false
+     */
+    bool open(const char* path = "/proc/net/dev");
+
+    /**
+     * @brief 关闭所有文件描述符
+     */
+    void close();
+
+    /**
+     * @brief 是否已打开
+     */
+    bool isOpen() const { return fd_ >= 0; }
+
+    /**
+     * @brief 读取一次统计并计算差值和速率
+     * @return 接口数，失败返回-1
+     */
+    int sample();
+
+    /**
+     * @brief 解析一段/proc/net/dev格式的内容
+     *
+     * sample()读到数据后调用，也可以直接传入录制的内容做测试。
+     * @param buf 文件内容
+     * @param len 内容长度
+     * @param now_ns 采样时间（纳秒），用于计算速率
+     * @return 接口数，格式错误返回-1
+     */
+    int parse(const char* buf, size_t len, uint64_t now_ns);
+
+    /**
+     * @brief 刷新所有接口的链路速度（/sys/class/net/<name>/speed）
+     * @return 读到速度的接口数
+     */
+    int readLinkSpeeds();
+
+    /**
+     * @brief 按接口名查找
+     * @param name 接口名称
+     * @return 采样结果，没有该接口返回nullptr
+     */
+    const InterfaceSample* find(const char* name) const;
+
+    /**
+     * @brief 最近一次采样中的所有接口
+     */
+    const std::vector<InterfaceSample>& interfaces() const { return samples_; }
+
+    /**
+     * @brief 采样次数
+     */
+    unsigned long sampleCount() const { return sample_count_; }
+
+private:
+    int fd_;
+    std::vector<char> buffer_;
+    std::vector<InterfaceSample> samples_;
+    unsigned long sample_count_;
+
+    /**
+     * @brief 查找或添加接口
+     * @param hint 按上次顺序预期的位置
+     * @param created 输出是否新添加
+     */
+    InterfaceSample* lookup(const char* name, size_t name_len, size_t hint, bool* created);
+
+    /**
+     * @brief 删除本次采样中没有出现的接口
+     */
+    void removeMissing();
+};
+
+#endif // INTERFACE_STATS_COLLECTOR_H
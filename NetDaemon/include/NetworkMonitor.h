@@ -6,6 +6,14 @@
 #include <map>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <set>
+#include "InterfaceStatsCollector.h"
+#include "TrafficHistory.h"
+
+struct nlmsghdr;
 
 /**
  * @brief 网络状态枚举
@@ -86,6 +94,10 @@ struct NetworkEvent {
  * @brief 网络状态监控器
  * 
  * 实时监控网络连接状态，检测网络变化，通知上层网络状态变化
+ *
+ * 监控线程在epoll上等待RTNETLINK的link/address/route组播消息，不做轮询。
+ * 一批变化先记入待处理集合，去抖定时器（timerfd）到期后与上次的状态比较，
+ * 只对真正变化的接口产生NetworkEvent，抖动后恢复原状的接口不产生事件。
  */
 class NetworkMonitor {
 public:
@@ -122,16 +134,18 @@ public:
     /**
      * @brief 根据网络ID获取连接信息
      * @param network_id 网络ID
-     * @return 网络连接信息
+     * @param out 输出连接信息的副本
+     * @return 找到返回true
      */
-    NetworkConnection* getConnection(const std::string& network_id);
+    bool getConnection(const std::string& network_id, NetworkConnection* out) const;
 
     /**
      * @brief 根据接口获取连接信息
      * @param interface 接口名称
-     * @return 网络连接信息
+     * @param out 输出连接信息的副本
+     * @return 找到返回true
      */
-    NetworkConnection* getConnectionByInterface(const std::string& interface);
+    bool getConnectionByInterface(const std::string& interface, NetworkConnection* out) const;
 
     /**
      * @brief 获取网络统计信息
@@ -140,6 +154,62 @@ public:
      */
     NetworkStats getNetworkStats(const std::string& interface);
 
+    /**
+     * @brief 获取接口最近两次采样之间的速率
+     * @param interface 接口名称
+     * @return 速率，没有统计数据时全为0
+     */
+    InterfaceRates getNetworkRates(const std::string& interface);
+
+    /**
+     * @brief 设置流量统计采样间隔
+     *
+     * 监控线程按此间隔读取/proc/net/dev，采样本身不分配内存，
+     * 可以在上百个接口上以100Hz持续运行。
+     * @param interval_ms 间隔（毫秒），0表示只在getNetworkStats()等调用时采样
+     * @return 成功返回true，失败返回false
+     */
+    bool setStatsSamplingInterval(int interval_ms);
+
+    /**
+     * @brief 查询接口最近一段时间的流量历史
+     *
+     * 历史由流量统计采样记录，需要先用setStatsSamplingInterval()开启持续采样。
+     * 时间为CLOCK_MONOTONIC秒，窗口以最近一个完整秒为终点。
+     * @param interface 接口名称
+     * @param metric 指标
+     * @param resolution 分辨率（1秒、1分钟、1小时）
+     * @param window_seconds 窗口长度（秒）
+     * @param out 输出缓冲区，由调用方提供，查询不分配内存
+     * @param max_points 输出缓冲区大小
+     * @return 写入的点数
+     */
+    size_t getTrafficHistory(const std::string& interface, HistoryMetric metric, HistoryResolution resolution,
+                             int window_seconds, HistoryPoint* out, size_t max_points) const;
+
+    /**
+     * @brief 汇总接口最近一段时间的流量（min/max/avg）
+     * @param interface 接口名称
+     * @param metric 指标
+     * @param window_seconds 窗口长度（秒），自动选择覆盖窗口的最细分辨率
+     * @param out 输出汇总
+     * @return 有数据返回true
+     */
+    bool getTrafficSummary(const std::string& interface, HistoryMetric metric, int window_seconds,
+                           HistorySummary* out) const;
+
+    /**
+     * @brief 接口最近一段时间流量的百分位数
+     * @param interface 接口名称
+     * @param metric 指标
+     * @param window_seconds 窗口长度（秒）
+     * @param percentile 百分位（0-100）
+     * @param value 输出百分位数
+     * @return 有数据返回true
+     */
+    bool getTrafficPercentile(const std::string& interface, HistoryMetric metric, int window_seconds,
+                              double percentile, double* value);
+
     /**
      * @brief 刷新网络状态
      * @return 成功返回true，失败返回false
@@ -188,9 +258,10 @@ public:
 
     /**
      * @brief 获取活动连接
-     * @return 活动连接信息
+     * @param out 输出连接信息的副本
+     * @return 有已连接的网络返回true
      */
-    NetworkConnection* getActiveConnection();
+    bool getActiveConnection(NetworkConnection* out) const;
 
     /**
      * @brief 模拟网络状态变化（用于测试）
@@ -200,6 +271,31 @@ public:
      */
     bool simulateStateChange(const std::string& network_id, NetworkState new_state);
 
+    /**
+     * @brief 处理一段netlink消息（RTM_NEWLINK/DELLINK/NEWADDR/DELADDR/NEWROUTE/DELROUTE）
+     *
+     * 监控线程收到的消息和初始化时的dump都经过这里，也可以直接传入录制的
+     * netlink消息做测试。变化只记入待处理集合，由去抖定时器或
+     * flushPendingEvents()产生事件。
+     * @param buf 消息缓冲区
+     * @param len 缓冲区长度
+     * @return 处理的消息数，消息格式错误返回-1
+     */
+    int handleNetlinkBuffer(const void* buf, size_t len);
+
+    /**
+     * @brief 立即处理去抖中的变化并产生事件
+     * @return 产生的事件数
+     */
+    int flushPendingEvents();
+
+    /**
+     * @brief 设置去抖时间
+     * @param debounce_ms 毫秒，0表示每批消息处理完立即产生事件
+     * @return 成功返回true，失败返回false
+     */
+    bool setDebounceInterval(int debounce_ms);
+
     /**
      * @brief 获取监控器状态
      */
@@ -208,19 +304,135 @@ public:
         int monitoring_interval;
         unsigned long total_events;
         unsigned long connection_changes;
+        unsigned long netlink_messages;  // 处理的netlink消息数
+        unsigned long resyncs;           // 接收缓冲区溢出后的重新同步次数
+        unsigned long stats_samples;     // 流量统计采样次数
     };
     MonitorStats getMonitorStats() const;
 
 private:
+    /**
+     * @brief 内核中一个接口的状态（按ifindex）
+     */
+    struct LinkState {
+        std::string name;
+        unsigned int flags = 0;          // IFF_* 标志
+        bool present = false;            // 接口仍然存在
+        bool seen = false;               // 重新同步时本轮dump见过
+        std::vector<std::string> addresses;
+        std::string gateway;             // 经过该接口的默认路由网关
+        bool routes_changed = false;
+    };
+
+    /**
+     * @brief dump阶段，依次dump link、address、route
+     */
+    enum DumpStage {
+        DUMP_NONE,
+        DUMP_LINK,
+        DUMP_ADDR,
+        DUMP_ROUTE
+    };
+
     std::map<std::string, NetworkConnection> connections_;
     std::map<std::string, NetworkStats> stats_;
     StateChangeCallback state_callback_;
     ConnectionCallback connection_callback_;
     bool initialized_;
-    bool running_;
+    std::atomic<bool> running_;          // 监控线程出错退出时由它置为false
     int monitoring_interval_;
     MonitorStats monitor_stats_;
 
+    std::map<int, LinkState> links_;
+    std::set<int> dirty_links_;
+    int netlink_fd_;
+    int epoll_fd_;
+    int event_fd_;                       // 通知监控线程退出
+    int timer_fd_;                       // 去抖定时器
+    bool timer_armed_;
+    int debounce_ms_;
+    DumpStage dump_stage_;
+    unsigned int dump_seq_;
+    std::thread monitor_thread_;
+    mutable std::mutex mutex_;
+
+    InterfaceStatsCollector stats_collector_;
+    TrafficHistory traffic_history_;
+    mutable std::mutex stats_mutex_;     // 保护stats_collector_和traffic_history_，与mutex_互不嵌套
+    int stats_timer_fd_;                 // 流量统计采样定时器
+    int stats_interval_ms_;
+
+    /**
+     * @brief 打开并订阅RTNETLINK组播
+     */
+    bool openNetlink();
+
+    /**
+     * @brief 关闭netlink及监控线程用的文件描述符
+     */
+    void closeNetlink();
+
+    /**
+     * @brief 开始dump阶段（调用方持有mutex_）
+     */
+    void startDump(DumpStage stage);
+
+    /**
+     * @brief 读取netlink套接字上所有可读的消息
+     * @return 套接字仍然可用返回true
+     */
+    bool readNetlink();
+
+    /**
+     * @brief 监控线程主循环
+     */
+    void monitorLoop();
+
+    /**
+     * @brief 处理单条netlink消息（调用方持有mutex_）
+     */
+    void handleNetlinkMessage(const nlmsghdr* nlh);
+    void handleLinkMessage(const nlmsghdr* nlh);
+    void handleAddrMessage(const nlmsghdr* nlh);
+    void handleRouteMessage(const nlmsghdr* nlh);
+
+    /**
+     * @brief 将待处理的变化应用到connections_
+     * @param events 输出需要触发的事件，为nullptr时只更新状态
+     */
+    void applyPendingChanges(std::vector<NetworkEvent>* events);
+
+    /**
+     * @brief 有新变化时启动去抖定时器（调用方持有mutex_）
+     */
+    void armDebounceTimer();
+
+    /**
+     * @brief 按stats_interval_ms_设置采样定时器
+     */
+    void armStatsTimer();
+
+    /**
+     * @brief 采样一次并记入流量历史（调用方持有stats_mutex_）
+     * @return 接口数，失败返回-1
+     */
+    int sampleCollector();
+
+    /**
+     * @brief 采样一次流量统计，每隔一段时间顺便刷新链路速度
+     */
+    void sampleStats();
+
+    /**
+     * @brief 根据接口名推断网络类型
+     */
+    static NetworkType guessNetworkType(const std::string& ifname);
+
+    /**
+     * @brief 根据IFF_*标志得到连接状态
+     */
+    static NetworkState flagsToState(unsigned int flags);
+
     /**
      * @brief 读取网络状态
      */
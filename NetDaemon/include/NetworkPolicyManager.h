@@ -1,11 +1,15 @@
 #ifndef NETWORK_POLICY_MANAGER_H
 #define NETWORK_POLICY_MANAGER_H
 
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <map>
 #include <functional>
 
+class PolicyDecisionTable;
+
 /**
  * @brief 网络优先级策略类型
  */
@@ -48,11 +52,28 @@ struct AppNetworkPolicy {
     bool enabled;
 };
 
+/**
+ * @brief 应用能否使用某个网络的决定
+ */
+struct PolicyDecision {
+    NetworkUsagePolicy usage;            // 对该应用生效的使用策略
+    NetworkPriority priority;
+    bool metered;
+    int bandwidth_limit;                 // 带宽限制 (kbps)，0为不限
+};
+
 /**
  * @brief 网络策略管理器
  * 
  * 负责根据ConnectivityService的策略执行网络配置
  * 实现网络优先级规则和处理网络切换逻辑
+ *
+ * 策略每次修改后编译为PolicyDecisionTable（网络按编号、应用按UID索引），原子地
+ * 替换旧表，decide()不加锁。网络编号由internNetwork()分配，包名到UID由setAppUid()
+ * 登记，没有登记UID的应用策略不进入决定表。beginUpdate()和commitUpdate()之间的
+ * 修改只在最后编译一次，期间decide()返回修改前的结果。
+ *
+ * decide()可以在任意线程调用，其他方法由调用方在同一线程调用。
  */
 class NetworkPolicyManager {
 public:
@@ -110,7 +131,7 @@ public:
     bool setNetworkPriority(const std::string& network_id, NetworkPriority priority);
 
     /**
-     * @brief 获取网络优先级
+     * @brief 获取网络优先级，从决定表中查
      * @param network_id 网络ID
      * @return 网络优先级
      */
@@ -145,6 +166,45 @@ public:
      */
     bool removeAppNetworkPolicy(const std::string& package_name, const std::string& network_id);
 
+    /**
+     * @brief 批量添加应用网络策略，只编译一次决定表
+     * @param policies 应用网络策略列表
+     * @return 成功返回true，失败返回false
+     */
+    bool addAppNetworkPolicies(const std::vector<AppNetworkPolicy>& policies);
+
+    /**
+     * @brief 登记应用的UID
+     * @param package_name 包名
+     * @param uid 应用UID，共享UID的包按同一应用决定
+     */
+    void setAppUid(const std::string& package_name, uint32_t uid);
+
+    /**
+     * @brief 取得网络的编号，没有时分配一个
+     * @param network_id 网络ID
+     * @return 网络编号，之后不变
+     */
+    uint32_t internNetwork(const std::string& network_id);
+
+    /**
+     * @brief 开始批量修改，可以嵌套
+     */
+    void beginUpdate();
+
+    /**
+     * @brief 结束批量修改，最外层结束时编译并替换决定表
+     */
+    void commitUpdate();
+
+    /**
+     * @brief 查询应用能否使用网络，不加锁
+     * @param uid 应用UID
+     * @param network 网络编号（internNetwork()的返回值）
+     * @return 决定；没有策略的网络允许使用，没有应用策略的应用按网络的策略
+     */
+    PolicyDecision decide(uint32_t uid, uint32_t network) const;
+
     /**
      * @brief 设置网络计量属性
      * @param network_id 网络ID
@@ -154,7 +214,7 @@ public:
     bool setNetworkMetered(const std::string& network_id, bool metered);
 
     /**
-     * @brief 检查网络是否计量
+     * @brief 检查网络是否计量，从决定表中查
      * @param network_id 网络ID
      * @return 是否计量
      */
@@ -196,6 +256,15 @@ public:
     bool setActiveNetwork(const std::string& network_id);
 
 private:
+    static const size_t READER_SLOTS = 16;
+
+    /**
+     * @brief 读者计数，按两个纪元分开，每个线程固定用一个槽
+     */
+    struct alignas(64) ReaderSlot {
+        std::atomic<unsigned long> count[2];
+    };
+
     std::map<std::string, NetworkPolicy> network_policies_;
     std::map<std::string, AppNetworkPolicy> app_policies_;
     PolicyCallback policy_callback_;
@@ -203,6 +272,23 @@ private:
     std::string active_network_;
     int next_policy_id_;
 
+    std::map<std::string, uint32_t> network_ids_;  // 网络ID → 编号
+    std::map<std::string, uint32_t> app_uids_;     // 包名 → UID
+    int update_depth_;
+    std::atomic<const PolicyDecisionTable*> table_;
+    std::atomic<unsigned> epoch_;
+    mutable ReaderSlot readers_[READER_SLOTS];
+
+    /**
+     * @brief 编译决定表并替换，等没有读者使用旧表后释放旧表；批量修改中不做
+     */
+    void publishTable();
+
+    /**
+     * @brief 网络的默认决定，与getNetworkPriority()一样取第一条启用的策略
+     */
+    PolicyDecision compileNetwork(const std::string& network_id) const;
+
     /**
      * @brief 执行策略命令
      */
@@ -0,0 +1,182 @@
+#ifndef PACKET_CLASSIFIER_H
+#define PACKET_CLASSIFIER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 数据包五元组（IPv4，地址和端口为主机字节序）
+ */
+struct PacketTuple {
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint8_t protocol;            // IP协议号，例如6为TCP
+
+    /**
+     * @brief 由文本构造
+     * @param protocol 协议名（tcp、udp、icmp等）或协议号
+     * @return 成功返回true，地址或协议无法解析返回false
+     */
+    static bool parse(const std::string& src_ip, const std::string& dst_ip, const std::string& protocol,
+                      uint16_t src_port, uint16_t dst_port, PacketTuple* out);
+};
+
+/**
+ * @brief 分类规则的匹配条件
+ */
+struct ClassifierRule {
+    uint32_t src_ip;             // 前缀，之后的位为0
+    int src_len;
+    uint32_t dst_ip;
+    int dst_len;
+    int protocol;                // -1表示任意协议
+    uint16_t src_port_min;
+    uint16_t src_port_max;
+    uint16_t dst_port_min;
+    uint16_t dst_port_max;
+
+    /**
+     * @brief 按iptables的写法解析匹配条件，空字符串表示任意
+     * @param protocol 协议名或协议号，"all"表示任意
+     * @param src_ip 地址，可带"/长度"或"/掩码"
+     * @param src_port 端口或端口范围"起:止"，只能用于tcp、udp、sctp、udplite
+     * @return 成功返回true；不支持的写法（取反、主机名、服务名等）返回false
+     */
+    static bool parse(const std::string& protocol, const std::string& src_ip, const std::string& dst_ip,
+                      const std::string& src_port, const std::string& dst_port, ClassifierRule* out);
+};
+
+/**
+ * @brief 元组空间搜索的数据包分类器
+ *
+ * 按规则的形状（源、目的前缀长度，是否指定协议）分组，每组一张开放寻址哈希表，
+ * 键为按该组掩码处理后的地址和协议。端口不参与分组，否则每种端口范围拆出的
+ * 前缀长度组合都是一组，组数会多到每次查找要查上百张表。同一个键上只有一条不限
+ * 端口的规则时直接存在表项里（常见的封禁列表）；否则表项指向一个端口组，组内
+ * 规则按优先级排序，规则较多时按目的端口建区间索引（端口范围的端点把0-65535
+ * 切成若干区间，每个区间记录覆盖它的规则），再逐条比较源端口。
+ *
+ * 查找时把数据包按每组的掩码处理后各查一次哈希表。各组按组内最高优先级（数值
+ * 最小，即链中最靠前）排序，已找到的规则比剩下的组都靠前时提前结束。
+ *
+ * 只支持整体重建（clear()后重新add()），不是线程安全的，由调用方加锁。
+ */
+class PacketClassifier {
+public:
+    static const uint32_t NO_MATCH = 0xffffffffu;
+
+    PacketClassifier();
+
+    /**
+     * @brief 添加规则
+     * @param rule 匹配条件
+     * @param priority 优先级，数值越小越靠前
+     * @param value 命中时返回的值，不能为NO_MATCH
+     * @param conditional 命中后调用方还要另行检查（例如集合成员），不通过时用min_priority
+     *                    继续查找；这样的规则不会遮住后面同一键上的规则
+     */
+    void add(const ClassifierRule& rule, uint32_t priority, uint32_t value, bool conditional = false);
+
+    /**
+     * @brief 清空所有规则
+     */
+    void clear();
+
+    /**
+     * @brief 查找数据包命中的优先级最高的规则
+     * @param min_priority 只考虑优先级数值不小于它的规则，用于跳过调用方另行检查未通过的规则
+     * @return 规则的value，没有命中返回NO_MATCH
+     */
+    uint32_t classify(const PacketTuple& packet, uint32_t min_priority = 0) const;
+
+    /**
+     * @brief 规则条数
+     */
+    size_t size() const { return rule_count_; }
+
+    /**
+     * @brief 规则形状（哈希表）的个数
+     */
+    size_t tupleCount() const { return tuples_.size(); }
+
+    /**
+     * @brief 占用的内存（字节），不含vector以外的堆开销
+     */
+    size_t memoryUsage() const;
+
+private:
+    /**
+     * @brief 掩码处理后的地址和协议
+     */
+    struct Key {
+        uint32_t src_ip;
+        uint32_t dst_ip;
+        uint32_t protocol;
+    };
+
+    /**
+     * @brief 哈希表项，priority为NO_MATCH表示空
+     *
+     * group为NO_MATCH时表项本身就是一条不限端口、无条件的规则，否则为端口组编号，
+     * priority为组内最高优先级。
+     */
+    struct Entry {
+        Key key;
+        uint32_t priority;
+        uint32_t value;
+        uint32_t group;
+    };
+
+    /**
+     * @brief 端口组中的一条规则
+     */
+    struct PortRule {
+        uint32_t priority;
+        uint32_t value;
+        uint16_t src_port_min;
+        uint16_t src_port_max;
+        uint16_t dst_port_min;
+        uint16_t dst_port_max;
+    };
+
+    /**
+     * @brief 地址和协议相同的一组规则
+     *
+     * 规则较少时逐条比较rules；超过阈值后建目的端口区间索引：bounds为各区间的
+     * 起点（第一个为0），intervals[i]为覆盖第i个区间的规则，均按优先级排序。
+     */
+    struct PortGroup {
+        std::vector<PortRule> rules;
+        std::vector<uint32_t> bounds;
+        std::vector<std::vector<PortRule>> intervals;
+    };
+
+    /**
+     * @brief 一种规则形状
+     */
+    struct Tuple {
+        Key mask;
+        uint32_t min_priority;       // 组内最高优先级
+        size_t used;
+        std::vector<Entry> entries;  // 容量为2的幂
+    };
+
+    std::vector<Tuple> tuples_;      // 按min_priority排序
+    std::vector<PortGroup> groups_;
+    size_t rule_count_;
+
+    Tuple& findTuple(const Key& mask, uint32_t priority);
+    Entry* findEntry(Tuple& tuple, const Key& key);
+    void addToGroup(uint32_t group, const PortRule& rule);
+    static void insertSorted(std::vector<PortRule>& rules, const PortRule& rule);
+    static void splitInterval(PortGroup& group, uint32_t bound);
+    static uint32_t matchGroup(const PortGroup& group, uint16_t src_port, uint16_t dst_port, uint32_t min_priority,
+                               uint32_t* priority);
+    static size_t hashKey(const Key& key);
+};
+
+#endif // PACKET_CLASSIFIER_H
@@ -0,0 +1,78 @@
+#ifndef POLICY_DECISION_TABLE_H
+#define POLICY_DECISION_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "NetworkPolicyManager.h"
+
+/**
+ * @brief 编译后的应用网络策略决定表
+ *
+ * 网络按编号（0到networkCount()-1）存放在数组中，每项是该网络的默认决定。
+ * 有应用策略的UID各占一行，一行是两个按网络编号的位图（禁止、受限），UID到
+ * 行号用开放寻址哈希表查找。decide()只有一次哈希探测和两次数组访问，不分配
+ * 内存、不加锁。
+ *
+ * 构造后不再修改，可以在任意线程同时读；更新时由NetworkPolicyManager编译一张
+ * 新表整体替换。
+ */
+class PolicyDecisionTable {
+public:
+    /**
+     * @brief 一条编译前的应用策略
+     */
+    struct AppRule {
+        uint32_t uid;
+        uint32_t network;                // 网络编号
+        NetworkUsagePolicy policy;
+    };
+
+    /**
+     * @brief 编译
+     * @param networks 各网络的默认决定，下标为网络编号
+     * @param rules 应用策略，网络编号超出范围的忽略
+     *
+     * 网络被禁止（BLOCKED或优先级NEVER）时对所有应用禁止；否则有应用策略的
+     * 按应用策略，同一UID（共享UID的多个包）在同一网络上有多条时取最严格的。
+     */
+    PolicyDecisionTable(const std::vector<PolicyDecision>& networks, const std::vector<AppRule>& rules);
+
+    /**
+     * @brief 查询应用能否使用网络
+     * @param network 网络编号，超出范围的按没有策略的网络处理
+     */
+    PolicyDecision decide(uint32_t uid, uint32_t network) const;
+
+    size_t networkCount() const { return networks_.size(); }
+
+    /**
+     * @brief 有应用策略的UID数
+     */
+    size_t appCount() const { return rows_; }
+
+    /**
+     * @brief 占用的内存（字节）
+     */
+    size_t memoryUsage() const;
+
+private:
+    /**
+     * @brief UID哈希表的槽，row为INVALID表示空
+     */
+    struct Slot {
+        uint32_t uid;
+        uint32_t row;
+    };
+
+    std::vector<PolicyDecision> networks_;
+    std::vector<Slot> slots_;            // 容量为2的幂，负载不超过一半
+    size_t rows_;
+    size_t words_;                       // 每行每个位图的64位字数
+    std::vector<uint64_t> blocked_;      // 第row行从row * words_开始
+    std::vector<uint64_t> restricted_;
+
+    uint32_t findRow(uint32_t uid) const;
+};
+
+#endif // POLICY_DECISION_TABLE_H
@@ -0,0 +1,210 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "FirewallManager.h"
+#include "NetworkPolicyManager.h"
+#include "TimerWheel.h"
+
+/**
+ * @brief 用户态分层令牌桶限速器
+ *
+ * 用于本进程代理的流量，按接口、策略、应用三层（最多8层）组织令牌桶。每个桶有
+ * 保证速率（rate）和上限速率（ceil），与tc的HTB一样：发送时从叶子往上找第一个
+ * 保证速率还有余量的桶借出带宽，借用经过的桶都不能超过上限。借出的桶和它的
+ * 祖先扣保证速率的令牌（祖先不检查，可以欠账，从而限制其他借用者），路径上
+ * 所有桶都扣上限的令牌。根桶的保证速率等于上限。应用在保证速率内总能发送，
+ * 借用者之间先到先得，没有按比例分配。
+ *
+ * 令牌桶用GCRA表示：每个桶只有一个"理论到达时间"（纳秒），令牌数由它和当前
+ * 时间算出，不需要定时补充令牌。tryConsume()只读写这些原子变量，不加锁、不
+ * 分配内存；检查和扣除不是一个原子操作，并发时最多多放行同时调用的线程数个包。
+ * 比突发还大的包在桶满时也允许发送，之后按速率欠账。
+ *
+ * 发送失败时可以用nextSendTime()算出最早能发送的时间，或者用wait()登记回调，
+ * 回调放在时间轮（tick为1毫秒）上，由调用方每毫秒左右调用一次runTimers()触发。
+ *
+ * 时间由调用方传入（纳秒，单调时钟），便于测试。桶只能增加（最多capacity个），
+ * 不能删除，不再使用的桶设为不限速。公开方法可以在任意线程调用。
+ */
+class RateLimiter {
+public:
+    static const uint32_t INVALID = 0xffffffffu;
+    static const int MAX_DEPTH = 8;
+
+    /**
+     * @brief 桶的统计信息
+     */
+    struct BucketStats {
+        unsigned long bytes;             // 在这个桶上调用tryConsume()放行的字节数
+        unsigned long packets;           // 放行的包数
+        unsigned long denied;            // 在这个桶上调用tryConsume()被拒绝的次数
+        unsigned long borrowed;          // 从上层借用带宽放行的包数
+    };
+
+    /**
+     * @param capacity 最多的桶数
+     */
+    explicit RateLimiter(size_t capacity = 4096);
+    ~RateLimiter();
+
+    /**
+     * @brief 添加桶
+     * @param parent 父桶，INVALID为根（接口）
+     * @param rate_kbps 保证速率，0为没有保证、总是向上借用；根桶忽略，等于上限
+     * @param ceil_kbps 上限速率，0为自身不限（仍受祖先限制）
+     * @param burst_bytes 突发（字节），0为速率10ms的量，至少1500字节
+     * @return 桶编号，父桶无效、层数超过MAX_DEPTH或桶数已满返回INVALID
+     */
+    uint32_t addBucket(uint32_t parent, unsigned int rate_kbps, unsigned int ceil_kbps, unsigned int burst_bytes);
+
+    /**
+     * @brief 修改桶的速率，参数含义与addBucket()相同，已经欠的账保留
+     * @return 桶不存在返回false
+     */
+    bool setLimit(uint32_t bucket, unsigned int rate_kbps, unsigned int ceil_kbps, unsigned int burst_bytes);
+
+    /**
+     * @brief 按流量控制规则设置接口的桶，没有时添加
+     *
+     * 规则的rate为接口的速率，burst为突发字节数；规则禁用时接口不限速。
+     * @return 接口的桶编号
+     */
+    uint32_t applyRule(const TrafficControlRule& rule);
+
+    /**
+     * @brief 按网络策略设置策略的桶，挂在以network_id为名的接口下（没有时添加不限速的接口）
+     *
+     * bandwidth_limit同时是策略的保证速率和上限；为0或策略禁用时不限速，用接口的带宽。
+     * @return 策略的桶编号
+     */
+    uint32_t applyPolicy(const NetworkPolicy& policy);
+
+    /**
+     * @brief 接口的桶编号，没有时返回INVALID
+     */
+    uint32_t findInterface(const std::string& interface) const;
+
+    /**
+     * @brief 策略的桶编号，没有时返回INVALID
+     */
+    uint32_t findPolicy(const std::string& policy_id) const;
+
+    /**
+     * @brief 尝试发送bytes字节，成功时扣除路径上各桶的令牌，不加锁
+     * @param bucket 发送方所在的桶（通常是应用的桶）
+     * @return 可以发送返回true
+     */
+    bool tryConsume(uint32_t bucket, uint32_t bytes, uint64_t now_ns);
+
+    /**
+     * @brief 没有其他流量时，最早能发送bytes字节的时间（纳秒），现在就能发送时返回now_ns，
+     *        桶无效时返回UINT64_MAX
+     */
+    uint64_t nextSendTime(uint32_t bucket, uint32_t bytes, uint64_t now_ns) const;
+
+    /**
+     * @brief 在最早能发送bytes字节时调用回调，回调中应重新tryConsume()
+     * @return 等待编号，用于cancelWait()
+     */
+    uint32_t wait(uint32_t bucket, uint32_t bytes, uint64_t now_ns, std::function<void()> callback);
+
+    /**
+     * @brief 取消等待
+     * @return 回调还没有调用时返回true
+     */
+    bool cancelWait(uint32_t waiter);
+
+    /**
+     * @brief 推进时间轮，调用到期的回调（在调用线程中，不持有锁）
+     * @return 调用的回调数
+     */
+    size_t runTimers(uint64_t now_ns);
+
+    BucketStats getStats(uint32_t bucket) const;
+
+    size_t size() const { return count_.load(std::memory_order_acquire); }
+
+    /**
+     * @brief 当前单调时钟的纳秒数
+     */
+    static uint64_t now();
+
+private:
+    /**
+     * @brief GCRA状态，ns_per_byte为每字节的纳秒数（16位小数），0为不限，NEVER为没有令牌
+     */
+    struct Gcra {
+        std::atomic<uint64_t> tat;
+        std::atomic<uint64_t> ns_per_byte;
+        std::atomic<uint64_t> tolerance;     // 突发对应的纳秒数
+    };
+
+    struct Bucket {
+        uint32_t parent;
+        int depth;
+        Gcra assured;
+        Gcra ceil;
+        std::atomic<unsigned long> bytes;
+        std::atomic<unsigned long> packets;
+        std::atomic<unsigned long> denied;
+        std::atomic<unsigned long> borrowed;
+    };
+
+    struct Waiter {
+        std::function<void()> callback;
+        uint32_t timer;                  // 空闲时为TimerWheel::INVALID
+    };
+
+    std::unique_ptr<Bucket[]> buckets_;
+    size_t capacity_;
+    std::atomic<size_t> count_;
+
+    mutable std::mutex mutex_;           // 保护以下成员和桶的添加
+    std::map<std::string, uint32_t> interfaces_;
+    std::map<std::string, uint32_t> policies_;
+    TimerWheel wheel_;
+    std::vector<Waiter> waiters_;        // 按编号，释放的放入free_waiters_
+    std::vector<uint32_t> free_waiters_;
+    std::vector<uint64_t> expired_;
+
+    static void configure(Gcra& gcra, unsigned int kbps, uint64_t burst_bytes, bool never_if_zero);
+    static uint64_t cost(const Gcra& gcra, uint32_t bytes);
+
+    /**
+     * @brief 按GCRA判断现在能否发送，不修改状态
+     */
+    static bool conforms(const Gcra& gcra, uint32_t bytes, uint64_t now_ns);
+
+    /**
+     * @brief 最早能发送的时间，不能发送（NEVER）时返回UINT64_MAX
+     */
+    static uint64_t readyTime(const Gcra& gcra, uint32_t bytes, uint64_t now_ns);
+
+    static void charge(Gcra& gcra, uint32_t bytes, uint64_t now_ns);
+
+    /**
+     * @brief 从bucket到根的路径
+     * @return 路径长度，bucket无效时为0
+     */
+    size_t path(uint32_t bucket, uint32_t* out) const;
+
+    /**
+     * @brief 添加或修改接口的桶，调用方持有mutex_
+     */
+    uint32_t interfaceBucket(const std::string& interface, unsigned int rate_kbps, unsigned int burst_bytes,
+                             bool update);
+
+    uint32_t addBucketLocked(uint32_t parent, unsigned int rate_kbps, unsigned int ceil_kbps,
+                             unsigned int burst_bytes);
+};
+
+#endif // RATE_LIMITER_H
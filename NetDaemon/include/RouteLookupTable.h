@@ -0,0 +1,185 @@
+#ifndef ROUTE_LOOKUP_TABLE_H
+#define ROUTE_LOOKUP_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "RouteTableManager.h"
+
+/**
+ * @brief IP地址（网络字节序），IPv4只使用前4个字节
+ */
+struct IpAddress {
+    int family;                  // AF_INET / AF_INET6
+    uint8_t bytes[16];
+
+    /**
+     * @brief 解析点分十进制或IPv6文本地址
+     * @return 成功返回true，失败返回false
+     */
+    static bool parse(const std::string& text, IpAddress* out);
+
+    /**
+     * @brief 由主机字节序的IPv4地址构造
+     */
+    static IpAddress fromIpv4(uint32_t host_order);
+};
+
+/**
+ * @brief IP前缀，地址中前缀长度之后的位为0
+ */
+struct IpPrefix {
+    IpAddress address;
+    int length;
+
+    /**
+     * @brief 解析"192.168.1.0/24"、"fe80::/64"、"default"，没有长度时为主机路由
+     * @return 成功返回true，失败返回false
+     */
+    static bool parse(const std::string& text, IpPrefix* out);
+
+    bool operator==(const IpPrefix& other) const;
+};
+
+/**
+ * @brief IpPrefix的哈希
+ */
+struct IpPrefixHash {
+    size_t operator()(const IpPrefix& prefix) const;
+};
+
+/**
+ * @brief 最长前缀匹配路由查找表
+ *
+ * 多比特trie。第一级16位（2^16个槽的数组），之后IPv4每级8位（16-8-8，
+ * 最多3次数组访问）。IPv6每级4位并做路径压缩：只有一条路径经过的各级不建
+ * 节点，子节点记录自己所在的级和路径上的地址位，查找时比较跳过的几级，不一致
+ * 即结束，稀疏的IPv6表不会因为长前缀的每一级都建节点而占用过多内存。
+ *
+ * 每个前缀放在它所在的一级，较短的前缀在本级展开到它覆盖的所有槽（受控前缀
+ * 扩展），槽记录设置它的前缀长度，插入时只覆盖长度不大于自己的槽；删除时对
+ * 这些槽在本级内找下一个覆盖它的较短前缀，找不到再置空。查找沿途保留最后一个
+ * 命中的路由，上级的路由不推到叶子，增删只修改一个节点内的槽。删除后回收空
+ * 节点，IPv6只剩一个子节点的节点重新压缩掉。
+ *
+ * 同一前缀有多条路由时取metric最小的，metric相同取先加入的。
+ * lookup()返回的指针在下一次修改前有效。
+ *
+ * 不是线程安全的，由调用方加锁。
+ */
+class RouteLookupTable {
+public:
+    RouteLookupTable();
+
+    /**
+     * @brief 添加路由
+     * @param route 路由条目，destination须为可解析的前缀
+     * @return 成功返回true，destination无法解析返回false
+     */
+    bool add(const RouteEntry& route);
+
+    /**
+     * @brief 删除路由
+     * @param destination 目标前缀
+     * @param gateway 网关地址
+     * @return 删除成功返回true，没有该路由返回false
+     */
+    bool remove(const std::string& destination, const std::string& gateway);
+
+    /**
+     * @brief 清空所有路由
+     */
+    void clear();
+
+    /**
+     * @brief 查找地址使用的路由
+     * @return 路由条目，没有匹配返回nullptr
+     */
+    const RouteEntry* lookup(const IpAddress& address) const;
+
+    /**
+     * @brief 查找IPv4地址使用的路由（主机字节序）
+     */
+    const RouteEntry* lookup(uint32_t ipv4) const;
+
+    /**
+     * @brief 路由条数
+     */
+    size_t size() const { return route_count_; }
+
+    /**
+     * @brief 查找结构占用的内存（字节）
+     */
+    size_t memoryUsage() const;
+
+private:
+    /**
+     * @brief 一个槽：info为(路由编号+1)<<8 | 前缀长度，0表示没有路由；child为子节点编号
+     */
+    struct Slot {
+        uint32_t info;
+        uint32_t child;
+    };
+
+    /**
+     * @brief 子节点信息
+     */
+    struct NodeInfo {
+        uint16_t level;              // 所在的级，第一级为0
+        uint16_t used;               // 非空的槽数
+        uint8_t key[16];             // 到达该节点的地址位，用于比较压缩掉的各级
+    };
+
+    /**
+     * @brief 一个地址族的trie
+     */
+    struct Trie {
+        int stride;                  // 第一级之后每级的位数
+        bool compressed;             // 是否路径压缩
+        std::vector<Slot> root;      // 第一级，2^16个槽，第一次使用时分配
+        std::vector<Slot> nodes;     // 节点i的槽从 i << stride 开始，节点0不用
+        std::vector<NodeInfo> info;
+        std::vector<uint32_t> free_nodes;
+    };
+
+    /**
+     * @brief 一个前缀上的所有路由
+     */
+    struct PrefixRoutes {
+        std::vector<uint32_t> routes;
+        uint32_t best;
+    };
+
+    std::vector<RouteEntry> routes_;
+    std::vector<uint32_t> free_routes_;
+    size_t route_count_;
+    std::unordered_map<IpPrefix, PrefixRoutes, IpPrefixHash> prefixes_;
+    Trie trie4_;
+    Trie trie6_;
+
+    static void resetTrie(Trie* trie, int stride, bool compressed);
+    static Slot* slots(Trie& trie, uint32_t node);
+    static uint32_t newNode(Trie& trie, int level, const uint8_t* key);
+    uint32_t bestRoute(const PrefixRoutes& entry) const;
+
+    /**
+     * @brief 前缀的最佳路由变化后更新trie，info为0表示该前缀已没有路由
+     */
+    void updatePrefix(const IpPrefix& prefix, uint32_t info);
+
+    /**
+     * @brief 删除后回收空节点、压缩只剩一个子节点的节点
+     */
+    void compact(Trie& trie, uint32_t node, const uint32_t* path_node, const size_t* path_index, int depth);
+
+    /**
+     * @brief 槽被清空后，在本级内找覆盖它的下一个较短前缀
+     */
+    uint32_t coveringInfo(const IpPrefix& prefix, int stride, int level, size_t slot_index) const;
+
+    const RouteEntry* lookupTrie(const Trie& trie, const uint8_t* bytes) const;
+};
+
+#endif // ROUTE_LOOKUP_TABLE_H
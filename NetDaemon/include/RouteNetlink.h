@@ -0,0 +1,100 @@
+#ifndef ROUTE_NETLINK_H
+#define ROUTE_NETLINK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "RouteTableManager.h"
+
+/**
+ * @brief 一次批量修改的结果
+ */
+struct RouteBatchResult {
+    size_t succeeded;            // 内核确认成功的条数（回滚前）
+    size_t failed;               // 失败的条数
+    size_t first_failed;         // 第一条失败的序号，全部成功时等于修改条数
+    int error;                   // 第一条失败的errno
+    size_t rolled_back;          // 撤销的条数
+    bool rollback_ok;            // 撤销是否全部成功
+};
+
+/**
+ * @brief 通过rtnetlink批量修改内核路由表
+ *
+ * 每条修改编码为一条RTM_NEWROUTE/RTM_DELROUTE消息（带NLM_F_ACK），多条消息
+ * 打包在同一个发送缓冲区里一次send，再按序号收集每条的ACK。内核对一次发送中的
+ * 消息逐条处理，失败的不影响后面的，所以部分失败时按相反顺序撤销已成功的修改
+ * （添加的删除，删除的加回），整批要么全部生效，要么全部不生效。
+ *
+ * attach()可以传入任意已连接的套接字（例如socketpair的一端），由假的netlink
+ * 对端应答，不需要root权限就能测试编码、ACK处理和回滚。
+ *
+ * 不是线程安全的，由调用方加锁。
+ */
+class RouteNetlink {
+public:
+    RouteNetlink();
+    ~RouteNetlink();
+
+    /**
+     * @brief 打开NETLINK_ROUTE套接字
+     * @return 成功返回true，失败返回false
+     */
+    bool open();
+
+    /**
+     * @brief 使用已有的套接字，之后由本对象关闭
+     * @param fd 已连接到netlink对端的套接字
+     * @return 成功返回true，fd无效返回false
+     */
+    bool attach(int fd);
+
+    /**
+     * @brief 关闭套接字
+     */
+    void close();
+
+    bool isOpen() const { return fd_ >= 0; }
+
+    /**
+     * @brief 设置等待ACK的超时时间
+     * @param timeout_ms 超时（毫秒），超时未确认的修改按失败（ETIMEDOUT）处理
+     */
+    void setAckTimeout(int timeout_ms) { ack_timeout_ms_ = timeout_ms; }
+
+    /**
+     * @brief 批量修改路由，部分失败时撤销已成功的修改
+     * @param changes 修改列表，按顺序下发
+     * @param result 输出结果，可以为nullptr
+     * @return 全部成功返回true
+     */
+    bool apply(const std::vector<RouteChange>& changes, RouteBatchResult* result);
+
+private:
+    int fd_;
+    uint32_t seq_;
+    int ack_timeout_ms_;
+    std::vector<uint8_t> send_buf_;
+    std::vector<uint8_t> recv_buf_;
+
+    /**
+     * @brief 下发一批修改并收集ACK，不做回滚
+     * @param ifindex 每条修改的出接口索引，0表示不指定
+     * @param errors 输出每条修改的结果，0为成功，否则为errno
+     */
+    void submit(const RouteChange* changes, const int* ifindex, size_t count, int* errors);
+
+    /**
+     * @brief 等待序号在[first_seq, first_seq + count)内的ACK，超时未确认的记为失败
+     */
+    void collectAcks(uint32_t first_seq, size_t count, int* errors);
+
+    /**
+     * @brief 把一条修改编码为netlink消息
+     * @return 消息长度，失败（地址无法解析或缓冲区不够）返回0
+     */
+    static size_t encode(const RouteChange& change, int ifindex, uint32_t seq, uint8_t* buf, size_t size);
+};
+
+#endif // ROUTE_NETLINK_H
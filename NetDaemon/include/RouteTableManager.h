@@ -4,8 +4,13 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 #include <functional>
 
+class RouteLookupTable;
+class RouteNetlink;
+struct IpAddress;
+
 /**
  * @brief 路由类型枚举
  */
@@ -41,6 +46,22 @@ struct RouteEntry {
     unsigned int table_id;
 };
 
+/**
+ * @brief 路由修改动作
+ */
+enum class RouteChangeAction {
+    ADD,
+    DELETE
+};
+
+/**
+ * @brief 一条路由修改
+ */
+struct RouteChange {
+    RouteChangeAction action;
+    RouteEntry route;
+};
+
 /**
  * @brief 路由表管理器
  * 
@@ -87,6 +108,38 @@ public:
      */
     bool deleteRoute(const std::string& destination, const std::string& gateway);
 
+    /**
+     * @brief 批量修改路由，全部生效或全部不生效
+     *
+     * netlink后端把所有修改打包一次发给内核，逐条收集ACK，部分失败时撤销已成功的；
+     * 命令后端逐条执行ip route命令，失败时按相反顺序执行反向命令。
+     * @param changes 修改列表，按顺序执行；删除的条目须与已有路由的目标、网关、表ID一致
+     * @return 全部成功返回true，失败时路由表不变
+     */
+    bool applyRouteChanges(const std::vector<RouteChange>& changes);
+
+    /**
+     * @brief 用一组路由替换指定表中的全部路由
+     *
+     * 与当前路由比较，只下发差异（先删除后添加），作为一批执行。
+     * @param table_id 路由表ID
+     * @param routes 新的路由，table_id以参数为准
+     * @return 成功返回true，失败时路由表不变
+     */
+    bool replaceTable(unsigned int table_id, const std::vector<RouteEntry>& routes);
+
+    /**
+     * @brief 改用rtnetlink直接修改内核路由表，代替逐条执行ip route命令
+     * @param fd 已连接到netlink对端的套接字（例如测试用的socketpair），-1表示打开NETLINK_ROUTE套接字
+     * @return 成功返回true，失败时仍使用命令后端
+     */
+    bool enableNetlink(int fd = -1);
+
+    /**
+     * @brief 恢复使用ip route命令
+     */
+    void disableNetlink();
+
     /**
      * @brief 设置默认路由（实现WiFi优先）
      * @param interface 接口名称
@@ -124,6 +177,19 @@ public:
      */
     bool disableWifiPriority();
 
+    /**
+     * @brief 查找目的地址使用的路由（最长前缀匹配，同一前缀取metric最小的）
+     * @param address 目的地址
+     * @param table_id 路由表ID，0表示依次查找local(255)、main(254)、default(253)
+     * @return 路由条目，没有匹配返回nullptr；指针在下一次修改路由前有效
+     */
+    const RouteEntry* lookupRoute(const std::string& address, unsigned int table_id = 0) const;
+
+    /**
+     * @brief 查找目的地址使用的路由，不解析字符串
+     */
+    const RouteEntry* lookupRoute(const IpAddress& address, unsigned int table_id = 0) const;
+
     /**
      * @brief 注册路由变化回调
      * @param callback 回调函数
@@ -139,6 +205,8 @@ public:
 
 private:
     std::vector<RouteEntry> routes_;
+    std::map<unsigned int, std::unique_ptr<RouteLookupTable>> lookup_tables_;  // 按表ID
+    std::unique_ptr<RouteNetlink> netlink_;    // 为空时使用ip route命令
     RouteCallback route_callback_;
     bool initialized_;
     bool wifi_priority_enabled_;
@@ -155,6 +223,21 @@ private:
      */
     bool executeCommand(const std::string& command);
 
+    /**
+     * @brief 删除时匹配路由用的键：目标、网关、表ID
+     */
+    static std::string routeKey(const RouteEntry& route);
+
+    /**
+     * @brief 生成一条修改对应的ip route命令
+     */
+    static std::string routeCommand(const RouteChange& change);
+
+    /**
+     * @brief 逐条执行修改命令，失败时执行已成功修改的反向命令
+     */
+    bool executeChanges(const std::vector<RouteChange>& changes);
+
     /**
      * @brief 更新路由优先级
      */
@@ -164,6 +247,16 @@ private:
      * @brief 排序路由表
      */
     void sortRoutes();
+
+    /**
+     * @brief 按routes_重建查找表，metric批量变化后调用
+     */
+    void rebuildLookupTables();
+
+    /**
+     * @brief 获取（不存在时创建）指定表ID的查找表
+     */
+    RouteLookupTable& lookupTable(unsigned int table_id);
 };
 
 #endif // ROUTE_TABLE_MANAGER_H
\ No newline at end of file
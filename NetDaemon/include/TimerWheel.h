@@ -0,0 +1,88 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief 分层时间轮
+ *
+ * 4级，每级64个槽，时间以调用方定义的tick为单位（例如DNS缓存用秒），一次能
+ * 放下2^24个tick以内的到期时间，更远的先放在最远处，走到那里时再重新放置。
+ * 定时器放在与当前时间最高的不同6位所在的一级：第0级的槽对应单个tick，
+ * 上级的槽在时间走到它的起点时整体下放到下级。添加和取消都是O(1)（槽内是
+ * 双向链表），推进时每个定时器最多下放3次。
+ *
+ * 定时器节点放在一个数组中按下标引用，释放后复用，不逐个分配内存。
+ *
+ * 不是线程安全的，由调用方加锁。
+ */
+class TimerWheel {
+public:
+    static const uint32_t INVALID = 0xffffffffu;
+
+    /**
+     * @param now 当前时间（tick）
+     */
+    explicit TimerWheel(uint64_t now = 0);
+
+    /**
+     * @brief 添加定时器
+     * @param expires 到期时间（tick），不晚于上次推进到的时间的，在下次推进到更晚的时间时到期
+     * @param data 到期时返回给调用方的数据
+     * @return 定时器编号，用于取消和修改
+     */
+    uint32_t schedule(uint64_t expires, uint64_t data);
+
+    /**
+     * @brief 修改到期时间
+     */
+    void reschedule(uint32_t timer, uint64_t expires);
+
+    /**
+     * @brief 取消定时器，之后编号可能被新的定时器复用
+     */
+    void cancel(uint32_t timer);
+
+    /**
+     * @brief 推进到now，到期时间不晚于now的定时器到期并释放
+     * @param expired 追加到期定时器的数据
+     * @return 到期的定时器数
+     */
+    size_t advance(uint64_t now, std::vector<uint64_t>* expired);
+
+    /**
+     * @brief 未到期的定时器数
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * @brief 下一个要处理的tick，早于它的定时器都已到期
+     */
+    uint64_t now() const { return now_; }
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const uint32_t SLOTS = 1u << SLOT_BITS;
+
+    struct Node {
+        uint64_t expires;
+        uint64_t data;
+        uint32_t prev;
+        uint32_t next;                   // 空闲时为空闲链表的下一个
+        uint32_t slot;                   // 所在的槽（级 * SLOTS + 槽号），空闲时为INVALID
+    };
+
+    std::vector<Node> nodes_;
+    uint32_t free_;
+    uint32_t heads_[LEVELS * SLOTS];
+    uint64_t now_;
+    size_t size_;
+
+    void link(uint32_t timer);
+    void unlink(uint32_t timer);
+};
+
+#endif // TIMER_WHEEL_H
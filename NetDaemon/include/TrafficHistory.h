@@ -0,0 +1,263 @@
+#ifndef TRAFFIC_HISTORY_H
+#define TRAFFIC_HISTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "InterfaceStatsCollector.h"
+
+/**
+ * @brief 历史数据中的指标
+ */
+enum class HistoryMetric {
+    RX_BPS,
+    TX_BPS,
+    RX_PPS,
+    TX_PPS
+};
+
+/**
+ * @brief 历史数据的分辨率
+ */
+enum class HistoryResolution {
+    SECOND,
+    MINUTE,
+    HOUR
+};
+
+/**
+ * @brief 历史数据容量配置
+ *
+ * 每个接口占用约 (second_slots * 24 + (minute_slots + hour_slots) * 56) 字节，
+ * 默认配置约140KB，256个接口约36MB。
+ */
+struct HistoryConfig {
+    size_t second_slots = 900;       // 1秒分辨率，15分钟
+    size_t minute_slots = 1440;      // 1分钟分辨率，24小时
+    size_t hour_slots = 720;         // 1小时分辨率，30天
+    size_t max_interfaces = 256;     // 超过时复用最久未更新的接口
+};
+
+/**
+ * @brief 一个时间槽的数据，1秒分辨率时min/max/avg相同
+ */
+struct HistoryPoint {
+    int64_t time;                    // 槽起始时间（秒）
+    float min;
+    float max;
+    float avg;
+};
+
+/**
+ * @brief 一段时间窗口内的汇总
+ */
+struct HistorySummary {
+    int64_t from;                    // 窗口内第一个有数据的槽（秒）
+    int64_t to;                      // 窗口内最后一个有数据的槽（秒）
+    size_t points;                   // 有数据的槽数
+    HistoryResolution resolution;    // 使用的分辨率
+    double min;
+    double max;
+    double avg;
+};
+
+/**
+ * @brief 单个接口的流量历史
+ *
+ * 三级环形缓冲区，按结构数组（SoA）存放，每个指标一段连续的float：
+ * 1秒一级只存平均值，1分钟和1小时两级存min/max/avg。槽位置由时间直接算出
+ * （槽号 % 容量），另存槽号判断数据是否有效，中间缺失的时间自然成为空洞。
+ *
+ * record()传入累计计数，跨秒时按两次记录间的差值计算这一秒的速率（相隔不超过
+ * 10秒时平均分到中间的每一秒，更长的间隔留空，计数器复位时记为0）；同时
+ * 累加到当前分钟和当前小时，分钟或小时结束时写入对应一级，汇总是O(1)的，
+ * 不回头扫描，所以分钟和小时两级只包含已经结束的分钟和小时。
+ * 所有内存在构造时分配，之后记录和查询都不分配。
+ */
+class InterfaceHistory {
+public:
+    static const int METRIC_COUNT = 4;
+
+    explicit InterfaceHistory(const HistoryConfig& config);
+
+    /**
+     * @brief 清空历史，复用已分配的内存
+     */
+    void reset();
+
+    /**
+     * @brief 记录一次累计计数
+     * @param counters 接口累计计数
+     * @param now_ns 采样时间（纳秒）
+     */
+    void record(const InterfaceCounters& counters, uint64_t now_ns);
+
+    /**
+     * @brief 查询一段时间内的数据
+     * @param metric 指标
+     * @param resolution 分辨率
+     * @param from 起始时间（秒，含）
+     * @param to 结束时间（秒，含）
+     * @param out 输出缓冲区，由调用方提供
+     * @param max_points 输出缓冲区大小
+     * @return 写入的点数，按时间从早到晚
+     */
+    size_t query(HistoryMetric metric, HistoryResolution resolution, int64_t from, int64_t to,
+                 HistoryPoint* out, size_t max_points) const;
+
+    /**
+     * @brief 汇总一段时间内的数据
+     * @return 窗口内有数据返回true
+     */
+    bool summarize(HistoryMetric metric, HistoryResolution resolution, int64_t from, int64_t to,
+                   HistorySummary* out) const;
+
+    /**
+     * @brief 一段时间内的百分位数（分钟、小时分辨率时按每槽平均值计算）
+     * @param p 百分位（0-100）
+     * @param scratch 临时缓冲区，不小于该分辨率的槽数
+     * @param value 输出百分位数
+     * @return 窗口内有数据返回true
+     */
+    bool percentile(HistoryMetric metric, HistoryResolution resolution, int64_t from, int64_t to,
+                    double p, float* scratch, size_t scratch_size, double* value) const;
+
+    /**
+     * @brief 覆盖from的最细分辨率
+     * @param from 起始时间（秒）
+     */
+    HistoryResolution resolutionFor(int64_t from) const;
+
+    /**
+     * @brief 最近一个完整秒（秒），没有数据返回-1
+     */
+    int64_t latestSecond() const { return seconds_.newest; }
+
+private:
+    /**
+     * @brief 一级环形缓冲区
+     */
+    struct Ring {
+        int64_t period;              // 每槽秒数
+        size_t capacity;
+        int64_t newest;              // 最新槽号，-1表示空
+        std::vector<int64_t> slots;  // 每个位置当前存放的槽号
+        std::vector<float> avg[METRIC_COUNT];
+        std::vector<float> min[METRIC_COUNT];  // 1秒一级不使用
+        std::vector<float> max[METRIC_COUNT];
+    };
+
+    /**
+     * @brief 正在累加的分钟或小时
+     */
+    struct Accumulator {
+        int64_t slot;                // -1表示空
+        uint32_t count;
+        double sum[METRIC_COUNT];
+        float min[METRIC_COUNT];
+        float max[METRIC_COUNT];
+    };
+
+    Ring seconds_;
+    Ring minutes_;
+    Ring hours_;
+    Accumulator minute_acc_;
+    Accumulator hour_acc_;
+
+    InterfaceCounters base_counters_;
+    uint64_t base_ns_;
+    bool has_base_;
+
+    static void initRing(Ring* ring, int64_t period, size_t capacity, bool aggregated);
+    static void clearAccumulator(Accumulator* acc);
+    const Ring& ring(HistoryResolution resolution) const;
+
+    /**
+     * @brief 写入一个完整的秒并累加到分钟和小时
+     */
+    void putSecond(int64_t second, const float* values);
+
+    /**
+     * @brief 把累加结果写入对应一级，分钟结束时继续累加到小时
+     */
+    void flushAccumulator(Accumulator* acc, Ring* ring, Accumulator* next);
+    static void accumulate(Accumulator* acc, int64_t slot, const float* min, const float* max,
+                           const float* avg, uint32_t count);
+};
+
+/**
+ * @brief 所有接口的流量历史
+ *
+ * 接口数量上限由HistoryConfig::max_interfaces决定，满了以后复用最久没有
+ * 更新的接口，内存不随运行时间和接口变化增长。只有第一次见到某个接口、
+ * 且还没到上限时才分配内存。
+ *
+ * 查询时间与记录时传入的时钟一致（NetworkMonitor使用CLOCK_MONOTONIC），
+ * 窗口以该接口最近一个完整秒为终点。
+ *
+ * 不是线程安全的，由调用方加锁。
+ */
+class TrafficHistory {
+public:
+    explicit TrafficHistory(const HistoryConfig& config = HistoryConfig());
+
+    /**
+     * @brief 记录采集器中所有接口的最新计数
+     */
+    void record(const InterfaceStatsCollector& collector);
+
+    /**
+     * @brief 记录一个接口的累计计数
+     */
+    void record(const char* name, const InterfaceCounters& counters, uint64_t now_ns);
+
+    /**
+     * @brief 按接口名查找
+     * @return 没有该接口的历史返回nullptr
+     */
+    const InterfaceHistory* find(const char* name) const;
+
+    /**
+     * @brief 查询最近window_seconds秒的数据
+     * @return 写入的点数
+     */
+    size_t query(const char* name, HistoryMetric metric, HistoryResolution resolution, int64_t window_seconds,
+                 HistoryPoint* out, size_t max_points) const;
+
+    /**
+     * @brief 汇总最近window_seconds秒，自动选择覆盖窗口的最细分辨率
+     * @return 有数据返回true
+     */
+    bool summarize(const char* name, HistoryMetric metric, int64_t window_seconds, HistorySummary* out) const;
+
+    /**
+     * @brief 最近window_seconds秒的百分位数，自动选择分辨率
+     * @param p 百分位（0-100）
+     * @return 有数据返回true
+     */
+    bool percentile(const char* name, HistoryMetric metric, int64_t window_seconds, double p, double* value);
+
+    /**
+     * @brief 已跟踪的接口数
+     */
+    size_t size() const { return entries_.size(); }
+
+private:
+    struct Entry {
+        char name[InterfaceSample::NAME_SIZE];
+        uint64_t last_ns;
+        InterfaceHistory history;
+
+        explicit Entry(const HistoryConfig& config) : last_ns(0), history(config) { name[0] = '\0'; }
+    };
+
+    HistoryConfig config_;
+    std::vector<Entry> entries_;
+    std::vector<float> scratch_;     // percentile()用
+    int64_t last_second_;            // 上次按采集器记录的秒
+
+    void record(const char* name, const InterfaceCounters& counters, uint64_t now_ns, size_t hint);
+    Entry* lookup(const char* name, size_t hint);
+};
+
+#endif // TRAFFIC_HISTORY_H
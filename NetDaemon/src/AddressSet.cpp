@@ -0,0 +1,246 @@
+#include "AddressSet.h"
+#include "RouteLookupTable.h"
+#include <arpa/inet.h>
+
+namespace {
+
+const uint64_t EMPTY = ~0ull;
+const size_t INITIAL_SLOTS = 16;
+// 长度25-31的网段仍按长度查表
+const uint64_t LONG_LENGTHS = ((1ull << 32) - 1) & ~((1ull << 25) - 1);
+
+uint32_t prefixMask(int length) {
+    return length == 0 ? 0 : 0xffffffffu << (32 - length);
+}
+
+// 容纳count个成员（负载不超过一半）的最小容量
+size_t capacityFor(size_t count) {
+    size_t capacity = INITIAL_SLOTS;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+}  // namespace
+
+AddressSet::AddressSet() : lengths_(0), size_(0), cover16_((1u << 16) / 64, 0) {
+    for (auto& table : tables_) {
+        table.used = 0;
+    }
+}
+
+bool AddressSet::parse(const std::string& text, uint32_t* address, int* length) {
+    IpPrefix prefix;
+    if (text == "default" || !IpPrefix::parse(text, &prefix) || prefix.address.family != AF_INET) {
+        return false;
+    }
+    *address = (static_cast<uint32_t>(prefix.address.bytes[0]) << 24) |
+               (static_cast<uint32_t>(prefix.address.bytes[1]) << 16) |
+               (static_cast<uint32_t>(prefix.address.bytes[2]) << 8) | prefix.address.bytes[3];
+    *length = prefix.length;
+    return true;
+}
+
+void AddressSet::reserve(size_t count) {
+    Table& table = tables_[32];
+    size_t capacity = capacityFor(table.used + count);
+    if (capacity > table.slots.size()) {
+        rehash(table, capacity);
+    }
+}
+
+bool AddressSet::add(uint32_t address, int length) {
+    if (length < 0 || length > 32) {
+        return false;
+    }
+    address &= prefixMask(length);
+    Table& table = tables_[length];
+    if ((table.used + 1) * 2 > table.slots.size()) {
+        rehash(table, capacityFor(table.used + 1));
+    }
+
+    size_t mask = table.slots.size() - 1;
+    for (size_t i = hashAddress(address) & mask;; i = (i + 1) & mask) {
+        if (table.slots[i] == EMPTY) {
+            table.slots[i] = address;
+            break;
+        }
+        if (table.slots[i] == address) {
+            return false;
+        }
+    }
+    table.used++;
+    lengths_ |= 1ull << length;
+    size_++;
+    updateCover(address, length, true);
+    return true;
+}
+
+bool AddressSet::remove(uint32_t address, int length) {
+    if (length < 0 || length > 32) {
+        return false;
+    }
+    address &= prefixMask(length);
+    Table& table = tables_[length];
+    if (table.used == 0) {
+        return false;
+    }
+
+    size_t mask = table.slots.size() - 1;
+    size_t i = hashAddress(address) & mask;
+    while (table.slots[i] != address) {
+        if (table.slots[i] == EMPTY) {
+            return false;
+        }
+        i = (i + 1) & mask;
+    }
+
+    // 后移法：把后面不在自己位置上的成员往前挪，填上空出的槽
+    size_t hole = i;
+    for (size_t j = (i + 1) & mask; table.slots[j] != EMPTY; j = (j + 1) & mask) {
+        size_t home = hashAddress(static_cast<uint32_t>(table.slots[j])) & mask;
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            table.slots[hole] = table.slots[j];
+            hole = j;
+        }
+    }
+    table.slots[hole] = EMPTY;
+
+    if (--table.used == 0) {
+        lengths_ &= ~(1ull << length);
+    }
+    size_--;
+    updateCover(address, length, false);
+    return true;
+}
+
+void AddressSet::clear() {
+    for (auto& table : tables_) {
+        table.slots.clear();
+        table.used = 0;
+    }
+    lengths_ = 0;
+    size_ = 0;
+    cover16_.assign(cover16_.size(), 0);
+    cover24_.clear();
+}
+
+bool AddressSet::contains(uint32_t address) const {
+    uint32_t slot16 = address >> 16;
+    if (cover16_[slot16 / 64] & (1ull << (slot16 % 64))) {
+        return true;
+    }
+    uint32_t slot24 = address >> 8;
+    if (!cover24_.empty() && (cover24_[slot24 / 64] & (1ull << (slot24 % 64)))) {
+        return true;
+    }
+    if (tables_[32].used != 0 && tableContains(32, address)) {
+        return true;
+    }
+
+    uint64_t lengths = lengths_ & LONG_LENGTHS;
+    while (lengths != 0) {
+        int length = 63 - __builtin_clzll(lengths);
+        lengths &= ~(1ull << length);
+        if (tableContains(length, address & prefixMask(length))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::pair<uint32_t, int>> AddressSet::members() const {
+    std::vector<std::pair<uint32_t, int>> result;
+    result.reserve(size_);
+    for (int length = 0; length <= 32; ++length) {
+        for (uint64_t slot : tables_[length].slots) {
+            if (slot != EMPTY) {
+                result.push_back(std::make_pair(static_cast<uint32_t>(slot), length));
+            }
+        }
+    }
+    return result;
+}
+
+size_t AddressSet::memoryUsage() const {
+    size_t bytes = (cover16_.capacity() + cover24_.capacity()) * sizeof(uint64_t);
+    for (const auto& table : tables_) {
+        bytes += table.slots.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
+
+std::string AddressSet::format(uint32_t address, int length) {
+    std::string text = std::to_string(address >> 24) + "." + std::to_string((address >> 16) & 0xff) + "." +
+                       std::to_string((address >> 8) & 0xff) + "." + std::to_string(address & 0xff);
+    if (length != 32) {
+        text += "/" + std::to_string(length);
+    }
+    return text;
+}
+
+bool AddressSet::tableContains(int length, uint32_t address) const {
+    const Table& table = tables_[length];
+    size_t mask = table.slots.size() - 1;
+    for (size_t i = hashAddress(address) & mask; table.slots[i] != EMPTY; i = (i + 1) & mask) {
+        if (table.slots[i] == address) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void AddressSet::updateCover(uint32_t address, int length, bool covered) {
+    if (length > 24) {
+        return;
+    }
+    // 位图的粒度，以及会设置这张位图的长度范围
+    int bits = length <= 16 ? 16 : 24;
+    int min_length = length <= 16 ? 0 : 17;
+    std::vector<uint64_t>& cover = length <= 16 ? cover16_ : cover24_;
+    if (cover.empty()) {
+        if (!covered) {
+            return;
+        }
+        cover.assign((1u << bits) / 64, 0);
+    }
+
+    uint32_t first = address >> (32 - bits);
+    uint32_t count = 1u << (bits - length);
+    for (uint32_t slot = first; slot < first + count; ++slot) {
+        bool still_covered = covered;
+        for (int l = min_length; !still_covered && l <= bits; ++l) {
+            if (lengths_ & (1ull << l)) {
+                uint32_t key = (slot << (32 - bits)) & prefixMask(l);
+                still_covered = tableContains(l, key);
+            }
+        }
+        if (still_covered) {
+            cover[slot / 64] |= 1ull << (slot % 64);
+        } else {
+            cover[slot / 64] &= ~(1ull << (slot % 64));
+        }
+    }
+}
+
+size_t AddressSet::hashAddress(uint32_t address) {
+    uint64_t h = address * 0x9e3779b97f4a7c15ull;
+    return static_cast<size_t>(h ^ (h >> 29));
+}
+
+void AddressSet::rehash(Table& table, size_t capacity) {
+    std::vector<uint64_t> slots(capacity, EMPTY);
+    size_t mask = capacity - 1;
+    for (uint64_t slot : table.slots) {
+        if (slot == EMPTY) {
+            continue;
+        }
+        size_t i = hashAddress(static_cast<uint32_t>(slot)) & mask;
+        while (slots[i] != EMPTY) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+    table.slots.swap(slots);
+}
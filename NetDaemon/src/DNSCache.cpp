@@ -0,0 +1,294 @@
+#include "DNSCache.h"
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+
+namespace {
+
+const uint64_t TICK_MS = 1000;
+const uint32_t INVALID = 0xffffffffu;
+const size_t INITIAL_SLOTS = 16;
+// TTL短于此的记录不预取，最后10%不足1秒
+const int MIN_PREFETCH_TTL = 10;
+
+uint64_t tickOf(uint64_t ms) {
+    return (ms + TICK_MS - 1) / TICK_MS;
+}
+
+}  // namespace
+
+DNSCache::DNSCache(size_t shards) : shard_mask_(0), max_ttl_(3600), negative_ttl_(60), prefetch_hits_(2) {
+    size_t count = 1;
+    while (count < shards) {
+        count *= 2;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        shards_.push_back(std::unique_ptr<Shard>(new Shard()));
+        shards_.back()->used = 0;
+    }
+    shard_mask_ = count - 1;
+}
+
+void DNSCache::setLimits(int max_ttl, int negative_ttl) {
+    max_ttl_ = std::max(0, max_ttl);
+    negative_ttl_ = std::max(0, negative_ttl);
+}
+
+void DNSCache::setPrefetchHits(unsigned int min_hits) {
+    prefetch_hits_ = min_hits;
+}
+
+DNSCache::Status DNSCache::lookup(const std::string& name, DNSQueryType type, uint64_t now_ms,
+                                  DNSResolution* result) {
+    size_t length;
+    uint64_t key = hashKey(name, type, &length);
+    Shard& shard = *shards_[key & shard_mask_];
+    uint32_t hash = static_cast<uint32_t>(key >> 32);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    expireShard(shard, now_ms);
+
+    uint32_t index = find(shard, hash, name, length, type);
+    if (index == INVALID) {
+        return Status::MISS;
+    }
+    Entry& entry = shard.entries[index];
+    if (entry.expires_ms <= now_ms) {
+        // 时间轮按整秒推进，到期不足一秒的还没有触发
+        shard.wheel.cancel(entry.timer);
+        removeEntry(shard, index);
+        return Status::MISS;
+    }
+
+    *result = entry.resolution;
+    uint64_t remaining = entry.expires_ms - now_ms;
+    result->ttl = static_cast<int>((remaining + TICK_MS - 1) / TICK_MS);
+    entry.hits++;
+
+    unsigned int min_hits = prefetch_hits_;
+    if (min_hits != 0 && entry.prefetch_eligible && !entry.prefetching && entry.hits >= min_hits &&
+        remaining * 10 < static_cast<uint64_t>(entry.ttl) * TICK_MS) {
+        entry.prefetching = true;
+        return Status::PREFETCH;
+    }
+    return Status::HIT;
+}
+
+bool DNSCache::insert(const std::string& name, DNSQueryType type, const DNSResolution& result, uint64_t now_ms) {
+    int ttl;
+    if (result.success && !result.ip_addresses.empty()) {
+        ttl = std::min(result.ttl, static_cast<int>(max_ttl_));
+    } else if (!result.success && (result.rcode == 3 || (result.rcode == 0 && result.ip_addresses.empty()))) {
+        // NXDOMAIN或没有记录（NODATA）；超时、截断等没有确定应答的rcode为-1，不缓存
+        ttl = std::min(static_cast<int>(negative_ttl_), static_cast<int>(max_ttl_));
+    } else {
+        ttl = 0;
+    }
+
+    size_t length;
+    uint64_t key = hashKey(name, type, &length);
+    Shard& shard = *shards_[key & shard_mask_];
+    uint32_t hash = static_cast<uint32_t>(key >> 32);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    expireShard(shard, now_ms);
+
+    uint32_t index = find(shard, hash, name, length, type);
+    if (ttl <= 0) {
+        // 刷新失败时保留原来的记录，到期前还可以再次预取
+        if (index != INVALID) {
+            shard.entries[index].prefetching = false;
+        }
+        return false;
+    }
+
+    uint64_t expires_ms = now_ms + static_cast<uint64_t>(ttl) * TICK_MS;
+    if (index != INVALID) {
+        shard.wheel.reschedule(shard.entries[index].timer, tickOf(expires_ms));
+    } else {
+        if (shard.free.empty()) {
+            index = static_cast<uint32_t>(shard.entries.size());
+            shard.entries.push_back(Entry());
+        } else {
+            index = shard.free.back();
+            shard.free.pop_back();
+        }
+        Entry& entry = shard.entries[index];
+        entry.name.resize(length);
+        for (size_t i = 0; i < length; ++i) {
+            entry.name[i] = static_cast<char>(tolower(static_cast<unsigned char>(name[i])));
+        }
+        entry.hash = hash;
+        entry.type = type;
+        entry.timer = shard.wheel.schedule(tickOf(expires_ms), index);
+        insertSlot(shard, hash, index);
+    }
+
+    Entry& entry = shard.entries[index];
+    entry.resolution = result;
+    entry.resolution.ttl = ttl;
+    entry.expires_ms = expires_ms;
+    entry.timestamp = time(nullptr);
+    entry.ttl = ttl;
+    entry.hits = 0;
+    entry.prefetch_eligible = result.success && ttl >= MIN_PREFETCH_TTL;
+    entry.prefetching = false;
+    return true;
+}
+
+size_t DNSCache::expire(uint64_t now_ms) {
+    size_t removed = 0;
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        removed += expireShard(*shard, now_ms);
+    }
+    return removed;
+}
+
+void DNSCache::clear() {
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        uint64_t now = shard->wheel.now();
+        shard->slots.clear();
+        shard->used = 0;
+        shard->entries.clear();
+        shard->free.clear();
+        shard->wheel = TimerWheel(now);
+    }
+}
+
+size_t DNSCache::size() const {
+    size_t count = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        count += shard->used;
+    }
+    return count;
+}
+
+std::vector<DNSCacheEntry> DNSCache::entries(uint64_t now_ms) const {
+    std::vector<DNSCacheEntry> result;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        for (const auto& slot : shard->slots) {
+            if (slot.index == INVALID || shard->entries[slot.index].expires_ms <= now_ms) {
+                continue;
+            }
+            const Entry& entry = shard->entries[slot.index];
+            DNSCacheEntry item;
+            item.hostname = entry.name;
+            item.query_type = entry.type;
+            item.resolution = entry.resolution;
+            item.timestamp = entry.timestamp;
+            item.ttl = entry.ttl;
+            result.push_back(item);
+        }
+    }
+    return result;
+}
+
+uint64_t DNSCache::hashKey(const std::string& name, DNSQueryType type, size_t* length) {
+    size_t n = name.size();
+    if (n > 0 && name[n - 1] == '.') {
+        n--;
+    }
+    // FNV-1a，最后再混合一次，使高位也均匀
+    uint64_t h = 0xcbf29ce484222325ull ^ static_cast<uint64_t>(type);
+    for (size_t i = 0; i < n; ++i) {
+        h ^= static_cast<uint64_t>(tolower(static_cast<unsigned char>(name[i])));
+        h *= 0x100000001b3ull;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    *length = n;
+    return h;
+}
+
+uint32_t DNSCache::find(const Shard& shard, uint32_t hash, const std::string& name, size_t length,
+                        DNSQueryType type) {
+    if (shard.slots.empty()) {
+        return INVALID;
+    }
+    size_t mask = shard.slots.size() - 1;
+    for (size_t i = hash & mask; shard.slots[i].index != INVALID; i = (i + 1) & mask) {
+        if (shard.slots[i].hash != hash) {
+            continue;
+        }
+        const Entry& entry = shard.entries[shard.slots[i].index];
+        if (entry.type != type || entry.name.size() != length) {
+            continue;
+        }
+        size_t j = 0;
+        while (j < length && entry.name[j] == tolower(static_cast<unsigned char>(name[j]))) {
+            j++;
+        }
+        if (j == length) {
+            return shard.slots[i].index;
+        }
+    }
+    return INVALID;
+}
+
+void DNSCache::insertSlot(Shard& shard, uint32_t hash, uint32_t index) {
+    if ((shard.used + 1) * 2 > shard.slots.size()) {
+        size_t capacity = std::max(INITIAL_SLOTS, shard.slots.size() * 2);
+        std::vector<Slot> slots(capacity, Slot{0, INVALID});
+        size_t mask = capacity - 1;
+        for (const auto& slot : shard.slots) {
+            if (slot.index == INVALID) {
+                continue;
+            }
+            size_t i = slot.hash & mask;
+            while (slots[i].index != INVALID) {
+                i = (i + 1) & mask;
+            }
+            slots[i] = slot;
+        }
+        shard.slots.swap(slots);
+    }
+
+    size_t mask = shard.slots.size() - 1;
+    size_t i = hash & mask;
+    while (shard.slots[i].index != INVALID) {
+        i = (i + 1) & mask;
+    }
+    shard.slots[i].hash = hash;
+    shard.slots[i].index = index;
+    shard.used++;
+}
+
+void DNSCache::removeEntry(Shard& shard, uint32_t index) {
+    Entry& entry = shard.entries[index];
+
+    size_t mask = shard.slots.size() - 1;
+    size_t i = entry.hash & mask;
+    while (shard.slots[i].index != index) {
+        i = (i + 1) & mask;
+    }
+    // 后移法：把后面不在自己位置上的槽往前挪，填上空出的槽
+    size_t hole = i;
+    for (size_t j = (i + 1) & mask; shard.slots[j].index != INVALID; j = (j + 1) & mask) {
+        size_t home = shard.slots[j].hash & mask;
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            shard.slots[hole] = shard.slots[j];
+            hole = j;
+        }
+    }
+    shard.slots[hole].index = INVALID;
+    shard.used--;
+
+    entry.resolution = DNSResolution();
+    shard.free.push_back(index);
+}
+
+size_t DNSCache::expireShard(Shard& shard, uint64_t now_ms) {
+    // 时间轮的tick向上取整，定时器到期时条目一定已经到期
+    if (now_ms / TICK_MS < shard.wheel.now()) {
+        return 0;
+    }
+    shard.expired.clear();
+    shard.wheel.advance(now_ms / TICK_MS, &shard.expired);
+    for (uint64_t index : shard.expired) {
+        removeEntry(shard, static_cast<uint32_t>(index));
+    }
+    return shard.expired.size();
+}
@@ -0,0 +1,533 @@
+#include "DNSForwarder.h"
+#include "DNSResolver.h"
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+namespace {
+
+const uint16_t TYPE_A = 1;
+const uint16_t TYPE_PTR = 12;
+const uint16_t TYPE_AAAA = 28;
+const uint16_t TYPE_SRV = 33;
+const uint16_t TYPE_OPT = 41;
+const uint16_t CLASS_IN = 1;
+
+const uint16_t FLAG_QR = 0x8000;
+const uint16_t FLAG_TC = 0x0200;
+const uint16_t FLAG_RD = 0x0100;
+const uint16_t FLAG_RA = 0x0080;
+const int RCODE_FORMERR = 1;
+const int RCODE_SERVFAIL = 2;
+const int RCODE_NXDOMAIN = 3;
+const int RCODE_NOTIMP = 4;
+
+const size_t HEADER_SIZE = 12;
+const size_t OPT_SIZE = 11;
+const size_t MAX_RDATA = 6 + 255;        // SRV：优先级、权重、端口和目标域名
+const size_t MAX_PACKET = 512;
+const uint16_t EDNS_UDP_SIZE = 1232;
+
+const unsigned int BATCH = 64;           // 每次recvmmsg()/sendmmsg()的报文数
+const size_t MAX_QUERY = 1500;
+const int MAX_RECV_ROUNDS = 4;           // 连续接收几批后先发送一次
+const int SEND_WAIT_MS = 100;            // 发送缓冲区满时等待的时间
+const int SOCKET_BUFFER = 1 << 20;
+
+uint16_t read16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+void write16(uint8_t* p, uint16_t value) {
+    p[0] = static_cast<uint8_t>(value >> 8);
+    p[1] = static_cast<uint8_t>(value);
+}
+
+void write32(uint8_t* p, uint32_t value) {
+    write16(p, static_cast<uint16_t>(value >> 16));
+    write16(p + 2, static_cast<uint16_t>(value));
+}
+
+bool queryTypeOf(uint16_t code, DNSQueryType* type) {
+    switch (code) {
+        case TYPE_A: *type = DNSQueryType::A; return true;
+        case TYPE_AAAA: *type = DNSQueryType::AAAA; return true;
+        case TYPE_PTR: *type = DNSQueryType::PTR; return true;
+        case TYPE_SRV: *type = DNSQueryType::SRV; return true;
+        default: return false;
+    }
+}
+
+/**
+ * @brief 把解析结果中的一项编码为资源记录数据
+ * @return 数据长度，无法编码时返回0
+ */
+size_t encodeRdata(uint16_t qtype, const std::string& value, uint8_t* buf, size_t size) {
+    switch (qtype) {
+        case TYPE_A:
+            return size >= 4 && inet_pton(AF_INET, value.c_str(), buf) == 1 ? 4 : 0;
+        case TYPE_AAAA:
+            return size >= 16 && inet_pton(AF_INET6, value.c_str(), buf) == 1 ? 16 : 0;
+        case TYPE_PTR:
+            return DNSResolver::encodeName(value, buf, size);
+        case TYPE_SRV: {
+            // DNSResolver的格式："优先级 权重 端口 目标"
+            std::istringstream fields(value);
+            unsigned int priority, weight, port;
+            std::string target;
+            if (size < 6 || !(fields >> priority >> weight >> port >> target) || priority > 0xffff ||
+                weight > 0xffff || port > 0xffff) {
+                return 0;
+            }
+            size_t length = DNSResolver::encodeName(target, buf + 6, size - 6);
+            if (length == 0) {
+                return 0;
+            }
+            write16(buf, static_cast<uint16_t>(priority));
+            write16(buf + 2, static_cast<uint16_t>(weight));
+            write16(buf + 4, static_cast<uint16_t>(port));
+            return 6 + length;
+        }
+        default:
+            return 0;
+    }
+}
+
+}  // namespace
+
+DNSForwarder::Outbox::Outbox() : notified(false), closed(false) {
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+DNSForwarder::Outbox::~Outbox() {
+    if (event_fd >= 0) {
+        close(event_fd);
+    }
+}
+
+void DNSForwarder::Outbox::push(Response&& response) {
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed) {
+            return;
+        }
+        responses.push_back(std::move(response));
+        wake = !notified;
+        notified = true;
+    }
+    if (wake) {
+        uint64_t one = 1;
+        ssize_t ret = write(event_fd, &one, sizeof(one));
+        (void)ret;
+    }
+}
+
+DNSForwarder::DNSForwarder(DNSManager& manager)
+    : manager_(manager), running_(false), socket_(-1), epoll_fd_(-1), port_(0), stats_(new StatCounters()) {
+    stats_->queries = 0;
+    stats_->responses = 0;
+    stats_->errors = 0;
+    stats_->truncated = 0;
+    stats_->dropped = 0;
+    stats_->recv_batches = 0;
+    stats_->send_batches = 0;
+}
+
+DNSForwarder::~DNSForwarder() {
+    stop();
+}
+
+bool DNSForwarder::start(const std::string& address, uint16_t port) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) {
+        return true;
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    // 只监听本机回环地址，不能成为对外开放的递归服务器
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1 || (ntohl(addr.sin_addr.s_addr) >> 24) != 127) {
+        std::cerr << "[DNSForwarder] Listen address must be in 127.0.0.0/8: " << address << std::endl;
+        return false;
+    }
+
+    std::shared_ptr<Outbox> outbox(new Outbox());
+    socket_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    socklen_t len = sizeof(addr);
+    if (socket_ < 0 || epoll_fd_ < 0 || outbox->event_fd < 0 ||
+        bind(socket_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        getsockname(socket_, reinterpret_cast<sockaddr*>(&addr), &len) < 0) {
+        std::cerr << "[DNSForwarder] Failed to listen on " << address << ":" << port << ": " << strerror(errno)
+                  << std::endl;
+        if (socket_ >= 0) {
+            close(socket_);
+        }
+        if (epoll_fd_ >= 0) {
+            close(epoll_fd_);
+        }
+        socket_ = epoll_fd_ = -1;
+        return false;
+    }
+    int size = SOCKET_BUFFER;
+    setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(socket_, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+    int fds[] = {socket_, outbox->event_fd};
+    for (int fd : fds) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    address_ = address;
+    port_ = ntohs(addr.sin_port);
+    outbox_ = outbox;
+    running_ = true;
+    thread_ = std::thread(&DNSForwarder::loop, this);
+    std::cout << "[DNSForwarder] Listening on " << address_ << ":" << port_ << std::endl;
+    return true;
+}
+
+void DNSForwarder::stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!thread_.joinable()) {
+        return;
+    }
+    running_ = false;
+    uint64_t one = 1;
+    ssize_t ret = write(outbox_->event_fd, &one, sizeof(one));
+    (void)ret;
+    thread_.join();
+
+    // 解析线程中还没完成的查询持有发送队列，关闭后它们的应答直接丢弃
+    {
+        std::lock_guard<std::mutex> outbox_lock(outbox_->mutex);
+        outbox_->closed = true;
+        outbox_->responses.clear();
+    }
+    outbox_.reset();
+    close(socket_);
+    close(epoll_fd_);
+    socket_ = epoll_fd_ = -1;
+    port_ = 0;
+    std::cout << "[DNSForwarder] Stopped" << std::endl;
+}
+
+std::string DNSForwarder::getAddress() const {
+    return address_;
+}
+
+uint16_t DNSForwarder::getPort() const {
+    return port_;
+}
+
+DNSForwarder::ForwarderStats DNSForwarder::getStats() const {
+    ForwarderStats stats;
+    stats.queries = stats_->queries;
+    stats.responses = stats_->responses;
+    stats.errors = stats_->errors;
+    stats.truncated = stats_->truncated;
+    stats.dropped = stats_->dropped;
+    stats.recv_batches = stats_->recv_batches;
+    stats.send_batches = stats_->send_batches;
+    return stats;
+}
+
+void DNSForwarder::loop() {
+    std::vector<uint8_t> buffers(BATCH * MAX_QUERY);
+    std::vector<mmsghdr> msgs(BATCH);
+    std::vector<iovec> iovs(BATCH);
+    std::vector<sockaddr_storage> addrs(BATCH);
+    int event_fd = outbox_->event_fd;
+
+    while (running_) {
+        struct epoll_event events[2];
+        int n = epoll_wait(epoll_fd_, events, 2, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "[DNSForwarder] epoll_wait failed: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        bool readable = false;
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.fd == event_fd) {
+                uint64_t value;
+                ssize_t ret = read(event_fd, &value, sizeof(value));
+                (void)ret;
+            } else {
+                readable = true;
+            }
+        }
+        if (!running_) {
+            break;
+        }
+
+        for (int round = 0; readable && round < MAX_RECV_ROUNDS; ++round) {
+            for (unsigned int i = 0; i < BATCH; ++i) {
+                iovs[i].iov_base = buffers.data() + i * MAX_QUERY;
+                iovs[i].iov_len = MAX_QUERY;
+                memset(&msgs[i], 0, sizeof(msgs[i]));
+                msgs[i].msg_hdr.msg_name = &addrs[i];
+                msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            int received = recvmmsg(socket_, msgs.data(), BATCH, MSG_DONTWAIT, nullptr);
+            if (received <= 0) {
+                break;
+            }
+            stats_->recv_batches++;
+
+            // 处理这一批时解析线程完成的应答不必唤醒，随后一起发送
+            {
+                std::lock_guard<std::mutex> lock(outbox_->mutex);
+                outbox_->notified = true;
+            }
+            for (int i = 0; i < received; ++i) {
+                if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                    stats_->dropped++;
+                    continue;
+                }
+                handleQuery(static_cast<const uint8_t*>(iovs[i].iov_base), msgs[i].msg_len, addrs[i],
+                            msgs[i].msg_hdr.msg_namelen);
+            }
+            flush();
+            readable = received == static_cast<int>(BATCH);
+        }
+        flush();
+    }
+}
+
+void DNSForwarder::handleQuery(const uint8_t* msg, size_t len, const sockaddr_storage& from, socklen_t from_len) {
+    stats_->queries++;
+    if (len < HEADER_SIZE || (read16(msg + 2) & FLAG_QR)) {
+        stats_->dropped++;
+        return;
+    }
+
+    Query query;
+    query.addr = from;
+    query.addr_len = from_len;
+    query.id = read16(msg);
+    query.flags = read16(msg + 2);
+    query.qtype = 0;
+    query.edns = false;
+    query.limit = MAX_PACKET;
+
+    // 只接受一个问题的标准查询
+    int opcode = (query.flags >> 11) & 0xf;
+    std::string name;
+    size_t offset = HEADER_SIZE;
+    if (read16(msg + 4) != 1 || !DNSResolver::readName(msg, len, &offset, &name) || offset + 4 > len) {
+        outbox_->push(encodeResponse(query, opcode != 0 ? RCODE_NOTIMP : RCODE_FORMERR, nullptr, *stats_));
+        return;
+    }
+    query.qtype = read16(msg + offset);
+    uint16_t qclass = read16(msg + offset + 2);
+    query.question.assign(msg + HEADER_SIZE, msg + offset + 4);
+    offset += 4;
+
+    // EDNS0：附加段中的OPT记录，类为客户端能接收的UDP大小
+    if (read16(msg + 6) == 0 && read16(msg + 8) == 0 && read16(msg + 10) >= 1 && offset + OPT_SIZE <= len &&
+        msg[offset] == 0 && read16(msg + offset + 1) == TYPE_OPT) {
+        query.edns = true;
+        query.limit = std::min<size_t>(EDNS_UDP_SIZE, std::max<size_t>(MAX_PACKET, read16(msg + offset + 3)));
+    }
+
+    if (opcode != 0 || qclass != CLASS_IN) {
+        outbox_->push(encodeResponse(query, RCODE_NOTIMP, nullptr, *stats_));
+        return;
+    }
+
+    // 缓存命中时回调在这里立即调用，否则在解析线程中调用；转发器停止后回调仍可能被调用
+    std::shared_ptr<Outbox> outbox = outbox_;
+    std::shared_ptr<StatCounters> stats = stats_;
+    DNSQueryType type;
+    if (!queryTypeOf(query.qtype, &type)) {
+        // 解析器不解析的类型原样转发给上游
+        if (!manager_.relayAsync(msg, len, [outbox, stats, query](const std::vector<uint8_t>& response) {
+                outbox->push(relayResponse(query, response, *stats));
+            })) {
+            outbox_->push(encodeResponse(query, RCODE_SERVFAIL, nullptr, *stats_));
+        }
+        return;
+    }
+    if (!manager_.resolveAsync(name, type, [outbox, stats, query](const DNSResolution& result) {
+            outbox->push(encodeResponse(query, 0, &result, *stats));
+        })) {
+        outbox_->push(encodeResponse(query, RCODE_SERVFAIL, nullptr, *stats_));
+    }
+}
+
+void DNSForwarder::flush() {
+    sending_.clear();
+    {
+        std::lock_guard<std::mutex> lock(outbox_->mutex);
+        sending_.swap(outbox_->responses);
+        outbox_->notified = false;
+    }
+
+    mmsghdr msgs[BATCH];
+    iovec iovs[BATCH];
+    size_t done = 0;
+    while (done < sending_.size()) {
+        unsigned int count = static_cast<unsigned int>(std::min<size_t>(BATCH, sending_.size() - done));
+        for (unsigned int i = 0; i < count; ++i) {
+            Response& response = sending_[done + i];
+            iovs[i].iov_base = response.data.data();
+            iovs[i].iov_len = response.data.size();
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_name = &response.addr;
+            msgs[i].msg_hdr.msg_namelen = response.addr_len;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int sent = sendmmsg(socket_, msgs, count, 0);
+        stats_->send_batches++;
+        if (sent > 0) {
+            done += sent;
+            stats_->responses += sent;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            struct pollfd pfd;
+            pfd.fd = socket_;
+            pfd.events = POLLOUT;
+            if (poll(&pfd, 1, SEND_WAIT_MS) > 0) {
+                continue;
+            }
+            stats_->dropped += sending_.size() - done;
+            break;
+        }
+        // 第一个报文发送失败（例如客户端地址无效），跳过它
+        stats_->dropped++;
+        done++;
+    }
+    sending_.clear();
+}
+
+DNSForwarder::Response DNSForwarder::encodeResponse(const Query& query, int rcode, const DNSResolution* result,
+                                                    StatCounters& stats) {
+    Response response;
+    response.addr = query.addr;
+    response.addr_len = query.addr_len;
+    if (result != nullptr) {
+        // 没有记录（NODATA）的rcode为0；超时、上游出错和截断的rcode为-1，返回SERVFAIL
+        if (result->success || (result->rcode == 0 && result->ip_addresses.empty())) {
+            rcode = 0;
+        } else if (result->rcode == RCODE_NXDOMAIN) {
+            rcode = RCODE_NXDOMAIN;
+        } else {
+            rcode = RCODE_SERVFAIL;
+        }
+    }
+    if (rcode != 0 && rcode != RCODE_NXDOMAIN) {
+        stats.errors++;
+    }
+
+    uint8_t buf[EDNS_UDP_SIZE];
+    size_t limit = query.limit - (query.edns ? OPT_SIZE : 0);
+    uint16_t flags = static_cast<uint16_t>(FLAG_QR | (query.flags & (0x7800 | FLAG_RD)) | FLAG_RA | rcode);
+    memset(buf, 0, HEADER_SIZE);
+    write16(buf, query.id);
+    write16(buf + 4, query.question.empty() ? 0 : 1);
+    size_t pos = HEADER_SIZE;
+    if (!query.question.empty()) {
+        memcpy(buf + pos, query.question.data(), query.question.size());
+        pos += query.question.size();
+    }
+
+    // 回答的所有者用指向问题段域名（偏移12）的压缩指针
+    uint16_t answers = 0;
+    if (result != nullptr && result->success && !query.question.empty()) {
+        uint32_t ttl = static_cast<uint32_t>(std::max(result->ttl, 0));
+        uint8_t rdata[MAX_RDATA];
+        for (const auto& value : result->ip_addresses) {
+            size_t length = encodeRdata(query.qtype, value, rdata, sizeof(rdata));
+            if (length == 0) {
+                continue;
+            }
+            if (pos + 12 + length > limit) {
+                flags |= FLAG_TC;
+                break;
+            }
+            memcpy(buf + pos + 12, rdata, length);
+            write16(buf + pos, 0xc000 | HEADER_SIZE);
+            write16(buf + pos + 2, query.qtype);
+            write16(buf + pos + 4, CLASS_IN);
+            write32(buf + pos + 6, ttl);
+            write16(buf + pos + 10, static_cast<uint16_t>(length));
+            pos += 12 + length;
+            answers++;
+        }
+    }
+    if (flags & FLAG_TC) {
+        stats.truncated++;
+    }
+    write16(buf + 2, flags);
+    write16(buf + 6, answers);
+
+    if (query.edns) {
+        memset(buf + pos, 0, OPT_SIZE);
+        write16(buf + pos + 1, TYPE_OPT);
+        write16(buf + pos + 3, EDNS_UDP_SIZE);
+        write16(buf + 10, 1);
+        pos += OPT_SIZE;
+    }
+    response.data.assign(buf, buf + pos);
+    return response;
+}
+
+DNSForwarder::Response DNSForwarder::relayResponse(const Query& query, const std::vector<uint8_t>& upstream,
+                                                   StatCounters& stats) {
+    // 问题段与发出的只有大小写不同，长度一样
+    size_t question_end = HEADER_SIZE + query.question.size();
+    if (upstream.size() < question_end || read16(upstream.data() + 4) != 1) {
+        return encodeResponse(query, RCODE_SERVFAIL, nullptr, stats);
+    }
+    int rcode = upstream[3] & 0x0f;
+    if (upstream.size() > query.limit) {
+        // 客户端收不下，只返回头部和问题段并设置TC
+        Response response = encodeResponse(query, rcode, nullptr, stats);
+        write16(response.data.data() + 2, static_cast<uint16_t>(read16(response.data.data() + 2) | FLAG_TC));
+        stats.truncated++;
+        return response;
+    }
+    if (rcode != 0 && rcode != RCODE_NXDOMAIN) {
+        stats.errors++;
+    }
+
+    Response response;
+    response.addr = query.addr;
+    response.addr_len = query.addr_len;
+    response.data = upstream;
+    write16(response.data.data(), query.id);
+    memcpy(response.data.data() + HEADER_SIZE, query.question.data(), query.question.size());
+    if (response.data[2] & (FLAG_TC >> 8)) {
+        stats.truncated++;
+    }
+    return response;
+}
@@ -1,19 +1,55 @@
 #include "DNSManager.h"
+#include "DNSCache.h"
+#include "DNSForwarder.h"
+#include "DNSResolver.h"
 #include <iostream>
 #include <sstream>
 #include <cstring>
 #include <ctime>
+#include <chrono>
 #include <algorithm>
+#include <cctype>
+#include <future>
+
+namespace {
+
+const int DEFAULT_NEGATIVE_TTL = 60;
+
+DNSResolution notSubmitted(const std::string& hostname) {
+    DNSResolution result;
+    result.hostname = hostname;
+    result.ttl = 0;
+    result.rcode = -1;
+    result.success = false;
+    result.error_message = "DNS resolver not available";
+    return result;
+}
+
+uint64_t nowMs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+}  // namespace
 
 DNSManager::DNSManager()
-    : initialized_(false), cache_enabled_(true), cache_ttl_(3600) {
+    : initialized_(false), cache_enabled_(true), cache_ttl_(3600), negative_ttl_(DEFAULT_NEGATIVE_TTL),
+      cache_(new DNSCache()), resolver_(new DNSResolver()) {
     stats_.total_queries = 0;
     stats_.cache_hits = 0;
     stats_.cache_misses = 0;
     stats_.failed_queries = 0;
+    stats_.prefetches = 0;
+    stats_.upstream_queries = 0;
+    stats_.coalesced_queries = 0;
+    stats_.waiting_queries = 0;
+    cache_->setLimits(cache_ttl_, negative_ttl_);
 }
 
 DNSManager::~DNSManager() {
+    // 先停止转发线程和解析线程，未完成的查询在回调中还会访问缓存
+    stopForwarder();
+    resolver_->stop();
 }
 
 bool DNSManager::initialize() {
@@ -34,6 +70,7 @@ bool DNSManager::initialize() {
     google_dns2.priority = 2;
     google_dns2.interface = "";
     dns_servers_[google_dns2.ip_address] = google_dns2;
+    syncServers();
 
     initialized_ = true;
     return true;
@@ -49,6 +86,7 @@ std::vector<DNSServer> DNSManager::getDNSServers() const {
 
 bool DNSManager::addDNSServer(const DNSServer& server) {
     dns_servers_[server.ip_address] = server;
+    syncServers();
     std::cout << "[DNSManager] Added DNS server: " << server.ip_address << std::endl;
     return true;
 }
@@ -57,6 +95,7 @@ bool DNSManager::removeDNSServer(const std::string& ip_address) {
     auto it = dns_servers_.find(ip_address);
     if (it != dns_servers_.end()) {
         dns_servers_.erase(it);
+        syncServers();
         std::cout << "[DNSManager] Removed DNS server: " << ip_address << std::endl;
         return true;
     }
@@ -77,46 +116,53 @@ bool DNSManager::setDefaultDNSServer(const std::string& ip_address) {
             pair.second.priority++;
         }
     }
+    syncServers();
 
     return true;
 }
 
-DNSResolution DNSManager::resolve(const std::string& hostname, DNSQueryType query_type) {
-    stats_.total_queries++;
-
-    // 清理过期缓存
-    cleanupExpiredCache();
-
-    // 检查缓存
-    if (cache_enabled_) {
-        DNSCacheEntry* cached = findInCache(hostname);
-        if (cached) {
-            stats_.cache_hits++;
-            DNSResolution result = cached->resolution;
-            if (dns_callback_) {
-                dns_callback_(hostname, result);
-            }
-            return result;
+DNSResolution DNSManager::resolve(const std::string& hostname, DNSQueryType query_type, bool race) {
+    DNSResolution result;
+    if (lookupCache(hostname, query_type, &result)) {
+        if (dns_callback_) {
+            dns_callback_(hostname, result);
         }
+        return result;
     }
 
-    stats_.cache_misses++;
-
-    // 执行DNS查询
-    DNSResolution result = performDNSQuery(hostname, query_type);
+    // 执行DNS查询，已有相同的在途查询时等待它的结果
+    auto promise = std::make_shared<std::promise<DNSResolution>>();
+    std::future<DNSResolution> future = promise->get_future();
+    if (!joinQuery(hostname, query_type, [promise](const DNSResolution& resolved) {
+            promise->set_value(resolved);
+        }, race)) {
+        result = notSubmitted(hostname);
+        recordResult(hostname, result);
+        return result;
+    }
+    return future.get();
+}
 
-    // 缓存结果
-    if (result.success && cache_enabled_) {
-        addToCache(hostname, result);
-    } else {
-        stats_.failed_queries++;
+bool DNSManager::resolveAsync(const std::string& hostname, DNSQueryType query_type, ResolveCallback callback,
+                              bool race) {
+    DNSResolution cached;
+    if (lookupCache(hostname, query_type, &cached)) {
+        if (dns_callback_) {
+            dns_callback_(hostname, cached);
+        }
+        callback(cached);
+        return true;
     }
 
-    if (dns_callback_) {
-        dns_callback_(hostname, result);
+    if (!joinQuery(hostname, query_type, callback, race)) {
+        stats_.failed_queries++;
+        return false;
     }
+    return true;
+}
 
-    return result;
+std::vector<DNSServerStats> DNSManager::getServerStats() const {
+    return resolver_->getServerStats();
 }
 
 DNSResolution DNSManager::reverseLookup(const std::string& ip_address) {
@@ -124,18 +170,16 @@ DNSResolution DNSManager::reverseLookup(const std::string& ip_address) {
 
     // 执行反向DNS查询
     DNSResolution result;
+    std::string name = DNSResolver::reverseName(ip_address);
+    if (name.empty()) {
+        result.ttl = 0;
+        result.rcode = -1;
+        result.success = false;
+        result.error_message = "Invalid IP address: " + ip_address;
+    } else {
+        result = performDNSQuery(name, DNSQueryType::PTR);
+    }
     result.hostname = ip_address;
-    
-    std::ostringstream cmd;
-    cmd << "nslookup " << ip_address;
-
-    std::cout << "[DNSManager] Executing: " << cmd.str() << std::endl;
-    
-    // 模拟执行
-    result.success = true;
-    result.ip_addresses.push_back("example.com");
-    result.dns_server = dns_servers_.empty() ? "" : dns_servers_.begin()->second.ip_address;
-    result.ttl = cache_ttl_;
 
     if (!result.success) {
         stats_.failed_queries++;
@@ -145,23 +189,22 @@ DNSResolution DNSManager::reverseLookup(const std::string& ip_address) {
 }
 
 bool DNSManager::clearCache() {
-    dns_cache_.clear();
+    cache_->clear();
     std::cout << "[DNSManager] DNS cache cleared" << std::endl;
     return true;
 }
 
 bool DNSManager::refreshCache() {
     // 清理过期条目
-    cleanupExpiredCache();
+    size_t removed = cache_->expire(nowMs());
+    if (removed > 0) {
+        std::cout << "[DNSManager] Removed " << removed << " expired cache entries" << std::endl;
+    }
     return true;
 }
 
 std::vector<DNSCacheEntry> DNSManager::getCache() const {
-    std::vector<DNSCacheEntry> result;
-    for (const auto& pair : dns_cache_) {
-        result.push_back(pair.second);
-    }
-    return result;
+    return cache_->entries(nowMs());
 }
 
 bool DNSManager::setCacheTTL(int ttl) {
@@ -169,16 +212,51 @@ bool DNSManager::setCacheTTL(int ttl) {
         return false;
     }
     cache_ttl_ = ttl;
+    cache_->setLimits(cache_ttl_, negative_ttl_);
     std::cout << "[DNSManager] DNS cache TTL set to " << ttl << " seconds" << std::endl;
     return true;
 }
 
+bool DNSManager::setNegativeCacheTTL(int ttl) {
+    if (ttl < 0) {
+        return false;
+    }
+    negative_ttl_ = ttl;
+    cache_->setLimits(cache_ttl_, negative_ttl_);
+    return true;
+}
+
 bool DNSManager::setCacheEnabled(bool enabled) {
     cache_enabled_ = enabled;
     std::cout << "[DNSManager] DNS cache " << (enabled ? "enabled" : "disabled") << std::endl;
     return true;
 }
 
+void DNSManager::setServerPort(uint16_t port) {
+    resolver_->setPort(port);
+}
+
+void DNSManager::setQueryTimeout(int timeout_ms, int attempts) {
+    resolver_->setTimeout(timeout_ms, attempts);
+}
+
+bool DNSManager::startForwarder(const std::string& address, uint16_t port) {
+    if (!forwarder_) {
+        forwarder_.reset(new DNSForwarder(*this));
+    }
+    return ensureResolver() && forwarder_->start(address, port);
+}
+
+void DNSManager::stopForwarder() {
+    if (forwarder_) {
+        forwarder_->stop();
+    }
+}
+
+uint16_t DNSManager::getForwarderPort() const {
+    return forwarder_ ? forwarder_->getPort() : 0;
+}
+
 bool DNSManager::configureSystemDNS() {
     std::ostringstream resolv_conf;
     resolv_conf << "# Generated by NetDaemon\n";
@@ -193,15 +271,39 @@ bool DNSManager::configureSystemDNS() {
         resolv_conf << "\n";
     }
 
-    // 添加DNS服务器（按优先级排序）
+    // 添加DNS服务器：健康的在前，测到RTT的按RTT，其余按优先级
+    std::map<std::string, DNSServerStats> health;
+    for (const auto& stats : getServerStats()) {
+        health[stats.ip_address] = stats;
+    }
     std::vector<DNSServer> servers = getDNSServers();
-    std::sort(servers.begin(), servers.end(),
-        [](const DNSServer& a, const DNSServer& b) {
+    std::stable_sort(servers.begin(), servers.end(),
+        [&health](const DNSServer& a, const DNSServer& b) {
+            auto x = health.find(a.ip_address);
+            auto y = health.find(b.ip_address);
+            bool x_healthy = x == health.end() || x->second.healthy;
+            bool y_healthy = y == health.end() || y->second.healthy;
+            if (x_healthy != y_healthy) {
+                return x_healthy;
+            }
+            double x_rtt = x == health.end() ? -1 : x->second.srtt_ms;
+            double y_rtt = y == health.end() ? -1 : y->second.srtt_ms;
+            if ((x_rtt >= 0) != (y_rtt >= 0)) {
+                return x_rtt >= 0;
+            }
+            if (x_rtt >= 0 && x_rtt != y_rtt) {
+                return x_rtt < y_rtt;
+            }
             return a.priority < b.priority;
         });
 
-    for (const auto& server : servers) {
-        resolv_conf << "nameserver " << server.ip_address << "\n";
+    // resolv.conf不能指定端口，转发器不在53端口时仍直接指向上游服务器
+    if (forwarder_ && forwarder_->isRunning() && forwarder_->getPort() == 53) {
+        resolv_conf << "nameserver " << forwarder_->getAddress() << "\n";
+    } else {
+        for (const auto& server : servers) {
+            resolv_conf << "nameserver " << server.ip_address << "\n";
+        }
     }
 
     std::cout << "[DNSManager] System DNS configuration:\n" << resolv_conf.str();
@@ -234,73 +336,174 @@ void DNSManager::registerCallback(DNSCallback callback) {
 }
 
 DNSManager::DNSStats DNSManager::getStats() const {
-    return stats_;
+    DNSStats stats;
+    stats.total_queries = stats_.total_queries;
+    stats.cache_hits = stats_.cache_hits;
+    stats.cache_misses = stats_.cache_misses;
+    stats.failed_queries = stats_.failed_queries;
+    stats.prefetches = stats_.prefetches;
+    stats.upstream_queries = stats_.upstream_queries;
+    stats.coalesced_queries = stats_.coalesced_queries;
+    stats.waiting_queries = stats_.waiting_queries;
+    return stats;
 }
 
 DNSResolution DNSManager::performDNSQuery(const std::string& hostname, DNSQueryType query_type) {
-    DNSResolution result;
-    result.hostname = hostname;
-    
-    std::ostringstream cmd;
-    cmd << "nslookup -type=" << getQueryTypeString(query_type) << " " << hostname;
-
-    // 执行命令
-    std::cout << "[DNSManager] Executing: " << cmd.str() << std::endl;
-
-    // 模拟DNS解析结果
-    if (query_type == DNSQueryType::A) {
-        result.ip_addresses.push_back("93.184.216.34");
-    } else if (query_type == DNSQueryType::AAAA) {
-        result.ip_addresses.push_back("2606:2800:220:1:248:1893:25c8:1946");
+    if (!ensureResolver()) {
+        return notSubmitted(hostname);
     }
 
-    result.success = !result.ip_addresses.empty();
-    result.dns_server = dns_servers_.empty() ? "" : dns_servers_.begin()->second.ip_address;
-    result.ttl = cache_ttl_;
-
+    DNSResolution result = resolver_->resolve(hostname, query_type).get();
     if (!result.success) {
-        result.error_message = "Failed to resolve hostname: " + hostname;
+        std::cerr << "[DNSManager] " << getQueryTypeString(query_type) << " query for " << hostname
+                  << " failed: " << result.error_message << std::endl;
     }
-
     return result;
 }
 
-DNSCacheEntry* DNSManager::findInCache(const std::string& hostname) {
-    auto it = dns_cache_.find(hostname);
-    if (it != dns_cache_.end()) {
-        time_t now = time(nullptr);
-        if (now - it->second.timestamp < it->second.ttl) {
-            return &it->second;
+bool DNSManager::relayAsync(const uint8_t* query, size_t len, RelayCallback callback) {
+    stats_.upstream_queries++;
+    return ensureResolver() && resolver_->relayAsync(query, len, std::move(callback));
+}
+
+bool DNSManager::ensureResolver() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return resolver_->isRunning() || resolver_->start();
+}
+
+void DNSManager::syncServers() {
+    resolver_->setServers(getDNSServers());
+}
+
+bool DNSManager::lookupCache(const std::string& hostname, DNSQueryType query_type, DNSResolution* result) {
+    stats_.total_queries++;
+
+    // 检查缓存，到期的条目在查找时由时间轮删除
+    if (cache_enabled_) {
+        DNSCache::Status status = cache_->lookup(hostname, query_type, nowMs(), result);
+        if (status != DNSCache::Status::MISS) {
+            stats_.cache_hits++;
+            if (status == DNSCache::Status::PREFETCH) {
+                prefetch(hostname, query_type);
+            }
+            return true;
         }
     }
-    return nullptr;
+
+    stats_.cache_misses++;
+    return false;
 }
 
-void DNSManager::addToCache(const std::string& hostname, const DNSResolution& resolution) {
-    DNSCacheEntry entry;
-    entry.hostname = hostname;
-    entry.resolution = resolution;
-    entry.timestamp = time(nullptr);
-    entry.ttl = cache_ttl_;
-    
-    dns_cache_[hostname] = entry;
-    std::cout << "[DNSManager] Cached DNS resolution for: " << hostname << std::endl;
+bool DNSManager::joinQuery(const std::string& hostname, DNSQueryType query_type, ResolveCallback callback,
+                           bool race) {
+    std::string key = flightKey(hostname, query_type);
+    {
+        std::lock_guard<std::mutex> lock(flights_mutex_);
+        auto it = flights_.find(key);
+        if (it != flights_.end()) {
+            if (callback) {
+                it->second.push_back(Waiter{hostname, callback});
+                stats_.coalesced_queries++;
+                stats_.waiting_queries++;
+            }
+            return true;
+        }
+        std::vector<Waiter>& waiters = flights_[key];
+        if (callback) {
+            waiters.push_back(Waiter{hostname, callback});
+            stats_.waiting_queries++;
+        }
+    }
+
+    stats_.upstream_queries++;
+    if (ensureResolver() && resolver_->resolveAsync(hostname, query_type,
+            [this, key, hostname, query_type](const DNSResolution& result) {
+                completeQuery(key, hostname, query_type, result);
+            }, race)) {
+        return true;
+    }
+
+    // 发出失败：自己返回false，之后加入的等待者已经返回true，仍要通知它们
+    std::vector<Waiter> waiters;
+    {
+        std::lock_guard<std::mutex> lock(flights_mutex_);
+        auto it = flights_.find(key);
+        waiters.swap(it->second);
+        flights_.erase(it);
+    }
+    stats_.waiting_queries -= waiters.size();
+    for (size_t i = callback ? 1 : 0; i < waiters.size(); ++i) {
+        DNSResolution result = notSubmitted(waiters[i].hostname);
+        recordResult(waiters[i].hostname, result);
+        waiters[i].callback(result);
+    }
+    return false;
 }
 
-void DNSManager::cleanupExpiredCache() {
-    time_t now = time(nullptr);
-    auto it = dns_cache_.begin();
-    
-    while (it != dns_cache_.end()) {
-        if (now - it->second.timestamp >= it->second.ttl) {
-            std::cout << "[DNSManager] Removed expired cache entry: " << it->first << std::endl;
-            it = dns_cache_.erase(it);
+void DNSManager::completeQuery(const std::string& key, const std::string& hostname, DNSQueryType query_type,
+                               const DNSResolution& result) {
+    // 先加入缓存再移除在途查询，之后的查询要么命中缓存，要么加入这次查询
+    if (cache_enabled_) {
+        cache_->insert(hostname, query_type, result, nowMs());
+    }
+
+    std::vector<Waiter> waiters;
+    {
+        std::lock_guard<std::mutex> lock(flights_mutex_);
+        auto it = flights_.find(key);
+        if (it != flights_.end()) {
+            waiters.swap(it->second);
+            flights_.erase(it);
+        }
+    }
+    stats_.waiting_queries -= waiters.size();
+
+    if (!result.success && !waiters.empty()) {
+        std::cerr << "[DNSManager] " << getQueryTypeString(query_type) << " query for " << hostname
+                  << " failed: " << result.error_message << std::endl;
+    }
+    for (const auto& waiter : waiters) {
+        if (waiter.hostname == result.hostname) {
+            recordResult(waiter.hostname, result);
+            waiter.callback(result);
         } else {
-            ++it;
+            DNSResolution own = result;
+            own.hostname = waiter.hostname;
+            recordResult(waiter.hostname, own);
+            waiter.callback(own);
         }
     }
 }
 
+void DNSManager::recordResult(const std::string& hostname, const DNSResolution& result) {
+    if (!result.success) {
+        stats_.failed_queries++;
+    }
+
+    if (dns_callback_) {
+        dns_callback_(hostname, result);
+    }
+}
+
+std::string DNSManager::flightKey(const std::string& hostname, DNSQueryType query_type) {
+    size_t length = hostname.size();
+    if (length > 0 && hostname[length - 1] == '.') {
+        length--;
+    }
+    std::string key(1, static_cast<char>('0' + static_cast<int>(query_type)));
+    key.reserve(length + 1);
+    for (size_t i = 0; i < length; ++i) {
+        key.push_back(static_cast<char>(tolower(static_cast<unsigned char>(hostname[i]))));
+    }
+    return key;
+}
+
+void DNSManager::prefetch(const std::string& hostname, DNSQueryType query_type) {
+    stats_.prefetches++;
+    // 提交失败时条目保持预取中的标记，到期后按未命中处理
+    joinQuery(hostname, query_type, ResolveCallback(), false);
+}
+
 bool DNSManager::executeCommand(const std::string& command) {
     // 模拟执行命令
     std::cout << "[DNSManager] Executing: " << command << std::endl;
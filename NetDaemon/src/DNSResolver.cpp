@@ -0,0 +1,1220 @@
+#include "DNSResolver.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+#include <fstream>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+namespace {
+
+const uint16_t TYPE_A = 1;
+const uint16_t TYPE_CNAME = 5;
+const uint16_t TYPE_PTR = 12;
+const uint16_t TYPE_AAAA = 28;
+const uint16_t TYPE_SRV = 33;
+const uint16_t TYPE_OPT = 41;
+const uint16_t CLASS_IN = 1;
+
+const uint16_t FLAG_QR = 0x8000;
+const uint16_t FLAG_TC = 0x0200;
+const uint16_t FLAG_RD = 0x0100;
+const int RCODE_NXDOMAIN = 3;
+
+const size_t HEADER_SIZE = 12;
+const size_t MAX_NAME = 255;
+const size_t MAX_LABEL = 63;
+// EDNS0通告的UDP应答大小，不会在常见路径上分片
+const uint16_t EDNS_UDP_SIZE = 1232;
+const size_t MAX_PACKET = 512;
+const size_t MAX_RELAY = 1500;           // 原样转发的查询的最大长度
+const size_t RECV_BUFFER = 65536;
+const int MAX_CNAME_HOPS = 8;
+const int SOCKET_RCVBUF = 1 << 20;
+// 在途查询数上限，查询ID只有16位，留出空闲的ID让随机ID不易猜中、查找很快结束
+const size_t MAX_INFLIGHT = 16384;
+
+// 套接字池
+const size_t SOCKET_POOL = 16;           // 每个地址族的套接字数
+const unsigned long SOCKET_ROTATE = 256; // 一个套接字发出多少个查询后换新的
+const int BIND_TRIES = 8;                // 随机端口被占用时重试的次数
+const uint16_t DEFAULT_PORT_MIN = 32768; // 读不到ip_local_port_range时的临时端口范围
+const uint16_t DEFAULT_PORT_MAX = 60999;
+
+// 服务器选择
+const double RTT_GAIN = 0.125;
+const double FAILURE_GAIN = 0.25;
+const double UNHEALTHY_RATE = 0.5;
+const double UNKNOWN_RTT_MS = 100;
+const int RECOVERY_MS = 30000;           // 不健康的服务器多久没有再失败后重新探测
+const size_t MAX_SERVERS = 64;           // Query::tried的位数
+const size_t RACE_SERVERS = 2;
+
+uint16_t queryTypeCode(DNSQueryType type) {
+    switch (type) {
+        case DNSQueryType::A: return TYPE_A;
+        case DNSQueryType::AAAA: return TYPE_AAAA;
+        case DNSQueryType::PTR: return TYPE_PTR;
+        case DNSQueryType::SRV: return TYPE_SRV;
+        default: return 0;
+    }
+}
+
+uint16_t read16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t read32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+void write16(uint8_t* p, uint16_t value) {
+    p[0] = static_cast<uint8_t>(value >> 8);
+    p[1] = static_cast<uint8_t>(value);
+}
+
+bool sameName(const std::string& a, const std::string& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (tolower(static_cast<unsigned char>(a[i])) != tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sameAddress(const sockaddr_storage& a, const sockaddr_storage& b) {
+    if (a.ss_family != b.ss_family) {
+        return false;
+    }
+    if (a.ss_family == AF_INET) {
+        const sockaddr_in& x = reinterpret_cast<const sockaddr_in&>(a);
+        const sockaddr_in& y = reinterpret_cast<const sockaddr_in&>(b);
+        return x.sin_port == y.sin_port && x.sin_addr.s_addr == y.sin_addr.s_addr;
+    }
+    const sockaddr_in6& x = reinterpret_cast<const sockaddr_in6&>(a);
+    const sockaddr_in6& y = reinterpret_cast<const sockaddr_in6&>(b);
+    return x.sin6_port == y.sin6_port && memcmp(&x.sin6_addr, &y.sin6_addr, sizeof(x.sin6_addr)) == 0;
+}
+
+/**
+ * @brief 读取系统的临时端口范围
+ */
+void localPortRange(uint16_t* low, uint16_t* high) {
+    std::ifstream file("/proc/sys/net/ipv4/ip_local_port_range");
+    unsigned int first = 0;
+    unsigned int last = 0;
+    if (file >> first >> last && first >= 1024 && first <= last && last <= 65535) {
+        *low = static_cast<uint16_t>(first);
+        *high = static_cast<uint16_t>(last);
+    } else {
+        *low = DEFAULT_PORT_MIN;
+        *high = DEFAULT_PORT_MAX;
+    }
+}
+
+bool bindPort(int fd, int family, uint16_t port) {
+    sockaddr_storage addr;
+    memset(&addr, 0, sizeof(addr));
+    socklen_t len;
+    if (family == AF_INET) {
+        sockaddr_in& addr4 = reinterpret_cast<sockaddr_in&>(addr);
+        addr4.sin_family = AF_INET;
+        addr4.sin_port = htons(port);
+        len = sizeof(addr4);
+    } else {
+        sockaddr_in6& addr6 = reinterpret_cast<sockaddr_in6&>(addr);
+        addr6.sin6_family = AF_INET6;
+        addr6.sin6_port = htons(port);
+        len = sizeof(addr6);
+    }
+    return bind(fd, reinterpret_cast<const sockaddr*>(&addr), len) == 0;
+}
+
+/**
+ * @brief 应答中的一条资源记录
+ */
+struct Record {
+    std::string owner;
+    uint16_t type;
+    uint32_t ttl;
+    size_t rdata;                        // 数据在报文中的位置
+    uint16_t rdlength;
+};
+
+}  // namespace
+
+DNSResolver::DNSResolver()
+    : running_(false), epoll_fd_(-1), event_fd_(-1),
+      servers_changed_(false), port_(53), timeout_ms_(1000), attempts_(2), max_inflight_(1024),
+      active_timeout_ms_(1000), active_max_tries_(0), active_max_inflight_(1024), next_socket_(1),
+      port_min_(DEFAULT_PORT_MIN), port_max_(DEFAULT_PORT_MAX),
+      rng_(std::random_device()()), recv_buf_(RECV_BUFFER), stats_changed_(false) {
+}
+
+DNSResolver::~DNSResolver() {
+    stop();
+}
+
+bool DNSResolver::start() {
+    if (running_) {
+        return true;
+    }
+    // 解析线程可能因错误已经退出
+    stop();
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ >= 0 && event_fd_ >= 0) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = event_fd_;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &ev);
+
+        localPortRange(&port_min_, &port_max_);
+        int families[] = {AF_INET, AF_INET6};
+        for (int family : families) {
+            Socket sock;
+            for (size_t i = 0; i < SOCKET_POOL && openSocket(family, &sock); ++i) {
+                sockets_.push_back(sock);
+            }
+        }
+    }
+    if (epoll_fd_ < 0 || event_fd_ < 0 || sockets_.empty()) {
+        std::cerr << "[DNSResolver] Failed to create epoll/eventfd/socket: " << strerror(errno) << std::endl;
+        closeSockets();
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        servers_changed_ = true;
+        running_ = true;
+    }
+    thread_ = std::thread(&DNSResolver::loop, this);
+    return true;
+}
+
+void DNSResolver::stop() {
+    {
+        // 在锁内修改，之后resolveAsync()不会再往pending_中加查询
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    if (!thread_.joinable()) {
+        return;
+    }
+    uint64_t one = 1;
+    if (write(event_fd_, &one, sizeof(one)) < 0) {
+        std::cerr << "[DNSResolver] Failed to wake resolver thread: " << strerror(errno) << std::endl;
+    }
+    thread_.join();
+    closeSockets();
+}
+
+void DNSResolver::closeSockets() {
+    for (const auto& sock : sockets_) {
+        close(sock.fd);
+    }
+    for (const auto& sock : retired_) {
+        close(sock.fd);
+    }
+    sockets_.clear();
+    retired_.clear();
+    int fds[] = {epoll_fd_, event_fd_};
+    for (int fd : fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    epoll_fd_ = event_fd_ = -1;
+}
+
+void DNSResolver::setServers(const std::vector<DNSServer>& servers) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    servers_ = servers;
+    std::stable_sort(servers_.begin(), servers_.end(),
+        [](const DNSServer& a, const DNSServer& b) {
+            return a.priority < b.priority;
+        });
+    servers_changed_ = true;
+}
+
+void DNSResolver::setPort(uint16_t port) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    port_ = port;
+    servers_changed_ = true;
+}
+
+void DNSResolver::setTimeout(int timeout_ms, int attempts) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    timeout_ms_ = std::max(1, timeout_ms);
+    attempts_ = std::max(1, attempts);
+    servers_changed_ = true;
+}
+
+void DNSResolver::setMaxInflight(size_t max_inflight) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_inflight_ = std::min(std::max<size_t>(1, max_inflight), MAX_INFLIGHT);
+    servers_changed_ = true;
+}
+
+bool DNSResolver::resolveAsync(const std::string& name, DNSQueryType type, Callback callback, bool race) {
+    Request request;
+    request.name = name;
+    request.race = race;
+    if (!request.name.empty() && request.name.back() == '.') {
+        request.name.pop_back();
+    }
+    request.qtype = queryTypeCode(type);
+    request.callback = std::move(callback);
+    uint8_t packet[MAX_PACKET];
+    if (request.qtype == 0 || encodeQuery(request.name, request.qtype, 0, packet, sizeof(packet)) == 0) {
+        return false;
+    }
+
+    // 在锁内通知，stop()不会在这之间关闭event_fd_
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) {
+        return false;
+    }
+    // 解析线程取走pending_之前只需通知一次
+    if (pending_.empty()) {
+        uint64_t one = 1;
+        if (write(event_fd_, &one, sizeof(one)) < 0) {
+            std::cerr << "[DNSResolver] Failed to wake resolver thread: " << strerror(errno) << std::endl;
+        }
+    }
+    pending_.push_back(std::move(request));
+    return true;
+}
+
+bool DNSResolver::relayAsync(const uint8_t* query, size_t len, RelayCallback callback) {
+    Request request;
+    request.race = false;
+    size_t offset = HEADER_SIZE;
+    if (len < HEADER_SIZE || len > MAX_RELAY || (read16(query + 2) & FLAG_QR) || read16(query + 4) != 1 ||
+        !readName(query, len, &offset, &request.name) || request.name.empty() || offset + 4 > len ||
+        read16(query + offset + 2) != CLASS_IN) {
+        return false;
+    }
+    request.qtype = read16(query + offset);
+    request.relay.assign(query, query + len);
+    request.relay_callback = std::move(callback);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) {
+        return false;
+    }
+    if (pending_.empty()) {
+        uint64_t one = 1;
+        if (write(event_fd_, &one, sizeof(one)) < 0) {
+            std::cerr << "[DNSResolver] Failed to wake resolver thread: " << strerror(errno) << std::endl;
+        }
+    }
+    pending_.push_back(std::move(request));
+    return true;
+}
+
+std::future<DNSResolution> DNSResolver::resolve(const std::string& name, DNSQueryType type, bool race) {
+    std::shared_ptr<std::promise<DNSResolution>> promise = std::make_shared<std::promise<DNSResolution>>();
+    std::future<DNSResolution> future = promise->get_future();
+    bool submitted = resolveAsync(name, type, [promise](const DNSResolution& result) {
+        promise->set_value(result);
+    }, race);
+    if (!submitted) {
+        DNSResolution result;
+        result.hostname = name;
+        result.ttl = 0;
+        result.rcode = -1;
+        result.success = false;
+        result.error_message = running_ ? "Invalid query: " + name : "Resolver not running";
+        promise->set_value(result);
+    }
+    return future;
+}
+
+std::vector<DNSServerStats> DNSResolver::getServerStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return server_stats_;
+}
+
+std::string DNSResolver::reverseName(const std::string& ip_address) {
+    uint8_t bytes[16];
+    static const char HEX[] = "0123456789abcdef";
+    std::string name;
+    if (inet_pton(AF_INET, ip_address.c_str(), bytes) == 1) {
+        for (int i = 3; i >= 0; --i) {
+            name += std::to_string(bytes[i]) + ".";
+        }
+        return name + "in-addr.arpa";
+    }
+    if (inet_pton(AF_INET6, ip_address.c_str(), bytes) == 1) {
+        for (int i = 15; i >= 0; --i) {
+            name += HEX[bytes[i] & 0xf];
+            name += '.';
+            name += HEX[bytes[i] >> 4];
+            name += '.';
+        }
+        return name + "ip6.arpa";
+    }
+    return "";
+}
+
+size_t DNSResolver::encodeQuery(const std::string& name, uint16_t qtype, uint16_t id, uint8_t* buf, size_t size) {
+    // 头部 + 域名（最长255）+ 类型和类 + OPT记录
+    if (name.empty() || name.size() + 2 > MAX_NAME || size < HEADER_SIZE + name.size() + 2 + 4 + 11) {
+        return 0;
+    }
+    memset(buf, 0, HEADER_SIZE);
+    write16(buf, id);
+    write16(buf + 2, FLAG_RD);
+    write16(buf + 4, 1);
+    write16(buf + 10, 1);
+
+    size_t pos = HEADER_SIZE + encodeName(name, buf + HEADER_SIZE, size - HEADER_SIZE);
+    if (pos == HEADER_SIZE) {
+        return 0;
+    }
+    write16(buf + pos, qtype);
+    write16(buf + pos + 2, CLASS_IN);
+    pos += 4;
+
+    // EDNS0 OPT：根域名、类型41、类为UDP应答大小，TTL和数据长度为0
+    memset(buf + pos, 0, 11);
+    write16(buf + pos + 1, TYPE_OPT);
+    write16(buf + pos + 3, EDNS_UDP_SIZE);
+    return pos + 11;
+}
+
+size_t DNSResolver::encodeName(const std::string& name, uint8_t* buf, size_t size) {
+    if (name.empty() || name.size() + 2 > MAX_NAME || size < name.size() + 2) {
+        return 0;
+    }
+    size_t pos = 0;
+    size_t start = 0;
+    while (start <= name.size()) {
+        size_t dot = name.find('.', start);
+        if (dot == std::string::npos) {
+            dot = name.size();
+        }
+        size_t label = dot - start;
+        if (label == 0 || label > MAX_LABEL) {
+            return 0;
+        }
+        buf[pos++] = static_cast<uint8_t>(label);
+        memcpy(buf + pos, name.data() + start, label);
+        pos += label;
+        start = dot + 1;
+    }
+    buf[pos++] = 0;
+    return pos;
+}
+
+bool DNSResolver::readName(const uint8_t* msg, size_t len, size_t* offset, std::string* name) {
+    name->clear();
+    size_t pos = *offset;
+    size_t end = 0;                      // 第一个压缩指针之后的位置
+    int jumps = 0;
+    while (true) {
+        if (pos >= len) {
+            return false;
+        }
+        uint8_t label = msg[pos];
+        if ((label & 0xc0) == 0xc0) {
+            if (pos + 1 >= len || ++jumps > 16) {
+                return false;
+            }
+            if (end == 0) {
+                end = pos + 2;
+            }
+            pos = static_cast<size_t>(((label & 0x3f) << 8) | msg[pos + 1]);
+            continue;
+        }
+        if (label & 0xc0) {
+            return false;
+        }
+        if (label == 0) {
+            *offset = end != 0 ? end : pos + 1;
+            return true;
+        }
+        if (pos + 1 + label > len || name->size() + label + 1 > MAX_NAME) {
+            return false;
+        }
+        if (!name->empty()) {
+            *name += '.';
+        }
+        name->append(reinterpret_cast<const char*>(msg + pos + 1), label);
+        pos += 1 + label;
+    }
+}
+
+void DNSResolver::loop() {
+    struct epoll_event events[4];
+    while (running_) {
+        Clock::time_point now = Clock::now();
+        Clock::time_point next = closeRetired(now);
+        if (!deadlines_.empty()) {
+            next = std::min(next, deadlines_.begin()->first);
+        }
+        int timeout = -1;
+        if (next != Clock::time_point::max()) {
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next - now).count();
+            timeout = wait < 0 ? 0 : static_cast<int>(wait) + 1;
+        }
+        int n = epoll_wait(epoll_fd_, events, 4, timeout);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "[DNSResolver] epoll_wait failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == event_fd_) {
+                uint64_t count;
+                if (read(event_fd_, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                    std::cerr << "[DNSResolver] Failed to read eventfd: " << strerror(errno) << std::endl;
+                }
+            } else {
+                auto tcp = tcp_queries_.find(fd);
+                if (tcp != tcp_queries_.end()) {
+                    handleTcp(tcp->second);
+                } else {
+                    receive(fd);
+                }
+            }
+        }
+        expireQueries();
+        startQueries();
+    }
+
+    // 停止：未完成的查询以失败结束
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+        for (auto& request : pending_) {
+            backlog_.push_back(std::move(request));
+        }
+        pending_.clear();
+    }
+    DNSResolution result;
+    result.ttl = 0;
+    result.rcode = -1;
+    result.success = false;
+    result.error_message = "Resolver stopped";
+    while (!queries_.empty()) {
+        result.hostname = queries_.begin()->second.name;
+        finish(queries_.begin()->first, result);
+    }
+    while (!backlog_.empty()) {
+        Request request = std::move(backlog_.front());
+        backlog_.pop_front();
+        result.hostname = request.name;
+        if (request.relay_callback) {
+            request.relay_callback(std::vector<uint8_t>());
+        } else {
+            request.callback(result);
+        }
+    }
+    deadlines_.clear();
+}
+
+void DNSResolver::startQueries() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (servers_changed_) {
+            // 保留仍在列表中的服务器的统计
+            std::vector<Server> previous;
+            previous.swap(active_servers_);
+            for (const auto& server : servers_) {
+                Server entry;
+                if (active_servers_.size() >= MAX_SERVERS || !buildServer(server, port_, &entry)) {
+                    std::cerr << "[DNSResolver] Ignoring DNS server: " << server.ip_address << std::endl;
+                    continue;
+                }
+                for (const auto& old : previous) {
+                    if (sameAddress(old.addr, entry.addr)) {
+                        entry = old;
+                        entry.probing = false;
+                        break;
+                    }
+                }
+                active_servers_.push_back(entry);
+            }
+            // 在途查询记录的下标已经失效
+            for (auto& pair : queries_) {
+                pair.second.tried = 0;
+                pair.second.outstanding.clear();
+            }
+            active_timeout_ms_ = timeout_ms_;
+            active_max_tries_ = active_servers_.size() * static_cast<size_t>(attempts_);
+            active_max_inflight_ = max_inflight_;
+            servers_changed_ = false;
+            stats_changed_ = true;
+        }
+        if (stats_changed_) {
+            server_stats_.clear();
+            for (const auto& server : active_servers_) {
+                DNSServerStats stats;
+                stats.ip_address = server.address;
+                stats.srtt_ms = server.srtt_ms;
+                stats.failure_rate = server.failure_rate;
+                stats.queries = server.queries;
+                stats.failures = server.failures;
+                stats.healthy = server.failure_rate < UNHEALTHY_RATE;
+                server_stats_.push_back(stats);
+            }
+            stats_changed_ = false;
+        }
+        for (auto& request : pending_) {
+            backlog_.push_back(std::move(request));
+        }
+        pending_.clear();
+    }
+
+    while (!backlog_.empty() && queries_.size() < active_max_inflight_) {
+        // 随机的查询ID，避开在途的
+        uint16_t id = static_cast<uint16_t>(rng_());
+        while (queries_.count(id) != 0) {
+            id++;
+        }
+        Request& request = backlog_.front();
+        Query& query = queries_[id];
+        query.name = std::move(request.name);
+        query.qtype = request.qtype;
+        query.race = request.race;
+        query.callback = std::move(request.callback);
+        query.relay_callback = std::move(request.relay_callback);
+        query.tries = 0;
+        query.tried = 0;
+        query.outstanding.clear();
+        query.sockets.clear();
+        query.waiting = false;
+        query.tcp_fd = -1;
+        if (!request.relay.empty()) {
+            query.packet.swap(request.relay);
+            write16(query.packet.data(), id);
+        } else {
+            query.packet.resize(MAX_PACKET);
+            query.packet.resize(encodeQuery(query.name, query.qtype, id, query.packet.data(), query.packet.size()));
+        }
+        randomizeCase(query);
+        backlog_.pop_front();
+        sendQuery(id);
+    }
+}
+
+void DNSResolver::randomizeCase(Query& query) {
+    // 伪造的应答除了端口和查询ID，还要猜中每个字母的大小写
+    size_t pos = HEADER_SIZE;
+    uint32_t bits = 0;
+    int left = 0;
+    while (pos < query.packet.size() && query.packet[pos] != 0 && !(query.packet[pos] & 0xc0)) {
+        size_t end = std::min(query.packet.size(), pos + 1 + query.packet[pos]);
+        for (++pos; pos < end; ++pos) {
+            int c = query.packet[pos];
+            if (!isalpha(c)) {
+                continue;
+            }
+            if (left == 0) {
+                bits = rng_();
+                left = 32;
+            }
+            query.packet[pos] = static_cast<uint8_t>((bits & 1) ? toupper(c) : tolower(c));
+            bits >>= 1;
+            left--;
+        }
+    }
+    size_t offset = HEADER_SIZE;
+    readName(query.packet.data(), query.packet.size(), &offset, &query.sent_name);
+}
+
+void DNSResolver::sendQuery(uint16_t id) {
+    Query& query = queries_[id];
+    if (query.waiting) {
+        deadlines_.erase(query.deadline);
+        query.waiting = false;
+    }
+    // 竞速的查询第一次同时发给最好的两个服务器
+    Clock::time_point now = Clock::now();
+    size_t sends = query.race && query.tries == 0 ? std::min(RACE_SERVERS, active_servers_.size()) : 1;
+    while (query.tries < active_max_tries_ && query.outstanding.size() < sends) {
+        size_t index = pickServer(query, now);
+        Server& server = active_servers_[index];
+        query.tries++;
+        server.queries++;
+        stats_changed_ = true;
+        size_t sock = pickSocket(server.addr.ss_family);
+        if (sock == sockets_.size()) {
+            query.last_error = "No socket for " + server.address;
+            recordFailure(index, now);
+            continue;
+        }
+        ssize_t sent = sendto(sockets_[sock].fd, query.packet.data(), query.packet.size(), 0,
+                              reinterpret_cast<const sockaddr*>(&server.addr), server.addr_len);
+        if (sent < 0) {
+            query.last_error = server.address + ": " + strerror(errno);
+            recordFailure(index, now);
+            continue;
+        }
+        sockets_[sock].sends++;
+        if (std::find(query.sockets.begin(), query.sockets.end(), sockets_[sock].serial) == query.sockets.end()) {
+            query.sockets.push_back(sockets_[sock].serial);
+        }
+        query.outstanding.push_back(Attempt{index, now});
+    }
+    if (!query.outstanding.empty()) {
+        query.deadline = deadlines_.insert(std::make_pair(now + std::chrono::milliseconds(active_timeout_ms_), id));
+        query.waiting = true;
+        return;
+    }
+
+    DNSResolution result;
+    result.hostname = query.name;
+    result.ttl = 0;
+    result.rcode = -1;
+    result.success = false;
+    if (active_servers_.empty()) {
+        result.error_message = "No DNS servers configured";
+    } else {
+        result.error_message = query.last_error.empty() ? "Timed out resolving " + query.name : query.last_error;
+    }
+    finish(id, result);
+}
+
+size_t DNSResolver::pickServer(Query& query, Clock::time_point now) {
+    size_t count = active_servers_.size();
+    uint64_t all = count >= MAX_SERVERS ? ~0ull : (1ull << count) - 1;
+    if ((query.tried & all) == all) {
+        query.tried = 0;
+    }
+
+    size_t best = count;
+    double best_score = 0;
+    bool best_healthy = false;
+    for (size_t i = 0; i < count; ++i) {
+        if (query.tried & (1ull << i)) {
+            continue;
+        }
+        Server& server = active_servers_[i];
+        bool healthy = server.failure_rate < UNHEALTHY_RATE;
+        // 还没测到RTT的和不健康很久的服务器，用新查询的第一次发送探测一次
+        if (query.tries == 0 && !server.probing &&
+            ((healthy && server.srtt_ms < 0) ||
+             (!healthy && now - server.last_failure > std::chrono::milliseconds(RECOVERY_MS)))) {
+            server.probing = true;
+            best = i;
+            break;
+        }
+        double score = (server.srtt_ms < 0 ? UNKNOWN_RTT_MS : server.srtt_ms) +
+                       server.failure_rate * active_timeout_ms_;
+        // 相同时保留下标小的，即优先级高的
+        if (best == count || (healthy && !best_healthy) || (healthy == best_healthy && score < best_score)) {
+            best = i;
+            best_score = score;
+            best_healthy = healthy;
+        }
+    }
+    query.tried |= 1ull << best;
+    return best;
+}
+
+void DNSResolver::recordSuccess(size_t server, Clock::duration rtt) {
+    Server& entry = active_servers_[server];
+    double sample = std::chrono::duration<double, std::milli>(rtt).count();
+    entry.srtt_ms = entry.srtt_ms < 0 ? sample : entry.srtt_ms + RTT_GAIN * (sample - entry.srtt_ms);
+    // 不健康的服务器应答后立即恢复为健康
+    entry.failure_rate = std::min(entry.failure_rate, UNHEALTHY_RATE) * (1 - FAILURE_GAIN);
+    entry.probing = false;
+    stats_changed_ = true;
+}
+
+void DNSResolver::recordFailure(size_t server, Clock::time_point now) {
+    Server& entry = active_servers_[server];
+    entry.failure_rate += FAILURE_GAIN * (1 - entry.failure_rate);
+    entry.failures++;
+    entry.last_failure = now;
+    entry.probing = false;
+    stats_changed_ = true;
+}
+
+bool DNSResolver::takeAttempt(Query& query, size_t server, Attempt* attempt) {
+    for (size_t i = 0; i < query.outstanding.size(); ++i) {
+        if (query.outstanding[i].server == server) {
+            *attempt = query.outstanding[i];
+            query.outstanding.erase(query.outstanding.begin() + i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DNSResolver::openSocket(int family, Socket* out) {
+    int fd = createSocket(family);
+    if (fd < 0) {
+        return false;
+    }
+    // 随机的临时端口，被占用时换一个，都不行时由系统分配
+    bool bound = false;
+    for (int i = 0; i < BIND_TRIES && !bound; ++i) {
+        bound = bindPort(fd, family, static_cast<uint16_t>(port_min_ + rng_() % (port_max_ - port_min_ + 1u)));
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if ((!bound && !bindPort(fd, family, 0)) || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        close(fd);
+        return false;
+    }
+    out->fd = fd;
+    out->family = family;
+    out->serial = next_socket_++;
+    out->sends = 0;
+    return true;
+}
+
+size_t DNSResolver::pickSocket(int family) {
+    size_t count = 0;
+    for (const auto& sock : sockets_) {
+        count += sock.family == family;
+    }
+    if (count == 0) {
+        return sockets_.size();
+    }
+    size_t pick = rng_() % count;
+    size_t index = 0;
+    while (sockets_[index].family != family || pick-- != 0) {
+        index++;
+    }
+
+    // 用够了的套接字换成新端口的，打开失败时继续用旧的
+    Socket fresh;
+    if (sockets_[index].sends >= SOCKET_ROTATE && openSocket(family, &fresh)) {
+        Socket& old = sockets_[index];
+        old.close_at = Clock::now() + std::chrono::milliseconds(active_timeout_ms_) *
+                       static_cast<int>(std::max<size_t>(1, active_max_tries_));
+        retired_.push_back(old);
+        old = fresh;
+    }
+    return index;
+}
+
+DNSResolver::Clock::time_point DNSResolver::closeRetired(Clock::time_point now) {
+    Clock::time_point next = Clock::time_point::max();
+    size_t kept = 0;
+    for (size_t i = 0; i < retired_.size(); ++i) {
+        if (retired_[i].close_at <= now) {
+            close(retired_[i].fd);
+            continue;
+        }
+        next = std::min(next, retired_[i].close_at);
+        retired_[kept++] = retired_[i];
+    }
+    retired_.resize(kept);
+    return next;
+}
+
+void DNSResolver::receive(int fd) {
+    uint32_t serial = 0;
+    for (const auto& sock : sockets_) {
+        if (sock.fd == fd) {
+            serial = sock.serial;
+        }
+    }
+    for (const auto& sock : retired_) {
+        if (sock.fd == fd) {
+            serial = sock.serial;
+        }
+    }
+    if (serial == 0) {
+        return;
+    }
+    while (true) {
+        sockaddr_storage from;
+        socklen_t from_len = sizeof(from);
+        ssize_t len = recvfrom(fd, recv_buf_.data(), recv_buf_.size(), 0,
+                               reinterpret_cast<sockaddr*>(&from), &from_len);
+        if (len < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "[DNSResolver] recvfrom failed: " << strerror(errno) << std::endl;
+            }
+            return;
+        }
+        handleResponse(recv_buf_.data(), static_cast<size_t>(len), from, serial);
+    }
+}
+
+void DNSResolver::handleResponse(const uint8_t* msg, size_t len, const sockaddr_storage& from, uint32_t socket) {
+    if (len < HEADER_SIZE) {
+        return;
+    }
+    // 已经改用TCP的查询不再接受UDP应答
+    auto it = queries_.find(read16(msg));
+    if (it == queries_.end() || it->second.tcp_fd >= 0 ||
+        std::find(it->second.sockets.begin(), it->second.sockets.end(), socket) == it->second.sockets.end()) {
+        return;
+    }
+    size_t server = 0;
+    while (server < active_servers_.size() && !sameAddress(active_servers_[server].addr, from)) {
+        server++;
+    }
+    if (server == active_servers_.size()) {
+        return;
+    }
+
+    Query& query = it->second;
+    DNSResolution result;
+    result.hostname = query.name;
+    result.dns_server = active_servers_[server].address;
+    result.ttl = 0;
+    result.rcode = -1;
+    result.success = false;
+    ResponseAction action = parseResponse(msg, len, query, &result);
+    if (action == ResponseAction::IGNORE) {
+        return;
+    }
+
+    // 超时后才到的应答不计RTT，超时时已经计过失败
+    Attempt attempt;
+    bool measured = takeAttempt(query, server, &attempt);
+    if (action == ResponseAction::RETRY) {
+        recordFailure(server, Clock::now());
+        query.last_error = result.error_message;
+        // 竞速时另一个服务器可能还会应答
+        if (query.outstanding.empty()) {
+            sendQuery(it->first);
+        }
+        return;
+    }
+    if (measured) {
+        recordSuccess(server, Clock::now() - attempt.sent);
+    }
+    uint16_t flags = read16(msg + 2);
+    if ((flags & FLAG_TC) && (flags & 0x0f) == 0) {
+        startTcp(it->first, server);
+        return;
+    }
+    finish(it->first, result, msg, len);
+}
+
+void DNSResolver::startTcp(uint16_t id, size_t server) {
+    Query& query = queries_[id];
+    if (query.waiting) {
+        deadlines_.erase(query.deadline);
+        query.waiting = false;
+    }
+    // 竞速时另一个服务器的应答不再等待
+    query.outstanding.clear();
+    const Server& entry = active_servers_[server];
+    query.tcp_server = entry.address;
+
+    int fd = socket(entry.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        failTcp(id, strerror(errno));
+        return;
+    }
+    query.tcp_fd = fd;
+    tcp_queries_[fd] = id;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLOUT;
+    ev.data.fd = fd;
+    if ((connect(fd, reinterpret_cast<const sockaddr*>(&entry.addr), entry.addr_len) < 0 && errno != EINPROGRESS) ||
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        failTcp(id, strerror(errno));
+        return;
+    }
+
+    // TCP上的报文前面是两个字节的长度
+    query.tcp_buf.resize(2);
+    write16(query.tcp_buf.data(), static_cast<uint16_t>(query.packet.size()));
+    query.tcp_buf.insert(query.tcp_buf.end(), query.packet.begin(), query.packet.end());
+    query.tcp_done = 0;
+    query.tcp_sending = true;
+    query.deadline = deadlines_.insert(std::make_pair(
+        Clock::now() + std::chrono::milliseconds(active_timeout_ms_), id));
+    query.waiting = true;
+}
+
+void DNSResolver::handleTcp(uint16_t id) {
+    Query& query = queries_[id];
+    int fd = query.tcp_fd;
+    if (query.tcp_sending) {
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) < 0 || error != 0) {
+            failTcp(id, strerror(error != 0 ? error : errno));
+            return;
+        }
+        while (query.tcp_done < query.tcp_buf.size()) {
+            ssize_t sent = send(fd, query.tcp_buf.data() + query.tcp_done, query.tcp_buf.size() - query.tcp_done,
+                                MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    failTcp(id, strerror(errno));
+                }
+                return;
+            }
+            query.tcp_done += static_cast<size_t>(sent);
+        }
+        // 先收两个字节的长度
+        query.tcp_sending = false;
+        query.tcp_buf.assign(2, 0);
+        query.tcp_done = 0;
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev);
+        return;
+    }
+
+    while (query.tcp_done < query.tcp_buf.size()) {
+        ssize_t received = recv(fd, query.tcp_buf.data() + query.tcp_done, query.tcp_buf.size() - query.tcp_done, 0);
+        if (received == 0) {
+            failTcp(id, "connection closed");
+            return;
+        }
+        if (received < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                failTcp(id, strerror(errno));
+            }
+            return;
+        }
+        query.tcp_done += static_cast<size_t>(received);
+        if (query.tcp_done == 2 && query.tcp_buf.size() == 2) {
+            query.tcp_buf.resize(2 + read16(query.tcp_buf.data()));
+        }
+    }
+
+    const uint8_t* msg = query.tcp_buf.data() + 2;
+    size_t len = query.tcp_buf.size() - 2;
+    DNSResolution result;
+    result.hostname = query.name;
+    result.dns_server = query.tcp_server;
+    result.ttl = 0;
+    result.rcode = -1;
+    result.success = false;
+    ResponseAction action = len >= HEADER_SIZE && read16(msg) == id ? parseResponse(msg, len, query, &result)
+                                                                     : ResponseAction::IGNORE;
+    if (action == ResponseAction::IGNORE) {
+        failTcp(id, "invalid response");
+    } else if (action == ResponseAction::RETRY) {
+        failTcp(id, result.error_message);
+    } else {
+        finish(id, result, msg, len);
+    }
+}
+
+void DNSResolver::failTcp(uint16_t id, const std::string& reason) {
+    Query& query = queries_[id];
+    DNSResolution result;
+    result.hostname = query.name;
+    result.dns_server = query.tcp_server;
+    result.ttl = 0;
+    result.rcode = -1;
+    result.success = false;
+    result.error_message = "Truncated response for " + query.name + " (TCP: " + reason + ")";
+    finish(id, result);
+}
+
+void DNSResolver::expireQueries() {
+    Clock::time_point now = Clock::now();
+    while (!deadlines_.empty() && deadlines_.begin()->first <= now) {
+        uint16_t id = deadlines_.begin()->second;
+        Query& query = queries_[id];
+        if (query.tcp_fd >= 0) {
+            failTcp(id, "timed out");
+            continue;
+        }
+        query.last_error = "Timed out resolving " + query.name;
+        for (const auto& attempt : query.outstanding) {
+            recordFailure(attempt.server, now);
+        }
+        query.outstanding.clear();
+        sendQuery(id);
+    }
+}
+
+void DNSResolver::finish(uint16_t id, DNSResolution& result, const uint8_t* msg, size_t len) {
+    auto it = queries_.find(id);
+    if (it->second.waiting) {
+        deadlines_.erase(it->second.deadline);
+    }
+    if (it->second.tcp_fd >= 0) {
+        tcp_queries_.erase(it->second.tcp_fd);
+        close(it->second.tcp_fd);
+    }
+    Callback callback = std::move(it->second.callback);
+    RelayCallback relay_callback = std::move(it->second.relay_callback);
+    std::vector<uint8_t> response;
+    if (relay_callback && msg != nullptr) {
+        response.assign(msg, msg + len);
+    }
+    queries_.erase(it);
+    if (relay_callback) {
+        relay_callback(response);
+    } else {
+        callback(result);
+    }
+}
+
+DNSResolver::ResponseAction DNSResolver::parseResponse(const uint8_t* msg, size_t len, const Query& query,
+                                                       DNSResolution* result) {
+    uint16_t flags = read16(msg + 2);
+    if (!(flags & FLAG_QR) || read16(msg + 4) != 1) {
+        return ResponseAction::IGNORE;
+    }
+    size_t pos = HEADER_SIZE;
+    std::string qname;
+    if (!readName(msg, len, &pos, &qname) || pos + 4 > len || qname != query.sent_name ||
+        read16(msg + pos) != query.qtype || read16(msg + pos + 2) != CLASS_IN) {
+        return ResponseAction::IGNORE;
+    }
+    pos += 4;
+
+    int rcode = flags & 0x0f;
+    result->rcode = rcode;
+    if (rcode == RCODE_NXDOMAIN) {
+        result->error_message = "Domain not found: " + query.name;
+        return ResponseAction::DONE;
+    }
+    if (rcode != 0) {
+        result->error_message = result->dns_server + " returned rcode " + std::to_string(rcode);
+        return ResponseAction::RETRY;
+    }
+
+    // 截断的应答只使用其中完整的记录
+    std::vector<Record> records;
+    uint16_t count = read16(msg + 6);
+    for (uint16_t i = 0; i < count; ++i) {
+        Record record;
+        if (!readName(msg, len, &pos, &record.owner) || pos + 10 > len) {
+            break;
+        }
+        record.type = read16(msg + pos);
+        record.ttl = read32(msg + pos + 4);
+        record.rdlength = read16(msg + pos + 8);
+        record.rdata = pos + 10;
+        if (record.rdata + record.rdlength > len) {
+            break;
+        }
+        pos = record.rdata + record.rdlength;
+        if (read16(msg + record.rdata - 8) == CLASS_IN) {
+            records.push_back(record);
+        }
+    }
+
+    // 沿CNAME链找到查询类型的记录
+    std::string current = query.name;
+    uint32_t ttl = UINT32_MAX;
+    for (int hop = 0; hop <= MAX_CNAME_HOPS; ++hop) {
+        const Record* cname = nullptr;
+        for (const auto& record : records) {
+            if (!sameName(record.owner, current)) {
+                continue;
+            }
+            const uint8_t* rdata = msg + record.rdata;
+            std::string value;
+            if (record.type == TYPE_CNAME) {
+                cname = &record;
+                continue;
+            } else if (record.type != query.qtype) {
+                continue;
+            } else if (record.type == TYPE_A && record.rdlength == 4) {
+                char text[INET_ADDRSTRLEN];
+                value = inet_ntop(AF_INET, rdata, text, sizeof(text));
+            } else if (record.type == TYPE_AAAA && record.rdlength == 16) {
+                char text[INET6_ADDRSTRLEN];
+                value = inet_ntop(AF_INET6, rdata, text, sizeof(text));
+            } else if (record.type == TYPE_PTR) {
+                size_t offset = record.rdata;
+                if (!readName(msg, len, &offset, &value)) {
+                    continue;
+                }
+            } else if (record.type == TYPE_SRV && record.rdlength >= 7) {
+                size_t offset = record.rdata + 6;
+                std::string target;
+                if (!readName(msg, len, &offset, &target)) {
+                    continue;
+                }
+                value = std::to_string(read16(rdata)) + " " + std::to_string(read16(rdata + 2)) + " " +
+                        std::to_string(read16(rdata + 4)) + " " + target;
+            } else {
+                continue;
+            }
+            result->ip_addresses.push_back(value);
+            ttl = std::min(ttl, record.ttl);
+        }
+        if (!result->ip_addresses.empty() || cname == nullptr) {
+            break;
+        }
+        size_t offset = cname->rdata;
+        if (!readName(msg, len, &offset, &current)) {
+            break;
+        }
+        ttl = std::min(ttl, cname->ttl);
+    }
+
+    // TCP的应答也截断时没有确定的结果
+    if (result->ip_addresses.empty() && (flags & FLAG_TC)) {
+        result->rcode = -1;
+        result->error_message = "Truncated response for " + query.name;
+        return ResponseAction::DONE;
+    }
+    if (result->ip_addresses.empty()) {
+        result->error_message = "No records found for " + query.name;
+        return ResponseAction::DONE;
+    }
+    result->ttl = static_cast<int>(std::min<uint32_t>(ttl, INT32_MAX));
+    result->success = true;
+    return ResponseAction::DONE;
+}
+
+bool DNSResolver::buildServer(const DNSServer& server, uint16_t port, Server* out) {
+    memset(&out->addr, 0, sizeof(out->addr));
+    out->address = server.ip_address;
+    out->srtt_ms = -1;
+    out->failure_rate = 0;
+    out->queries = 0;
+    out->failures = 0;
+    out->probing = false;
+    sockaddr_in* addr4 = reinterpret_cast<sockaddr_in*>(&out->addr);
+    sockaddr_in6* addr6 = reinterpret_cast<sockaddr_in6*>(&out->addr);
+    if (inet_pton(AF_INET, server.ip_address.c_str(), &addr4->sin_addr) == 1) {
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(port);
+        out->addr_len = sizeof(sockaddr_in);
+        return true;
+    }
+    if (inet_pton(AF_INET6, server.ip_address.c_str(), &addr6->sin6_addr) == 1) {
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port = htons(port);
+        out->addr_len = sizeof(sockaddr_in6);
+        return true;
+    }
+    return false;
+}
+
+int DNSResolver::createSocket(int family) {
+    int fd = socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    // 大量查询同时在途时，应答可能在一次epoll_wait之间集中到达
+    int size = SOCKET_RCVBUF;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    return fd;
+}
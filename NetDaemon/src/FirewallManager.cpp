@@ -2,9 +2,14 @@
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
+#include <cstdio>
+#include <cctype>
+#include <sys/wait.h>
 
 FirewallManager::FirewallManager()
-    : initialized_(false), next_rule_id_(1) {
+    : next_append_(1), next_insert_(-1), auto_commit_(true),
+      initialized_(false), next_rule_id_(1) {
 }
 
 FirewallManager::~FirewallManager() {
@@ -24,7 +29,7 @@ bool FirewallManager::initialize() {
     default_rule.protocol = "tcp";
     default_rule.action = "ACCEPT";
     default_rule.enabled = true;
-    firewall_rules_[default_rule.id] = default_rule;
+    stageRule(default_rule);
 
     initialized_ = true;
     return true;
@@ -39,22 +44,39 @@ std::vector<FirewallRule> FirewallManager::getFirewallRules() const {
 }
 
 bool FirewallManager::addFirewallRule(const FirewallRule& rule) {
-    std::string rule_id = rule.id.empty() ? ("rule_" + std::to_string(next_rule_id_++)) : rule.id;
-    
-    FirewallRule new_rule = rule;
-    new_rule.id = rule_id;
-    
-    // 执行iptables命令
-    std::string cmd = buildIptablesCommand(new_rule);
-    if (executeCommand(cmd)) {
-        firewall_rules_[rule_id] = new_rule;
-        if (firewall_callback_) {
+    if (!checkAddressSets(rule)) {
+        return false;
+    }
+    std::string rule_id = stageRule(rule);
+    if (auto_commit_ && !commit()) {
+        return false;
+    }
+    if (firewall_callback_) {
+        firewall_callback_(rule_id, true);
+    }
+    return true;
+}
+
+bool FirewallManager::addFirewallRules(const std::vector<FirewallRule>& rules) {
+    for (const auto& rule : rules) {
+        if (!checkAddressSets(rule)) {
+            return false;
+        }
+    }
+    std::vector<std::string> rule_ids;
+    rule_ids.reserve(rules.size());
+    for (const auto& rule : rules) {
+        rule_ids.push_back(stageRule(rule));
+    }
+    if (auto_commit_ && !commit()) {
+        return false;
+    }
+    if (firewall_callback_) {
+        for (const auto& rule_id : rule_ids) {
             firewall_callback_(rule_id, true);
         }
-        return true;
     }
-
-    return false;
+    return true;
 }
 
 bool FirewallManager::deleteFirewallRule(const std::string& rule_id) {
@@ -63,20 +85,17 @@ bool FirewallManager::deleteFirewallRule(const std::string& rule_id) {
         return false;
     }
 
-    // 执行删除命令
-    FirewallRule rule = it->second;
-    rule.operation = IptablesOperation::DELETE;
-    std::string cmd = buildIptablesCommand(rule);
-    
-    if (executeCommand(cmd)) {
-        firewall_rules_.erase(it);
-        if (firewall_callback_) {
-            firewall_callback_(rule_id, false);
-        }
-        return true;
+    invalidateClassifier(it->second.table, it->second.chain);
+    firewall_rules_.erase(it);
+    rule_positions_.erase(rule_id);
+    dirty_rules_.insert(rule_id);
+    if (auto_commit_ && !commit()) {
+        return false;
     }
-
-    return false;
+    if (firewall_callback_) {
+        firewall_callback_(rule_id, false);
+    }
+    return true;
 }
 
 bool FirewallManager::enableFirewallRule(const std::string& rule_id) {
@@ -84,10 +103,16 @@ bool FirewallManager::enableFirewallRule(const std::string& rule_id) {
     if (it == firewall_rules_.end()) {
         return false;
     }
+    if (it->second.enabled) {
+        return true;
+    }
 
+    // 与重新执行-A/-I一样，重新启用的规则放到链的末尾（INSERT为最前）
     it->second.enabled = true;
-    std::string cmd = buildIptablesCommand(it->second);
-    return executeCommand(cmd);
+    rule_positions_[rule_id] = nextPosition(it->second);
+    invalidateClassifier(it->second.table, it->second.chain);
+    dirty_rules_.insert(rule_id);
+    return !auto_commit_ || commit();
 }
 
 bool FirewallManager::disableFirewallRule(const std::string& rule_id) {
@@ -95,18 +120,455 @@ bool FirewallManager::disableFirewallRule(const std::string& rule_id) {
     if (it == firewall_rules_.end()) {
         return false;
     }
-
-    // 删除规则来禁用它
-    FirewallRule rule = it->second;
-    rule.operation = IptablesOperation::DELETE;
-    std::string cmd = buildIptablesCommand(rule);
-    
-    if (executeCommand(cmd)) {
-        it->second.enabled = false;
+    if (!it->second.enabled) {
         return true;
     }
 
-    return false;
+    // 从链中删除规则来禁用它
+    it->second.enabled = false;
+    invalidateClassifier(it->second.table, it->second.chain);
+    dirty_rules_.insert(rule_id);
+    return !auto_commit_ || commit();
+}
+
+void FirewallManager::setAutoCommit(bool auto_commit) {
+    auto_commit_ = auto_commit;
+}
+
+void FirewallManager::setRestoreCommand(const std::string& command) {
+    restore_command_ = command;
+}
+
+std::string FirewallManager::pendingRestorePayload() const {
+    CommitPlan plan;
+    planCommit(&plan);
+    std::string payload;
+    for (const auto& pair : plan.payloads) {
+        payload += pair.second;
+    }
+    return payload;
+}
+
+bool FirewallManager::commit() {
+    // 先下发集合，规则引用的集合须已存在。失败时保留命令下次重放（add/del都带
+    // -exist，重复执行结果相同），规则也留到下次提交
+    if (!ipset_pending_.empty()) {
+        if (!runRestore(ipset_command_, "ipset restore", ipset_pending_)) {
+            return false;
+        }
+        ipset_pending_.clear();
+    }
+
+    CommitPlan plan;
+    planCommit(&plan);
+
+    std::set<IptablesTable> failed_tables;
+    for (const auto& pair : plan.payloads) {
+        if (!executeRestore(pair.first, pair.second)) {
+            failed_tables.insert(pair.first);
+        }
+    }
+
+    // 成功的表更新已应用状态
+    for (const auto& rule_id : plan.removed) {
+        auto it = applied_rules_.find(rule_id);
+        if (it != applied_rules_.end() && failed_tables.count(it->second.chain.first) == 0) {
+            applied_rules_.erase(it);
+        }
+    }
+    for (const auto& rule_id : plan.added) {
+        const FirewallRule& rule = firewall_rules_.at(rule_id);
+        if (failed_tables.count(rule.table) != 0) {
+            continue;
+        }
+        AppliedRule& applied = applied_rules_[rule_id];
+        applied.chain = ChainKey(rule.table, rule.chain);
+        applied.spec = buildRuleSpec(rule);
+        applied.position = rule_positions_.at(rule_id);
+    }
+    for (const auto& chain : plan.rewritten) {
+        if (failed_tables.count(chain.first) != 0) {
+            continue;
+        }
+        synced_chains_.insert(chain);
+        pending_rewrites_.erase(chain);
+        hooked_chains_.insert(chain);
+    }
+
+    // 失败的表不知道执行到了哪里，涉及的链下次整链重写
+    if (!failed_tables.empty()) {
+        for (auto it = applied_rules_.begin(); it != applied_rules_.end();) {
+            if (failed_tables.count(it->second.chain.first) != 0) {
+                it = applied_rules_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (auto it = synced_chains_.begin(); it != synced_chains_.end();) {
+            if (failed_tables.count(it->first) != 0) {
+                pending_rewrites_.insert(*it);
+                it = synced_chains_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (const auto& chain : plan.rewritten) {
+            if (failed_tables.count(chain.first) != 0) {
+                pending_rewrites_.insert(chain);
+            }
+        }
+    }
+    dirty_rules_.clear();
+
+    // 不再被引用的集合在规则提交后才能删除。ipset restore在第一个失败的行停下，
+    // 先按原样create -exist，上次已删掉的集合重放时也不会失败
+    if (!failed_tables.empty()) {
+        return false;
+    }
+    if (!pending_set_destroys_.empty()) {
+        std::string destroys;
+        for (const auto& name : pending_set_destroys_) {
+            destroys += ipsetCreateLine(name);
+            destroys += "destroy " + name + "\n";
+        }
+        if (!runRestore(ipset_command_, "ipset restore (destroy)", destroys)) {
+            return false;
+        }
+        pending_set_destroys_.clear();
+    }
+    return true;
+}
+
+void FirewallManager::planCommit(CommitPlan* plan) const {
+    // 需要整链重写的链：之前失败的，以及这次涉及但还没有同步过的
+    std::set<ChainKey>& rewritten = plan->rewritten;
+    rewritten = pending_rewrites_;
+    for (const auto& rule_id : dirty_rules_) {
+        auto desired = firewall_rules_.find(rule_id);
+        if (desired != firewall_rules_.end() && desired->second.enabled) {
+            ChainKey chain(desired->second.table, desired->second.chain);
+            if (synced_chains_.count(chain) == 0) {
+                rewritten.insert(chain);
+            }
+        }
+    }
+
+    std::map<IptablesTable, std::string> declarations;
+    std::map<IptablesTable, std::string> lines;
+
+    // 整链重写：声明链（--noflush时会清空已有的链），按位置写入全部启用的规则
+    if (!rewritten.empty()) {
+        std::map<ChainKey, std::vector<std::pair<int64_t, const FirewallRule*>>> chain_rules;
+        for (const auto& pair : firewall_rules_) {
+            ChainKey chain(pair.second.table, pair.second.chain);
+            if (pair.second.enabled && rewritten.count(chain) != 0) {
+                chain_rules[chain].push_back(std::make_pair(rule_positions_.at(pair.first), &pair.second));
+            }
+        }
+        for (const auto& chain : rewritten) {
+            std::string own = getOwnChainName(chain.second);
+            declarations[chain.first] += ":" + own + " - [0:0]\n";
+            auto& rules = chain_rules[chain];
+            std::sort(rules.begin(), rules.end(),
+                [](const std::pair<int64_t, const FirewallRule*>& a, const std::pair<int64_t, const FirewallRule*>& b) {
+                    return a.first < b.first;
+                });
+            std::string& out = lines[chain.first];
+            for (const auto& item : rules) {
+                out += "-A " + own + " " + buildRuleSpec(*item.second) + "\n";
+                plan->added.push_back(item.second->id);
+            }
+            // 内置链跳转到我们的链，和链的内容在同一个事务里生效。restore载荷里不能先
+            // 检查（-C失败会中止整个事务），所以本进程只插入一次
+            if (hooked_chains_.count(chain) == 0) {
+                out += "-I " + getChainName(chain.second) + " -j " + own + "\n";
+            }
+        }
+        for (const auto& pair : applied_rules_) {
+            if (rewritten.count(pair.second.chain) != 0) {
+                plan->removed.push_back(pair.first);
+            }
+        }
+    }
+
+    // 其余的链只下发变化的规则：先删除，再按加入的先后添加
+    std::vector<std::pair<int64_t, const FirewallRule*>> additions;
+    for (const auto& rule_id : dirty_rules_) {
+        auto applied = applied_rules_.find(rule_id);
+        auto desired = firewall_rules_.find(rule_id);
+        bool wanted = desired != firewall_rules_.end() && desired->second.enabled;
+        ChainKey chain;
+        std::string spec;
+        int64_t position = 0;
+        if (wanted) {
+            chain = ChainKey(desired->second.table, desired->second.chain);
+            spec = buildRuleSpec(desired->second);
+            position = rule_positions_.at(rule_id);
+        }
+        bool unchanged = wanted && applied != applied_rules_.end() && applied->second.chain == chain &&
+                         applied->second.spec == spec && applied->second.position == position;
+        if (unchanged) {
+            continue;
+        }
+        if (applied != applied_rules_.end() && rewritten.count(applied->second.chain) == 0) {
+            lines[applied->second.chain.first] +=
+                "-D " + getOwnChainName(applied->second.chain.second) + " " + applied->second.spec + "\n";
+            plan->removed.push_back(rule_id);
+        }
+        if (wanted && rewritten.count(chain) == 0) {
+            additions.push_back(std::make_pair(position, &desired->second));
+        }
+    }
+    // INSERT按加入的先后逐条插到最前（位置-1、-2...），APPEND按先后追加
+    std::sort(additions.begin(), additions.end(),
+        [](const std::pair<int64_t, const FirewallRule*>& a, const std::pair<int64_t, const FirewallRule*>& b) {
+            if ((a.first < 0) != (b.first < 0)) {
+                return a.first < 0;
+            }
+            return a.first < 0 ? a.first > b.first : a.first < b.first;
+        });
+    for (const auto& item : additions) {
+        const FirewallRule& rule = *item.second;
+        std::string own = getOwnChainName(rule.chain);
+        if (item.first < 0) {
+            lines[rule.table] += "-I " + own + " 1 " + buildRuleSpec(rule) + "\n";
+        } else {
+            lines[rule.table] += "-A " + own + " " + buildRuleSpec(rule) + "\n";
+        }
+        plan->added.push_back(rule.id);
+    }
+
+    for (const auto& pair : lines) {
+        if (pair.second.empty() && declarations[pair.first].empty()) {
+            continue;
+        }
+        std::string& payload = plan->payloads[pair.first];
+        payload = "*" + getTableName(pair.first) + "\n" + declarations[pair.first] + pair.second + "COMMIT\n";
+    }
+}
+
+std::string FirewallManager::ipsetCreateLine(const std::string& name) const {
+    return "create " + name + " hash:net family inet maxelem 1048576 -exist\n";
+}
+
+void FirewallManager::setIpsetCommand(const std::string& command) {
+    ipset_command_ = command;
+}
+
+bool FirewallManager::createAddressSet(const std::string& name) {
+    if (name.empty() || name.size() > 31 || address_sets_.count(name) != 0) {
+        return false;
+    }
+    for (char c : name) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-' && c != '.') {
+            return false;
+        }
+    }
+
+    address_sets_[name] = AddressSet();
+    ipset_pending_ += ipsetCreateLine(name);
+    if (pending_set_destroys_.erase(name) != 0) {
+        // 内核中的同名集合还没删除，清掉旧成员
+        ipset_pending_ += "flush " + name + "\n";
+    }
+    return !auto_commit_ || commit();
+}
+
+bool FirewallManager::destroyAddressSet(const std::string& name) {
+    if (address_sets_.count(name) == 0) {
+        return false;
+    }
+    for (const auto& pair : firewall_rules_) {
+        if (pair.second.src_set == name || pair.second.dst_set == name) {
+            std::cerr << "[FirewallManager] Address set " << name << " is used by " << pair.first << std::endl;
+            return false;
+        }
+    }
+
+    address_sets_.erase(name);
+    pending_set_destroys_.insert(name);
+    return !auto_commit_ || commit();
+}
+
+bool FirewallManager::addToAddressSet(const std::string& name, const std::vector<std::string>& entries) {
+    auto it = address_sets_.find(name);
+    if (it == address_sets_.end()) {
+        return false;
+    }
+    std::vector<std::pair<uint32_t, int>> members(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (!AddressSet::parse(entries[i], &members[i].first, &members[i].second)) {
+            std::cerr << "[FirewallManager] Invalid address set entry: " << entries[i] << std::endl;
+            return false;
+        }
+    }
+
+    AddressSet& address_set = it->second;
+    address_set.reserve(members.size());
+    for (const auto& member : members) {
+        if (address_set.add(member.first, member.second)) {
+            ipset_pending_ += "add " + name + " " + AddressSet::format(member.first, member.second) + " -exist\n";
+        }
+    }
+    invalidateSetUsers(name);
+    return !auto_commit_ || commit();
+}
+
+bool FirewallManager::removeFromAddressSet(const std::string& name, const std::vector<std::string>& entries) {
+    auto it = address_sets_.find(name);
+    if (it == address_sets_.end()) {
+        return false;
+    }
+    std::vector<std::pair<uint32_t, int>> members(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (!AddressSet::parse(entries[i], &members[i].first, &members[i].second)) {
+            std::cerr << "[FirewallManager] Invalid address set entry: " << entries[i] << std::endl;
+            return false;
+        }
+    }
+
+    AddressSet& address_set = it->second;
+    for (const auto& member : members) {
+        if (address_set.remove(member.first, member.second)) {
+            ipset_pending_ += "del " + name + " " + AddressSet::format(member.first, member.second) + " -exist\n";
+        }
+    }
+    invalidateSetUsers(name);
+    return !auto_commit_ || commit();
+}
+
+const AddressSet* FirewallManager::getAddressSet(const std::string& name) const {
+    auto it = address_sets_.find(name);
+    return it == address_sets_.end() ? nullptr : &it->second;
+}
+
+bool FirewallManager::checkAddressSets(const FirewallRule& rule) const {
+    for (const std::string* name : {&rule.src_set, &rule.dst_set}) {
+        if (!name->empty() && address_sets_.count(*name) == 0) {
+            std::cerr << "[FirewallManager] Unknown address set: " << *name << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void FirewallManager::invalidateSetUsers(const std::string& name) {
+    for (const auto& pair : firewall_rules_) {
+        if (pair.second.src_set == name || pair.second.dst_set == name) {
+            invalidateClassifier(pair.second.table, pair.second.chain);
+        }
+    }
+}
+
+const FirewallRule* FirewallManager::classifyPacket(IptablesTable table, IptablesChain chain,
+                                                    const PacketTuple& packet) {
+    ChainKey key(table, chain);
+    ChainClassifier& classifier = classifiers_[key];
+    if (classifier.stale) {
+        rebuildClassifier(key, &classifier);
+    }
+    uint32_t min_priority = 0;
+    while (true) {
+        uint32_t index = classifier.classifier.classify(packet, min_priority);
+        if (index == PacketClassifier::NO_MATCH) {
+            return nullptr;
+        }
+        const SetCheck& check = classifier.set_checks[index];
+        if (check.set == nullptr || check.set->contains(check.source ? packet.src_ip : packet.dst_ip)) {
+            return classifier.rules[index];
+        }
+        // 没有展开的集合不包含该地址，从链中下一条规则继续找
+        min_priority = index + 1;
+    }
+}
+
+void FirewallManager::invalidateClassifier(IptablesTable table, IptablesChain chain) {
+    auto it = classifiers_.find(ChainKey(table, chain));
+    if (it != classifiers_.end()) {
+        it->second.stale = true;
+    }
+}
+
+void FirewallManager::rebuildClassifier(const ChainKey& chain, ChainClassifier* classifier) {
+    std::vector<std::pair<int64_t, const FirewallRule*>> rules;
+    for (const auto& pair : firewall_rules_) {
+        const FirewallRule& rule = pair.second;
+        if (rule.enabled && rule.table == chain.first && rule.chain == chain.second) {
+            rules.push_back(std::make_pair(rule_positions_.at(pair.first), &rule));
+        }
+    }
+    std::sort(rules.begin(), rules.end(),
+        [](const std::pair<int64_t, const FirewallRule*>& a, const std::pair<int64_t, const FirewallRule*>& b) {
+            return a.first < b.first;
+        });
+
+    classifier->classifier.clear();
+    classifier->rules.clear();
+    classifier->set_checks.clear();
+    size_t skipped = 0;
+    for (const auto& item : rules) {
+        const FirewallRule& rule = *item.second;
+        ClassifierRule match;
+        if (!ClassifierRule::parse(rule.protocol, rule.src_ip, rule.dst_ip, rule.src_port, rule.dst_port, &match) ||
+            (!rule.src_set.empty() && !rule.src_ip.empty()) || (!rule.dst_set.empty() && !rule.dst_ip.empty())) {
+            skipped++;
+            continue;
+        }
+        uint32_t index = static_cast<uint32_t>(classifier->rules.size());
+        classifier->rules.push_back(&rule);
+        SetCheck check = {nullptr, false};
+        if (rule.src_set.empty() && rule.dst_set.empty()) {
+            classifier->set_checks.push_back(check);
+            classifier->classifier.add(match, index, index);
+            continue;
+        }
+
+        // 引用集合的规则按集合成员展开，每个成员一条匹配条件；两边都引用集合时
+        // 只展开较小的一个，另一个不限地址，命中后再检查成员，避免两个集合的笛卡尔积
+        const AddressSet* src_set = rule.src_set.empty() ? nullptr : &address_sets_.at(rule.src_set);
+        const AddressSet* dst_set = rule.dst_set.empty() ? nullptr : &address_sets_.at(rule.dst_set);
+        bool expand_src = src_set != nullptr && (dst_set == nullptr || src_set->size() <= dst_set->size());
+        if (src_set != nullptr && dst_set != nullptr) {
+            check.set = expand_src ? dst_set : src_set;
+            check.source = !expand_src;
+        }
+        classifier->set_checks.push_back(check);
+        for (const auto& member : (expand_src ? src_set : dst_set)->members()) {
+            if (expand_src) {
+                match.src_ip = member.first;
+                match.src_len = member.second;
+            } else {
+                match.dst_ip = member.first;
+                match.dst_len = member.second;
+            }
+            classifier->classifier.add(match, index, index, check.set != nullptr);
+        }
+    }
+    if (skipped > 0) {
+        std::cerr << "[FirewallManager] " << skipped << " rules in " << getTableName(chain.first) << "/"
+                  << getChainName(chain.second) << " not supported by classifier, skipped" << std::endl;
+    }
+    classifier->stale = false;
+}
+
+std::string FirewallManager::stageRule(const FirewallRule& rule) {
+    std::string rule_id = rule.id.empty() ? ("rule_" + std::to_string(next_rule_id_++)) : rule.id;
+
+    FirewallRule new_rule = rule;
+    new_rule.id = rule_id;
+    auto existing = firewall_rules_.find(rule_id);
+    if (existing != firewall_rules_.end()) {
+        invalidateClassifier(existing->second.table, existing->second.chain);
+    }
+    invalidateClassifier(new_rule.table, new_rule.chain);
+    firewall_rules_[rule_id] = new_rule;
+    rule_positions_[rule_id] = nextPosition(new_rule);
+    dirty_rules_.insert(rule_id);
+    return rule_id;
+}
+
+int64_t FirewallManager::nextPosition(const FirewallRule& rule) {
+    return rule.operation == IptablesOperation::INSERT ? next_insert_-- : next_append_++;
 }
 
 bool FirewallManager::flushChain(IptablesTable table, IptablesChain chain) {
@@ -114,7 +576,34 @@ bool FirewallManager::flushChain(IptablesTable table, IptablesChain chain) {
     cmd << "iptables -t " << getTableName(table) 
         << " -F " << getChainName(chain);
     
-    return executeCommand(cmd.str());
+    if (!executeCommand(cmd.str())) {
+        return false;
+    }
+
+    // 内置链清空后跳转也没了，我们的链下次使用时整链重写并重新挂上
+    ChainKey key(table, chain);
+    for (auto it = firewall_rules_.begin(); it != firewall_rules_.end();) {
+        if (it->second.table == table && it->second.chain == chain) {
+            rule_positions_.erase(it->first);
+            dirty_rules_.erase(it->first);
+            it = firewall_rules_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = applied_rules_.begin(); it != applied_rules_.end();) {
+        if (it->second.chain == key) {
+            dirty_rules_.erase(it->first);
+            it = applied_rules_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    synced_chains_.erase(key);
+    pending_rewrites_.erase(key);
+    hooked_chains_.erase(key);
+    invalidateClassifier(table, chain);
+    return true;
 }
 
 bool FirewallManager::setDefaultPolicy(IptablesTable table, IptablesChain chain, 
@@ -243,39 +732,70 @@ void FirewallManager::registerCallback(FirewallCallback callback) {
     firewall_callback_ = callback;
 }
 
-std::string FirewallManager::buildIptablesCommand(const FirewallRule& rule) {
-    std::ostringstream cmd;
-    cmd << "iptables -t " << getTableName(rule.table)
-        << " " << getOperationName(rule.operation)
-        << " " << getChainName(rule.chain);
-
+std::string FirewallManager::buildRuleSpec(const FirewallRule& rule) const {
+    std::ostringstream spec;
     if (!rule.protocol.empty()) {
-        cmd << " -p " << rule.protocol;
+        spec << "-p " << rule.protocol << " ";
     }
 
     if (!rule.src_ip.empty()) {
-        cmd << " -s " << rule.src_ip;
+        spec << "-s " << rule.src_ip << " ";
     }
 
     if (!rule.dst_ip.empty()) {
-        cmd << " -d " << rule.dst_ip;
+        spec << "-d " << rule.dst_ip << " ";
     }
 
     if (!rule.src_port.empty()) {
-        cmd << " --sport " << rule.src_port;
+        spec << "--sport " << rule.src_port << " ";
     }
 
     if (!rule.dst_port.empty()) {
-        cmd << " --dport " << rule.dst_port;
+        spec << "--dport " << rule.dst_port << " ";
+    }
+
+    if (!rule.src_set.empty()) {
+        spec << "-m set --match-set " << rule.src_set << " src ";
+    }
+
+    if (!rule.dst_set.empty()) {
+        spec << "-m set --match-set " << rule.dst_set << " dst ";
     }
 
     if (!rule.extra_params.empty()) {
-        cmd << " " << rule.extra_params;
+        spec << rule.extra_params << " ";
     }
 
-    cmd << " -j " << rule.action;
+    spec << "-j " << rule.action;
+
+    return spec.str();
+}
 
-    return cmd.str();
+bool FirewallManager::executeRestore(IptablesTable table, const std::string& payload) {
+    return runRestore(restore_command_, "iptables-restore --noflush [" + getTableName(table) + "]", payload);
+}
+
+bool FirewallManager::runRestore(const std::string& command, const std::string& description,
+                                 const std::string& payload) {
+    if (command.empty()) {
+        // 模拟执行
+        size_t lines = static_cast<size_t>(std::count(payload.begin(), payload.end(), '\n'));
+        std::cout << "[FirewallManager] Executing: " << description << " (" << lines << " lines)" << std::endl;
+        return true;
+    }
+
+    FILE* pipe = popen(command.c_str(), "w");
+    if (!pipe) {
+        std::cerr << "[FirewallManager] Failed to run " << command << std::endl;
+        return false;
+    }
+    bool written = fwrite(payload.data(), 1, payload.size(), pipe) == payload.size();
+    int status = pclose(pipe);
+    if (!written || status == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::cerr << "[FirewallManager] " << description << " failed: " << command << std::endl;
+        return false;
+    }
+    return true;
 }
 
 bool FirewallManager::executeCommand(const std::string& command) {
@@ -285,7 +805,7 @@ bool FirewallManager::executeCommand(const std::string& command) {
     return true;
 }
 
-std::string FirewallManager::getTableName(IptablesTable table) {
+std::string FirewallManager::getTableName(IptablesTable table) const {
     switch (table) {
         case IptablesTable::FILTER: return "filter";
         case IptablesTable::NAT: return "nat";
@@ -295,7 +815,7 @@ std::string FirewallManager::getTableName(IptablesTable table) {
     }
 }
 
-std::string FirewallManager::getChainName(IptablesChain chain) {
+std::string FirewallManager::getChainName(IptablesChain chain) const {
     switch (chain) {
         case IptablesChain::INPUT: return "INPUT";
         case IptablesChain::OUTPUT: return "OUTPUT";
@@ -306,7 +826,11 @@ std::string FirewallManager::getChainName(IptablesChain chain) {
     }
 }
 
-std::string FirewallManager::getOperationName(IptablesOperation operation) {
+std::string FirewallManager::getOwnChainName(IptablesChain chain) const {
+    return "fw_" + getChainName(chain);
+}
+
+std::string FirewallManager::getOperationName(IptablesOperation operation) const {
     switch (operation) {
         case IptablesOperation::INSERT: return "-I";
         case IptablesOperation::APPEND: return "-A";
@@ -0,0 +1,284 @@
+#include "InterfaceStatsCollector.h"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// 初始读缓冲区，约可容纳400个接口，不够时加倍
+const size_t INITIAL_BUFFER_SIZE = 64 * 1024;
+// /proc/net/dev每行的计数器个数（接收8个，发送8个）
+const int PROC_NET_DEV_FIELDS = 16;
+// speed_fd的取值：尚未打开 / 该接口没有speed属性
+const int SPEED_FD_NONE = -1;
+const int SPEED_FD_UNAVAILABLE = -2;
+
+uint64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// 计数器变小说明接口重建或计数被复位，这一次不计差值
+uint64_t counterDelta(uint64_t current, uint64_t previous) {
+    return current >= previous ? current - previous : 0;
+}
+
+const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        ++p;
+    }
+    return p;
+}
+
+// 解析无符号十进制数，失败返回nullptr
+const char* parseNumber(const char* p, const char* end, uint64_t* value) {
+    p = skipSpaces(p, end);
+    if (p == end || *p < '0' || *p > '9') {
+        return nullptr;
+    }
+    uint64_t v = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = v * 10 + static_cast<uint64_t>(*p - '0');
+        ++p;
+    }
+    *value = v;
+    return p;
+}
+
+}  // namespace
+
+InterfaceStatsCollector::InterfaceStatsCollector()
+    : fd_(-1), sample_count_(0) {
+}
+
+InterfaceStatsCollector::~InterfaceStatsCollector() {
+    close();
+}
+
+bool InterfaceStatsCollector::open(const char* path) {
+    close();
+    fd_ = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        std::cerr << "[InterfaceStatsCollector] Failed to open " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (buffer_.size() < INITIAL_BUFFER_SIZE) {
+        buffer_.resize(INITIAL_BUFFER_SIZE);
+    }
+    return true;
+}
+
+void InterfaceStatsCollector::close() {
+    for (auto& s : samples_) {
+        if (s.speed_fd >= 0) {
+            ::close(s.speed_fd);
+        }
+    }
+    samples_.clear();
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+int InterfaceStatsCollector::sample() {
+    if (fd_ < 0) {
+        return -1;
+    }
+
+    // seq_file每次从偏移0重新生成内容；缓冲区读满说明可能还有，加倍后继续
+    size_t total = 0;
+    for (;;) {
+        ssize_t n = pread(fd_, &buffer_[total], buffer_.size() - total, static_cast<off_t>(total));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "[InterfaceStatsCollector] Read failed: " << strerror(errno) << std::endl;
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += static_cast<size_t>(n);
+        if (total == buffer_.size()) {
+            buffer_.resize(buffer_.size() * 2);
+        }
+    }
+
+    return parse(buffer_.data(), total, monotonicNs());
+}
+
+int InterfaceStatsCollector::parse(const char* buf, size_t len, uint64_t now_ns) {
+    const char* p = buf;
+    const char* end = buf + len;
+
+    // 跳过两行表头
+    for (int i = 0; i < 2; ++i) {
+        const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (nl == nullptr) {
+            return -1;
+        }
+        p = nl + 1;
+    }
+
+    for (auto& s : samples_) {
+        s.seen = false;
+    }
+
+    size_t index = 0;
+    while (p < end) {
+        const char* line_end = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (line_end == nullptr) {
+            line_end = end;
+        }
+        const char* name = skipSpaces(p, line_end);
+        if (name == line_end) {
+            p = line_end + 1;
+            continue;
+        }
+        const char* colon = static_cast<const char*>(memchr(name, ':', line_end - name));
+        if (colon == nullptr || colon == name || static_cast<size_t>(colon - name) >= InterfaceSample::NAME_SIZE) {
+            return -1;
+        }
+
+        uint64_t fields[PROC_NET_DEV_FIELDS];
+        const char* q = colon + 1;
+        for (int i = 0; i < PROC_NET_DEV_FIELDS; ++i) {
+            q = parseNumber(q, line_end, &fields[i]);
+            if (q == nullptr) {
+                return -1;
+            }
+        }
+
+        InterfaceCounters counters;
+        counters.rx_bytes = fields[0];
+        counters.rx_packets = fields[1];
+        counters.rx_errors = fields[2];
+        counters.rx_dropped = fields[3];
+        counters.tx_bytes = fields[8];
+        counters.tx_packets = fields[9];
+        counters.tx_errors = fields[10];
+        counters.tx_dropped = fields[11];
+
+        bool created = false;
+        InterfaceSample* s = lookup(name, colon - name, index, &created);
+        if (!created) {
+            const InterfaceCounters& prev = s->counters;
+            s->delta.rx_bytes = counterDelta(counters.rx_bytes, prev.rx_bytes);
+            s->delta.rx_packets = counterDelta(counters.rx_packets, prev.rx_packets);
+            s->delta.rx_errors = counterDelta(counters.rx_errors, prev.rx_errors);
+            s->delta.rx_dropped = counterDelta(counters.rx_dropped, prev.rx_dropped);
+            s->delta.tx_bytes = counterDelta(counters.tx_bytes, prev.tx_bytes);
+            s->delta.tx_packets = counterDelta(counters.tx_packets, prev.tx_packets);
+            s->delta.tx_errors = counterDelta(counters.tx_errors, prev.tx_errors);
+            s->delta.tx_dropped = counterDelta(counters.tx_dropped, prev.tx_dropped);
+            if (now_ns > s->sample_ns) {
+                double seconds = static_cast<double>(now_ns - s->sample_ns) / 1e9;
+                s->rates.rx_bps = static_cast<double>(s->delta.rx_bytes) * 8 / seconds;
+                s->rates.tx_bps = static_cast<double>(s->delta.tx_bytes) * 8 / seconds;
+                s->rates.rx_pps = static_cast<double>(s->delta.rx_packets) / seconds;
+                s->rates.tx_pps = static_cast<double>(s->delta.tx_packets) / seconds;
+            }
+            s->has_previous = true;
+        }
+        s->counters = counters;
+        s->sample_ns = now_ns;
+        s->seen = true;
+
+        ++index;
+        p = line_end + 1;
+    }
+
+    if (index != samples_.size()) {
+        removeMissing();
+    }
+    ++sample_count_;
+    return static_cast<int>(index);
+}
+
+int InterfaceStatsCollector::readLinkSpeeds() {
+    int count = 0;
+    char path[64];
+    char value[32];
+    for (auto& s : samples_) {
+        if (s.speed_fd == SPEED_FD_NONE) {
+            snprintf(path, sizeof(path), "/sys/class/net/%s/speed", s.name);
+            s.speed_fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (s.speed_fd < 0) {
+                s.speed_fd = SPEED_FD_UNAVAILABLE;
+            }
+        }
+        s.link_speed = -1;
+        if (s.speed_fd < 0) {
+            continue;
+        }
+        // 虚拟接口和未连接的接口读取时返回EINVAL
+        ssize_t n = pread(s.speed_fd, value, sizeof(value) - 1, 0);
+        if (n <= 0) {
+            continue;
+        }
+        value[n] = '\0';
+        int speed = 0;
+        if (sscanf(value, "%d", &speed) == 1 && speed > 0) {
+            s.link_speed = speed;
+            ++count;
+        }
+    }
+    return count;
+}
+
+const InterfaceSample* InterfaceStatsCollector::find(const char* name) const {
+    for (const auto& s : samples_) {
+        if (strncmp(s.name, name, InterfaceSample::NAME_SIZE) == 0) {
+            return &s;
+        }
+    }
+    return nullptr;
+}
+
+InterfaceSample* InterfaceStatsCollector::lookup(const char* name, size_t name_len, size_t hint, bool* created) {
+    if (hint < samples_.size()) {
+        InterfaceSample& s = samples_[hint];
+        if (strncmp(s.name, name, name_len) == 0 && s.name[name_len] == '\0') {
+            return &s;
+        }
+    }
+    for (auto& s : samples_) {
+        if (!s.seen && strncmp(s.name, name, name_len) == 0 && s.name[name_len] == '\0') {
+            return &s;
+        }
+    }
+
+    // 新接口，放在预期位置，下次采样时顺序匹配
+    *created = true;
+    InterfaceSample s;
+    memset(&s, 0, sizeof(s));
+    memcpy(s.name, name, name_len);
+    s.link_speed = -1;
+    s.speed_fd = SPEED_FD_NONE;
+    size_t pos = hint < samples_.size() ? hint : samples_.size();
+    return &*samples_.insert(samples_.begin() + pos, s);
+}
+
+void InterfaceStatsCollector::removeMissing() {
+    size_t out = 0;
+    for (size_t i = 0; i < samples_.size(); ++i) {
+        if (!samples_[i].seen) {
+            if (samples_[i].speed_fd >= 0) {
+                ::close(samples_[i].speed_fd);
+            }
+            continue;
+        }
+        if (out != i) {
+            samples_[out] = samples_[i];
+        }
+        ++out;
+    }
+    samples_.resize(out);
+}
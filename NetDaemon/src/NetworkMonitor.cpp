@@ -12,17 +12,60 @@
 #include <netdb.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <poll.h>
+
+// <linux/if.h>里定义，但它与<net/if.h>不能同时包含
+#ifndef IFF_LOWER_UP
+#define IFF_LOWER_UP 0x10000
+#endif
+
+namespace {
+
+// 接收缓冲区，一次recv可以拿到多条消息
+const size_t NETLINK_BUFFER_SIZE = 32 * 1024;
+// 内核socket接收缓冲区，减少突发时的ENOBUFS
+const int NETLINK_RCVBUF = 1024 * 1024;
+// 默认去抖时间（毫秒）
+const int DEFAULT_DEBOUNCE_MS = 5;
+// initialize()等待初始dump的最长时间（毫秒）
+const int DUMP_TIMEOUT_MS = 1000;
+// 持续采样时刷新链路速度的间隔（毫秒）
+const int LINK_SPEED_REFRESH_MS = 10000;
+
+std::string addressToString(int family, const void* data) {
+    char buf[INET6_ADDRSTRLEN] = {0};
+    if (inet_ntop(family, data, buf, sizeof(buf)) == nullptr) {
+        return "";
+    }
+    return buf;
+}
+
+}  // namespace
 
 NetworkMonitor::NetworkMonitor()
-    : initialized_(false), running_(false), monitoring_interval_(5) {
+    : initialized_(false), running_(false), monitoring_interval_(5),
+      netlink_fd_(-1), epoll_fd_(-1), event_fd_(-1), timer_fd_(-1),
+      timer_armed_(false), debounce_ms_(DEFAULT_DEBOUNCE_MS),
+      dump_stage_(DUMP_NONE), dump_seq_(0),
+      stats_timer_fd_(-1), stats_interval_ms_(0) {
     monitor_stats_.running = false;
     monitor_stats_.monitoring_interval = monitoring_interval_;
     monitor_stats_.total_events = 0;
     monitor_stats_.connection_changes = 0;
+    monitor_stats_.netlink_messages = 0;
+    monitor_stats_.resyncs = 0;
+    monitor_stats_.stats_samples = 0;
 }
 
 NetworkMonitor::~NetworkMonitor() {
     stop();
+    closeNetlink();
 }
 
 bool NetworkMonitor::initialize() {
@@ -42,30 +85,89 @@ bool NetworkMonitor::start() {
     if (running_) {
         return true;
     }
+    // 监控线程因netlink出错退出后，先回收它再重新启动
+    stop();
+    if (!initialized_) {
+        initialize();
+    }
+    if (netlink_fd_ < 0) {
+        std::cerr << "[NetworkMonitor] Netlink not available, state changes are not monitored" << std::endl;
+        return false;
+    }
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    stats_timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epoll_fd_ < 0 || event_fd_ < 0 || timer_fd_ < 0 || stats_timer_fd_ < 0) {
+        std::cerr << "[NetworkMonitor] Failed to create epoll/eventfd/timerfd: " << strerror(errno) << std::endl;
+        closeNetlink();
+        return false;
+    }
+    int fds[] = {netlink_fd_, event_fd_, timer_fd_, stats_timer_fd_};
+    for (int fd : fds) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+    }
 
     running_ = true;
-    monitor_stats_.running = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        monitor_stats_.running = true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        armStatsTimer();
+    }
+    monitor_thread_ = std::thread(&NetworkMonitor::monitorLoop, this);
     std::cout << "[NetworkMonitor] Started network monitoring" << std::endl;
 
-    // 在实际实现中，这里会启动一个监控线程
-    // 定期调用 detectStateChanges() 和 refreshStatus()
-
     return true;
 }
 
 bool NetworkMonitor::stop() {
-    if (!running_) {
-        return true;
+    // 监控线程出错时自己把running_置为false，此时仍需要join
+    bool was_running = running_.exchange(false);
+    if (monitor_thread_.joinable()) {
+        uint64_t one = 1;
+        if (write(event_fd_, &one, sizeof(one)) < 0) {
+            std::cerr << "[NetworkMonitor] Failed to wake monitor thread: " << strerror(errno) << std::endl;
+        }
+        monitor_thread_.join();
     }
 
-    running_ = false;
-    monitor_stats_.running = false;
-    std::cout << "[NetworkMonitor] Stopped network monitoring" << std::endl;
+    // netlink套接字保留，停止后仍用于同步dump
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int* fds[] = {&epoll_fd_, &event_fd_, &timer_fd_};
+        for (int* fd : fds) {
+            if (*fd >= 0) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+        timer_armed_ = false;
+        monitor_stats_.running = false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        if (stats_timer_fd_ >= 0) {
+            close(stats_timer_fd_);
+            stats_timer_fd_ = -1;
+        }
+    }
+    if (was_running) {
+        std::cout << "[NetworkMonitor] Stopped network monitoring" << std::endl;
+    }
 
     return true;
 }
 
 std::vector<NetworkConnection> NetworkMonitor::getConnections() const {
+    std::lock_guard<std::mutex> lock(mutex_);
     std::vector<NetworkConnection> result;
     for (const auto& pair : connections_) {
         result.push_back(pair.second);
@@ -73,24 +175,55 @@ std::vector<NetworkConnection> NetworkMonitor::getConnections() const {
     return result;
 }
 
-NetworkConnection* NetworkMonitor::getConnection(const std::string& network_id) {
+bool NetworkMonitor::getConnection(const std::string& network_id, NetworkConnection* out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto it = connections_.find(network_id);
-    if (it != connections_.end()) {
-        return &it->second;
+    if (it == connections_.end()) {
+        return false;
     }
-    return nullptr;
+    *out = it->second;
+    return true;
 }
 
-NetworkConnection* NetworkMonitor::getConnectionByInterface(const std::string& interface) {
-    for (auto& pair : connections_) {
+bool NetworkMonitor::getConnectionByInterface(const std::string& interface, NetworkConnection* out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& pair : connections_) {
         if (pair.second.interface == interface) {
-            return &pair.second;
+            *out = pair.second;
+            return true;
         }
     }
-    return nullptr;
+    return false;
 }
 
 NetworkStats NetworkMonitor::getNetworkStats(const std::string& interface) {
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        if (stats_collector_.isOpen()) {
+            if (stats_interval_ms_ == 0 || !running_) {
+                sampleCollector();
+            }
+            InterfaceCounters counters;
+            memset(&counters, 0, sizeof(counters));
+            const InterfaceSample* sample = stats_collector_.find(interface.c_str());
+            if (sample) {
+                counters = sample->counters;
+            }
+            NetworkStats result;
+            result.interface = interface;
+            result.rx_bytes = counters.rx_bytes;
+            result.tx_bytes = counters.tx_bytes;
+            result.rx_packets = counters.rx_packets;
+            result.tx_packets = counters.tx_packets;
+            result.rx_errors = counters.rx_errors;
+            result.tx_errors = counters.tx_errors;
+            result.rx_dropped = counters.rx_dropped;
+            result.tx_dropped = counters.tx_dropped;
+            return result;
+        }
+    }
+
+    // 无法读取/proc/net/dev时使用模拟数据
     auto it = stats_.find(interface);
     if (it != stats_.end()) {
         return it->second;
@@ -111,6 +244,50 @@ NetworkStats NetworkMonitor::getNetworkStats(const std::string& interface) {
     return empty_stats;
 }
 
+InterfaceRates NetworkMonitor::getNetworkRates(const std::string& interface) {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    if (stats_collector_.isOpen() && (stats_interval_ms_ == 0 || !running_)) {
+        sampleCollector();
+    }
+    InterfaceRates rates;
+    memset(&rates, 0, sizeof(rates));
+    const InterfaceSample* sample = stats_collector_.find(interface.c_str());
+    if (sample && sample->has_previous) {
+        rates = sample->rates;
+    }
+    return rates;
+}
+
+size_t NetworkMonitor::getTrafficHistory(const std::string& interface, HistoryMetric metric,
+                                         HistoryResolution resolution, int window_seconds,
+                                         HistoryPoint* out, size_t max_points) const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return traffic_history_.query(interface.c_str(), metric, resolution, window_seconds, out, max_points);
+}
+
+bool NetworkMonitor::getTrafficSummary(const std::string& interface, HistoryMetric metric, int window_seconds,
+                                       HistorySummary* out) const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return traffic_history_.summarize(interface.c_str(), metric, window_seconds, out);
+}
+
+bool NetworkMonitor::getTrafficPercentile(const std::string& interface, HistoryMetric metric, int window_seconds,
+                                          double percentile, double* value) {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return traffic_history_.percentile(interface.c_str(), metric, window_seconds, percentile, value);
+}
+
+bool NetworkMonitor::setStatsSamplingInterval(int interval_ms) {
+    if (interval_ms < 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_interval_ms_ = interval_ms;
+    armStatsTimer();
+    std::cout << "[NetworkMonitor] Stats sampling interval set to " << interval_ms << " ms" << std::endl;
+    return true;
+}
+
 bool NetworkMonitor::refreshStatus() {
     readNetworkStatus();
     readNetworkStats();
@@ -118,6 +295,58 @@ bool NetworkMonitor::refreshStatus() {
     return true;
 }
 
+int NetworkMonitor::handleNetlinkBuffer(const void* buf, size_t len) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const char* data = static_cast<const char*>(buf);
+    size_t offset = 0;
+    int handled = 0;
+    while (len - offset >= sizeof(struct nlmsghdr)) {
+        const struct nlmsghdr* nlh = reinterpret_cast<const struct nlmsghdr*>(data + offset);
+        if (nlh->nlmsg_len < sizeof(struct nlmsghdr) || nlh->nlmsg_len > len - offset) {
+            std::cerr << "[NetworkMonitor] Malformed netlink message" << std::endl;
+            return -1;
+        }
+        handleNetlinkMessage(nlh);
+        handled++;
+        offset += NLMSG_ALIGN(nlh->nlmsg_len);
+        if (offset > len) {
+            break;
+        }
+    }
+    monitor_stats_.netlink_messages += handled;
+    if (!dirty_links_.empty()) {
+        armDebounceTimer();
+    }
+    return handled;
+}
+
+int NetworkMonitor::flushPendingEvents() {
+    std::vector<NetworkEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        applyPendingChanges(&events);
+    }
+    // 回调在锁外执行，回调里可以查询连接信息
+    for (const auto& event : events) {
+        triggerEvent(event);
+        if (connection_callback_ && (event.type == NetworkEventType::CONNECTION_ESTABLISHED ||
+                                     event.type == NetworkEventType::CONNECTION_LOST)) {
+            connection_callback_(event.network_id, event.type == NetworkEventType::CONNECTION_ESTABLISHED);
+        }
+    }
+    return static_cast<int>(events.size());
+}
+
+bool NetworkMonitor::setDebounceInterval(int debounce_ms) {
+    if (debounce_ms < 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    debounce_ms_ = debounce_ms;
+    std::cout << "[NetworkMonitor] Debounce interval set to " << debounce_ms << " ms" << std::endl;
+    return true;
+}
+
 bool NetworkMonitor::checkConnectivity(const std::string& host) {
     std::cout << "[NetworkMonitor] Checking connectivity to " << host << std::endl;
 
@@ -209,17 +438,24 @@ bool NetworkMonitor::checkConnectivity(const std::string& host) {
 }
 
 int NetworkMonitor::getSignalStrength(const std::string& interface) {
-    auto* conn = getConnectionByInterface(interface);
-    if (conn) {
-        return conn->signal_strength;
+    NetworkConnection conn;
+    if (getConnectionByInterface(interface, &conn)) {
+        return conn.signal_strength;
     }
     return -1;
 }
 
 int NetworkMonitor::getLinkSpeed(const std::string& interface) {
-    auto* conn = getConnectionByInterface(interface);
-    if (conn) {
-        return conn->link_speed;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        const InterfaceSample* sample = stats_collector_.find(interface.c_str());
+        if (sample && sample->link_speed > 0) {
+            return sample->link_speed;
+        }
+    }
+    NetworkConnection conn;
+    if (getConnectionByInterface(interface, &conn)) {
+        return conn.link_speed;
     }
     return 0;
 }
@@ -242,24 +478,29 @@ void NetworkMonitor::registerConnectionCallback(ConnectionCallback callback) {
     connection_callback_ = callback;
 }
 
-NetworkConnection* NetworkMonitor::getActiveConnection() {
-    for (auto& pair : connections_) {
+bool NetworkMonitor::getActiveConnection(NetworkConnection* out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& pair : connections_) {
         if (pair.second.state == NetworkState::CONNECTED) {
-            return &pair.second;
+            *out = pair.second;
+            return true;
         }
     }
-    return nullptr;
+    return false;
 }
 
 bool NetworkMonitor::simulateStateChange(const std::string& network_id, NetworkState new_state) {
-    auto* conn = getConnection(network_id);
-    if (!conn) {
-        return false;
+    std::string old_state;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = connections_.find(network_id);
+        if (it == connections_.end()) {
+            return false;
+        }
+        old_state = getStateString(it->second.state);
+        it->second.state = new_state;
     }
 
-    std::string old_state = getStateString(conn->state);
-    conn->state = new_state;
-
     // 触发事件
     NetworkEvent event;
     event.type = NetworkEventType::STATE_CHANGED;
@@ -275,6 +516,7 @@ bool NetworkMonitor::simulateStateChange(const std::string& network_id, NetworkS
         if (connection_callback_) {
             connection_callback_(network_id, new_state == NetworkState::CONNECTED);
         }
+        std::lock_guard<std::mutex> lock(mutex_);
         monitor_stats_.connection_changes++;
     }
 
@@ -285,12 +527,56 @@ bool NetworkMonitor::simulateStateChange(const std::string& network_id, NetworkS
 }
 
 NetworkMonitor::MonitorStats NetworkMonitor::getMonitorStats() const {
-    return monitor_stats_;
+    MonitorStats stats;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats = monitor_stats_;
+    }
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats.stats_samples = stats_collector_.sampleCount();
+    return stats;
 }
 
 void NetworkMonitor::readNetworkStatus() {
-    // 模拟读取网络状态
-    // 实际实现中会读取 /sys/class/net 或使用 netlink socket
+    if (running_) {
+        // 监控线程在运行，重新dump由它读取
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (dump_stage_ == DUMP_NONE) {
+            startDump(DUMP_LINK);
+        }
+        return;
+    }
+
+    if (netlink_fd_ >= 0 || openNetlink()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            startDump(DUMP_LINK);
+        }
+        // 同步等待link/address/route三轮dump完成
+        struct pollfd pfd;
+        pfd.fd = netlink_fd_;
+        pfd.events = POLLIN;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (dump_stage_ == DUMP_NONE) {
+                    break;
+                }
+            }
+            if (poll(&pfd, 1, DUMP_TIMEOUT_MS) <= 0 || !readNetlink()) {
+                std::cerr << "[NetworkMonitor] Netlink dump did not complete" << std::endl;
+                break;
+            }
+        }
+        // 初始状态不产生事件
+        std::lock_guard<std::mutex> lock(mutex_);
+        applyPendingChanges(nullptr);
+        return;
+    }
+
+    // 没有netlink（非Linux或受限环境）时使用模拟数据
+    std::cout << "[NetworkMonitor] Netlink not available, using simulated status" << std::endl;
+    std::lock_guard<std::mutex> lock(mutex_);
 
     // 添加WiFi连接
     NetworkConnection wifi_conn;
@@ -320,8 +606,16 @@ void NetworkMonitor::readNetworkStatus() {
 }
 
 void NetworkMonitor::readNetworkStats() {
-    // 模拟读取网络统计信息
-    // 实际实现中会读取 /proc/net/dev
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        if (stats_collector_.isOpen() || stats_collector_.open()) {
+            sampleCollector();
+            stats_collector_.readLinkSpeeds();
+            return;
+        }
+    }
+
+    // 没有/proc/net/dev时使用模拟的统计信息
 
     // WiFi统计
     NetworkStats wifi_stats;
@@ -351,12 +645,479 @@ void NetworkMonitor::readNetworkStats() {
 }
 
 void NetworkMonitor::detectStateChanges() {
-    // 在实际实现中，这里会比较之前和当前的网络状态
-    // 检测变化并触发相应的事件
+    // 状态变化由netlink消息驱动，这里只处理去抖中尚未产生的事件
+    flushPendingEvents();
+}
+
+bool NetworkMonitor::openNetlink() {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        std::cerr << "[NetworkMonitor] Failed to open netlink socket: " << strerror(errno) << std::endl;
+        return false;
+    }
+    int rcvbuf = NETLINK_RCVBUF;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR |
+                     RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        std::cerr << "[NetworkMonitor] Failed to bind netlink socket: " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+    netlink_fd_ = fd;
+    return true;
+}
+
+void NetworkMonitor::closeNetlink() {
+    int* fds[] = {&netlink_fd_, &epoll_fd_, &event_fd_, &timer_fd_, &stats_timer_fd_};
+    for (int* fd : fds) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+    timer_armed_ = false;
+}
+
+void NetworkMonitor::startDump(DumpStage stage) {
+    dump_stage_ = stage;
+    if (stage == DUMP_NONE) {
+        return;
+    }
+
+    // 每轮dump前清除该类信息，dump结束时未出现的即为已删除
+    for (auto& pair : links_) {
+        LinkState& link = pair.second;
+        if (stage == DUMP_LINK) {
+            link.seen = false;
+        } else if (stage == DUMP_ADDR && !link.addresses.empty()) {
+            link.addresses.clear();
+            dirty_links_.insert(pair.first);
+        } else if (stage == DUMP_ROUTE && !link.gateway.empty()) {
+            link.gateway.clear();
+            dirty_links_.insert(pair.first);
+        }
+    }
+    if (netlink_fd_ < 0) {
+        return;
+    }
+
+    struct {
+        struct nlmsghdr nlh;
+        struct rtgenmsg gen;
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = sizeof(req);
+    req.nlh.nlmsg_type = stage == DUMP_LINK ? RTM_GETLINK : (stage == DUMP_ADDR ? RTM_GETADDR : RTM_GETROUTE);
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nlh.nlmsg_seq = ++dump_seq_;
+    req.gen.rtgen_family = AF_UNSPEC;
+    if (send(netlink_fd_, &req, sizeof(req), 0) < 0) {
+        std::cerr << "[NetworkMonitor] Failed to request netlink dump: " << strerror(errno) << std::endl;
+        dump_stage_ = DUMP_NONE;
+    }
+}
+
+bool NetworkMonitor::readNetlink() {
+    char buf[NETLINK_BUFFER_SIZE];
+    while (true) {
+        ssize_t n = recv(netlink_fd_, buf, sizeof(buf), 0);
+        if (n > 0) {
+            handleNetlinkBuffer(buf, static_cast<size_t>(n));
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        if (n < 0 && errno == ENOBUFS) {
+            // 内核丢弃了消息，重新dump全部状态
+            std::cerr << "[NetworkMonitor] Netlink receive buffer overrun, resyncing" << std::endl;
+            std::lock_guard<std::mutex> lock(mutex_);
+            monitor_stats_.resyncs++;
+            startDump(DUMP_LINK);
+            continue;
+        }
+        std::cerr << "[NetworkMonitor] Netlink receive failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+}
+
+void NetworkMonitor::monitorLoop() {
+    struct epoll_event events[5];
+    while (running_) {
+        int n = epoll_wait(epoll_fd_, events, 5, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "[NetworkMonitor] epoll_wait failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        bool flush = false;
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == netlink_fd_) {
+                if (!readNetlink()) {
+                    // 由stop()回收线程和文件描述符
+                    running_ = false;
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    monitor_stats_.running = false;
+                }
+                std::lock_guard<std::mutex> lock(mutex_);
+                flush = debounce_ms_ == 0 && !dirty_links_.empty();
+            } else if (fd == stats_timer_fd_) {
+                uint64_t expirations;
+                if (read(stats_timer_fd_, &expirations, sizeof(expirations)) > 0) {
+                    sampleStats();
+                }
+            } else if (fd == timer_fd_) {
+                uint64_t expirations;
+                if (read(timer_fd_, &expirations, sizeof(expirations)) > 0) {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    timer_armed_ = false;
+                    flush = true;
+                }
+            }
+        }
+        if (flush) {
+            flushPendingEvents();
+        }
+    }
+}
+
+void NetworkMonitor::handleNetlinkMessage(const nlmsghdr* nlh) {
+    switch (nlh->nlmsg_type) {
+        case NLMSG_DONE:
+            // dump按 link -> address -> route 顺序进行
+            if (dump_stage_ == DUMP_LINK) {
+                for (auto& pair : links_) {
+                    if (pair.second.present && !pair.second.seen) {
+                        pair.second.present = false;
+                        dirty_links_.insert(pair.first);
+                    }
+                }
+                startDump(DUMP_ADDR);
+            } else if (dump_stage_ == DUMP_ADDR) {
+                startDump(DUMP_ROUTE);
+            } else if (dump_stage_ == DUMP_ROUTE) {
+                startDump(DUMP_NONE);
+            }
+            break;
+        case NLMSG_ERROR: {
+            if (nlh->nlmsg_len >= NLMSG_LENGTH(sizeof(struct nlmsgerr))) {
+                const struct nlmsgerr* err = static_cast<const struct nlmsgerr*>(NLMSG_DATA(nlh));
+                if (err->error != 0) {
+                    std::cerr << "[NetworkMonitor] Netlink error: " << strerror(-err->error) << std::endl;
+                    if (dump_stage_ != DUMP_NONE) {
+                        startDump(DUMP_NONE);
+                    }
+                }
+            }
+            break;
+        }
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+            handleLinkMessage(nlh);
+            break;
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+            handleAddrMessage(nlh);
+            break;
+        case RTM_NEWROUTE:
+        case RTM_DELROUTE:
+            handleRouteMessage(nlh);
+            break;
+        default:
+            break;
+    }
+}
+
+void NetworkMonitor::handleLinkMessage(const nlmsghdr* nlh) {
+    if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg))) {
+        return;
+    }
+    const struct ifinfomsg* ifi = static_cast<const struct ifinfomsg*>(NLMSG_DATA(nlh));
+    if (ifi->ifi_flags & IFF_LOOPBACK) {
+        return;
+    }
+
+    std::string name;
+    int len = static_cast<int>(IFLA_PAYLOAD(nlh));
+    for (const struct rtattr* rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if (rta->rta_type == IFLA_IFNAME) {
+            name.assign(static_cast<const char*>(RTA_DATA(rta)), strnlen(static_cast<const char*>(RTA_DATA(rta)), RTA_PAYLOAD(rta)));
+        }
+    }
+
+    LinkState& link = links_[ifi->ifi_index];
+    if (nlh->nlmsg_type == RTM_DELLINK) {
+        link.present = false;
+    } else {
+        if (!name.empty()) {
+            link.name = name;
+        }
+        link.flags = ifi->ifi_flags;
+        link.present = true;
+        link.seen = true;
+    }
+    dirty_links_.insert(ifi->ifi_index);
+}
+
+void NetworkMonitor::handleAddrMessage(const nlmsghdr* nlh) {
+    if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifaddrmsg))) {
+        return;
+    }
+    const struct ifaddrmsg* ifa = static_cast<const struct ifaddrmsg*>(NLMSG_DATA(nlh));
+    auto it = links_.find(static_cast<int>(ifa->ifa_index));
+    if (it == links_.end()) {
+        return;
+    }
+
+    // IFA_LOCAL是本端地址（点对点接口上IFA_ADDRESS是对端）
+    std::string address;
+    std::string local;
+    int len = static_cast<int>(IFA_PAYLOAD(nlh));
+    for (const struct rtattr* rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if (rta->rta_type == IFA_ADDRESS) {
+            address = addressToString(ifa->ifa_family, RTA_DATA(rta));
+        } else if (rta->rta_type == IFA_LOCAL) {
+            local = addressToString(ifa->ifa_family, RTA_DATA(rta));
+        }
+    }
+    if (!local.empty()) {
+        address = local;
+    }
+    if (address.empty() || (ifa->ifa_family == AF_INET6 && ifa->ifa_scope == RT_SCOPE_LINK)) {
+        return;
+    }
+
+    std::vector<std::string>& addresses = it->second.addresses;
+    auto pos = std::find(addresses.begin(), addresses.end(), address);
+    if (nlh->nlmsg_type == RTM_NEWADDR && pos == addresses.end()) {
+        // IPv4地址排在前面，作为连接的ip_address
+        if (ifa->ifa_family == AF_INET) {
+            addresses.insert(addresses.begin(), address);
+        } else {
+            addresses.push_back(address);
+        }
+        dirty_links_.insert(it->first);
+    } else if (nlh->nlmsg_type == RTM_DELADDR && pos != addresses.end()) {
+        addresses.erase(pos);
+        dirty_links_.insert(it->first);
+    }
+}
+
+void NetworkMonitor::handleRouteMessage(const nlmsghdr* nlh) {
+    if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(struct rtmsg))) {
+        return;
+    }
+    const struct rtmsg* rtm = static_cast<const struct rtmsg*>(NLMSG_DATA(nlh));
+    if (rtm->rtm_table != RT_TABLE_MAIN || rtm->rtm_type != RTN_UNICAST) {
+        return;
+    }
+
+    int oif = -1;
+    std::string gateway;
+    int len = static_cast<int>(RTM_PAYLOAD(nlh));
+    for (const struct rtattr* rta = RTM_RTA(rtm); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if (rta->rta_type == RTA_OIF) {
+            oif = *static_cast<const int*>(RTA_DATA(rta));
+        } else if (rta->rta_type == RTA_GATEWAY) {
+            gateway = addressToString(rtm->rtm_family, RTA_DATA(rta));
+        }
+    }
+    auto it = links_.find(oif);
+    if (it == links_.end()) {
+        return;
+    }
+
+    LinkState& link = it->second;
+    link.routes_changed = true;
+    if (rtm->rtm_dst_len == 0 && !gateway.empty()) {
+        if (nlh->nlmsg_type == RTM_NEWROUTE && (link.gateway.empty() || rtm->rtm_family == AF_INET)) {
+            link.gateway = gateway;
+        } else if (nlh->nlmsg_type == RTM_DELROUTE && link.gateway == gateway) {
+            link.gateway.clear();
+        }
+    }
+    dirty_links_.insert(oif);
+}
+
+void NetworkMonitor::applyPendingChanges(std::vector<NetworkEvent>* events) {
+    time_t now = time(nullptr);
+    for (int index : dirty_links_) {
+        auto lit = links_.find(index);
+        if (lit == links_.end()) {
+            continue;
+        }
+        LinkState& link = lit->second;
+        bool routes_changed = link.routes_changed;
+        link.routes_changed = false;
+        if (link.name.empty()) {
+            continue;
+        }
+
+        NetworkEvent event;
+        event.network_id = link.name;
+        event.timestamp = now;
+        auto cit = connections_.find(link.name);
+
+        if (!link.present) {
+            if (cit != connections_.end()) {
+                if (events) {
+                    event.type = NetworkEventType::CONNECTION_LOST;
+                    event.old_state = getStateString(cit->second.state);
+                    event.new_state = getStateString(NetworkState::DISCONNECTED);
+                    events->push_back(event);
+                    monitor_stats_.connection_changes++;
+                }
+                connections_.erase(cit);
+            }
+            links_.erase(lit);
+            continue;
+        }
+
+        NetworkState state = flagsToState(link.flags);
+        std::string ip = link.addresses.empty() ? "" : link.addresses.front();
+        if (cit == connections_.end()) {
+            NetworkConnection conn;
+            conn.network_id = link.name;
+            conn.interface = link.name;
+            conn.type = guessNetworkType(link.name);
+            conn.state = NetworkState::UNKNOWN;
+            conn.signal_strength = -1;
+            conn.link_speed = 0;
+            conn.connected_time = 0;
+            cit = connections_.insert(std::make_pair(link.name, conn)).first;
+        }
+        NetworkConnection& conn = cit->second;
+
+        if (conn.state != state) {
+            NetworkState old_state = conn.state;
+            conn.state = state;
+            if (state == NetworkState::CONNECTED) {
+                conn.connected_time = now;
+            }
+            if (events) {
+                event.type = NetworkEventType::STATE_CHANGED;
+                event.old_state = getStateString(old_state);
+                event.new_state = getStateString(state);
+                events->push_back(event);
+                if (state == NetworkState::CONNECTED || old_state == NetworkState::CONNECTED) {
+                    event.type = state == NetworkState::CONNECTED ? NetworkEventType::CONNECTION_ESTABLISHED
+                                                                  : NetworkEventType::CONNECTION_LOST;
+                    events->push_back(event);
+                    monitor_stats_.connection_changes++;
+                }
+            }
+        }
+        if (conn.ip_address != ip) {
+            if (events) {
+                event.type = NetworkEventType::IP_CHANGED;
+                event.old_state = conn.ip_address;
+                event.new_state = ip;
+                events->push_back(event);
+            }
+            conn.ip_address = ip;
+        }
+        if (conn.gateway != link.gateway || (routes_changed && events)) {
+            if (events) {
+                event.type = NetworkEventType::ROUTE_CHANGED;
+                event.old_state = conn.gateway;
+                event.new_state = link.gateway;
+                events->push_back(event);
+            }
+            conn.gateway = link.gateway;
+        }
+    }
+    dirty_links_.clear();
+}
+
+void NetworkMonitor::armDebounceTimer() {
+    if (timer_fd_ < 0 || timer_armed_ || debounce_ms_ == 0) {
+        return;
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = debounce_ms_ / 1000;
+    its.it_value.tv_nsec = (debounce_ms_ % 1000) * 1000000L;
+    if (timerfd_settime(timer_fd_, 0, &its, nullptr) == 0) {
+        timer_armed_ = true;
+    }
+}
+
+void NetworkMonitor::armStatsTimer() {
+    if (stats_timer_fd_ < 0) {
+        return;
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (stats_interval_ms_ > 0 && stats_collector_.isOpen()) {
+        its.it_interval.tv_sec = stats_interval_ms_ / 1000;
+        its.it_interval.tv_nsec = (stats_interval_ms_ % 1000) * 1000000L;
+        its.it_value = its.it_interval;
+    }
+    timerfd_settime(stats_timer_fd_, 0, &its, nullptr);
+}
+
+int NetworkMonitor::sampleCollector() {
+    int count = stats_collector_.sample();
+    if (count >= 0) {
+        traffic_history_.record(stats_collector_);
+    }
+    return count;
+}
+
+void NetworkMonitor::sampleStats() {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    if (sampleCollector() < 0 || stats_interval_ms_ == 0) {
+        return;
+    }
+    unsigned long every = std::max(1, LINK_SPEED_REFRESH_MS / stats_interval_ms_);
+    if (stats_collector_.sampleCount() % every == 0) {
+        stats_collector_.readLinkSpeeds();
+    }
+}
+
+NetworkType NetworkMonitor::guessNetworkType(const std::string& ifname) {
+    struct Prefix {
+        const char* prefix;
+        NetworkType type;
+    };
+    static const Prefix prefixes[] = {
+        {"wlan", NetworkType::WIFI}, {"wl", NetworkType::WIFI},
+        {"rmnet", NetworkType::MOBILE}, {"ccmni", NetworkType::MOBILE}, {"wwan", NetworkType::MOBILE},
+        {"bt-pan", NetworkType::BLUETOOTH}, {"bnep", NetworkType::BLUETOOTH},
+        {"tun", NetworkType::VPN}, {"ppp", NetworkType::VPN}, {"wg", NetworkType::VPN}, {"ipsec", NetworkType::VPN},
+    };
+    for (const auto& p : prefixes) {
+        if (ifname.compare(0, strlen(p.prefix), p.prefix) == 0) {
+            return p.type;
+        }
+    }
+    return NetworkType::ETHERNET;
+}
+
+NetworkState NetworkMonitor::flagsToState(unsigned int flags) {
+    if (!(flags & IFF_UP)) {
+        return NetworkState::DISCONNECTED;
+    }
+    // 接口已启用但还没有载波
+    return (flags & IFF_LOWER_UP) ? NetworkState::CONNECTED : NetworkState::CONNECTING;
 }
 
 void NetworkMonitor::triggerEvent(const NetworkEvent& event) {
-    monitor_stats_.total_events++;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        monitor_stats_.total_events++;
+    }
     
     if (state_callback_) {
         state_callback_(event);
@@ -1,13 +1,34 @@
 #include "NetworkPolicyManager.h"
+#include "PolicyDecisionTable.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <thread>
+
+namespace {
+
+/**
+ * @brief 当前线程的读者槽，线程第一次调用时轮流分配
+ */
+size_t readerSlot(size_t slots) {
+    static std::atomic<size_t> next(0);
+    thread_local size_t slot = next.fetch_add(1, std::memory_order_relaxed);
+    return slot % slots;
+}
+
+}  // namespace
 
 NetworkPolicyManager::NetworkPolicyManager()
-    : initialized_(false), next_policy_id_(1) {
+    : initialized_(false), next_policy_id_(1), update_depth_(0), epoch_(0) {
+    for (auto& slot : readers_) {
+        slot.count[0] = 0;
+        slot.count[1] = 0;
+    }
+    table_ = new PolicyDecisionTable(std::vector<PolicyDecision>(), std::vector<PolicyDecisionTable::AppRule>());
 }
 
 NetworkPolicyManager::~NetworkPolicyManager() {
+    delete table_.load();
 }
 
 bool NetworkPolicyManager::initialize() {
@@ -37,6 +58,7 @@ bool NetworkPolicyManager::initialize() {
     network_policies_[mobile_policy.id] = mobile_policy;
 
     initialized_ = true;
+    publishTable();
     return true;
 }
 
@@ -56,6 +78,7 @@ bool NetworkPolicyManager::addNetworkPolicy(const NetworkPolicy& policy) {
     
     network_policies_[policy_id] = new_policy;
     applyNetworkPolicy(new_policy);
+    publishTable();
     
     if (policy_callback_) {
         policy_callback_(policy_id, true);
@@ -73,6 +96,7 @@ bool NetworkPolicyManager::removeNetworkPolicy(const std::string& policy_id) {
     }
 
     network_policies_.erase(it);
+    publishTable();
     
     if (policy_callback_) {
         policy_callback_(policy_id, false);
@@ -90,6 +114,7 @@ bool NetworkPolicyManager::enableNetworkPolicy(const std::string& policy_id) {
 
     it->second.enabled = true;
     applyNetworkPolicy(it->second);
+    publishTable();
     return true;
 }
 
@@ -100,6 +125,7 @@ bool NetworkPolicyManager::disableNetworkPolicy(const std::string& policy_id) {
     }
 
     it->second.enabled = false;
+    publishTable();
     return true;
 }
 
@@ -108,6 +134,7 @@ bool NetworkPolicyManager::setNetworkPriority(const std::string& network_id, Net
         if (pair.second.network_id == network_id) {
             pair.second.priority = priority;
             applyNetworkPolicy(pair.second);
+            publishTable();
             std::cout << "[NetworkPolicyManager] Set network priority: " << network_id 
                       << " -> " << getPriorityString(priority) << std::endl;
             return true;
@@ -117,12 +144,11 @@ bool NetworkPolicyManager::setNetworkPriority(const std::string& network_id, Net
 }
 
 NetworkPriority NetworkPolicyManager::getNetworkPriority(const std::string& network_id) {
-    for (const auto& pair : network_policies_) {
-        if (pair.second.network_id == network_id && pair.second.enabled) {
-            return pair.second.priority;
-        }
+    auto it = network_ids_.find(network_id);
+    if (it == network_ids_.end()) {
+        return NetworkPriority::DEFAULT;
     }
-    return NetworkPriority::DEFAULT;
+    return table_.load(std::memory_order_relaxed)->decide(0, it->second).priority;
 }
 
 bool NetworkPolicyManager::setNetworkUsagePolicy(const std::string& network_id, NetworkUsagePolicy policy) {
@@ -130,6 +156,7 @@ bool NetworkPolicyManager::setNetworkUsagePolicy(const std::string& network_id,
         if (pair.second.network_id == network_id) {
             pair.second.usage_policy = policy;
             applyNetworkPolicy(pair.second);
+            publishTable();
             return true;
         }
     }
@@ -147,6 +174,7 @@ std::vector<AppNetworkPolicy> NetworkPolicyManager::getAppNetworkPolicies() cons
 bool NetworkPolicyManager::addAppNetworkPolicy(const AppNetworkPolicy& policy) {
     std::string key = policy.package_name + ":" + policy.network_id;
     app_policies_[key] = policy;
+    publishTable();
 
     std::cout << "[NetworkPolicyManager] Added app network policy: " 
               << policy.package_name << " on " << policy.network_id << std::endl;
@@ -159,15 +187,62 @@ bool NetworkPolicyManager::removeAppNetworkPolicy(const std::string& package_nam
     auto it = app_policies_.find(key);
     if (it != app_policies_.end()) {
         app_policies_.erase(it);
+        publishTable();
         return true;
     }
     return false;
 }
 
+bool NetworkPolicyManager::addAppNetworkPolicies(const std::vector<AppNetworkPolicy>& policies) {
+    for (const auto& policy : policies) {
+        app_policies_[policy.package_name + ":" + policy.network_id] = policy;
+    }
+    publishTable();
+
+    std::cerr << "[NetworkPolicyManager] Added " << policies.size() << " app network policies" << std::endl;
+    return true;
+}
+
+void NetworkPolicyManager::setAppUid(const std::string& package_name, uint32_t uid) {
+    auto it = app_uids_.find(package_name);
+    if (it != app_uids_.end() && it->second == uid) {
+        return;
+    }
+    app_uids_[package_name] = uid;
+    publishTable();
+}
+
+uint32_t NetworkPolicyManager::internNetwork(const std::string& network_id) {
+    // 新网络没有策略，超出旧表范围的编号本来就按没有策略处理，不必重新编译
+    auto result = network_ids_.insert(std::make_pair(network_id, static_cast<uint32_t>(network_ids_.size())));
+    return result.first->second;
+}
+
+void NetworkPolicyManager::beginUpdate() {
+    update_depth_++;
+}
+
+void NetworkPolicyManager::commitUpdate() {
+    if (update_depth_ > 0 && --update_depth_ == 0) {
+        publishTable();
+    }
+}
+
+PolicyDecision NetworkPolicyManager::decide(uint32_t uid, uint32_t network) const {
+    // 先在当前纪元登记再读表，publishTable()据此判断旧表是否还有人在用
+    ReaderSlot& slot = readers_[readerSlot(READER_SLOTS)];
+    unsigned epoch = epoch_.load() & 1;
+    slot.count[epoch].fetch_add(1);
+    PolicyDecision result = table_.load()->decide(uid, network);
+    slot.count[epoch].fetch_sub(1, std::memory_order_release);
+    return result;
+}
+
 bool NetworkPolicyManager::setNetworkMetered(const std::string& network_id, bool metered) {
     for (auto& pair : network_policies_) {
         if (pair.second.network_id == network_id) {
             pair.second.metered = metered;
+            publishTable();
             std::cout << "[NetworkPolicyManager] Set network metered: " << network_id 
                       << " -> " << (metered ? "yes" : "no") << std::endl;
             return true;
@@ -177,16 +252,17 @@ bool NetworkPolicyManager::setNetworkMetered(const std::string& network_id, bool
 }
 
 bool NetworkPolicyManager::isNetworkMetered(const std::string& network_id) {
-    for (const auto& pair : network_policies_) {
-        if (pair.second.network_id == network_id && pair.second.enabled) {
-            return pair.second.metered;
-        }
+    auto it = network_ids_.find(network_id);
+    if (it == network_ids_.end()) {
+        return false;
     }
-    return false;
+    return table_.load(std::memory_order_relaxed)->decide(0, it->second).metered;
 }
 
 bool NetworkPolicyManager::applyWifiPriorityPolicy(const std::string& wifi_id, 
                                                     const std::string& mobile_id) {
+    beginUpdate();
+
     // 设置WiFi为高优先级
     setNetworkPriority(wifi_id, NetworkPriority::HIGH);
     
@@ -197,6 +273,8 @@ bool NetworkPolicyManager::applyWifiPriorityPolicy(const std::string& wifi_id,
     setNetworkMetered(mobile_id, true);
     setNetworkMetered(wifi_id, false);
 
+    commitUpdate();
+
     std::cout << "[NetworkPolicyManager] Applied WiFi priority policy" << std::endl;
     std::cout << "[NetworkPolicyManager] WiFi: " << wifi_id << " (HIGH priority, unmetered)" << std::endl;
     std::cout << "[NetworkPolicyManager] Mobile: " << mobile_id << " (LOW priority, metered)" << std::endl;
@@ -279,6 +357,57 @@ bool NetworkPolicyManager::applyNetworkPolicy(const NetworkPolicy& policy) {
     return true;
 }
 
+void NetworkPolicyManager::publishTable() {
+    if (update_depth_ > 0) {
+        return;
+    }
+
+    for (const auto& pair : network_policies_) {
+        internNetwork(pair.second.network_id);
+    }
+    for (const auto& pair : app_policies_) {
+        internNetwork(pair.second.network_id);
+    }
+    std::vector<PolicyDecision> networks(network_ids_.size());
+    for (const auto& pair : network_ids_) {
+        networks[pair.second] = compileNetwork(pair.first);
+    }
+    std::vector<PolicyDecisionTable::AppRule> rules;
+    for (const auto& pair : app_policies_) {
+        const AppNetworkPolicy& policy = pair.second;
+        auto uid = app_uids_.find(policy.package_name);
+        if (!policy.enabled || uid == app_uids_.end()) {
+            continue;
+        }
+        rules.push_back(PolicyDecisionTable::AppRule{uid->second, network_ids_[policy.network_id], policy.policy});
+    }
+
+    const PolicyDecisionTable* old = table_.exchange(new PolicyDecisionTable(networks, rules));
+
+    // 读者可能在更早的纪元读到纪元号、之后才登记，所以翻转两次，每次等上一个纪元的读者退出。
+    // 读者先登记再读表，这里先换表再读计数，两边都须是seq_cst，否则可能读到0而读者还拿着旧表
+    for (int i = 0; i < 2; ++i) {
+        unsigned previous = epoch_.load();
+        epoch_.store(previous + 1);
+        for (const auto& slot : readers_) {
+            while (slot.count[previous & 1].load() != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+    delete old;
+}
+
+PolicyDecision NetworkPolicyManager::compileNetwork(const std::string& network_id) const {
+    for (const auto& pair : network_policies_) {
+        const NetworkPolicy& policy = pair.second;
+        if (policy.network_id == network_id && policy.enabled) {
+            return PolicyDecision{policy.usage_policy, policy.priority, policy.metered, policy.bandwidth_limit};
+        }
+    }
+    return PolicyDecision{NetworkUsagePolicy::ALLOWED, NetworkPriority::DEFAULT, false, 0};
+}
+
 std::string NetworkPolicyManager::generatePolicyId() {
     return "policy_" + std::to_string(next_policy_id_++);
 }
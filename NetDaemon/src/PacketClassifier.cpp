@@ -0,0 +1,448 @@
+#include "PacketClassifier.h"
+#include <algorithm>
+#include <cstdlib>
+#include <arpa/inet.h>
+
+namespace {
+
+const size_t INITIAL_ENTRIES = 16;
+// 端口组超过这么多条规则时建区间索引
+const size_t GROUP_INDEX_THRESHOLD = 8;
+// 查找时预取槽位的组数
+const size_t PREFETCH_TUPLES = 8;
+
+/**
+ * @brief 解析协议名或协议号，任意协议为-1
+ */
+bool parseProtocol(const std::string& text, int* protocol) {
+    static const struct {
+        const char* name;
+        int number;
+    } PROTOCOLS[] = {
+        {"icmp", 1}, {"igmp", 2}, {"tcp", 6}, {"udp", 17}, {"gre", 47},
+        {"esp", 50}, {"ah", 51}, {"icmpv6", 58}, {"sctp", 132}, {"udplite", 136},
+    };
+
+    if (text.empty() || text == "all") {
+        *protocol = -1;
+        return true;
+    }
+    for (const auto& item : PROTOCOLS) {
+        if (text == item.name) {
+            *protocol = item.number;
+            return true;
+        }
+    }
+    char* end = nullptr;
+    long number = strtol(text.c_str(), &end, 10);
+    if (*end != '\0' || number < 0 || number > 255) {
+        return false;
+    }
+    *protocol = number == 0 ? -1 : static_cast<int>(number);
+    return true;
+}
+
+bool hasPorts(int protocol) {
+    return protocol == 6 || protocol == 17 || protocol == 132 || protocol == 136;
+}
+
+uint32_t prefixMask(int length) {
+    return length == 0 ? 0 : 0xffffffffu << (32 - length);
+}
+
+bool parseIpv4(const std::string& text, uint32_t* address) {
+    struct in_addr addr;
+    if (inet_pton(AF_INET, text.c_str(), &addr) != 1) {
+        return false;
+    }
+    *address = ntohl(addr.s_addr);
+    return true;
+}
+
+/**
+ * @brief 解析"a.b.c.d"、"a.b.c.d/长度"、"a.b.c.d/掩码"，空字符串为0.0.0.0/0
+ */
+bool parsePrefix(const std::string& text, uint32_t* address, int* length) {
+    if (text.empty()) {
+        *address = 0;
+        *length = 0;
+        return true;
+    }
+    size_t slash = text.find('/');
+    if (!parseIpv4(text.substr(0, slash), address)) {
+        return false;
+    }
+    *length = 32;
+    if (slash != std::string::npos) {
+        std::string suffix = text.substr(slash + 1);
+        uint32_t mask = 0;
+        if (suffix.find('.') != std::string::npos) {
+            if (!parseIpv4(suffix, &mask) || (mask & (~mask >> 1)) != 0) {
+                return false;
+            }
+            *length = 0;
+            while (*length < 32 && (mask & (0x80000000u >> *length))) {
+                (*length)++;
+            }
+        } else {
+            char* end = nullptr;
+            long value = strtol(suffix.c_str(), &end, 10);
+            if (suffix.empty() || *end != '\0' || value < 0 || value > 32) {
+                return false;
+            }
+            *length = static_cast<int>(value);
+        }
+    }
+    *address &= prefixMask(*length);
+    return true;
+}
+
+bool parsePort(const std::string& text, uint16_t* port) {
+    char* end = nullptr;
+    long value = strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || value < 0 || value > 65535) {
+        return false;
+    }
+    *port = static_cast<uint16_t>(value);
+    return true;
+}
+
+/**
+ * @brief 解析"80"、"1000:2000"、":1024"、"1024:"，空字符串为全部端口
+ */
+bool parsePortRange(const std::string& text, uint16_t* min, uint16_t* max) {
+    *min = 0;
+    *max = 65535;
+    if (text.empty()) {
+        return true;
+    }
+    size_t colon = text.find(':');
+    if (colon == std::string::npos) {
+        if (!parsePort(text, min)) {
+            return false;
+        }
+        *max = *min;
+        return true;
+    }
+    std::string low = text.substr(0, colon);
+    std::string high = text.substr(colon + 1);
+    if ((!low.empty() && !parsePort(low, min)) || (!high.empty() && !parsePort(high, max))) {
+        return false;
+    }
+    return *min <= *max;
+}
+
+}  // namespace
+
+bool PacketTuple::parse(const std::string& src_ip, const std::string& dst_ip, const std::string& protocol,
+                        uint16_t src_port, uint16_t dst_port, PacketTuple* out) {
+    int number = 0;
+    if (!parseIpv4(src_ip, &out->src_ip) || !parseIpv4(dst_ip, &out->dst_ip) ||
+        !parseProtocol(protocol, &number) || number < 0) {
+        return false;
+    }
+    out->protocol = static_cast<uint8_t>(number);
+    out->src_port = src_port;
+    out->dst_port = dst_port;
+    return true;
+}
+
+bool ClassifierRule::parse(const std::string& protocol, const std::string& src_ip, const std::string& dst_ip,
+                           const std::string& src_port, const std::string& dst_port, ClassifierRule* out) {
+    if (!parseProtocol(protocol, &out->protocol) ||
+        !parsePrefix(src_ip, &out->src_ip, &out->src_len) ||
+        !parsePrefix(dst_ip, &out->dst_ip, &out->dst_len) ||
+        !parsePortRange(src_port, &out->src_port_min, &out->src_port_max) ||
+        !parsePortRange(dst_port, &out->dst_port_min, &out->dst_port_max)) {
+        return false;
+    }
+    // 与iptables一样，端口条件需要指定带端口的协议
+    if ((!src_port.empty() || !dst_port.empty()) && !hasPorts(out->protocol)) {
+        return false;
+    }
+    return true;
+}
+
+PacketClassifier::PacketClassifier() : rule_count_(0) {
+}
+
+void PacketClassifier::add(const ClassifierRule& rule, uint32_t priority, uint32_t value, bool conditional) {
+    Key mask;
+    mask.src_ip = prefixMask(rule.src_len);
+    mask.dst_ip = prefixMask(rule.dst_len);
+    mask.protocol = rule.protocol < 0 ? 0 : 0xff;
+    Key key;
+    key.src_ip = rule.src_ip & mask.src_ip;
+    key.dst_ip = rule.dst_ip & mask.dst_ip;
+    key.protocol = rule.protocol < 0 ? 0 : static_cast<uint32_t>(rule.protocol);
+
+    PortRule port_rule;
+    port_rule.priority = priority;
+    port_rule.value = value;
+    port_rule.src_port_min = rule.src_port_min;
+    port_rule.src_port_max = rule.src_port_max;
+    port_rule.dst_port_min = rule.dst_port_min;
+    port_rule.dst_port_max = rule.dst_port_max;
+    bool any_port = rule.src_port_min == 0 && rule.src_port_max == 65535 &&
+                    rule.dst_port_min == 0 && rule.dst_port_max == 65535;
+
+    rule_count_++;
+    Tuple& tuple = findTuple(mask, priority);
+    Entry* entry = findEntry(tuple, key);
+    if (entry->priority == NO_MATCH) {
+        entry->priority = priority;
+        entry->value = value;
+        entry->group = NO_MATCH;
+        // 有条件的规则放在端口组里，检查不通过时组内后面的规则还能命中
+        if (!any_port || conditional) {
+            entry->value = NO_MATCH;
+            entry->group = static_cast<uint32_t>(groups_.size());
+            groups_.push_back(PortGroup());
+            addToGroup(entry->group, port_rule);
+        }
+        return;
+    }
+
+    if (entry->group == NO_MATCH) {
+        if (entry->priority < priority) {
+            // 被前面不限端口、无条件的规则完全遮住
+            return;
+        }
+        PortRule existing;
+        existing.priority = entry->priority;
+        existing.value = entry->value;
+        existing.src_port_min = 0;
+        existing.src_port_max = 65535;
+        existing.dst_port_min = 0;
+        existing.dst_port_max = 65535;
+        uint32_t group = static_cast<uint32_t>(groups_.size());
+        groups_.push_back(PortGroup());
+        addToGroup(group, existing);
+        entry->value = NO_MATCH;
+        entry->group = group;
+    }
+    addToGroup(entry->group, port_rule);
+    entry->priority = std::min(entry->priority, priority);
+}
+
+void PacketClassifier::clear() {
+    tuples_.clear();
+    groups_.clear();
+    rule_count_ = 0;
+}
+
+uint32_t PacketClassifier::classify(const PacketTuple& packet, uint32_t min_priority) const {
+    // 先算出前几组的槽位并预取，几张表的缓存未命中可以重叠
+    size_t slots[PREFETCH_TUPLES];
+    size_t prefetched = std::min(tuples_.size(), PREFETCH_TUPLES);
+    for (size_t t = 0; t < prefetched; ++t) {
+        const Tuple& tuple = tuples_[t];
+        Key key;
+        key.src_ip = packet.src_ip & tuple.mask.src_ip;
+        key.dst_ip = packet.dst_ip & tuple.mask.dst_ip;
+        key.protocol = packet.protocol & tuple.mask.protocol;
+        slots[t] = hashKey(key) & (tuple.entries.size() - 1);
+        __builtin_prefetch(&tuple.entries[slots[t]]);
+    }
+
+    uint32_t best_priority = NO_MATCH;
+    uint32_t best_value = NO_MATCH;
+    for (size_t t = 0; t < tuples_.size(); ++t) {
+        const Tuple& tuple = tuples_[t];
+        if (tuple.min_priority >= best_priority) {
+            break;
+        }
+        Key key;
+        key.src_ip = packet.src_ip & tuple.mask.src_ip;
+        key.dst_ip = packet.dst_ip & tuple.mask.dst_ip;
+        key.protocol = packet.protocol & tuple.mask.protocol;
+
+        size_t capacity_mask = tuple.entries.size() - 1;
+        size_t first = t < prefetched ? slots[t] : hashKey(key) & capacity_mask;
+        for (size_t i = first;; i = (i + 1) & capacity_mask) {
+            const Entry& entry = tuple.entries[i];
+            if (entry.priority == NO_MATCH) {
+                break;
+            }
+            if (entry.key.src_ip != key.src_ip || entry.key.dst_ip != key.dst_ip ||
+                entry.key.protocol != key.protocol) {
+                continue;
+            }
+            if (entry.priority < best_priority) {
+                if (entry.group == NO_MATCH) {
+                    if (entry.priority < min_priority) {
+                        break;
+                    }
+                    best_priority = entry.priority;
+                    best_value = entry.value;
+                } else {
+                    uint32_t value = matchGroup(groups_[entry.group], packet.src_port, packet.dst_port,
+                                                min_priority, &best_priority);
+                    if (value != NO_MATCH) {
+                        best_value = value;
+                    }
+                }
+            }
+            break;
+        }
+    }
+    return best_value;
+}
+
+size_t PacketClassifier::memoryUsage() const {
+    size_t bytes = tuples_.capacity() * sizeof(Tuple) + groups_.capacity() * sizeof(PortGroup);
+    for (const auto& tuple : tuples_) {
+        bytes += tuple.entries.capacity() * sizeof(Entry);
+    }
+    for (const auto& group : groups_) {
+        bytes += group.rules.capacity() * sizeof(PortRule) + group.bounds.capacity() * sizeof(uint32_t) +
+                 group.intervals.capacity() * sizeof(std::vector<PortRule>);
+        for (const auto& interval : group.intervals) {
+            bytes += interval.capacity() * sizeof(PortRule);
+        }
+    }
+    return bytes;
+}
+
+PacketClassifier::Tuple& PacketClassifier::findTuple(const Key& mask, uint32_t priority) {
+    size_t index = 0;
+    while (index < tuples_.size()) {
+        const Key& other = tuples_[index].mask;
+        if (other.src_ip == mask.src_ip && other.dst_ip == mask.dst_ip && other.protocol == mask.protocol) {
+            break;
+        }
+        index++;
+    }
+    if (index == tuples_.size()) {
+        Tuple tuple;
+        tuple.mask = mask;
+        tuple.min_priority = NO_MATCH;
+        tuple.used = 0;
+        Entry empty;
+        empty.priority = NO_MATCH;
+        tuple.entries.assign(INITIAL_ENTRIES, empty);
+        tuples_.push_back(tuple);
+    }
+
+    if (priority < tuples_[index].min_priority) {
+        tuples_[index].min_priority = priority;
+        // 保持按组内最高优先级排序，只需把这一组往前移
+        while (index > 0 && tuples_[index - 1].min_priority > tuples_[index].min_priority) {
+            std::swap(tuples_[index - 1], tuples_[index]);
+            index--;
+        }
+    }
+    return tuples_[index];
+}
+
+PacketClassifier::Entry* PacketClassifier::findEntry(Tuple& tuple, const Key& key) {
+    // 负载超过一半时扩容
+    if ((tuple.used + 1) * 2 > tuple.entries.size()) {
+        Entry empty;
+        empty.priority = NO_MATCH;
+        std::vector<Entry> entries(tuple.entries.size() * 2, empty);
+        size_t capacity_mask = entries.size() - 1;
+        for (const auto& entry : tuple.entries) {
+            if (entry.priority == NO_MATCH) {
+                continue;
+            }
+            size_t i = hashKey(entry.key) & capacity_mask;
+            while (entries[i].priority != NO_MATCH) {
+                i = (i + 1) & capacity_mask;
+            }
+            entries[i] = entry;
+        }
+        tuple.entries.swap(entries);
+    }
+
+    size_t capacity_mask = tuple.entries.size() - 1;
+    for (size_t i = hashKey(key) & capacity_mask;; i = (i + 1) & capacity_mask) {
+        Entry& entry = tuple.entries[i];
+        if (entry.priority == NO_MATCH) {
+            entry.key = key;
+            tuple.used++;
+            return &entry;
+        }
+        if (entry.key.src_ip == key.src_ip && entry.key.dst_ip == key.dst_ip && entry.key.protocol == key.protocol) {
+            return &entry;
+        }
+    }
+}
+
+void PacketClassifier::addToGroup(uint32_t group_index, const PortRule& rule) {
+    PortGroup& group = groups_[group_index];
+    insertSorted(group.rules, rule);
+
+    std::vector<PortRule> pending;
+    if (!group.bounds.empty()) {
+        pending.push_back(rule);
+    } else if (group.rules.size() > GROUP_INDEX_THRESHOLD) {
+        group.bounds.assign(1, 0);
+        group.intervals.assign(1, std::vector<PortRule>());
+        pending = group.rules;
+    }
+
+    for (const auto& item : pending) {
+        splitInterval(group, item.dst_port_min);
+        splitInterval(group, static_cast<uint32_t>(item.dst_port_max) + 1);
+        size_t first = std::lower_bound(group.bounds.begin(), group.bounds.end(), item.dst_port_min) -
+                       group.bounds.begin();
+        for (size_t i = first; i < group.bounds.size() && group.bounds[i] <= item.dst_port_max; ++i) {
+            insertSorted(group.intervals[i], item);
+        }
+    }
+}
+
+void PacketClassifier::insertSorted(std::vector<PortRule>& rules, const PortRule& rule) {
+    auto it = std::upper_bound(rules.begin(), rules.end(), rule,
+        [](const PortRule& a, const PortRule& b) { return a.priority < b.priority; });
+    rules.insert(it, rule);
+}
+
+void PacketClassifier::splitInterval(PortGroup& group, uint32_t bound) {
+    if (bound > 65535) {
+        return;
+    }
+    auto it = std::upper_bound(group.bounds.begin(), group.bounds.end(), bound);
+    size_t index = static_cast<size_t>(it - group.bounds.begin()) - 1;
+    if (group.bounds[index] == bound) {
+        return;
+    }
+    std::vector<PortRule> covering = group.intervals[index];
+    group.bounds.insert(group.bounds.begin() + index + 1, bound);
+    group.intervals.insert(group.intervals.begin() + index + 1, covering);
+}
+
+uint32_t PacketClassifier::matchGroup(const PortGroup& group, uint16_t src_port, uint16_t dst_port,
+                                      uint32_t min_priority, uint32_t* priority) {
+    const std::vector<PortRule>* rules = &group.rules;
+    if (!group.bounds.empty()) {
+        auto it = std::upper_bound(group.bounds.begin(), group.bounds.end(), static_cast<uint32_t>(dst_port));
+        rules = &group.intervals[static_cast<size_t>(it - group.bounds.begin()) - 1];
+    }
+    for (const auto& rule : *rules) {
+        if (rule.priority >= *priority) {
+            break;
+        }
+        if (rule.priority < min_priority) {
+            continue;
+        }
+        if (src_port >= rule.src_port_min && src_port <= rule.src_port_max &&
+            dst_port >= rule.dst_port_min && dst_port <= rule.dst_port_max) {
+            *priority = rule.priority;
+            return rule.value;
+        }
+    }
+    return NO_MATCH;
+}
+
+size_t PacketClassifier::hashKey(const Key& key) {
+    uint64_t h = (static_cast<uint64_t>(key.src_ip) << 32) | key.dst_ip;
+    h ^= static_cast<uint64_t>(key.protocol) * 0x9e3779b97f4a7c15ull;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return static_cast<size_t>(h);
+}
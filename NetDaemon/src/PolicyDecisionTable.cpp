@@ -0,0 +1,131 @@
+#include "PolicyDecisionTable.h"
+#include <algorithm>
+
+namespace {
+
+const uint32_t INVALID = 0xffffffffu;
+const size_t INITIAL_SLOTS = 16;
+
+size_t hashUid(uint32_t uid) {
+    return static_cast<size_t>((uid * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+bool isBlocked(const PolicyDecision& decision) {
+    return decision.usage == NetworkUsagePolicy::BLOCKED || decision.priority == NetworkPriority::NEVER;
+}
+
+// 数值越大越严格
+int severity(NetworkUsagePolicy policy) {
+    switch (policy) {
+        case NetworkUsagePolicy::BLOCKED: return 2;
+        case NetworkUsagePolicy::RESTRICTED: return 1;
+        default: return 0;
+    }
+}
+
+}  // namespace
+
+PolicyDecisionTable::PolicyDecisionTable(const std::vector<PolicyDecision>& networks,
+                                         const std::vector<AppRule>& rules)
+    : networks_(networks), rows_(0), words_((networks.size() + 63) / 64) {
+    for (auto& network : networks_) {
+        if (isBlocked(network)) {
+            network.usage = NetworkUsagePolicy::BLOCKED;
+        }
+    }
+
+    std::vector<uint32_t> uids;
+    for (const auto& rule : rules) {
+        if (rule.network < networks_.size()) {
+            uids.push_back(rule.uid);
+        }
+    }
+    std::sort(uids.begin(), uids.end());
+    uids.erase(std::unique(uids.begin(), uids.end()), uids.end());
+    rows_ = uids.size();
+
+    size_t capacity = INITIAL_SLOTS;
+    while (capacity < rows_ * 2) {
+        capacity *= 2;
+    }
+    slots_.assign(capacity, Slot{0, INVALID});
+    size_t mask = capacity - 1;
+    for (size_t row = 0; row < rows_; ++row) {
+        size_t i = hashUid(uids[row]) & mask;
+        while (slots_[i].row != INVALID) {
+            i = (i + 1) & mask;
+        }
+        slots_[i].uid = uids[row];
+        slots_[i].row = static_cast<uint32_t>(row);
+    }
+
+    // 每行先填网络的默认决定，再按应用策略覆盖
+    std::vector<uint64_t> blocked_row(words_, 0);
+    std::vector<uint64_t> restricted_row(words_, 0);
+    for (size_t n = 0; n < networks_.size(); ++n) {
+        uint64_t bit = 1ull << (n % 64);
+        if (networks_[n].usage == NetworkUsagePolicy::BLOCKED) {
+            blocked_row[n / 64] |= bit;
+        } else if (networks_[n].usage == NetworkUsagePolicy::RESTRICTED) {
+            restricted_row[n / 64] |= bit;
+        }
+    }
+    blocked_.reserve(rows_ * words_);
+    restricted_.reserve(rows_ * words_);
+    for (size_t row = 0; row < rows_; ++row) {
+        blocked_.insert(blocked_.end(), blocked_row.begin(), blocked_row.end());
+        restricted_.insert(restricted_.end(), restricted_row.begin(), restricted_row.end());
+    }
+
+    std::vector<uint64_t> overridden(rows_ * words_, 0);
+    for (const auto& rule : rules) {
+        if (rule.network >= networks_.size() || networks_[rule.network].usage == NetworkUsagePolicy::BLOCKED) {
+            continue;
+        }
+        size_t word = findRow(rule.uid) * words_ + rule.network / 64;
+        uint64_t bit = 1ull << (rule.network % 64);
+        int current = blocked_[word] & bit ? 2 : (restricted_[word] & bit ? 1 : 0);
+        int wanted = severity(rule.policy);
+        if (overridden[word] & bit) {
+            wanted = std::max(wanted, current);
+        }
+        overridden[word] |= bit;
+        blocked_[word] = wanted == 2 ? blocked_[word] | bit : blocked_[word] & ~bit;
+        restricted_[word] = wanted == 1 ? restricted_[word] | bit : restricted_[word] & ~bit;
+    }
+}
+
+PolicyDecision PolicyDecisionTable::decide(uint32_t uid, uint32_t network) const {
+    if (network >= networks_.size()) {
+        return PolicyDecision{NetworkUsagePolicy::ALLOWED, NetworkPriority::DEFAULT, false, 0};
+    }
+    PolicyDecision result = networks_[network];
+    uint32_t row = findRow(uid);
+    if (row != INVALID) {
+        size_t word = row * words_ + network / 64;
+        uint64_t bit = 1ull << (network % 64);
+        if (blocked_[word] & bit) {
+            result.usage = NetworkUsagePolicy::BLOCKED;
+        } else if (restricted_[word] & bit) {
+            result.usage = NetworkUsagePolicy::RESTRICTED;
+        } else {
+            result.usage = NetworkUsagePolicy::ALLOWED;
+        }
+    }
+    return result;
+}
+
+size_t PolicyDecisionTable::memoryUsage() const {
+    return sizeof(*this) + networks_.capacity() * sizeof(PolicyDecision) + slots_.capacity() * sizeof(Slot) +
+           (blocked_.capacity() + restricted_.capacity()) * sizeof(uint64_t);
+}
+
+uint32_t PolicyDecisionTable::findRow(uint32_t uid) const {
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hashUid(uid) & mask; slots_[i].row != INVALID; i = (i + 1) & mask) {
+        if (slots_[i].uid == uid) {
+            return slots_[i].row;
+        }
+    }
+    return INVALID;
+}
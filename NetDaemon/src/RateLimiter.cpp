@@ -0,0 +1,328 @@
+#include "RateLimiter.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+const uint64_t NEVER = ~0ull;
+const uint64_t FRACTION_BITS = 16;
+// 1 kbps下每字节的纳秒数
+const uint64_t NS_PER_BYTE_KBPS = 8000000;
+const uint64_t NS_PER_TICK = 1000000;
+const uint64_t MIN_BURST = 1500;
+
+}  // namespace
+
+RateLimiter::RateLimiter(size_t capacity)
+    : buckets_(new Bucket[capacity]), capacity_(capacity), count_(0) {
+}
+
+RateLimiter::~RateLimiter() {
+}
+
+uint32_t RateLimiter::addBucket(uint32_t parent, unsigned int rate_kbps, unsigned int ceil_kbps,
+                                unsigned int burst_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return addBucketLocked(parent, rate_kbps, ceil_kbps, burst_bytes);
+}
+
+bool RateLimiter::setLimit(uint32_t bucket, unsigned int rate_kbps, unsigned int ceil_kbps,
+                           unsigned int burst_bytes) {
+    if (bucket >= count_.load(std::memory_order_acquire)) {
+        return false;
+    }
+    Bucket& entry = buckets_[bucket];
+    bool root = entry.parent == INVALID;
+    configure(entry.assured, root ? ceil_kbps : rate_kbps, burst_bytes, !root);
+    configure(entry.ceil, ceil_kbps, burst_bytes, false);
+    return true;
+}
+
+uint32_t RateLimiter::applyRule(const TrafficControlRule& rule) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return interfaceBucket(rule.interface, rule.enabled ? rule.rate : 0, rule.burst, true);
+}
+
+uint32_t RateLimiter::applyPolicy(const NetworkPolicy& policy) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint32_t parent = interfaceBucket(policy.network_id, 0, 0, false);
+    if (parent == INVALID) {
+        return INVALID;
+    }
+    unsigned int limit = policy.enabled && policy.bandwidth_limit > 0 ? policy.bandwidth_limit : 0;
+
+    auto it = policies_.find(policy.id);
+    if (it != policies_.end()) {
+        if (buckets_[it->second].parent == parent) {
+            setLimit(it->second, limit, limit, 0);
+            return it->second;
+        }
+        // 换了网络：桶的父节点不能改，旧桶不再限速，另建一个
+        setLimit(it->second, 0, 0, 0);
+    }
+    uint32_t bucket = addBucketLocked(parent, limit, limit, 0);
+    if (bucket != INVALID) {
+        policies_[policy.id] = bucket;
+    }
+    return bucket;
+}
+
+uint32_t RateLimiter::findInterface(const std::string& interface) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = interfaces_.find(interface);
+    return it == interfaces_.end() ? INVALID : it->second;
+}
+
+uint32_t RateLimiter::findPolicy(const std::string& policy_id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = policies_.find(policy_id);
+    return it == policies_.end() ? INVALID : it->second;
+}
+
+bool RateLimiter::tryConsume(uint32_t bucket, uint32_t bytes, uint64_t now_ns) {
+    uint32_t nodes[MAX_DEPTH];
+    size_t count = path(bucket, nodes);
+    if (count == 0) {
+        return false;
+    }
+    Bucket& leaf = buckets_[bucket];
+
+    // 往上找第一个保证速率还有余量的桶借出，借用经过的桶（包括它）不能超过上限，
+    // 它上面的桶不检查，只扣令牌
+    size_t lender = 0;
+    for (; lender < count; ++lender) {
+        const Bucket& entry = buckets_[nodes[lender]];
+        if (!conforms(entry.ceil, bytes, now_ns)) {
+            lender = count;
+            break;
+        }
+        if (conforms(entry.assured, bytes, now_ns)) {
+            break;
+        }
+    }
+    if (lender == count) {
+        leaf.denied.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        Bucket& entry = buckets_[nodes[i]];
+        charge(entry.ceil, bytes, now_ns);
+        if (i >= lender) {
+            charge(entry.assured, bytes, now_ns);
+        }
+    }
+    leaf.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    leaf.packets.fetch_add(1, std::memory_order_relaxed);
+    if (lender > 0) {
+        leaf.borrowed.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+uint64_t RateLimiter::nextSendTime(uint32_t bucket, uint32_t bytes, uint64_t now_ns) const {
+    uint32_t nodes[MAX_DEPTH];
+    size_t count = path(bucket, nodes);
+    if (count == 0) {
+        return NEVER;
+    }
+    // 从第i层借出时，第0到i层的上限和第i层的保证速率都要满足，取各层中最早的
+    uint64_t ceil_ready = now_ns;
+    uint64_t ready = NEVER;
+    for (size_t i = 0; i < count; ++i) {
+        const Bucket& entry = buckets_[nodes[i]];
+        ceil_ready = std::max(ceil_ready, readyTime(entry.ceil, bytes, now_ns));
+        ready = std::min(ready, std::max(ceil_ready, readyTime(entry.assured, bytes, now_ns)));
+    }
+    return ready;
+}
+
+uint32_t RateLimiter::wait(uint32_t bucket, uint32_t bytes, uint64_t now_ns, std::function<void()> callback) {
+    uint64_t ready = nextSendTime(bucket, bytes, now_ns);
+    if (ready == NEVER) {
+        return INVALID;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (wheel_.size() == 0) {
+        // 空的时间轮直接跳到现在，不必逐个tick推进
+        wheel_.advance(now_ns / NS_PER_TICK, &expired_);
+    }
+    uint32_t waiter;
+    if (free_waiters_.empty()) {
+        waiter = static_cast<uint32_t>(waiters_.size());
+        waiters_.push_back(Waiter());
+    } else {
+        waiter = free_waiters_.back();
+        free_waiters_.pop_back();
+    }
+    waiters_[waiter].callback = std::move(callback);
+    waiters_[waiter].timer = wheel_.schedule((ready + NS_PER_TICK - 1) / NS_PER_TICK, waiter);
+    return waiter;
+}
+
+bool RateLimiter::cancelWait(uint32_t waiter) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (waiter >= waiters_.size() || waiters_[waiter].timer == TimerWheel::INVALID) {
+        return false;
+    }
+    wheel_.cancel(waiters_[waiter].timer);
+    waiters_[waiter].timer = TimerWheel::INVALID;
+    waiters_[waiter].callback = nullptr;
+    free_waiters_.push_back(waiter);
+    return true;
+}
+
+size_t RateLimiter::runTimers(uint64_t now_ns) {
+    std::vector<std::function<void()>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (now_ns / NS_PER_TICK < wheel_.now()) {
+            return 0;
+        }
+        expired_.clear();
+        wheel_.advance(now_ns / NS_PER_TICK, &expired_);
+        for (uint64_t index : expired_) {
+            Waiter& waiter = waiters_[index];
+            callbacks.push_back(std::move(waiter.callback));
+            waiter.callback = nullptr;
+            waiter.timer = TimerWheel::INVALID;
+            free_waiters_.push_back(static_cast<uint32_t>(index));
+        }
+    }
+    for (auto& callback : callbacks) {
+        callback();
+    }
+    return callbacks.size();
+}
+
+RateLimiter::BucketStats RateLimiter::getStats(uint32_t bucket) const {
+    BucketStats stats = BucketStats();
+    if (bucket >= count_.load(std::memory_order_acquire)) {
+        return stats;
+    }
+    const Bucket& entry = buckets_[bucket];
+    stats.bytes = entry.bytes.load(std::memory_order_relaxed);
+    stats.packets = entry.packets.load(std::memory_order_relaxed);
+    stats.denied = entry.denied.load(std::memory_order_relaxed);
+    stats.borrowed = entry.borrowed.load(std::memory_order_relaxed);
+    return stats;
+}
+
+uint64_t RateLimiter::now() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+void RateLimiter::configure(Gcra& gcra, unsigned int kbps, uint64_t burst_bytes, bool never_if_zero) {
+    if (kbps == 0) {
+        gcra.ns_per_byte.store(never_if_zero ? NEVER : 0, std::memory_order_relaxed);
+        gcra.tolerance.store(0, std::memory_order_relaxed);
+        return;
+    }
+    if (burst_bytes == 0) {
+        // 速率10ms的量
+        burst_bytes = std::max(static_cast<uint64_t>(kbps) * 10 / 8, MIN_BURST);
+    }
+    uint64_t ns_per_byte = (NS_PER_BYTE_KBPS << FRACTION_BITS) / kbps;
+    gcra.ns_per_byte.store(ns_per_byte, std::memory_order_relaxed);
+    gcra.tolerance.store(cost(gcra, static_cast<uint32_t>(std::min<uint64_t>(burst_bytes, 0xffffffffu))),
+                         std::memory_order_relaxed);
+}
+
+uint64_t RateLimiter::cost(const Gcra& gcra, uint32_t bytes) {
+    uint64_t ns_per_byte = gcra.ns_per_byte.load(std::memory_order_relaxed);
+    // 分开整数和小数部分相乘，避免溢出
+    return bytes * (ns_per_byte >> FRACTION_BITS) +
+           ((bytes * (ns_per_byte & ((1ull << FRACTION_BITS) - 1))) >> FRACTION_BITS);
+}
+
+bool RateLimiter::conforms(const Gcra& gcra, uint32_t bytes, uint64_t now_ns) {
+    uint64_t ns_per_byte = gcra.ns_per_byte.load(std::memory_order_relaxed);
+    if (ns_per_byte == 0) {
+        return true;
+    }
+    if (ns_per_byte == NEVER) {
+        return false;
+    }
+    uint64_t tolerance = gcra.tolerance.load(std::memory_order_relaxed);
+    uint64_t tat = gcra.tat.load(std::memory_order_relaxed);
+    return std::max(tat, now_ns) + std::min(cost(gcra, bytes), tolerance) <= now_ns + tolerance;
+}
+
+uint64_t RateLimiter::readyTime(const Gcra& gcra, uint32_t bytes, uint64_t now_ns) {
+    uint64_t ns_per_byte = gcra.ns_per_byte.load(std::memory_order_relaxed);
+    if (ns_per_byte == 0) {
+        return now_ns;
+    }
+    if (ns_per_byte == NEVER) {
+        return NEVER;
+    }
+    uint64_t tolerance = gcra.tolerance.load(std::memory_order_relaxed);
+    uint64_t due = gcra.tat.load(std::memory_order_relaxed) + std::min(cost(gcra, bytes), tolerance);
+    return due <= now_ns + tolerance ? now_ns : due - tolerance;
+}
+
+void RateLimiter::charge(Gcra& gcra, uint32_t bytes, uint64_t now_ns) {
+    uint64_t ns_per_byte = gcra.ns_per_byte.load(std::memory_order_relaxed);
+    if (ns_per_byte == 0 || ns_per_byte == NEVER) {
+        return;
+    }
+    uint64_t amount = cost(gcra, bytes);
+    uint64_t tat = gcra.tat.load(std::memory_order_relaxed);
+    while (!gcra.tat.compare_exchange_weak(tat, std::max(tat, now_ns) + amount, std::memory_order_relaxed)) {
+    }
+}
+
+size_t RateLimiter::path(uint32_t bucket, uint32_t* out) const {
+    size_t count = count_.load(std::memory_order_acquire);
+    size_t length = 0;
+    while (bucket < count && length < static_cast<size_t>(MAX_DEPTH)) {
+        out[length++] = bucket;
+        bucket = buckets_[bucket].parent;
+    }
+    return length;
+}
+
+uint32_t RateLimiter::interfaceBucket(const std::string& interface, unsigned int rate_kbps,
+                                      unsigned int burst_bytes, bool update) {
+    auto it = interfaces_.find(interface);
+    if (it != interfaces_.end()) {
+        if (update) {
+            setLimit(it->second, rate_kbps, rate_kbps, burst_bytes);
+        }
+        return it->second;
+    }
+    uint32_t bucket = addBucketLocked(INVALID, rate_kbps, rate_kbps, burst_bytes);
+    if (bucket != INVALID) {
+        interfaces_[interface] = bucket;
+    }
+    return bucket;
+}
+
+uint32_t RateLimiter::addBucketLocked(uint32_t parent, unsigned int rate_kbps, unsigned int ceil_kbps,
+                                      unsigned int burst_bytes) {
+    size_t count = count_.load(std::memory_order_relaxed);
+    if (count >= capacity_ || (parent != INVALID && parent >= count)) {
+        return INVALID;
+    }
+    int depth = parent == INVALID ? 1 : buckets_[parent].depth + 1;
+    if (depth > MAX_DEPTH) {
+        return INVALID;
+    }
+
+    Bucket& entry = buckets_[count];
+    entry.parent = parent;
+    entry.depth = depth;
+    entry.assured.tat.store(0, std::memory_order_relaxed);
+    entry.ceil.tat.store(0, std::memory_order_relaxed);
+    configure(entry.assured, parent == INVALID ? ceil_kbps : rate_kbps, burst_bytes, parent != INVALID);
+    configure(entry.ceil, ceil_kbps, burst_bytes, false);
+    entry.bytes.store(0, std::memory_order_relaxed);
+    entry.packets.store(0, std::memory_order_relaxed);
+    entry.denied.store(0, std::memory_order_relaxed);
+    entry.borrowed.store(0, std::memory_order_relaxed);
+    // 发布后其他线程才能看到这个桶
+    count_.store(count + 1, std::memory_order_release);
+    return static_cast<uint32_t>(count);
+}
@@ -0,0 +1,492 @@
+#include "RouteLookupTable.h"
+#include <cstring>
+#include <arpa/inet.h>
+
+namespace {
+
+// 第一级16位，之后IPv4每级8位、IPv6每级4位
+const int ROOT_BITS = 16;
+const size_t ROOT_SLOTS = 1u << ROOT_BITS;
+const int IPV4_STRIDE = 8;
+const int IPV6_STRIDE = 4;
+// IPv6最多 1 + (128 - 16) / 4 级
+const int MAX_LEVELS = 32;
+// 槽中路由编号占24位
+const uint32_t MAX_ROUTES = (1u << 24) - 1;
+const uint32_t NO_ROUTE = 0xffffffffu;
+
+int maxLength(int family) {
+    return family == AF_INET6 ? 128 : 32;
+}
+
+void maskAddress(IpAddress* address, int length) {
+    for (int bit = length; bit < 128; bit = (bit | 7) + 1) {
+        int byte = bit / 8;
+        int keep = bit % 8;
+        address->bytes[byte] &= static_cast<uint8_t>(0xff00 >> keep);
+    }
+}
+
+// 某一级之前已用的位数
+int levelStart(int level, int stride) {
+    return level == 0 ? 0 : ROOT_BITS + (level - 1) * stride;
+}
+
+int levelBits(int level, int stride) {
+    return level == 0 ? ROOT_BITS : stride;
+}
+
+// 前缀所在的一级
+int levelOf(int length, int stride) {
+    return length <= ROOT_BITS ? 0 : (length - ROOT_BITS + stride - 1) / stride;
+}
+
+// 地址在某一级上的槽号
+size_t chunkAt(const uint8_t* bytes, int level, int stride) {
+    if (level == 0) {
+        return (static_cast<size_t>(bytes[0]) << 8) | bytes[1];
+    }
+    int start = levelStart(level, stride);
+    uint8_t byte = bytes[start / 8];
+    if (stride == 8) {
+        return byte;
+    }
+    return (start % 8) ? (byte & 0x0f) : (byte >> 4);
+}
+
+void setChunkAt(uint8_t* bytes, int level, int stride, size_t index) {
+    if (level == 0) {
+        bytes[0] = static_cast<uint8_t>(index >> 8);
+        bytes[1] = static_cast<uint8_t>(index);
+        return;
+    }
+    int start = levelStart(level, stride);
+    uint8_t& byte = bytes[start / 8];
+    if (stride == 8) {
+        byte = static_cast<uint8_t>(index);
+    } else if (start % 8) {
+        byte = static_cast<uint8_t>((byte & 0xf0) | index);
+    } else {
+        byte = static_cast<uint8_t>((byte & 0x0f) | (index << 4));
+    }
+}
+
+uint32_t makeInfo(uint32_t route, int length) {
+    return ((route + 1) << 8) | static_cast<uint32_t>(length);
+}
+
+}  // namespace
+
+bool IpAddress::parse(const std::string& text, IpAddress* out) {
+    memset(out, 0, sizeof(*out));
+    if (inet_pton(AF_INET, text.c_str(), out->bytes) == 1) {
+        out->family = AF_INET;
+        return true;
+    }
+    if (inet_pton(AF_INET6, text.c_str(), out->bytes) == 1) {
+        out->family = AF_INET6;
+        return true;
+    }
+    return false;
+}
+
+IpAddress IpAddress::fromIpv4(uint32_t host_order) {
+    IpAddress address;
+    memset(&address, 0, sizeof(address));
+    address.family = AF_INET;
+    address.bytes[0] = static_cast<uint8_t>(host_order >> 24);
+    address.bytes[1] = static_cast<uint8_t>(host_order >> 16);
+    address.bytes[2] = static_cast<uint8_t>(host_order >> 8);
+    address.bytes[3] = static_cast<uint8_t>(host_order);
+    return address;
+}
+
+bool IpPrefix::parse(const std::string& text, IpPrefix* out) {
+    if (text == "default") {
+        memset(&out->address, 0, sizeof(out->address));
+        out->address.family = AF_INET;
+        out->length = 0;
+        return true;
+    }
+    size_t slash = text.find('/');
+    if (!IpAddress::parse(text.substr(0, slash), &out->address)) {
+        return false;
+    }
+    int max_length = maxLength(out->address.family);
+    out->length = max_length;
+    if (slash != std::string::npos) {
+        const char* p = text.c_str() + slash + 1;
+        if (*p == '\0') {
+            return false;
+        }
+        int length = 0;
+        for (; *p; ++p) {
+            if (*p < '0' || *p > '9' || length > max_length) {
+                return false;
+            }
+            length = length * 10 + (*p - '0');
+        }
+        if (length > max_length) {
+            return false;
+        }
+        out->length = length;
+    }
+    maskAddress(&out->address, out->length);
+    return true;
+}
+
+bool IpPrefix::operator==(const IpPrefix& other) const {
+    return address.family == other.address.family && length == other.length &&
+           memcmp(address.bytes, other.address.bytes, sizeof(address.bytes)) == 0;
+}
+
+size_t IpPrefixHash::operator()(const IpPrefix& prefix) const {
+    uint64_t hi;
+    uint64_t lo;
+    memcpy(&hi, prefix.address.bytes, sizeof(hi));
+    memcpy(&lo, prefix.address.bytes + 8, sizeof(lo));
+    uint64_t h = hi * 0x9e3779b97f4a7c15ULL;
+    h ^= (lo + 0x632be59bd9b4e019ULL + (h << 6) + (h >> 2));
+    h ^= static_cast<uint64_t>(prefix.length) << 8 | static_cast<uint64_t>(prefix.address.family);
+    h *= 0xff51afd7ed558ccdULL;
+    return static_cast<size_t>(h ^ (h >> 33));
+}
+
+
+RouteLookupTable::RouteLookupTable() {
+    clear();
+}
+
+void RouteLookupTable::clear() {
+    routes_.clear();
+    free_routes_.clear();
+    route_count_ = 0;
+    prefixes_.clear();
+    resetTrie(&trie4_, IPV4_STRIDE, false);
+    resetTrie(&trie6_, IPV6_STRIDE, true);
+    // IPv4查找不检查第一级是否为空
+    Slot empty = {0, 0};
+    trie4_.root.assign(ROOT_SLOTS, empty);
+}
+
+void RouteLookupTable::resetTrie(Trie* trie, int stride, bool compressed) {
+    Slot empty = {0, 0};
+    NodeInfo unused;
+    memset(&unused, 0, sizeof(unused));
+    trie->stride = stride;
+    trie->compressed = compressed;
+    trie->root.clear();
+    trie->nodes.assign(static_cast<size_t>(1) << stride, empty);
+    trie->info.assign(1, unused);
+    trie->free_nodes.clear();
+}
+
+bool RouteLookupTable::add(const RouteEntry& route) {
+    IpPrefix prefix;
+    if (!IpPrefix::parse(route.destination, &prefix)) {
+        return false;
+    }
+    uint32_t id;
+    if (!free_routes_.empty()) {
+        id = free_routes_.back();
+        free_routes_.pop_back();
+        routes_[id] = route;
+    } else {
+        if (routes_.size() >= MAX_ROUTES) {
+            return false;
+        }
+        id = static_cast<uint32_t>(routes_.size());
+        routes_.push_back(route);
+    }
+    route_count_++;
+
+    auto result = prefixes_.insert(std::make_pair(prefix, PrefixRoutes()));
+    PrefixRoutes& entry = result.first->second;
+    if (result.second) {
+        entry.best = NO_ROUTE;
+    }
+    entry.routes.push_back(id);
+    uint32_t best = bestRoute(entry);
+    if (best != entry.best) {
+        entry.best = best;
+        updatePrefix(prefix, makeInfo(best, prefix.length));
+    }
+    return true;
+}
+
+bool RouteLookupTable::remove(const std::string& destination, const std::string& gateway) {
+    IpPrefix prefix;
+    if (!IpPrefix::parse(destination, &prefix)) {
+        return false;
+    }
+    auto it = prefixes_.find(prefix);
+    if (it == prefixes_.end()) {
+        return false;
+    }
+    PrefixRoutes& entry = it->second;
+    for (size_t i = 0; i < entry.routes.size(); ++i) {
+        uint32_t id = entry.routes[i];
+        if (routes_[id].gateway != gateway) {
+            continue;
+        }
+        entry.routes.erase(entry.routes.begin() + i);
+        routes_[id] = RouteEntry();
+        free_routes_.push_back(id);
+        route_count_--;
+
+        if (entry.routes.empty()) {
+            // 先删除前缀，重新计算覆盖的槽时不会再找到它
+            prefixes_.erase(it);
+            updatePrefix(prefix, 0);
+        } else {
+            uint32_t best = bestRoute(entry);
+            if (best != entry.best) {
+                entry.best = best;
+                updatePrefix(prefix, makeInfo(best, prefix.length));
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+const RouteEntry* RouteLookupTable::lookup(uint32_t ipv4) const {
+    const Slot* s = &trie4_.root[ipv4 >> 16];
+    uint32_t best = s->info;
+    uint32_t child = s->child;
+    int shift = 8;
+    while (child) {
+        s = &trie4_.nodes[(static_cast<size_t>(child) << IPV4_STRIDE) | ((ipv4 >> shift) & 0xff)];
+        if (s->info) {
+            best = s->info;
+        }
+        child = s->child;
+        shift -= IPV4_STRIDE;
+    }
+    return best ? &routes_[(best >> 8) - 1] : nullptr;
+}
+
+const RouteEntry* RouteLookupTable::lookup(const IpAddress& address) const {
+    if (address.family == AF_INET) {
+        uint32_t ipv4 = (static_cast<uint32_t>(address.bytes[0]) << 24) |
+                        (static_cast<uint32_t>(address.bytes[1]) << 16) |
+                        (static_cast<uint32_t>(address.bytes[2]) << 8) | address.bytes[3];
+        return lookup(ipv4);
+    }
+    if (address.family == AF_INET6) {
+        return lookupTrie(trie6_, address.bytes);
+    }
+    return nullptr;
+}
+
+const RouteEntry* RouteLookupTable::lookupTrie(const Trie& trie, const uint8_t* bytes) const {
+    if (trie.root.empty()) {
+        return nullptr;
+    }
+    int stride = trie.stride;
+    const Slot* s = &trie.root[chunkAt(bytes, 0, stride)];
+    uint32_t best = s->info;
+    uint32_t child = s->child;
+    int level = 0;
+    while (child) {
+        const NodeInfo& node = trie.info[child];
+        for (int skipped = level + 1; skipped < node.level; ++skipped) {
+            if (chunkAt(bytes, skipped, stride) != chunkAt(node.key, skipped, stride)) {
+                return best ? &routes_[(best >> 8) - 1] : nullptr;
+            }
+        }
+        level = node.level;
+        s = &trie.nodes[(static_cast<size_t>(child) << stride) | chunkAt(bytes, level, stride)];
+        if (s->info) {
+            best = s->info;
+        }
+        child = s->child;
+    }
+    return best ? &routes_[(best >> 8) - 1] : nullptr;
+}
+
+size_t RouteLookupTable::memoryUsage() const {
+    size_t total = 0;
+    const Trie* tries[] = {&trie4_, &trie6_};
+    for (const Trie* trie : tries) {
+        total += (trie->root.capacity() + trie->nodes.capacity()) * sizeof(Slot) +
+                 trie->info.capacity() * sizeof(NodeInfo) + trie->free_nodes.capacity() * sizeof(uint32_t);
+    }
+    return total;
+}
+
+uint32_t RouteLookupTable::bestRoute(const PrefixRoutes& entry) const {
+    uint32_t best = NO_ROUTE;
+    for (uint32_t id : entry.routes) {
+        if (best == NO_ROUTE || routes_[id].metric < routes_[best].metric) {
+            best = id;
+        }
+    }
+    return best;
+}
+
+RouteLookupTable::Slot* RouteLookupTable::slots(Trie& trie, uint32_t node) {
+    if (node != 0) {
+        return &trie.nodes[static_cast<size_t>(node) << trie.stride];
+    }
+    return trie.root.data();
+}
+
+uint32_t RouteLookupTable::newNode(Trie& trie, int level, const uint8_t* key) {
+    uint32_t node;
+    if (!trie.free_nodes.empty()) {
+        node = trie.free_nodes.back();
+        trie.free_nodes.pop_back();
+    } else {
+        node = static_cast<uint32_t>(trie.info.size());
+        Slot empty = {0, 0};
+        trie.nodes.resize(trie.nodes.size() + (static_cast<size_t>(1) << trie.stride), empty);
+        trie.info.push_back(NodeInfo());
+    }
+    NodeInfo& info = trie.info[node];
+    info.level = static_cast<uint16_t>(level);
+    info.used = 0;
+    memcpy(info.key, key, sizeof(info.key));
+    return node;
+}
+
+void RouteLookupTable::updatePrefix(const IpPrefix& prefix, uint32_t info) {
+    Trie& trie = prefix.address.family == AF_INET6 ? trie6_ : trie4_;
+    if (trie.root.empty()) {
+        if (info == 0) {
+            return;
+        }
+        Slot empty = {0, 0};
+        trie.root.assign(ROOT_SLOTS, empty);
+    }
+    int stride = trie.stride;
+    int length = prefix.length;
+    int target = levelOf(length, stride);
+    const uint8_t* bytes = prefix.address.bytes;
+
+    // 找到前缀所在一级的节点，沿途记下路径，删除后回收节点用
+    uint32_t path_node[MAX_LEVELS];
+    size_t path_index[MAX_LEVELS];
+    int depth = 0;
+    uint32_t node = 0;
+    int level = 0;
+    while (level < target) {
+        size_t index = chunkAt(bytes, level, stride);
+        uint32_t child = slots(trie, node)[index].child;
+        if (child == 0) {
+            if (info == 0) {
+                return;
+            }
+            // 路径压缩时中间各级只有这一条路径，直接在目标一级建节点
+            child = newNode(trie, trie.compressed ? target : level + 1, bytes);
+            Slot& s = slots(trie, node)[index];
+            if (node != 0 && s.info == 0) {
+                trie.info[node].used++;
+            }
+            s.child = child;
+        } else {
+            // 比较子节点压缩掉的各级，不一致或前缀在这之间结束时拆出一个节点
+            int child_level = trie.info[child].level;
+            int limit = child_level < target ? child_level : target;
+            int split = level + 1;
+            while (split < limit &&
+                   chunkAt(bytes, split, stride) == chunkAt(trie.info[child].key, split, stride)) {
+                split++;
+            }
+            if (split < child_level) {
+                if (info == 0) {
+                    return;
+                }
+                uint8_t key[16];
+                memcpy(key, trie.info[child].key, sizeof(key));
+                uint32_t middle = newNode(trie, split, key);
+                slots(trie, middle)[chunkAt(key, split, stride)].child = child;
+                trie.info[middle].used = 1;
+                slots(trie, node)[index].child = middle;
+                child = middle;
+            }
+        }
+        path_node[depth] = node;
+        path_index[depth] = index;
+        depth++;
+        node = child;
+        level = trie.info[child].level;
+    }
+
+    // 前缀在本级覆盖的槽
+    int span = levelStart(level, stride) + levelBits(level, stride) - length;
+    size_t first = chunkAt(bytes, level, stride) & ~((static_cast<size_t>(1) << span) - 1);
+    size_t count = static_cast<size_t>(1) << span;
+    Slot* table = slots(trie, node);
+    for (size_t i = first; i < first + count; ++i) {
+        Slot& s = table[i];
+        bool was_empty = s.info == 0 && s.child == 0;
+        int current_length = static_cast<int>(s.info & 0xff);
+        if (info != 0) {
+            if (s.info == 0 || current_length <= length) {
+                s.info = info;
+            }
+        } else if (s.info != 0 && current_length == length) {
+            s.info = coveringInfo(prefix, stride, level, i);
+        }
+        bool is_empty = s.info == 0 && s.child == 0;
+        if (node != 0 && was_empty != is_empty) {
+            trie.info[node].used += is_empty ? -1 : 1;
+        }
+    }
+
+    if (info == 0) {
+        compact(trie, node, path_node, path_index, depth);
+    }
+}
+
+void RouteLookupTable::compact(Trie& trie, uint32_t node, const uint32_t* path_node,
+                               const size_t* path_index, int depth) {
+    while (node != 0 && depth > 0) {
+        uint32_t parent = path_node[depth - 1];
+        Slot& link = slots(trie, parent)[path_index[depth - 1]];
+        NodeInfo& info = trie.info[node];
+        if (info.used == 0) {
+            trie.free_nodes.push_back(node);
+            link.child = 0;
+            if (parent != 0 && link.info == 0) {
+                trie.info[parent].used--;
+            }
+            node = parent;
+            depth--;
+            continue;
+        }
+        if (info.used == 1 && trie.compressed) {
+            // 只剩一个子节点、没有路由时，让上级直接指向这个子节点
+            Slot* table = slots(trie, node);
+            size_t count = static_cast<size_t>(1) << trie.stride;
+            for (size_t i = 0; i < count; ++i) {
+                if (table[i].info != 0 || table[i].child != 0) {
+                    if (table[i].info == 0) {
+                        link.child = table[i].child;
+                        table[i].child = 0;
+                        trie.free_nodes.push_back(node);
+                    }
+                    break;
+                }
+            }
+        }
+        break;
+    }
+}
+
+uint32_t RouteLookupTable::coveringInfo(const IpPrefix& prefix, int stride, int level, size_t slot_index) const {
+    // 本级只存放长度在(start, start + bits]内的前缀，更短的在上一级
+    int shortest = level == 0 ? 0 : levelStart(level, stride) + 1;
+    IpPrefix candidate = prefix;
+    setChunkAt(candidate.address.bytes, level, stride, slot_index);
+    for (int length = prefix.length - 1; length >= shortest; --length) {
+        candidate.length = length;
+        maskAddress(&candidate.address, length);
+        auto it = prefixes_.find(candidate);
+        if (it != prefixes_.end()) {
+            return makeInfo(it->second.best, length);
+        }
+    }
+    return 0;
+}
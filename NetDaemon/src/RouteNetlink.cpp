@@ -0,0 +1,382 @@
+#include "RouteNetlink.h"
+#include "RouteLookupTable.h"
+#include <iostream>
+#include <map>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+namespace {
+
+// 一次send的上限，对应的ACK要能放进接收缓冲区
+const size_t SEND_CHUNK = 16 * 1024;
+// 一条消息的最大长度：rtmsg + DST/GATEWAY（16字节）+ TABLE/OIF/PRIORITY（4字节）
+const size_t MAX_MESSAGE_SIZE = NLMSG_SPACE(sizeof(struct rtmsg)) + 2 * RTA_SPACE(16) + 3 * RTA_SPACE(4);
+const size_t RECV_BUFFER_SIZE = 32 * 1024;
+const int NETLINK_RCVBUF = 1024 * 1024;
+const int DEFAULT_ACK_TIMEOUT_MS = 1000;
+// 尚未收到ACK
+const int ACK_PENDING = -1;
+
+void addAttr(struct nlmsghdr* nlh, unsigned short type, const void* data, size_t len) {
+    struct rtattr* rta = reinterpret_cast<struct rtattr*>(reinterpret_cast<uint8_t*>(nlh) + NLMSG_ALIGN(nlh->nlmsg_len));
+    rta->rta_type = type;
+    rta->rta_len = static_cast<unsigned short>(RTA_LENGTH(len));
+    memcpy(RTA_DATA(rta), data, len);
+    nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+unsigned char routeType(RouteType type) {
+    switch (type) {
+        case RouteType::LOCAL:     return RTN_LOCAL;
+        case RouteType::BROADCAST: return RTN_BROADCAST;
+        case RouteType::MULTICAST: return RTN_MULTICAST;
+        case RouteType::ANYCAST:   return RTN_ANYCAST;
+        default:                   return RTN_UNICAST;
+    }
+}
+
+unsigned char routeProtocol(RouteProtocol protocol) {
+    switch (protocol) {
+        case RouteProtocol::KERNEL:        return RTPROT_KERNEL;
+        case RouteProtocol::BOOT:          return RTPROT_BOOT;
+        case RouteProtocol::ICMP_REDIRECT: return RTPROT_REDIRECT;
+        case RouteProtocol::RA:            return RTPROT_RA;
+        default:                           return RTPROT_STATIC;
+    }
+}
+
+int64_t monotonicMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+}  // namespace
+
+RouteNetlink::RouteNetlink()
+    : fd_(-1), seq_(0), ack_timeout_ms_(DEFAULT_ACK_TIMEOUT_MS),
+      send_buf_(SEND_CHUNK), recv_buf_(RECV_BUFFER_SIZE) {
+    seq_ = static_cast<uint32_t>(time(nullptr));
+}
+
+RouteNetlink::~RouteNetlink() {
+    close();
+}
+
+bool RouteNetlink::open() {
+    close();
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        std::cerr << "[RouteNetlink] Failed to open netlink socket: " << strerror(errno) << std::endl;
+        return false;
+    }
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        std::cerr << "[RouteNetlink] Failed to bind netlink socket: " << strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    // 一批的ACK一次性排在接收队列里，接收缓冲区要放得下
+    int rcvbuf = NETLINK_RCVBUF;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+#ifdef NETLINK_CAP_ACK
+    // 出错时ACK不附带原消息
+    int one = 1;
+    setsockopt(fd, SOL_NETLINK, NETLINK_CAP_ACK, &one, sizeof(one));
+#endif
+    fd_ = fd;
+    return true;
+}
+
+bool RouteNetlink::attach(int fd) {
+    if (fd < 0) {
+        return false;
+    }
+    close();
+    fd_ = fd;
+    return true;
+}
+
+void RouteNetlink::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool RouteNetlink::apply(const std::vector<RouteChange>& changes, RouteBatchResult* result) {
+    RouteBatchResult local;
+    RouteBatchResult& r = result ? *result : local;
+    size_t count = changes.size();
+    r.succeeded = 0;
+    r.failed = 0;
+    r.first_failed = count;
+    r.error = 0;
+    r.rolled_back = 0;
+    r.rollback_ok = true;
+    if (count == 0) {
+        return true;
+    }
+
+    // 先检查每条修改都能编码、接口存在，有问题时什么都不下发
+    std::vector<int> ifindex(count, 0);
+    std::map<std::string, int> resolved;
+    int precheck = 0;
+    if (fd_ < 0) {
+        precheck = ENOTCONN;
+        r.first_failed = 0;
+    }
+    for (size_t i = 0; i < count && precheck == 0; ++i) {
+        const RouteChange& change = changes[i];
+        if (!change.route.interface.empty()) {
+            auto it = resolved.find(change.route.interface);
+            if (it == resolved.end()) {
+                int index = static_cast<int>(if_nametoindex(change.route.interface.c_str()));
+                it = resolved.insert(std::make_pair(change.route.interface, index)).first;
+            }
+            ifindex[i] = it->second;
+            // 接口已经消失时它的路由也已被内核删除，删除操作不指定接口
+            if (ifindex[i] == 0 && change.action == RouteChangeAction::ADD) {
+                precheck = ENODEV;
+            }
+        }
+        if (precheck == 0 && encode(change, ifindex[i], 0, send_buf_.data(), send_buf_.size()) == 0) {
+            precheck = EINVAL;
+        }
+        if (precheck != 0) {
+            r.first_failed = i;
+        }
+    }
+    if (precheck != 0) {
+        r.failed = count;
+        r.error = precheck;
+        std::cerr << "[RouteNetlink] Batch of " << count << " rejected at #" << r.first_failed
+                  << ": " << strerror(precheck) << std::endl;
+        return false;
+    }
+
+    std::vector<int> errors(count);
+    submit(changes.data(), ifindex.data(), count, errors.data());
+    // 要删除的路由已经不存在时视为成功，但回滚时不加回
+    std::vector<bool> absent(count, false);
+    for (size_t i = 0; i < count; ++i) {
+        if (errors[i] == ESRCH && changes[i].action == RouteChangeAction::DELETE) {
+            errors[i] = 0;
+            absent[i] = true;
+        }
+        if (errors[i] == 0) {
+            r.succeeded++;
+        } else {
+            if (r.failed == 0) {
+                r.first_failed = i;
+                r.error = errors[i];
+            }
+            r.failed++;
+        }
+    }
+    if (r.failed == 0) {
+        return true;
+    }
+
+    // 按相反顺序撤销已成功的修改
+    std::vector<RouteChange> undo;
+    std::vector<int> undo_ifindex;
+    for (size_t i = count; i-- > 0;) {
+        if (errors[i] != 0 || absent[i]) {
+            continue;
+        }
+        RouteChange inverse = changes[i];
+        inverse.action = inverse.action == RouteChangeAction::ADD ? RouteChangeAction::DELETE : RouteChangeAction::ADD;
+        undo.push_back(inverse);
+        undo_ifindex.push_back(ifindex[i]);
+    }
+    if (!undo.empty()) {
+        std::vector<int> undo_errors(undo.size());
+        submit(undo.data(), undo_ifindex.data(), undo.size(), undo_errors.data());
+        for (size_t i = 0; i < undo.size(); ++i) {
+            int error = undo_errors[i];
+            bool done = error == 0 ||
+                        (error == EEXIST && undo[i].action == RouteChangeAction::ADD) ||
+                        (error == ESRCH && undo[i].action == RouteChangeAction::DELETE);
+            if (done) {
+                r.rolled_back++;
+            } else {
+                r.rollback_ok = false;
+            }
+        }
+    }
+
+    const RouteChange& failed = changes[r.first_failed];
+    std::cerr << "[RouteNetlink] Batch of " << count << " failed at #" << r.first_failed << " ("
+              << (failed.action == RouteChangeAction::ADD ? "add " : "del ") << failed.route.destination
+              << "): " << strerror(r.error) << ", rolled back " << r.rolled_back
+              << (r.rollback_ok ? "" : " (rollback incomplete)") << std::endl;
+    return false;
+}
+
+void RouteNetlink::submit(const RouteChange* changes, const int* ifindex, size_t count, int* errors) {
+    size_t i = 0;
+    while (i < count) {
+        // 尽量多地打包，一次send
+        size_t first = i;
+        uint32_t first_seq = seq_ + 1;
+        size_t len = 0;
+        while (i < count && len + MAX_MESSAGE_SIZE <= send_buf_.size()) {
+            len += encode(changes[i], ifindex[i], ++seq_, send_buf_.data() + len, send_buf_.size() - len);
+            i++;
+        }
+
+        ssize_t sent;
+        do {
+            sent = send(fd_, send_buf_.data(), len, 0);
+        } while (sent < 0 && errno == EINTR);
+        if (sent < 0) {
+            int error = errno;
+            std::cerr << "[RouteNetlink] Failed to send route batch: " << strerror(error) << std::endl;
+            for (size_t k = first; k < count; ++k) {
+                errors[k] = error;
+            }
+            return;
+        }
+        collectAcks(first_seq, i - first, errors + first);
+    }
+}
+
+void RouteNetlink::collectAcks(uint32_t first_seq, size_t count, int* errors) {
+    for (size_t k = 0; k < count; ++k) {
+        errors[k] = ACK_PENDING;
+    }
+    size_t received = 0;
+    int64_t deadline = monotonicMs() + ack_timeout_ms_;
+    int lost = ETIMEDOUT;
+    while (received < count) {
+        int64_t remaining = deadline - monotonicMs();
+        struct pollfd pfd;
+        pfd.fd = fd_;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (remaining <= 0 || poll(&pfd, 1, static_cast<int>(remaining)) <= 0) {
+            break;
+        }
+        ssize_t n = recv(fd_, recv_buf_.data(), recv_buf_.size(), 0);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            // ENOBUFS表示有ACK被内核丢弃，无法知道那些修改的结果
+            lost = errno;
+            std::cerr << "[RouteNetlink] Failed to receive acks: " << strerror(lost) << std::endl;
+            break;
+        }
+        if (n == 0) {
+            lost = ECONNRESET;
+            break;
+        }
+
+        size_t offset = 0;
+        size_t total = static_cast<size_t>(n);
+        while (total - offset >= sizeof(struct nlmsghdr)) {
+            const struct nlmsghdr* nlh = reinterpret_cast<const struct nlmsghdr*>(recv_buf_.data() + offset);
+            if (nlh->nlmsg_len < sizeof(struct nlmsghdr) || nlh->nlmsg_len > total - offset) {
+                std::cerr << "[RouteNetlink] Malformed netlink message" << std::endl;
+                break;
+            }
+            size_t index = static_cast<uint32_t>(nlh->nlmsg_seq - first_seq);
+            if (nlh->nlmsg_type == NLMSG_ERROR && index < count && errors[index] == ACK_PENDING &&
+                nlh->nlmsg_len >= NLMSG_LENGTH(sizeof(struct nlmsgerr))) {
+                const struct nlmsgerr* err = static_cast<const struct nlmsgerr*>(NLMSG_DATA(nlh));
+                errors[index] = -err->error;
+                received++;
+            }
+            offset += NLMSG_ALIGN(nlh->nlmsg_len);
+        }
+    }
+
+    for (size_t k = 0; k < count; ++k) {
+        if (errors[k] == ACK_PENDING) {
+            errors[k] = lost;
+        }
+    }
+}
+
+size_t RouteNetlink::encode(const RouteChange& change, int ifindex, uint32_t seq, uint8_t* buf, size_t size) {
+    const RouteEntry& route = change.route;
+    IpPrefix prefix;
+    if (!IpPrefix::parse(route.destination, &prefix)) {
+        return 0;
+    }
+    IpAddress gateway;
+    bool has_gateway = !route.gateway.empty();
+    if (has_gateway) {
+        if (!IpAddress::parse(route.gateway, &gateway)) {
+            return 0;
+        }
+        // "default"按IPv4解析，IPv6默认路由由网关决定地址族
+        if (prefix.length == 0) {
+            prefix.address.family = gateway.family;
+        }
+        if (gateway.family != prefix.address.family) {
+            return 0;
+        }
+    }
+    if (size < MAX_MESSAGE_SIZE) {
+        return 0;
+    }
+
+    bool add = change.action == RouteChangeAction::ADD;
+    size_t addr_len = prefix.address.family == AF_INET ? 4 : 16;
+    uint32_t table = route.table_id == 0 ? RT_TABLE_MAIN : route.table_id;
+
+    memset(buf, 0, MAX_MESSAGE_SIZE);
+    struct nlmsghdr* nlh = reinterpret_cast<struct nlmsghdr*>(buf);
+    nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    nlh->nlmsg_type = add ? RTM_NEWROUTE : RTM_DELROUTE;
+    nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | (add ? NLM_F_CREATE | NLM_F_EXCL : 0);
+    nlh->nlmsg_seq = seq;
+
+    struct rtmsg* rtm = static_cast<struct rtmsg*>(NLMSG_DATA(nlh));
+    rtm->rtm_family = static_cast<unsigned char>(prefix.address.family);
+    rtm->rtm_dst_len = static_cast<unsigned char>(prefix.length);
+    rtm->rtm_table = static_cast<unsigned char>(table < 256 ? table : RT_TABLE_UNSPEC);
+    if (add) {
+        rtm->rtm_protocol = routeProtocol(route.protocol);
+        rtm->rtm_type = routeType(route.type);
+        if (route.type == RouteType::LOCAL) {
+            rtm->rtm_scope = RT_SCOPE_HOST;
+        } else if (has_gateway) {
+            rtm->rtm_scope = RT_SCOPE_UNIVERSE;
+        } else {
+            rtm->rtm_scope = RT_SCOPE_LINK;
+        }
+    } else {
+        // 删除时类型、协议、范围不参与匹配
+        rtm->rtm_scope = RT_SCOPE_NOWHERE;
+    }
+
+    addAttr(nlh, RTA_TABLE, &table, sizeof(table));
+    if (prefix.length > 0) {
+        addAttr(nlh, RTA_DST, prefix.address.bytes, addr_len);
+    }
+    if (has_gateway) {
+        addAttr(nlh, RTA_GATEWAY, gateway.bytes, addr_len);
+    }
+    if (ifindex > 0) {
+        uint32_t oif = static_cast<uint32_t>(ifindex);
+        addAttr(nlh, RTA_OIF, &oif, sizeof(oif));
+    }
+    uint32_t priority = static_cast<uint32_t>(route.metric);
+    addAttr(nlh, RTA_PRIORITY, &priority, sizeof(priority));
+    return NLMSG_ALIGN(nlh->nlmsg_len);
+}
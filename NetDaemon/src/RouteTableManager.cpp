@@ -1,7 +1,10 @@
 #include "RouteTableManager.h"
+#include "RouteLookupTable.h"
+#include "RouteNetlink.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <unordered_map>
 
 RouteTableManager::RouteTableManager()
     : initialized_(false), wifi_priority_enabled_(false) {
@@ -36,25 +39,10 @@ RouteEntry* RouteTableManager::getDefaultRoute() {
 }
 
 bool RouteTableManager::addRoute(const RouteEntry& route) {
-    // 模拟执行命令: ip route add <destination> via <gateway> dev <interface> metric <metric>
-    std::ostringstream cmd;
-    cmd << "ip route add " << route.destination;
-    if (!route.gateway.empty()) {
-        cmd << " via " << route.gateway;
-    }
-    cmd << " dev " << route.interface;
-    cmd << " metric " << route.metric;
-
-    if (executeCommand(cmd.str())) {
-        routes_.push_back(route);
-        sortRoutes();
-        if (route_callback_) {
-            route_callback_(route, true);
-        }
-        return true;
-    }
-
-    return false;
+    RouteChange change;
+    change.action = RouteChangeAction::ADD;
+    change.route = route;
+    return applyRouteChanges(std::vector<RouteChange>(1, change));
 }
 
 bool RouteTableManager::deleteRoute(const std::string& destination, const std::string& gateway) {
@@ -68,47 +56,157 @@ bool RouteTableManager::deleteRoute(const std::string& destination, const std::s
         return false;
     }
 
-    // 模拟执行命令: ip route del <destination>
-    std::ostringstream cmd;
-    cmd << "ip route del " << destination;
-    if (!gateway.empty()) {
-        cmd << " via " << gateway;
-    }
-
-    if (executeCommand(cmd.str())) {
-        if (route_callback_) {
-            route_callback_(*it, false);
-        }
-        routes_.erase(it);
-        return true;
-    }
-
-    return false;
+    RouteChange change;
+    change.action = RouteChangeAction::DELETE;
+    change.route = *it;
+    return applyRouteChanges(std::vector<RouteChange>(1, change));
 }
 
 bool RouteTableManager::setDefaultRoute(const std::string& interface, 
                                          const std::string& gateway, int metric) {
-    // 先删除现有的默认路由
+    // 删除现有的默认路由和添加新的默认路由作为一批执行，失败时保留原来的默认路由
+    std::vector<RouteChange> changes;
     auto it = std::find_if(routes_.begin(), routes_.end(),
         [](const RouteEntry& r) {
             return r.destination == "0.0.0.0" || r.destination == "default";
         });
 
     if (it != routes_.end()) {
-        deleteRoute(it->destination, it->gateway);
+        RouteChange removal;
+        removal.action = RouteChangeAction::DELETE;
+        removal.route = *it;
+        changes.push_back(removal);
     }
 
     // 添加新的默认路由
-    RouteEntry new_route;
-    new_route.destination = "0.0.0.0/0";
-    new_route.gateway = gateway;
-    new_route.interface = interface;
-    new_route.metric = metric;
-    new_route.type = RouteType::UNICAST;
-    new_route.protocol = RouteProtocol::STATIC;
-    new_route.table_id = 254; // main table
-
-    return addRoute(new_route);
+    RouteChange addition;
+    addition.action = RouteChangeAction::ADD;
+    addition.route.destination = "0.0.0.0/0";
+    addition.route.gateway = gateway;
+    addition.route.interface = interface;
+    addition.route.metric = metric;
+    addition.route.type = RouteType::UNICAST;
+    addition.route.protocol = RouteProtocol::STATIC;
+    addition.route.table_id = 254; // main table
+    changes.push_back(addition);
+
+    return applyRouteChanges(changes);
+}
+
+bool RouteTableManager::applyRouteChanges(const std::vector<RouteChange>& changes) {
+    if (changes.empty()) {
+        return true;
+    }
+
+    bool success;
+    if (netlink_) {
+        RouteBatchResult result;
+        success = netlink_->apply(changes, &result);
+        if (!success && !result.rollback_ok) {
+            std::cerr << "[RouteTableManager] Rollback incomplete, kernel routes may differ, refresh needed"
+                      << std::endl;
+        }
+    } else {
+        success = executeChanges(changes);
+    }
+    if (!success) {
+        return false;
+    }
+
+    // 全部成功后再更新本地路由表和查找表，删除的条目一次扫描移除
+    std::unordered_map<std::string, size_t> removals;
+    for (const auto& change : changes) {
+        if (change.action == RouteChangeAction::DELETE) {
+            removals[routeKey(change.route)]++;
+        }
+    }
+    if (!removals.empty()) {
+        routes_.erase(std::remove_if(routes_.begin(), routes_.end(),
+            [this, &removals](const RouteEntry& r) {
+                auto it = removals.find(routeKey(r));
+                if (it == removals.end() || it->second == 0) {
+                    return false;
+                }
+                it->second--;
+                lookupTable(r.table_id).remove(r.destination, r.gateway);
+                return true;
+            }), routes_.end());
+    }
+    for (const auto& change : changes) {
+        const RouteEntry& route = change.route;
+        if (change.action != RouteChangeAction::ADD) {
+            continue;
+        }
+        routes_.push_back(route);
+        if (!lookupTable(route.table_id).add(route)) {
+            std::cerr << "[RouteTableManager] Invalid destination, not used for lookups: "
+                      << route.destination << std::endl;
+        }
+    }
+    sortRoutes();
+
+    if (route_callback_) {
+        for (const auto& change : changes) {
+            route_callback_(change.route, change.action == RouteChangeAction::ADD);
+        }
+    }
+    return true;
+}
+
+bool RouteTableManager::replaceTable(unsigned int table_id, const std::vector<RouteEntry>& routes) {
+    // 目标、网关、接口、metric、类型、协议都相同的路由不动；只比较表内的路由，
+    // 键不含table_id，传入的路由不必填写table_id
+    auto key = [](const RouteEntry& r) {
+        return r.destination + ' ' + r.gateway + ' ' + r.interface + ' ' + std::to_string(r.metric) + ' ' +
+               std::to_string(static_cast<int>(r.type)) + ' ' + std::to_string(static_cast<int>(r.protocol));
+    };
+
+    std::unordered_map<std::string, const RouteEntry*> wanted;
+    for (const auto& route : routes) {
+        wanted[key(route)] = &route;
+    }
+    std::vector<RouteChange> changes;
+    for (const auto& route : routes_) {
+        if (route.table_id != table_id) {
+            continue;
+        }
+        if (wanted.erase(key(route)) == 0) {
+            RouteChange change;
+            change.action = RouteChangeAction::DELETE;
+            change.route = route;
+            changes.push_back(change);
+        }
+    }
+    // 按传入的顺序添加
+    for (const auto& route : routes) {
+        auto it = wanted.find(key(route));
+        if (it == wanted.end() || it->second != &route) {
+            continue;
+        }
+        RouteChange change;
+        change.action = RouteChangeAction::ADD;
+        change.route = route;
+        change.route.table_id = table_id;
+        changes.push_back(change);
+    }
+
+    return applyRouteChanges(changes);
+}
+
+bool RouteTableManager::enableNetlink(int fd) {
+    std::unique_ptr<RouteNetlink> netlink(new RouteNetlink());
+    bool opened = fd >= 0 ? netlink->attach(fd) : netlink->open();
+    if (!opened) {
+        std::cerr << "[RouteTableManager] Netlink not available, using ip route commands" << std::endl;
+        return false;
+    }
+    netlink_ = std::move(netlink);
+    std::cout << "[RouteTableManager] Programming routes through rtnetlink" << std::endl;
+    return true;
+}
+
+void RouteTableManager::disableNetlink() {
+    netlink_.reset();
 }
 
 bool RouteTableManager::refreshRoutes() {
@@ -117,6 +215,34 @@ bool RouteTableManager::refreshRoutes() {
     return true;
 }
 
+const RouteEntry* RouteTableManager::lookupRoute(const std::string& address, unsigned int table_id) const {
+    IpAddress parsed;
+    if (!IpAddress::parse(address, &parsed)) {
+        return nullptr;
+    }
+    return lookupRoute(parsed, table_id);
+}
+
+const RouteEntry* RouteTableManager::lookupRoute(const IpAddress& address, unsigned int table_id) const {
+    // 与默认的ip rule一致：local、main、default
+    static const unsigned int DEFAULT_ORDER[] = {255, 254, 253};
+    if (table_id != 0) {
+        auto it = lookup_tables_.find(table_id);
+        return it == lookup_tables_.end() ? nullptr : it->second->lookup(address);
+    }
+    for (unsigned int id : DEFAULT_ORDER) {
+        auto it = lookup_tables_.find(id);
+        if (it == lookup_tables_.end()) {
+            continue;
+        }
+        const RouteEntry* route = it->second->lookup(address);
+        if (route) {
+            return route;
+        }
+    }
+    return nullptr;
+}
+
 std::vector<RouteEntry> RouteTableManager::getRoutesByInterface(const std::string& interface) {
     std::vector<RouteEntry> result;
     for (const auto& route : routes_) {
@@ -143,6 +269,7 @@ bool RouteTableManager::enableWifiPriority(const std::string& wifi_interface,
 
     // 排序路由表
     sortRoutes();
+    rebuildLookupTables();
 
     wifi_priority_enabled_ = true;
 
@@ -237,6 +364,7 @@ void RouteTableManager::readRouteTable() {
 
     // 排序路由表
     sortRoutes();
+    rebuildLookupTables();
 }
 
 bool RouteTableManager::executeCommand(const std::string& command) {
@@ -246,6 +374,47 @@ bool RouteTableManager::executeCommand(const std::string& command) {
     return true;
 }
 
+std::string RouteTableManager::routeKey(const RouteEntry& route) {
+    return route.destination + ' ' + route.gateway + ' ' + std::to_string(route.table_id);
+}
+
+std::string RouteTableManager::routeCommand(const RouteChange& change) {
+    // ip route add <destination> via <gateway> dev <interface> metric <metric>
+    // ip route del <destination> via <gateway>
+    const RouteEntry& route = change.route;
+    std::ostringstream cmd;
+    bool add = change.action == RouteChangeAction::ADD;
+    cmd << "ip route " << (add ? "add " : "del ") << route.destination;
+    if (!route.gateway.empty()) {
+        cmd << " via " << route.gateway;
+    }
+    if (add) {
+        cmd << " dev " << route.interface;
+        cmd << " metric " << route.metric;
+    }
+    if (route.table_id != 0 && route.table_id != 254) {
+        cmd << " table " << route.table_id;
+    }
+    return cmd.str();
+}
+
+bool RouteTableManager::executeChanges(const std::vector<RouteChange>& changes) {
+    for (size_t i = 0; i < changes.size(); ++i) {
+        if (executeCommand(routeCommand(changes[i]))) {
+            continue;
+        }
+        // 撤销已执行的修改
+        for (size_t j = i; j-- > 0;) {
+            RouteChange inverse = changes[j];
+            inverse.action = inverse.action == RouteChangeAction::ADD ? RouteChangeAction::DELETE
+                                                                     : RouteChangeAction::ADD;
+            executeCommand(routeCommand(inverse));
+        }
+        return false;
+    }
+    return true;
+}
+
 bool RouteTableManager::updateRoutePriorities() {
     if (!wifi_priority_enabled_) {
         return true;
@@ -261,6 +430,7 @@ bool RouteTableManager::updateRoutePriorities() {
     }
 
     sortRoutes();
+    rebuildLookupTables();
     return true;
 }
 
@@ -270,4 +440,21 @@ void RouteTableManager::sortRoutes() {
         [](const RouteEntry& a, const RouteEntry& b) {
             return a.metric < b.metric;
         });
-}
\ No newline at end of file
+}
+
+void RouteTableManager::rebuildLookupTables() {
+    for (auto& pair : lookup_tables_) {
+        pair.second->clear();
+    }
+    for (const auto& route : routes_) {
+        lookupTable(route.table_id).add(route);
+    }
+}
+
+RouteLookupTable& RouteTableManager::lookupTable(unsigned int table_id) {
+    std::unique_ptr<RouteLookupTable>& table = lookup_tables_[table_id];
+    if (!table) {
+        table.reset(new RouteLookupTable());
+    }
+    return *table;
+}
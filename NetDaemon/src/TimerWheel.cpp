@@ -0,0 +1,122 @@
+#include "TimerWheel.h"
+
+namespace {
+
+// 能表示的最远到期时间（相对当前时间）
+const uint64_t MAX_DELAY = (1ull << 24) - 1;
+
+}  // namespace
+
+TimerWheel::TimerWheel(uint64_t now) : free_(INVALID), now_(now), size_(0) {
+    for (auto& head : heads_) {
+        head = INVALID;
+    }
+}
+
+uint32_t TimerWheel::schedule(uint64_t expires, uint64_t data) {
+    uint32_t timer = free_;
+    if (timer == INVALID) {
+        timer = static_cast<uint32_t>(nodes_.size());
+        nodes_.push_back(Node());
+    } else {
+        free_ = nodes_[timer].next;
+    }
+    nodes_[timer].expires = expires;
+    nodes_[timer].data = data;
+    link(timer);
+    size_++;
+    return timer;
+}
+
+void TimerWheel::reschedule(uint32_t timer, uint64_t expires) {
+    unlink(timer);
+    nodes_[timer].expires = expires;
+    link(timer);
+}
+
+void TimerWheel::cancel(uint32_t timer) {
+    unlink(timer);
+    nodes_[timer].slot = INVALID;
+    nodes_[timer].next = free_;
+    free_ = timer;
+    size_--;
+}
+
+size_t TimerWheel::advance(uint64_t now, std::vector<uint64_t>* expired) {
+    size_t count = 0;
+    if (size_ == 0) {
+        now_ = now + 1 > now_ ? now + 1 : now_;
+        return 0;
+    }
+    while (now_ <= now) {
+        // 走到上级槽的起点时，把槽中的定时器下放（从高到低，下放的可能还要继续下放）
+        for (int level = LEVELS - 1; level > 0; --level) {
+            if ((now_ & ((1ull << (SLOT_BITS * level)) - 1)) != 0) {
+                continue;
+            }
+            uint32_t& head = heads_[level * SLOTS + ((now_ >> (SLOT_BITS * level)) & (SLOTS - 1))];
+            uint32_t timer = head;
+            head = INVALID;
+            while (timer != INVALID) {
+                uint32_t next = nodes_[timer].next;
+                link(timer);
+                timer = next;
+            }
+        }
+
+        uint32_t& head = heads_[now_ & (SLOTS - 1)];
+        uint32_t timer = head;
+        head = INVALID;
+        while (timer != INVALID) {
+            Node& node = nodes_[timer];
+            uint32_t next = node.next;
+            expired->push_back(node.data);
+            node.slot = INVALID;
+            node.next = free_;
+            free_ = timer;
+            size_--;
+            count++;
+            timer = next;
+        }
+        now_++;
+        if (size_ == 0) {
+            now_ = now + 1;
+        }
+    }
+    return count;
+}
+
+void TimerWheel::link(uint32_t timer) {
+    Node& node = nodes_[timer];
+    // 过期的放到当前tick；太远的先放在最远处，走到那里时再重新放置
+    uint64_t expires = node.expires < now_ ? now_ : node.expires;
+    if (expires - now_ > MAX_DELAY) {
+        expires = now_ + MAX_DELAY;
+    }
+    uint64_t diff = expires ^ now_;
+    int level = diff == 0 ? 0 : (63 - __builtin_clzll(diff)) / SLOT_BITS;
+    if (level >= LEVELS) {
+        level = LEVELS - 1;
+    }
+    uint32_t slot = static_cast<uint32_t>(level) * SLOTS +
+                    static_cast<uint32_t>((expires >> (SLOT_BITS * level)) & (SLOTS - 1));
+    node.slot = slot;
+    node.prev = INVALID;
+    node.next = heads_[slot];
+    if (node.next != INVALID) {
+        nodes_[node.next].prev = timer;
+    }
+    heads_[slot] = timer;
+}
+
+void TimerWheel::unlink(uint32_t timer) {
+    Node& node = nodes_[timer];
+    if (node.prev != INVALID) {
+        nodes_[node.prev].next = node.next;
+    } else {
+        heads_[node.slot] = node.next;
+    }
+    if (node.next != INVALID) {
+        nodes_[node.next].prev = node.prev;
+    }
+}
@@ -0,0 +1,410 @@
+#include "TrafficHistory.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const int64_t SECONDS_PER_MINUTE = 60;
+const int64_t SECONDS_PER_HOUR = 3600;
+const uint64_t NS_PER_SECOND = 1000000000ULL;
+// 两次记录相隔不超过这么多秒时，把速率平均分到中间的每一秒；更长的间隔视为没有数据
+const int64_t MAX_FILL_SECONDS = 10;
+
+uint64_t counterDelta(uint64_t current, uint64_t previous) {
+    return current >= previous ? current - previous : 0;
+}
+
+// 向下取整到槽号，时间可能为负（查询窗口早于记录起点）
+int64_t slotOf(int64_t seconds, int64_t period) {
+    return seconds >= 0 ? seconds / period : -((-seconds + period - 1) / period);
+}
+
+// 换成更细一级分辨率，已经是秒级返回false
+bool finer(HistoryResolution* resolution) {
+    if (*resolution == HistoryResolution::SECOND) {
+        return false;
+    }
+    *resolution = *resolution == HistoryResolution::HOUR ? HistoryResolution::MINUTE : HistoryResolution::SECOND;
+    return true;
+}
+
+}  // namespace
+
+InterfaceHistory::InterfaceHistory(const HistoryConfig& config) {
+    initRing(&seconds_, 1, config.second_slots, false);
+    initRing(&minutes_, SECONDS_PER_MINUTE, config.minute_slots, true);
+    initRing(&hours_, SECONDS_PER_HOUR, config.hour_slots, true);
+    reset();
+}
+
+void InterfaceHistory::initRing(Ring* ring, int64_t period, size_t capacity, bool aggregated) {
+    ring->period = period;
+    ring->capacity = std::max<size_t>(capacity, 1);
+    ring->newest = -1;
+    ring->slots.assign(ring->capacity, -1);
+    for (int m = 0; m < METRIC_COUNT; ++m) {
+        ring->avg[m].assign(ring->capacity, 0.0f);
+        if (aggregated) {
+            ring->min[m].assign(ring->capacity, 0.0f);
+            ring->max[m].assign(ring->capacity, 0.0f);
+        }
+    }
+}
+
+void InterfaceHistory::clearAccumulator(Accumulator* acc) {
+    acc->slot = -1;
+    acc->count = 0;
+    for (int m = 0; m < METRIC_COUNT; ++m) {
+        acc->sum[m] = 0;
+        acc->min[m] = 0;
+        acc->max[m] = 0;
+    }
+}
+
+void InterfaceHistory::reset() {
+    Ring* rings[] = {&seconds_, &minutes_, &hours_};
+    for (Ring* r : rings) {
+        r->newest = -1;
+        std::fill(r->slots.begin(), r->slots.end(), -1);
+    }
+    clearAccumulator(&minute_acc_);
+    clearAccumulator(&hour_acc_);
+    memset(&base_counters_, 0, sizeof(base_counters_));
+    base_ns_ = 0;
+    has_base_ = false;
+}
+
+void InterfaceHistory::record(const InterfaceCounters& counters, uint64_t now_ns) {
+    if (!has_base_) {
+        base_counters_ = counters;
+        base_ns_ = now_ns;
+        has_base_ = true;
+        return;
+    }
+    int64_t base_second = static_cast<int64_t>(base_ns_ / NS_PER_SECOND);
+    int64_t now_second = static_cast<int64_t>(now_ns / NS_PER_SECOND);
+    if (now_second <= base_second) {
+        return;
+    }
+    if (now_second - base_second > MAX_FILL_SECONDS) {
+        // 间隔太长，中间留空，从这次记录重新开始
+        base_counters_ = counters;
+        base_ns_ = now_ns;
+        return;
+    }
+
+    // 上次记录到现在的平均速率，归入上次记录所在的秒到上一秒
+    double elapsed = static_cast<double>(now_ns - base_ns_) / NS_PER_SECOND;
+    float values[METRIC_COUNT];
+    values[static_cast<int>(HistoryMetric::RX_BPS)] =
+        static_cast<float>(counterDelta(counters.rx_bytes, base_counters_.rx_bytes) * 8 / elapsed);
+    values[static_cast<int>(HistoryMetric::TX_BPS)] =
+        static_cast<float>(counterDelta(counters.tx_bytes, base_counters_.tx_bytes) * 8 / elapsed);
+    values[static_cast<int>(HistoryMetric::RX_PPS)] =
+        static_cast<float>(counterDelta(counters.rx_packets, base_counters_.rx_packets) / elapsed);
+    values[static_cast<int>(HistoryMetric::TX_PPS)] =
+        static_cast<float>(counterDelta(counters.tx_packets, base_counters_.tx_packets) / elapsed);
+
+    for (int64_t s = base_second; s < now_second; ++s) {
+        putSecond(s, values);
+    }
+    base_counters_ = counters;
+    base_ns_ = now_ns;
+}
+
+void InterfaceHistory::putSecond(int64_t second, const float* values) {
+    if (second <= seconds_.newest) {
+        return;
+    }
+    size_t pos = static_cast<size_t>(second % static_cast<int64_t>(seconds_.capacity));
+    seconds_.slots[pos] = second;
+    for (int m = 0; m < METRIC_COUNT; ++m) {
+        seconds_.avg[m][pos] = values[m];
+    }
+    seconds_.newest = second;
+
+    int64_t minute = second / SECONDS_PER_MINUTE;
+    if (minute_acc_.slot != minute) {
+        flushAccumulator(&minute_acc_, &minutes_, &hour_acc_);
+    }
+    accumulate(&minute_acc_, minute, values, values, values, 1);
+}
+
+void InterfaceHistory::accumulate(Accumulator* acc, int64_t slot, const float* min, const float* max,
+                                  const float* avg, uint32_t count) {
+    if (acc->slot != slot) {
+        acc->slot = slot;
+        acc->count = 0;
+        for (int m = 0; m < METRIC_COUNT; ++m) {
+            acc->sum[m] = 0;
+            acc->min[m] = min[m];
+            acc->max[m] = max[m];
+        }
+    }
+    for (int m = 0; m < METRIC_COUNT; ++m) {
+        acc->sum[m] += static_cast<double>(avg[m]) * count;
+        acc->min[m] = std::min(acc->min[m], min[m]);
+        acc->max[m] = std::max(acc->max[m], max[m]);
+    }
+    acc->count += count;
+}
+
+void InterfaceHistory::flushAccumulator(Accumulator* acc, Ring* ring, Accumulator* next) {
+    if (acc->slot < 0 || acc->count == 0) {
+        return;
+    }
+    float avg[METRIC_COUNT];
+    for (int m = 0; m < METRIC_COUNT; ++m) {
+        avg[m] = static_cast<float>(acc->sum[m] / acc->count);
+    }
+    if (acc->slot > ring->newest) {
+        size_t pos = static_cast<size_t>(acc->slot % static_cast<int64_t>(ring->capacity));
+        ring->slots[pos] = acc->slot;
+        for (int m = 0; m < METRIC_COUNT; ++m) {
+            ring->avg[m][pos] = avg[m];
+            ring->min[m][pos] = acc->min[m];
+            ring->max[m][pos] = acc->max[m];
+        }
+        ring->newest = acc->slot;
+    }
+
+    if (next) {
+        // 小时按秒数加权，缺了几秒的分钟不会被当成完整的一分钟
+        int64_t hour = acc->slot * ring->period / SECONDS_PER_HOUR;
+        if (next->slot != hour) {
+            flushAccumulator(next, &hours_, nullptr);
+        }
+        accumulate(next, hour, acc->min, acc->max, avg, acc->count);
+    }
+    acc->count = 0;
+}
+
+const InterfaceHistory::Ring& InterfaceHistory::ring(HistoryResolution resolution) const {
+    switch (resolution) {
+        case HistoryResolution::MINUTE:
+            return minutes_;
+        case HistoryResolution::HOUR:
+            return hours_;
+        default:
+            return seconds_;
+    }
+}
+
+size_t InterfaceHistory::query(HistoryMetric metric, HistoryResolution resolution, int64_t from, int64_t to,
+                               HistoryPoint* out, size_t max_points) const {
+    const Ring& r = ring(resolution);
+    if (r.newest < 0) {
+        return 0;
+    }
+    int m = static_cast<int>(metric);
+    int64_t first = std::max(slotOf(from, r.period), r.newest - static_cast<int64_t>(r.capacity) + 1);
+    int64_t last = std::min(slotOf(to, r.period), r.newest);
+    size_t n = 0;
+    for (int64_t slot = std::max<int64_t>(first, 0); slot <= last && n < max_points; ++slot) {
+        size_t pos = static_cast<size_t>(slot % static_cast<int64_t>(r.capacity));
+        if (r.slots[pos] != slot) {
+            continue;
+        }
+        HistoryPoint& point = out[n++];
+        point.time = slot * r.period;
+        point.avg = r.avg[m][pos];
+        point.min = r.min[m].empty() ? point.avg : r.min[m][pos];
+        point.max = r.max[m].empty() ? point.avg : r.max[m][pos];
+    }
+    return n;
+}
+
+bool InterfaceHistory::summarize(HistoryMetric metric, HistoryResolution resolution, int64_t from, int64_t to,
+                                 HistorySummary* out) const {
+    const Ring& r = ring(resolution);
+    if (r.newest < 0) {
+        return false;
+    }
+    int m = static_cast<int>(metric);
+    int64_t first = std::max(slotOf(from, r.period), r.newest - static_cast<int64_t>(r.capacity) + 1);
+    int64_t last = std::min(slotOf(to, r.period), r.newest);
+    out->points = 0;
+    out->resolution = resolution;
+    double sum = 0;
+    for (int64_t slot = std::max<int64_t>(first, 0); slot <= last; ++slot) {
+        size_t pos = static_cast<size_t>(slot % static_cast<int64_t>(r.capacity));
+        if (r.slots[pos] != slot) {
+            continue;
+        }
+        double avg = r.avg[m][pos];
+        double min = r.min[m].empty() ? avg : r.min[m][pos];
+        double max = r.max[m].empty() ? avg : r.max[m][pos];
+        if (out->points == 0) {
+            out->from = slot * r.period;
+            out->min = min;
+            out->max = max;
+        }
+        out->to = slot * r.period;
+        out->min = std::min(out->min, min);
+        out->max = std::max(out->max, max);
+        sum += avg;
+        out->points++;
+    }
+    if (out->points == 0) {
+        return false;
+    }
+    out->avg = sum / out->points;
+    return true;
+}
+
+bool InterfaceHistory::percentile(HistoryMetric metric, HistoryResolution resolution, int64_t from, int64_t to,
+                                  double p, float* scratch, size_t scratch_size, double* value) const {
+    const Ring& r = ring(resolution);
+    if (r.newest < 0) {
+        return false;
+    }
+    int m = static_cast<int>(metric);
+    int64_t first = std::max(slotOf(from, r.period), r.newest - static_cast<int64_t>(r.capacity) + 1);
+    int64_t last = std::min(slotOf(to, r.period), r.newest);
+    size_t n = 0;
+    for (int64_t slot = std::max<int64_t>(first, 0); slot <= last && n < scratch_size; ++slot) {
+        size_t pos = static_cast<size_t>(slot % static_cast<int64_t>(r.capacity));
+        if (r.slots[pos] == slot) {
+            scratch[n++] = r.avg[m][pos];
+        }
+    }
+    if (n == 0) {
+        return false;
+    }
+    // 最近秩法
+    p = std::min(std::max(p, 0.0), 100.0);
+    size_t rank = static_cast<size_t>(p / 100.0 * (n - 1) + 0.5);
+    std::nth_element(scratch, scratch + rank, scratch + n);
+    *value = scratch[rank];
+    return true;
+}
+
+HistoryResolution InterfaceHistory::resolutionFor(int64_t from) const {
+    int64_t newest = seconds_.newest;
+    if (newest - from < static_cast<int64_t>(seconds_.capacity)) {
+        return HistoryResolution::SECOND;
+    }
+    if (newest - from < static_cast<int64_t>(minutes_.capacity) * SECONDS_PER_MINUTE) {
+        return HistoryResolution::MINUTE;
+    }
+    return HistoryResolution::HOUR;
+}
+
+TrafficHistory::TrafficHistory(const HistoryConfig& config)
+    : config_(config), last_second_(-1) {
+    if (config_.max_interfaces == 0) {
+        config_.max_interfaces = 1;
+    }
+    entries_.reserve(config_.max_interfaces);
+    size_t slots = std::max(config_.second_slots, std::max(config_.minute_slots, config_.hour_slots));
+    scratch_.resize(slots);
+}
+
+void TrafficHistory::record(const InterfaceStatsCollector& collector) {
+    const std::vector<InterfaceSample>& samples = collector.interfaces();
+    if (samples.empty()) {
+        return;
+    }
+    // 历史只有秒级，同一秒内的其余采样直接跳过
+    int64_t second = static_cast<int64_t>(samples.front().sample_ns / NS_PER_SECOND);
+    if (second == last_second_) {
+        return;
+    }
+    last_second_ = second;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        record(samples[i].name, samples[i].counters, samples[i].sample_ns, i);
+    }
+}
+
+void TrafficHistory::record(const char* name, const InterfaceCounters& counters, uint64_t now_ns) {
+    record(name, counters, now_ns, entries_.size());
+}
+
+void TrafficHistory::record(const char* name, const InterfaceCounters& counters, uint64_t now_ns, size_t hint) {
+    Entry* entry = lookup(name, hint);
+    if (entry->last_ns == 0) {
+        // 新接口或复用的位置
+        strncpy(entry->name, name, sizeof(entry->name) - 1);
+        entry->name[sizeof(entry->name) - 1] = '\0';
+    }
+    entry->history.record(counters, now_ns);
+    entry->last_ns = now_ns;
+}
+
+const InterfaceHistory* TrafficHistory::find(const char* name) const {
+    for (const auto& entry : entries_) {
+        if (strncmp(entry.name, name, sizeof(entry.name)) == 0) {
+            return &entry.history;
+        }
+    }
+    return nullptr;
+}
+
+size_t TrafficHistory::query(const char* name, HistoryMetric metric, HistoryResolution resolution,
+                             int64_t window_seconds, HistoryPoint* out, size_t max_points) const {
+    const InterfaceHistory* history = find(name);
+    if (history == nullptr || history->latestSecond() < 0) {
+        return 0;
+    }
+    int64_t to = history->latestSecond();
+    return history->query(metric, resolution, to - window_seconds + 1, to, out, max_points);
+}
+
+bool TrafficHistory::summarize(const char* name, HistoryMetric metric, int64_t window_seconds,
+                               HistorySummary* out) const {
+    const InterfaceHistory* history = find(name);
+    if (history == nullptr || history->latestSecond() < 0) {
+        return false;
+    }
+    int64_t to = history->latestSecond();
+    int64_t from = to - window_seconds + 1;
+    // 刚启动时较粗的一级还没有完整的分钟或小时，退到更细的一级
+    HistoryResolution resolution = history->resolutionFor(from);
+    do {
+        if (history->summarize(metric, resolution, from, to, out)) {
+            return true;
+        }
+    } while (finer(&resolution));
+    return false;
+}
+
+bool TrafficHistory::percentile(const char* name, HistoryMetric metric, int64_t window_seconds, double p,
+                                double* value) {
+    const InterfaceHistory* history = find(name);
+    if (history == nullptr || history->latestSecond() < 0) {
+        return false;
+    }
+    int64_t to = history->latestSecond();
+    int64_t from = to - window_seconds + 1;
+    HistoryResolution resolution = history->resolutionFor(from);
+    do {
+        if (history->percentile(metric, resolution, from, to, p, scratch_.data(), scratch_.size(), value)) {
+            return true;
+        }
+    } while (finer(&resolution));
+    return false;
+}
+
+TrafficHistory::Entry* TrafficHistory::lookup(const char* name, size_t hint) {
+    // 采集器的接口顺序基本固定，先看预期位置
+    if (hint < entries_.size() && strncmp(entries_[hint].name, name, sizeof(entries_[hint].name)) == 0) {
+        return &entries_[hint];
+    }
+    Entry* oldest = nullptr;
+    for (auto& entry : entries_) {
+        if (strncmp(entry.name, name, sizeof(entry.name)) == 0) {
+            return &entry;
+        }
+        if (oldest == nullptr || entry.last_ns < oldest->last_ns) {
+            oldest = &entry;
+        }
+    }
+    if (entries_.size() < config_.max_interfaces) {
+        entries_.push_back(Entry(config_));
+        return &entries_.back();
+    }
+    // 满了，复用最久没有更新的接口
+    oldest->history.reset();
+    oldest->last_ns = 0;
+    return oldest;
+}
@@ -132,6 +132,8 @@ void demoDNSManager(DNSManager& dns_mgr) {
             if (i < result.ip_addresses.size() - 1) std::cout << ", ";
         }
         std::cout << std::endl;
+    } else {
+        std::cout << "  解析失败: " << result.error_message << std::endl;
     }
 
     // 显示统计信息
@@ -190,22 +192,30 @@ void demoNetworkMonitor(NetworkMonitor& monitor) {
         std::cout << std::endl;
     }
 
-    // 获取网络统计
-    std::cout << "网络统计 (wlan0):\n" << std::endl;
-    auto stats = monitor.getNetworkStats("wlan0");
+    // 获取网络统计（/proc/net/dev，每100ms采样一次）
+    std::string stats_if = connections.empty() ? "wlan0" : connections.front().interface;
+    monitor.setStatsSamplingInterval(100);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    std::cout << "网络统计 (" << stats_if << "):\n" << std::endl;
+    auto stats = monitor.getNetworkStats(stats_if);
     std::cout << "  接收字节: " << stats.rx_bytes << std::endl;
     std::cout << "  发送字节: " << stats.tx_bytes << std::endl;
     std::cout << "  接收包数: " << stats.rx_packets << std::endl;
     std::cout << "  发送包数: " << stats.tx_packets << std::endl;
+    auto rates = monitor.getNetworkRates(stats_if);
+    std::cout << "  接收速率: " << rates.rx_bps << " bps, " << rates.rx_pps << " pps" << std::endl;
+    std::cout << "  发送速率: " << rates.tx_bps << " bps, " << rates.tx_pps << " pps" << std::endl;
 
     // 检查连通性
     std::cout << "\n检查网络连通性..." << std::endl;
     bool connected = monitor.checkConnectivity("8.8.8.8");
     std::cout << "  连通状态: " << (connected ? "正常" : "异常") << std::endl;
 
-    // 模拟状态变化
-    std::cout << "\n模拟WiFi断开..." << std::endl;
-    monitor.simulateStateChange("wifi_network", NetworkState::DISCONNECTED);
+    // 模拟状态变化（连接信息来自netlink，取第一个连接演示）
+    if (!connections.empty()) {
+        std::cout << "\n模拟" << connections.front().interface << "断开..." << std::endl;
+        monitor.simulateStateChange(connections.front().network_id, NetworkState::DISCONNECTED);
+    }
     
     // 显示监控器统计
     auto monitor_stats = monitor.getMonitorStats();
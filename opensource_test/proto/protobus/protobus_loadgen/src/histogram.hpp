@@ -0,0 +1,99 @@
+#ifndef __LOADGEN_HISTOGRAM_H
+#define __LOADGEN_HISTOGRAM_H
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+/*
+ * Log-linear latency histogram: 16 linear sub buckets per power of two,
+ * about 6% resolution from 1 ns to 2^64 ns. record() is a relaxed atomic
+ * increment so the subscriber callback and the reporter need no lock.
+ */
+#define HIST_SUB_BITS 4
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+/* plain counts, what is sent to the parent process and merged there */
+struct hist_counts
+{
+    uint64_t buckets[HIST_BUCKETS];
+
+    hist_counts() { clear(); }
+    void clear() { memset(buckets, 0, sizeof(buckets)); }
+    void merge(const hist_counts &other)
+    {
+        for (int i = 0; i < HIST_BUCKETS; i++)
+            buckets[i] += other.buckets[i];
+    }
+    uint64_t count() const
+    {
+        uint64_t n = 0;
+        for (int i = 0; i < HIST_BUCKETS; i++)
+            n += buckets[i];
+        return n;
+    }
+
+    static inline int index(uint64_t value)
+    {
+        if (value < HIST_SUB_COUNT)
+            return static_cast<int>(value);
+        int exp = 63 - __builtin_clzll(value);
+        int sub = static_cast<int>((value >> (exp - HIST_SUB_BITS)) & (HIST_SUB_COUNT - 1));
+        return (exp - HIST_SUB_BITS + 1) * HIST_SUB_COUNT + sub;
+    }
+    /* upper bound of a bucket */
+    static inline uint64_t value(int index)
+    {
+        if (index < HIST_SUB_COUNT)
+            return index;
+        int exp = index / HIST_SUB_COUNT + HIST_SUB_BITS - 1;
+        uint64_t sub = index % HIST_SUB_COUNT;
+        return ((HIST_SUB_COUNT + sub + 1) << (exp - HIST_SUB_BITS)) - 1;
+    }
+    /* p in [0,100] */
+    uint64_t percentile(double p) const
+    {
+        uint64_t total = count();
+        if (total == 0)
+            return 0;
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * total + 0.5);
+        if (rank == 0)
+            rank = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < HIST_BUCKETS; i++)
+        {
+            seen += buckets[i];
+            if (seen >= rank)
+                return value(i);
+        }
+        return value(HIST_BUCKETS - 1);
+    }
+    uint64_t max() const
+    {
+        for (int i = HIST_BUCKETS - 1; i >= 0; i--)
+        {
+            if (buckets[i] != 0)
+                return value(i);
+        }
+        return 0;
+    }
+};
+
+class latency_histogram
+{
+public:
+    inline void record(uint64_t ns)
+    {
+        buckets[hist_counts::index(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+    /* move the counts out and start a new interval */
+    void drain(hist_counts &out)
+    {
+        for (int i = 0; i < HIST_BUCKETS; i++)
+            out.buckets[i] = buckets[i].exchange(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> buckets[HIST_BUCKETS] = {};
+};
+#endif
@@ -0,0 +1,505 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <random>
+#include <unistd.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "protobus.hpp"
+#include "workload.hpp"
+using namespace std;
+
+/*
+ * Open loop load generator for protobus_proxy.
+ *
+ * Publishers send on a fixed schedule and stamp every message with the time
+ * it was due, not the time it left: when the bus stalls, the messages queued
+ * behind the stall are charged for the wait (coordinated omission). Every
+ * publisher and subscriber is its own process, protobus is a singleton.
+ */
+static volatile sig_atomic_t stop_flag = 0;
+
+static void sig_handle(int sig_num)
+{
+    switch (sig_num)
+    {
+    case SIGTERM:
+    case SIGINT:
+        stop_flag = 1;
+        break;
+    default:
+        break;
+    }
+}
+
+static void write_report(int fd, const child_report &report)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(&report);
+    size_t left = sizeof(report);
+    while (left > 0)
+    {
+        ssize_t n = write(fd, p, left);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        p += n;
+        left -= n;
+    }
+}
+
+static void run_publisher(const loadgen_options &opt, int index, int fd)
+{
+    std::string name = "loadgen_pub" + std::to_string(index);
+    std::shared_ptr<protobus> bus = protobus::get_instance(name.c_str());
+    // let the connection to the proxy come up
+    usleep(500 * 1000);
+
+    std::mt19937_64 rng(index + 1);
+    size_distribution sizes = opt.sizes;
+    std::string payload;
+    child_report report = {};
+    report.role = child_report::PUBLISHER;
+    report.index = index;
+
+    uint64_t period = 1000000000ull / opt.rate;
+    uint64_t start = monotonic_ns();
+    uint64_t start_rt = realtime_ns();
+    uint64_t end = opt.duration == 0 ? UINT64_MAX : start + opt.duration * 1000000000ull;
+    uint64_t next_report = start + opt.interval * 1000000000ull;
+    uint64_t max_lag = 0;
+    for (uint64_t seq = 0; !stop_flag; seq++)
+    {
+        uint64_t due = start + seq * period;
+        if (due >= end)
+            break;
+        if (monotonic_ns() < due)
+        {
+            struct timespec ts = {static_cast<time_t>(due / 1000000000ull), static_cast<long>(due % 1000000000ull)};
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+        }
+        size_t size = sizes.next(rng);
+        if (payload.size() < size)
+            payload.resize(size, 'x');
+
+        MSG::WrapperMessage msg;
+        msg.set_topic(LOADGEN_TOPIC_PREFIX + std::to_string(seq % opt.topics));
+        uint64_t due_rt = start_rt + (due - start);
+        msg.mutable_timestamp()->set_seconds(due_rt / 1000000000ull);
+        msg.mutable_timestamp()->set_nanos(due_rt % 1000000000ull);
+        MSG::msg_people *people = msg.mutable_people();
+        people->set_age(index);
+        people->set_count(seq);
+        people->set_name(payload.data(), size);
+        bus->send(std::move(msg));
+
+        uint64_t now = monotonic_ns();
+        report.messages++;
+        report.bytes += size;
+        max_lag = std::max(max_lag, now - due);
+        if (now >= next_report)
+        {
+            report.lag_ns = max_lag;
+            report.rss_kb = current_rss_kb();
+            write_report(fd, report);
+            report.messages = 0;
+            report.bytes = 0;
+            max_lag = 0;
+            next_report += opt.interval * 1000000000ull;
+        }
+    }
+    // give the pub thread time to flush its queue
+    sleep(1);
+    report.final = 1;
+    report.lag_ns = max_lag;
+    report.rss_kb = current_rss_kb();
+    write_report(fd, report);
+    close(fd);
+    _exit(0);
+}
+
+static latency_histogram sub_latency;
+static std::atomic<uint64_t> sub_messages{0};
+static std::atomic<uint64_t> sub_bytes{0};
+
+static void loadgen_callback(const MSG::WrapperMessage &msg)
+{
+    uint64_t now = realtime_ns();
+    uint64_t due = static_cast<uint64_t>(msg.timestamp().seconds()) * 1000000000ull + msg.timestamp().nanos();
+    sub_latency.record(now > due ? now - due : 0);
+    sub_messages.fetch_add(1, std::memory_order_relaxed);
+    sub_bytes.fetch_add(msg.people().name().size(), std::memory_order_relaxed);
+}
+
+static void run_subscriber(const loadgen_options &opt, int index, int fd)
+{
+    std::string name = "loadgen_sub" + std::to_string(index);
+    std::shared_ptr<protobus> bus = protobus::get_instance(name.c_str());
+    bus->add_subscriber(LOADGEN_TOPIC_PREFIX, loadgen_callback);
+
+    child_report report = {};
+    report.role = child_report::SUBSCRIBER;
+    report.index = index;
+    uint64_t next_report = monotonic_ns() + opt.interval * 1000000000ull;
+    while (true)
+    {
+        while (!stop_flag && monotonic_ns() < next_report)
+        {
+            usleep(10 * 1000);
+        }
+        next_report += opt.interval * 1000000000ull;
+        report.final = stop_flag ? 1 : 0;
+        report.messages = sub_messages.exchange(0);
+        report.bytes = sub_bytes.exchange(0);
+        report.rss_kb = current_rss_kb();
+        sub_latency.drain(report.latency);
+        write_report(fd, report);
+        if (report.final)
+            break;
+    }
+    close(fd);
+    _exit(0);
+}
+
+struct child
+{
+    pid_t pid;
+    int fd;
+    int role;
+    int index;
+    bool done;
+    std::vector<uint8_t> rbuf;
+    uint64_t rss_kb;
+    uint64_t rss_base;
+    bool rss_flagged;
+};
+
+static bool spawn(const loadgen_options &opt, int role, int index, std::vector<child> &children)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        perror("pipe");
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        for (const child &c : children)
+            close(c.fd);
+        if (role == child_report::PUBLISHER)
+            run_publisher(opt, index, fds[1]);
+        else
+            run_subscriber(opt, index, fds[1]);
+    }
+    close(fds[1]);
+    children.push_back(child{pid, fds[0], role, index, false, {}, 0, 0, false});
+    return true;
+}
+
+static std::string format_ns(uint64_t ns)
+{
+    char buf[32];
+    if (ns < 1000)
+        snprintf(buf, sizeof(buf), "%lluns", static_cast<unsigned long long>(ns));
+    else if (ns < 1000000)
+        snprintf(buf, sizeof(buf), "%.1fus", ns / 1e3);
+    else if (ns < 1000000000)
+        snprintf(buf, sizeof(buf), "%.2fms", ns / 1e6);
+    else
+        snprintf(buf, sizeof(buf), "%.2fs", ns / 1e9);
+    return buf;
+}
+
+/* everything received from the children since the last print, and since the start */
+struct totals
+{
+    uint64_t sent = 0;
+    uint64_t sent_bytes = 0;
+    uint64_t received = 0;
+    uint64_t received_bytes = 0;
+    uint64_t lag_ns = 0;
+    hist_counts latency;
+
+    void add(const child_report &report)
+    {
+        if (report.role == child_report::PUBLISHER)
+        {
+            sent += report.messages;
+            sent_bytes += report.bytes;
+            lag_ns = std::max(lag_ns, report.lag_ns);
+        }
+        else
+        {
+            received += report.messages;
+            received_bytes += report.bytes;
+            latency.merge(report.latency);
+        }
+    }
+};
+
+static void usage(const char *name)
+{
+    cout << "usage: " << name << " [options]\n"
+         << "  -p N     publisher processes (1)\n"
+         << "  -s N     subscriber processes (1)\n"
+         << "  -t N     topics (4)\n"
+         << "  -r N     messages per second per publisher (1000)\n"
+         << "  -d SEC   duration, 0 runs until SIGINT (10)\n"
+         << "  -i SEC   report interval (1)\n"
+         << "  -z DIST  payload size: fixed:N uniform:MIN:MAX exp:MEAN bimodal:S:L:P (fixed:64)\n"
+         << "  -S       soak: flag throughput degradation and memory growth\n"
+         << "  -D FRAC  soak: allowed throughput drop (0.1)\n"
+         << "  -M FRAC  soak: allowed RSS growth (0.2)\n"
+         << "  -w N     soak: warmup intervals before the baseline (5)\n";
+}
+
+int main(int argc, char *argv[])
+{
+    loadgen_options opt;
+    int c;
+    while ((c = getopt(argc, argv, "p:s:t:r:d:i:z:SD:M:w:h")) != -1)
+    {
+        switch (c)
+        {
+        case 'p':
+            opt.publishers = atoi(optarg);
+            break;
+        case 's':
+            opt.subscribers = atoi(optarg);
+            break;
+        case 't':
+            opt.topics = atoi(optarg);
+            break;
+        case 'r':
+            opt.rate = strtoull(optarg, nullptr, 0);
+            break;
+        case 'd':
+            opt.duration = strtoull(optarg, nullptr, 0);
+            break;
+        case 'i':
+            opt.interval = strtoull(optarg, nullptr, 0);
+            break;
+        case 'z':
+            if (!opt.sizes.parse(optarg))
+            {
+                cerr << "bad size distribution " << optarg << endl;
+                return 1;
+            }
+            break;
+        case 'S':
+            opt.soak = true;
+            break;
+        case 'D':
+            opt.degrade = strtod(optarg, nullptr);
+            break;
+        case 'M':
+            opt.rss_growth = strtod(optarg, nullptr);
+            break;
+        case 'w':
+            opt.warmup = strtoull(optarg, nullptr, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opt.publishers <= 0 || opt.subscribers < 0 || opt.topics <= 0 || opt.rate == 0 || opt.interval == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGTERM, sig_handle);
+    signal(SIGINT, sig_handle);
+    signal(SIGPIPE, SIG_IGN);
+    cout << "loadgen: " << opt.publishers << " pub x " << opt.rate << " msg/s, " << opt.subscribers << " sub, "
+         << opt.topics << " topics, size " << opt.sizes.spec() << ", "
+         << (opt.duration ? std::to_string(opt.duration) + "s" : std::string("until SIGINT")) << endl;
+
+    std::vector<child> children;
+    for (int i = 0; i < opt.subscribers; i++)
+        spawn(opt, child_report::SUBSCRIBER, i, children);
+    // subscriptions have to reach the proxy before the first message
+    sleep(1);
+    for (int i = 0; i < opt.publishers; i++)
+        spawn(opt, child_report::PUBLISHER, i, children);
+
+    totals all;
+    totals interval;
+    uint64_t start = monotonic_ns();
+    uint64_t next_print = start + opt.interval * 1000000000ull;
+    uint64_t interval_count = 0;
+    double baseline = 0;
+    uint64_t baseline_samples = 0;
+    uint64_t degraded = 0;
+    uint64_t rss_flags = 0;
+    uint64_t pubs_done_at = 0;
+    bool subs_stopped = false;
+
+    while (true)
+    {
+        std::vector<pollfd> fds;
+        std::vector<child *> owners;
+        for (child &ch : children)
+        {
+            if (!ch.done)
+            {
+                fds.push_back(pollfd{ch.fd, POLLIN, 0});
+                owners.push_back(&ch);
+            }
+        }
+        if (fds.empty())
+            break;
+
+        uint64_t now = monotonic_ns();
+        int timeout = next_print > now ? static_cast<int>((next_print - now) / 1000000) + 1 : 0;
+        int n = poll(fds.data(), fds.size(), timeout);
+        for (size_t i = 0; n > 0 && i < fds.size(); i++)
+        {
+            if (fds[i].revents == 0)
+                continue;
+            child &ch = *owners[i];
+            uint8_t buf[4096];
+            ssize_t len = read(ch.fd, buf, sizeof(buf));
+            if (len <= 0)
+            {
+                ch.done = true;
+                close(ch.fd);
+                continue;
+            }
+            ch.rbuf.insert(ch.rbuf.end(), buf, buf + len);
+            while (ch.rbuf.size() >= sizeof(child_report))
+            {
+                child_report report;
+                memcpy(&report, ch.rbuf.data(), sizeof(report));
+                ch.rbuf.erase(ch.rbuf.begin(), ch.rbuf.begin() + sizeof(report));
+                ch.rss_kb = report.rss_kb;
+                all.add(report);
+                interval.add(report);
+            }
+        }
+
+        now = monotonic_ns();
+        if (now >= next_print)
+        {
+            interval_count++;
+            double secs = opt.interval;
+            double recv_rate = interval.received / secs;
+            uint64_t pub_rss = 0;
+            uint64_t sub_rss = 0;
+            for (child &ch : children)
+            {
+                if (ch.role == child_report::PUBLISHER)
+                    pub_rss = std::max(pub_rss, ch.rss_kb);
+                else
+                    sub_rss = std::max(sub_rss, ch.rss_kb);
+            }
+            printf("[%6llus] pub %.0f msg/s lag %s | sub %.0f msg/s %.2f MB/s p50 %s p99 %s p99.9 %s max %s | rss pub %.1f MB sub %.1f MB",
+                   static_cast<unsigned long long>((now - start) / 1000000000ull), interval.sent / secs,
+                   format_ns(interval.lag_ns).c_str(), recv_rate, interval.received_bytes / secs / 1e6,
+                   format_ns(interval.latency.percentile(50)).c_str(), format_ns(interval.latency.percentile(99)).c_str(),
+                   format_ns(interval.latency.percentile(99.9)).c_str(), format_ns(interval.latency.max()).c_str(),
+                   pub_rss / 1024.0, sub_rss / 1024.0);
+
+            if (opt.soak && pubs_done_at == 0 && interval_count > opt.warmup)
+            {
+                // baseline is the mean of the first intervals after warmup
+                if (baseline_samples < opt.warmup)
+                {
+                    baseline = (baseline * baseline_samples + recv_rate) / (baseline_samples + 1);
+                    baseline_samples++;
+                    for (child &ch : children)
+                    {
+                        if (ch.rss_base == 0 || ch.rss_kb < ch.rss_base)
+                            ch.rss_base = ch.rss_kb;
+                    }
+                }
+                else
+                {
+                    if (recv_rate < baseline * (1 - opt.degrade))
+                    {
+                        degraded++;
+                        printf(" DEGRADED (baseline %.0f msg/s)", baseline);
+                    }
+                    for (child &ch : children)
+                    {
+                        if (!ch.rss_flagged && ch.rss_base != 0 && ch.rss_kb > ch.rss_base * (1 + opt.rss_growth))
+                        {
+                            ch.rss_flagged = true;
+                            rss_flags++;
+                            printf(" RSS GROWTH %s%d %.1f -> %.1f MB", ch.role == child_report::PUBLISHER ? "pub" : "sub",
+                                   ch.index, ch.rss_base / 1024.0, ch.rss_kb / 1024.0);
+                        }
+                    }
+                }
+            }
+            printf("\n");
+            fflush(stdout);
+            interval = totals();
+            next_print += opt.interval * 1000000000ull;
+        }
+
+        if (stop_flag && pubs_done_at == 0)
+        {
+            for (child &ch : children)
+            {
+                if (ch.role == child_report::PUBLISHER && !ch.done)
+                    kill(ch.pid, SIGTERM);
+            }
+        }
+        bool pubs_running = false;
+        for (child &ch : children)
+        {
+            if (ch.role == child_report::PUBLISHER && !ch.done)
+                pubs_running = true;
+        }
+        if (!pubs_running && pubs_done_at == 0)
+            pubs_done_at = monotonic_ns();
+        // wait for the messages in flight, then stop the subscribers
+        if (pubs_done_at != 0 && !subs_stopped && monotonic_ns() - pubs_done_at > 1000000000ull)
+        {
+            for (child &ch : children)
+            {
+                if (ch.role == child_report::SUBSCRIBER && !ch.done)
+                    kill(ch.pid, SIGTERM);
+            }
+            subs_stopped = true;
+        }
+    }
+    for (child &ch : children)
+        waitpid(ch.pid, nullptr, 0);
+
+    double secs = (monotonic_ns() - start) / 1e9;
+    uint64_t expected = all.sent * opt.subscribers;
+    uint64_t lost = expected > all.received ? expected - all.received : 0;
+    printf("\n==== loadgen report ====\n");
+    printf("run time      %.1f s\n", secs);
+    printf("sent          %llu msgs, %.2f MB\n", static_cast<unsigned long long>(all.sent), all.sent_bytes / 1e6);
+    printf("received      %llu of %llu expected, lost %llu (%.3f%%)\n", static_cast<unsigned long long>(all.received),
+           static_cast<unsigned long long>(expected), static_cast<unsigned long long>(lost), expected ? 100.0 * lost / expected : 0.0);
+    printf("throughput    pub %.0f msg/s, sub %.0f msg/s %.2f MB/s\n", all.sent / secs, all.received / secs, all.received_bytes / secs / 1e6);
+    printf("latency       p50 %s p90 %s p99 %s p99.9 %s p99.99 %s max %s\n",
+           format_ns(all.latency.percentile(50)).c_str(), format_ns(all.latency.percentile(90)).c_str(),
+           format_ns(all.latency.percentile(99)).c_str(), format_ns(all.latency.percentile(99.9)).c_str(),
+           format_ns(all.latency.percentile(99.99)).c_str(), format_ns(all.latency.max()).c_str());
+    printf("max pub lag   %s\n", format_ns(all.lag_ns).c_str());
+    if (opt.soak)
+    {
+        printf("soak          %llu degraded intervals, %llu processes with RSS growth\n",
+               static_cast<unsigned long long>(degraded), static_cast<unsigned long long>(rss_flags));
+        return degraded || rss_flags ? 2 : 0;
+    }
+    return 0;
+}
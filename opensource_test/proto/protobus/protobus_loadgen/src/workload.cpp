@@ -0,0 +1,106 @@
+#include "workload.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <time.h>
+#include <unistd.h>
+
+static std::vector<std::string> split(const std::string &s, char sep)
+{
+    std::vector<std::string> out;
+    size_t start = 0;
+    size_t pos;
+    while ((pos = s.find(sep, start)) != std::string::npos)
+    {
+        out.push_back(s.substr(start, pos - start));
+        start = pos + 1;
+    }
+    out.push_back(s.substr(start));
+    return out;
+}
+
+bool size_distribution::parse(const std::string &spec)
+{
+    std::vector<std::string> parts = split(spec, ':');
+    if (parts[0] == "fixed" && parts.size() == 2)
+    {
+        kind_ = FIXED;
+        a_ = b_ = strtoull(parts[1].c_str(), nullptr, 0);
+    }
+    else if (parts[0] == "uniform" && parts.size() == 3)
+    {
+        kind_ = UNIFORM;
+        a_ = strtoull(parts[1].c_str(), nullptr, 0);
+        b_ = strtoull(parts[2].c_str(), nullptr, 0);
+        if (b_ < a_)
+            return false;
+    }
+    else if (parts[0] == "exp" && parts.size() == 2)
+    {
+        kind_ = EXPONENTIAL;
+        a_ = strtoull(parts[1].c_str(), nullptr, 0);
+        if (a_ == 0)
+            return false;
+    }
+    else if (parts[0] == "bimodal" && parts.size() == 4)
+    {
+        kind_ = BIMODAL;
+        a_ = strtoull(parts[1].c_str(), nullptr, 0);
+        b_ = strtoull(parts[2].c_str(), nullptr, 0);
+        p_ = strtod(parts[3].c_str(), nullptr);
+        if (p_ < 0 || p_ > 1)
+            return false;
+    }
+    else
+    {
+        return false;
+    }
+    spec_ = spec;
+    return true;
+}
+
+size_t size_distribution::next(std::mt19937_64 &rng)
+{
+    switch (kind_)
+    {
+    case UNIFORM:
+        return std::uniform_int_distribution<size_t>(a_, b_)(rng);
+    case EXPONENTIAL:
+    {
+        double v = std::exponential_distribution<double>(1.0 / a_)(rng);
+        return std::min<size_t>(static_cast<size_t>(v), a_ * 64);
+    }
+    case BIMODAL:
+        return std::bernoulli_distribution(p_)(rng) ? b_ : a_;
+    default:
+        return a_;
+    }
+}
+
+uint64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+uint64_t realtime_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+uint64_t current_rss_kb()
+{
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp == nullptr)
+        return 0;
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    if (fscanf(fp, "%lu %lu", &size, &resident) != 2)
+        resident = 0;
+    fclose(fp);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
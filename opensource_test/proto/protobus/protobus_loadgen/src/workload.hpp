@@ -0,0 +1,85 @@
+#ifndef __LOADGEN_WORKLOAD_H
+#define __LOADGEN_WORKLOAD_H
+#include <cstdint>
+#include <string>
+#include <random>
+#include "histogram.hpp"
+
+/* payload size distribution, parsed from -z */
+class size_distribution
+{
+public:
+    /*
+     * fixed:N             always N bytes
+     * uniform:MIN:MAX     uniform in [MIN, MAX]
+     * exp:MEAN            exponential, capped at 64 * MEAN
+     * bimodal:S:L:P       L bytes with probability P, S otherwise
+     */
+    bool parse(const std::string &spec);
+    size_t next(std::mt19937_64 &rng);
+    inline const std::string &spec() const { return spec_; }
+
+private:
+    enum kind
+    {
+        FIXED,
+        UNIFORM,
+        EXPONENTIAL,
+        BIMODAL
+    };
+    kind kind_ = FIXED;
+    size_t a_ = 64;
+    size_t b_ = 64;
+    double p_ = 0;
+    std::string spec_ = "fixed:64";
+};
+
+struct loadgen_options
+{
+    int publishers = 1;
+    int subscribers = 1;
+    int topics = 4;
+    /* messages per second of each publisher */
+    uint64_t rate = 1000;
+    /* seconds, 0 runs until SIGINT */
+    uint64_t duration = 10;
+    /* seconds between interval reports */
+    uint64_t interval = 1;
+    size_distribution sizes;
+    /* soak: flag throughput below (1 - degrade) * baseline and RSS growth above rss_growth */
+    bool soak = false;
+    double degrade = 0.1;
+    double rss_growth = 0.2;
+    /* intervals ignored before the soak baseline is taken */
+    uint64_t warmup = 5;
+};
+
+/* what every child writes to its pipe once per interval */
+struct child_report
+{
+    enum
+    {
+        PUBLISHER,
+        SUBSCRIBER
+    };
+    int32_t role;
+    int32_t index;
+    /* 1 on the last report of the child */
+    int32_t final;
+    int32_t reserved;
+    /* this interval */
+    uint64_t messages;
+    uint64_t bytes;
+    /* publisher: how far behind its schedule it is, ns */
+    uint64_t lag_ns;
+    uint64_t rss_kb;
+    /* subscriber: latency from the intended send time */
+    hist_counts latency;
+};
+
+#define LOADGEN_TOPIC_PREFIX "lg."
+
+uint64_t monotonic_ns();
+uint64_t realtime_ns();
+uint64_t current_rss_kb();
+#endif
@@ -130,10 +130,10 @@ void protobus_callback(const MSG::WrapperMessage &msg)
     }
 }
 #endif
-MSG::WrapperMessage wrapper_msg;
 MSG::msg_people people_msg;
 MSG::msg_address addr_msg;
 #define SEND_COUNT 2000000
+#define SEND_BATCH 256
 int main(int argc, char **argv)
 {
     int nodeType = 0;
@@ -170,6 +170,8 @@ int main(int argc, char **argv)
         handle = protobus_init(basename(argv[0]));
     }
     sleep(1);
+    std::vector<MSG::WrapperMessage> batch;
+    batch.reserve(SEND_BATCH);
     while (1)
     {
 
@@ -177,6 +179,9 @@ int main(int argc, char **argv)
         {
             for (int i = 0; i < SEND_COUNT; i++)
             {
+                // 直接在批次里构造消息，避免再拷贝一次
+                batch.emplace_back();
+                MSG::WrapperMessage &wrapper_msg = batch.back();
                 if (i % 2 == 0)
                 {
                     addr_msg.set_city("abc");
@@ -199,11 +204,14 @@ int main(int argc, char **argv)
                     wrapper_msg.set_topic("people");
                     *wrapper_msg.mutable_people() = people_msg;
                 }
-                Timestamp timestamp;
-                timestamp.set_seconds(time(NULL));
-                timestamp.set_nanos(0);
-                *wrapper_msg.mutable_timestamp() = timestamp;
-                protobus_send(handle, wrapper_msg);
+                Timestamp *timestamp = wrapper_msg.mutable_timestamp();
+                timestamp->set_seconds(time(NULL));
+                timestamp->set_nanos(0);
+                if (batch.size() == SEND_BATCH || i == SEND_COUNT - 1)
+                {
+                    protobus_send_batch(handle, batch.data(), batch.size());
+                    batch.clear();
+                }
             }
             //break;
         }
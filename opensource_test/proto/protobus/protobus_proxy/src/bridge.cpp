@@ -0,0 +1,335 @@
+#include "bridge.hpp"
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <cstring>
+#ifdef PROTOBUS_BRIDGE_ZLIB
+#include <zlib.h>
+#endif
+#include "protobus_filter.hpp"
+
+/*
+ * batch body: header, then the entries (zlib compressed with BATCH_ZLIB)
+ * header: version u8, flags u8, reserved u16, count u32, size of the raw entries u32
+ * entry:  origin u64, msg id u64, hops u8, size u32, serialized WrapperMessage
+ * integers in host byte order, the fleet is little endian only
+ */
+#define BATCH_VERSION 1
+#define BATCH_ZLIB 0x01
+#define BATCH_HEADER_SIZE 12
+#define ENTRY_HEADER_SIZE 21
+/* topics whose export verdict is cached, the cache is dropped beyond */
+#define WANTED_CACHE_SIZE 4096
+
+static uint64_t now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <typename T>
+static void put(std::string &out, T value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T>
+static T get(const uint8_t *p)
+{
+    T value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+protobus_bridge::protobus_bridge(zmq::context_t &context, const bridge_options &options)
+    : options_(options), export_sock(context, zmq::socket_type::xpub), import_sock(context, zmq::socket_type::xsub)
+{
+    std::random_device rd;
+    origin_ = (static_cast<uint64_t>(rd()) << 32) | rd();
+    export_sock.set(zmq::sockopt::linger, 0);
+    import_sock.set(zmq::sockopt::linger, 0);
+    if (!options_.bind.empty())
+    {
+        export_sock.bind(options_.bind);
+        exporting = true;
+    }
+    for (const std::string &peer : options_.connect)
+    {
+        import_sock.connect(peer);
+        importing = true;
+    }
+#ifndef PROTOBUS_BRIDGE_ZLIB
+    if (options_.compress)
+    {
+        std::cerr << "bridge: built without PROTOBUS_BRIDGE_ZLIB, batches are sent uncompressed" << std::endl;
+        options_.compress = false;
+    }
+#endif
+}
+
+void protobus_bridge::on_local(const std::string &topic, const zmq::message_t &body)
+{
+    if (!exporting || !wanted(topic))
+        return;
+    add(topic, origin_, ++next_id, 0, body.data(), body.size());
+}
+
+void protobus_bridge::on_local_subscription(const zmq::message_t &frame)
+{
+    if (!importing || frame.size() < 1)
+        return;
+    const char *data = static_cast<const char *>(frame.data());
+    if (data[0] != 0 && data[0] != 1)
+        return;
+    // XSUB refcounts, the filters of one topic share its subscription
+    send_upstream(data[0] == 1, protobus_filter::plain_topic(std::string(data + 1, frame.size() - 1)));
+}
+
+void protobus_bridge::on_peer_subscription(zmq::socket_t &frontend)
+{
+    zmq::message_t frame;
+    if (!export_sock.recv(frame, zmq::recv_flags::dontwait).has_value() || frame.size() < 1)
+        return;
+    const char *data = static_cast<const char *>(frame.data());
+    std::string topic(data + 1, frame.size() - 1);
+    // XPUB passes only the first subscribe and the last unsubscribe of a topic
+    if (data[0] == 1)
+        remote.insert(topic);
+    else if (data[0] == 0)
+        remote.erase(topic);
+    else
+        return;
+    wanted_cache.clear();
+    if (options_.relay && importing)
+    {
+        send_upstream(data[0] == 1, topic);
+    }
+    // the local publishers only send topics someone subscribed to
+    frontend.send(frame, zmq::send_flags::none);
+}
+
+void protobus_bridge::on_batch(zmq::socket_t &backend, filter_router &router)
+{
+    zmq::message_t topic_frame;
+    if (!import_sock.recv(topic_frame, zmq::recv_flags::dontwait).has_value())
+        return;
+    if (!topic_frame.more())
+        return;
+    zmq::message_t body;
+    (void)import_sock.recv(body, zmq::recv_flags::none);
+    if (body.more())
+    {
+        // not a batch, drain it
+        zmq::message_t rest;
+        do
+        {
+            (void)import_sock.recv(rest, zmq::recv_flags::none);
+        } while (rest.more());
+        bad_batches++;
+        return;
+    }
+
+    const uint8_t *p = static_cast<const uint8_t *>(body.data());
+    if (body.size() < BATCH_HEADER_SIZE || p[0] != BATCH_VERSION)
+    {
+        bad_batches++;
+        return;
+    }
+    uint8_t flags = p[1];
+    uint32_t count = get<uint32_t>(p + 4);
+    const uint8_t *entries = p + BATCH_HEADER_SIZE;
+    size_t size = body.size() - BATCH_HEADER_SIZE;
+    if (flags & BATCH_ZLIB)
+    {
+#ifdef PROTOBUS_BRIDGE_ZLIB
+        uint32_t raw_size = get<uint32_t>(p + 8);
+        zbuf.resize(raw_size);
+        uLongf out_size = raw_size;
+        if (uncompress(reinterpret_cast<Bytef *>(&zbuf[0]), &out_size, entries, size) != Z_OK || out_size != raw_size)
+        {
+            bad_batches++;
+            return;
+        }
+        entries = reinterpret_cast<const uint8_t *>(zbuf.data());
+        size = raw_size;
+#else
+        bad_batches++;
+        return;
+#endif
+    }
+    recv_batches++;
+
+    std::string topic(static_cast<const char *>(topic_frame.data()), topic_frame.size());
+    size_t offset = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (size - offset < ENTRY_HEADER_SIZE)
+        {
+            bad_batches++;
+            return;
+        }
+        uint64_t origin = get<uint64_t>(entries + offset);
+        uint64_t id = get<uint64_t>(entries + offset + 8);
+        uint8_t hops = entries[offset + 16];
+        uint32_t len = get<uint32_t>(entries + offset + 17);
+        offset += ENTRY_HEADER_SIZE;
+        if (size - offset < len)
+        {
+            bad_batches++;
+            return;
+        }
+        const uint8_t *data = entries + offset;
+        offset += len;
+
+        if (origin == origin_)
+        {
+            loop_drops++;
+            continue;
+        }
+        if (seen(origin, id))
+        {
+            dup_drops++;
+            continue;
+        }
+        recv_msgs++;
+        if (options_.relay && exporting && wanted(topic))
+        {
+            if (hops + 1 < BRIDGE_MAX_HOPS)
+                add(topic, origin, id, hops + 1, data, len);
+            else
+                hop_drops++;
+        }
+        zmq::message_t msg(data, len);
+        if (router.size() > 0)
+        {
+            router.route(topic, msg, backend);
+        }
+        backend.send(zmq::buffer(topic), zmq::send_flags::sndmore);
+        backend.send(msg, zmq::send_flags::none);
+    }
+}
+
+long protobus_bridge::flush()
+{
+    long timeout = -1;
+    uint64_t now = now_ms();
+    for (auto &it : batches)
+    {
+        batch &b = it.second;
+        if (b.count == 0)
+            continue;
+        uint64_t age = now - b.first_ms;
+        if (age >= options_.batch_ms)
+        {
+            send(it.first, b);
+            continue;
+        }
+        long left = static_cast<long>(options_.batch_ms - age);
+        if (timeout < 0 || left < timeout)
+            timeout = left;
+    }
+    return timeout;
+}
+
+bool protobus_bridge::wanted(const std::string &topic)
+{
+    auto it = wanted_cache.find(topic);
+    if (it != wanted_cache.end())
+        return it->second;
+    bool want = false;
+    for (const std::string &prefix : remote)
+    {
+        if (topic.compare(0, prefix.size(), prefix) == 0)
+        {
+            want = true;
+            break;
+        }
+    }
+    if (wanted_cache.size() >= WANTED_CACHE_SIZE)
+        wanted_cache.clear();
+    wanted_cache.emplace(topic, want);
+    return want;
+}
+
+void protobus_bridge::add(const std::string &topic, uint64_t origin, uint64_t id, uint8_t hops, const void *data, size_t size)
+{
+    batch &b = batches[topic];
+    if (b.count == 0)
+        b.first_ms = now_ms();
+    put<uint64_t>(b.entries, origin);
+    put<uint64_t>(b.entries, id);
+    put<uint8_t>(b.entries, hops);
+    put<uint32_t>(b.entries, static_cast<uint32_t>(size));
+    b.entries.append(static_cast<const char *>(data), size);
+    b.count++;
+    if (b.entries.size() >= BRIDGE_BATCH_BYTES)
+        send(topic, b);
+}
+
+void protobus_bridge::send(const std::string &topic, batch &b)
+{
+    std::string out;
+    out.reserve(BATCH_HEADER_SIZE + b.entries.size());
+    put<uint8_t>(out, BATCH_VERSION);
+    uint8_t flags = 0;
+    put<uint8_t>(out, flags);
+    put<uint16_t>(out, 0);
+    put<uint32_t>(out, b.count);
+    put<uint32_t>(out, static_cast<uint32_t>(b.entries.size()));
+#ifdef PROTOBUS_BRIDGE_ZLIB
+    if (options_.compress && b.entries.size() >= BRIDGE_COMPRESS_MIN)
+    {
+        uLongf zsize = compressBound(b.entries.size());
+        zbuf.resize(zsize);
+        if (compress2(reinterpret_cast<Bytef *>(&zbuf[0]), &zsize, reinterpret_cast<const Bytef *>(b.entries.data()),
+                      b.entries.size(), Z_BEST_SPEED) == Z_OK &&
+            zsize < b.entries.size())
+        {
+            out[1] = BATCH_ZLIB;
+            out.append(zbuf.data(), zsize);
+        }
+    }
+#endif
+    if (out[1] == 0)
+        out += b.entries;
+
+    export_sock.send(zmq::buffer(topic), zmq::send_flags::sndmore);
+    export_sock.send(zmq::buffer(out), zmq::send_flags::none);
+    sent_batches++;
+    sent_msgs += b.count;
+    sent_bytes += out.size();
+    raw_bytes += BATCH_HEADER_SIZE + b.entries.size();
+    b.entries.clear();
+    b.count = 0;
+}
+
+/* true if the message already came in over another path */
+bool protobus_bridge::seen(uint64_t origin, uint64_t id)
+{
+    msg_key key{origin, id};
+    if (!recent.insert(key).second)
+        return true;
+    recent_order.push_back(key);
+    if (recent_order.size() > BRIDGE_DEDUPE_SIZE)
+    {
+        recent.erase(recent_order.front());
+        recent_order.pop_front();
+    }
+    return false;
+}
+
+void protobus_bridge::send_upstream(bool subscribe, const std::string &topic)
+{
+    std::string frame(1, subscribe ? 1 : 0);
+    frame += topic;
+    import_sock.send(zmq::buffer(frame), zmq::send_flags::none);
+}
+
+void protobus_bridge::print_stats() const
+{
+    if (!exporting && !importing)
+        return;
+    std::cout << "bridge: sent " << sent_msgs << " msgs in " << sent_batches << " batches (" << sent_bytes << " bytes, "
+              << raw_bytes << " uncompressed), received " << recv_msgs << " msgs in " << recv_batches << " batches, dropped "
+              << loop_drops << " looped, " << dup_drops << " duplicate, " << hop_drops << " over " << BRIDGE_MAX_HOPS
+              << " hops, " << bad_batches << " bad batches" << std::endl;
+}
@@ -0,0 +1,129 @@
+#ifndef __BRIDGE_H
+#define __BRIDGE_H
+#include <string>
+#include <vector>
+#include <set>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include "zmq/zmq.hpp"
+#include "filter_router.hpp"
+
+/* a message crossing more proxies than this is dropped */
+#define BRIDGE_MAX_HOPS 8
+/* a topic batch is sent when it is this big or BRIDGE_BATCH_MS old */
+#define BRIDGE_BATCH_BYTES (64 * 1024)
+#define BRIDGE_BATCH_MS 2
+/* batches smaller than this are never compressed */
+#define BRIDGE_COMPRESS_MIN 512
+/* (origin, msg id) pairs remembered for the diamond dedupe */
+#define BRIDGE_DEDUPE_SIZE 65536
+
+struct bridge_options
+{
+    /* XPUB the peers connect to, empty: no exports */
+    std::string bind;
+    /* bridge ports of the peers to import from */
+    std::vector<std::string> connect;
+    /* forward peer subscriptions and peer messages, for transit proxies */
+    bool relay = false;
+    /* zlib compress batches, needs PROTOBUS_BRIDGE_ZLIB */
+    bool compress = false;
+    uint32_t batch_ms = BRIDGE_BATCH_MS;
+};
+
+/*
+ * Proxy to proxy bridge.
+ *
+ * A proxy exports on its bridge port (XPUB) and imports by connecting an
+ * XSUB to the bridge ports of its peers. It subscribes there to the topics
+ * of its own subscribers, so a message only crosses a bridge when the other
+ * side has a subscriber for it, and the peer subscriptions are passed to the
+ * local publishers so they publish the topic at all.
+ *
+ * Messages are batched per topic, the topic frame keeps the XPUB filtering.
+ * Every entry carries the id of the proxy it entered the bridge at (origin),
+ * a message id of that origin and a hop count. A proxy drops entries of its
+ * own origin (loop), entries seen recently (the second path of a diamond)
+ * and entries past BRIDGE_MAX_HOPS.
+ *
+ * With relay a proxy forwards peer subscriptions to its own peers and
+ * re-exports what it imports, which multi hop and diamond topologies need.
+ * Relaying proxies must not form a cycle: the subscriptions would keep each
+ * other alive after the last subscriber is gone (data still stops at the
+ * loop check).
+ */
+class protobus_bridge
+{
+public:
+    protobus_bridge(zmq::context_t &context, const bridge_options &options);
+    inline bool exports() const { return exporting; }
+    inline bool imports() const { return importing; }
+    inline zmq::socket_t &export_socket() { return export_sock; }
+    inline zmq::socket_t &import_socket() { return import_sock; }
+
+    /* message from a local publisher */
+    void on_local(const std::string &topic, const zmq::message_t &body);
+    /* subscription frame of a local subscriber (XPUB frame) */
+    void on_local_subscription(const zmq::message_t &frame);
+    /* subscription of a peer on the export socket */
+    void on_peer_subscription(zmq::socket_t &frontend);
+    /* batch on the import socket, delivered to the local subscribers */
+    void on_batch(zmq::socket_t &backend, filter_router &router);
+    /* send the batches that are due, returns the poll timeout until the next one (-1: none pending) */
+    long flush();
+    /* counters, printed at exit */
+    void print_stats() const;
+
+private:
+    struct batch
+    {
+        std::string entries;
+        uint32_t count = 0;
+        uint64_t first_ms = 0;
+    };
+    struct msg_key
+    {
+        uint64_t origin;
+        uint64_t id;
+        bool operator==(const msg_key &other) const { return origin == other.origin && id == other.id; }
+    };
+    struct msg_key_hash
+    {
+        size_t operator()(const msg_key &key) const { return key.origin ^ (key.id * 0x9e3779b97f4a7c15ull); }
+    };
+
+    bool wanted(const std::string &topic);
+    void add(const std::string &topic, uint64_t origin, uint64_t id, uint8_t hops, const void *data, size_t size);
+    void send(const std::string &topic, batch &b);
+    bool seen(uint64_t origin, uint64_t id);
+    void send_upstream(bool subscribe, const std::string &topic);
+
+    bridge_options options_;
+    bool exporting = false;
+    bool importing = false;
+    zmq::socket_t export_sock;
+    zmq::socket_t import_sock;
+    uint64_t origin_ = 0;
+    uint64_t next_id = 0;
+    /* prefixes subscribed by the peers, and the per topic verdict */
+    std::set<std::string> remote;
+    std::unordered_map<std::string, bool> wanted_cache;
+    std::unordered_map<std::string, batch> batches;
+    std::unordered_set<msg_key, msg_key_hash> recent;
+    std::deque<msg_key> recent_order;
+    std::string zbuf;
+
+    uint64_t sent_batches = 0;
+    uint64_t sent_msgs = 0;
+    uint64_t sent_bytes = 0;
+    uint64_t raw_bytes = 0;
+    uint64_t recv_batches = 0;
+    uint64_t recv_msgs = 0;
+    uint64_t loop_drops = 0;
+    uint64_t dup_drops = 0;
+    uint64_t hop_drops = 0;
+    uint64_t bad_batches = 0;
+};
+#endif
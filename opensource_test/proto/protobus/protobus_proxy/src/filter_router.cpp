@@ -0,0 +1,64 @@
+#include "filter_router.hpp"
+#include <iostream>
+
+bool filter_router::on_subscription(const zmq::message_t &frame, zmq::socket_t &frontend)
+{
+    // XPUB subscription frame: 1 byte (1 subscribe, 0 unsubscribe) + topic
+    if (frame.size() < 2)
+        return false;
+    const char *data = static_cast<const char *>(frame.data());
+    if (!protobus_filter::is_filter_topic(data + 1, frame.size() - 1))
+        return false;
+
+    bool subscribe = data[0] == 1;
+    std::string key(data + 1, frame.size() - 1);
+    if (subscribe)
+    {
+        protobus_filter filter;
+        if (!filter.parse(key))
+        {
+            std::cerr << "bad filter subscription: " << filter.error() << std::endl;
+            return true;
+        }
+        std::string topic = filter.topic();
+        if (filters.emplace(key, std::move(filter)).second)
+        {
+            // XSUB refcounts topics, plain subscribers of the same topic are not affected
+            send_upstream(true, topic, frontend);
+        }
+    }
+    else
+    {
+        auto it = filters.find(key);
+        if (it != filters.end())
+        {
+            send_upstream(false, it->second.topic(), frontend);
+            filters.erase(it);
+        }
+    }
+    return true;
+}
+
+void filter_router::route(const std::string &topic, zmq::message_t &body, zmq::socket_t &backend)
+{
+    for (auto &it : filters)
+    {
+        const protobus_filter &filter = it.second;
+        if (topic.compare(0, filter.topic().size(), filter.topic()) != 0)
+            continue;
+        if (!filter.match(static_cast<const uint8_t *>(body.data()), body.size()))
+            continue;
+        zmq::message_t key(it.first.data(), it.first.size());
+        zmq::message_t copy;
+        copy.copy(body);
+        backend.send(key, zmq::send_flags::sndmore);
+        backend.send(copy, zmq::send_flags::none);
+    }
+}
+
+void filter_router::send_upstream(bool subscribe, const std::string &topic, zmq::socket_t &frontend)
+{
+    std::string frame(1, subscribe ? 1 : 0);
+    frame += topic;
+    frontend.send(zmq::buffer(frame), zmq::send_flags::none);
+}
@@ -0,0 +1,31 @@
+#ifndef __FILTER_ROUTER_H
+#define __FILTER_ROUTER_H
+#include <string>
+#include <unordered_map>
+#include "zmq/zmq.hpp"
+#include "protobus_filter.hpp"
+
+/*
+ * Content based routing for protobus_proxy.
+ *
+ * Filtered subscriptions coming from the XPUB side are kept here instead of
+ * being forwarded, the publishers only see a subscription to the plain topic.
+ * Every published message is offered to the filters of its topic and a copy
+ * is sent with the filter key as topic frame to each one that matches.
+ */
+class filter_router
+{
+public:
+    /* subscription frame from the backend, true if it was a filter (and has been handled) */
+    bool on_subscription(const zmq::message_t &frame, zmq::socket_t &frontend);
+    /* send one copy per matching filter, body is shared, not copied */
+    void route(const std::string &topic, zmq::message_t &body, zmq::socket_t &backend);
+    inline size_t size() const { return filters.size(); }
+
+private:
+    void send_upstream(bool subscribe, const std::string &topic, zmq::socket_t &frontend);
+
+    /* filter key -> parsed filter */
+    std::unordered_map<std::string, protobus_filter> filters;
+};
+#endif
@@ -0,0 +1,181 @@
+#include "ha_link.hpp"
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include "protobus_filter.hpp"
+
+#define HA_HEARTBEAT "hb"
+#define HA_SUBSCRIPTIONS "subs"
+
+static uint64_t now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ha_link::ha_link(zmq::context_t &context, bool standby, const std::string &endpoint)
+    : standby_(standby), sock_(context, standby ? zmq::socket_type::sub : zmq::socket_type::pub)
+{
+    if (standby_)
+    {
+        sock_.set(zmq::sockopt::subscribe, "");
+        // notice a restarted primary within a heartbeat or two
+        sock_.set(zmq::sockopt::reconnect_ivl, HA_HEARTBEAT_MS);
+        sock_.connect(endpoint);
+    }
+    else
+    {
+        // a heartbeat is worthless once late, never queue behind a slow standby
+        sock_.set(zmq::sockopt::sndhwm, 100);
+        sock_.bind(endpoint);
+    }
+    // the standby counts its start as the last heartbeat, no primary means take over
+    started_ms = now_ms();
+    last_heartbeat_ms = started_ms;
+}
+
+void ha_link::on_subscription(const zmq::message_t &frame)
+{
+    if (standby_ || frame.size() < 1)
+        return;
+    const char *data = static_cast<const char *>(frame.data());
+    std::string topic(data + 1, frame.size() - 1);
+    // XPUB passes only the first subscribe and the last unsubscribe of a topic
+    if (data[0] == 1)
+        dirty |= subscriptions.insert(topic).second;
+    else if (data[0] == 0)
+        dirty |= subscriptions.erase(topic) > 0;
+}
+
+void ha_link::send_snapshot()
+{
+    sock_.send(zmq::buffer(HA_SUBSCRIPTIONS, sizeof(HA_SUBSCRIPTIONS) - 1),
+               subscriptions.empty() ? zmq::send_flags::dontwait : zmq::send_flags::sndmore | zmq::send_flags::dontwait);
+    size_t left = subscriptions.size();
+    for (const std::string &topic : subscriptions)
+    {
+        --left;
+        sock_.send(zmq::buffer(topic), left == 0 ? zmq::send_flags::dontwait : zmq::send_flags::sndmore | zmq::send_flags::dontwait);
+    }
+}
+
+void ha_link::on_message(zmq::socket_t &frontend)
+{
+    zmq::message_t kind;
+    if (!sock_.recv(kind, zmq::recv_flags::dontwait).has_value())
+        return;
+    uint64_t now = now_ms();
+    last_heartbeat_ms = now;
+    if (active_ && primary_back_ms == 0)
+    {
+        primary_back_ms = now;
+        std::cout << "primary is back, handing back in " << HA_HANDBACK_MS << "ms" << std::endl;
+    }
+    bool snapshot = kind.size() == sizeof(HA_SUBSCRIPTIONS) - 1 && memcmp(kind.data(), HA_SUBSCRIPTIONS, kind.size()) == 0;
+    if (!snapshot)
+    {
+        while (kind.more())
+            (void)sock_.recv(kind, zmq::recv_flags::none);
+        return;
+    }
+    std::set<std::string> mirror;
+    bool more = kind.more();
+    while (more)
+    {
+        zmq::message_t topic;
+        (void)sock_.recv(topic, zmq::recv_flags::none);
+        more = topic.more();
+        mirror.emplace(static_cast<const char *>(topic.data()), topic.size());
+    }
+    subscriptions.swap(mirror);
+    if (active_)
+        sync(frontend);
+}
+
+void ha_link::hold(zmq::message_t &topic, zmq::message_t &body)
+{
+    uint64_t now = now_ms();
+    while (!held_.empty() && (held_.size() >= HA_HOLD_MAX || now - held_.front().ms > HA_HOLD_MS))
+        held_.pop_front();
+    held_.push_back(held_msg{now, std::move(topic), std::move(body)});
+}
+
+bool ha_link::tick(zmq::socket_t &frontend)
+{
+    uint64_t now = now_ms();
+    if (!standby_)
+    {
+        if (now - last_heartbeat_ms >= HA_HEARTBEAT_MS)
+        {
+            sock_.send(zmq::buffer(HA_HEARTBEAT, sizeof(HA_HEARTBEAT) - 1), zmq::send_flags::dontwait);
+            last_heartbeat_ms = now;
+        }
+        if (dirty || now - last_snapshot_ms >= HA_SNAPSHOT_MS)
+        {
+            send_snapshot();
+            last_snapshot_ms = now;
+            dirty = false;
+        }
+        return false;
+    }
+    if (!active_ && now - last_heartbeat_ms > HA_TAKEOVER_MS && now - started_ms > HA_STARTUP_MS)
+    {
+        take_over(frontend);
+        return true;
+    }
+    else if (active_ && primary_back_ms != 0 && now - primary_back_ms >= HA_HANDBACK_MS)
+    {
+        hand_back(frontend);
+    }
+    else if (active_ && primary_back_ms != 0 && now - last_heartbeat_ms > HA_TAKEOVER_MS)
+    {
+        // the primary went away again during the hand back
+        primary_back_ms = 0;
+    }
+    return false;
+}
+
+void ha_link::take_over(zmq::socket_t &frontend)
+{
+    std::cout << "no heartbeat for " << now_ms() - last_heartbeat_ms << "ms, standby takes over ("
+              << subscriptions.size() << " mirrored subscriptions, " << held_.size() << " held messages)" << std::endl;
+    active_ = true;
+    primary_back_ms = 0;
+    sync(frontend);
+}
+
+void ha_link::hand_back(zmq::socket_t &frontend)
+{
+    std::cout << "standby hands back to the primary" << std::endl;
+    active_ = false;
+    primary_back_ms = 0;
+    for (const std::string &topic : applied)
+        send_upstream(false, topic, frontend);
+    applied.clear();
+}
+
+/* subscribe upstream to the plain topics of the mirror, drop the ones no longer in it */
+void ha_link::sync(zmq::socket_t &frontend)
+{
+    std::set<std::string> wanted;
+    // the filters of the subscribers connected here are routed by their own subscriptions
+    for (const std::string &topic : subscriptions)
+        wanted.insert(protobus_filter::plain_topic(topic));
+    for (const std::string &topic : applied)
+    {
+        if (wanted.count(topic) == 0)
+            send_upstream(false, topic, frontend);
+    }
+    for (const std::string &topic : wanted)
+    {
+        if (applied.count(topic) == 0)
+            send_upstream(true, topic, frontend);
+    }
+    applied.swap(wanted);
+}
+
+void ha_link::send_upstream(bool subscribe, const std::string &topic, zmq::socket_t &frontend)
+{
+    std::string frame(1, subscribe ? 1 : 0);
+    frame += topic;
+    frontend.send(zmq::buffer(frame), zmq::send_flags::none);
+}
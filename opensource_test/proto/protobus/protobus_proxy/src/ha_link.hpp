@@ -0,0 +1,89 @@
+#ifndef __HA_LINK_H
+#define __HA_LINK_H
+#include <string>
+#include <set>
+#include <deque>
+#include <cstdint>
+#include "zmq/zmq.hpp"
+
+#define TCP_SUB_STANDBY "tcp://127.0.0.1:5557"
+#define TCP_PUB_STANDBY "tcp://127.0.0.1:5558"
+/* heartbeats and subscription state, primary -> standby */
+#define TCP_HA "tcp://127.0.0.1:5559"
+#define HA_HEARTBEAT_MS 10
+/* the standby takes over after this long without a heartbeat */
+#define HA_TAKEOVER_MS 50
+/* and keeps forwarding this long after the primary is back, clients dedupe the overlap */
+#define HA_HANDBACK_MS 500
+/* no take over in the first HA_STARTUP_MS, the first connect to the primary may need a zmq reconnect */
+#define HA_STARTUP_MS 500
+/* full subscription snapshot period, a change is sent at once */
+#define HA_SNAPSHOT_MS 200
+/* the passive standby holds back this long (and at most HA_HOLD_MAX messages) for the take over */
+#define HA_HOLD_MS (2 * HA_TAKEOVER_MS)
+#define HA_HOLD_MAX 20000
+
+/*
+ * Primary/standby link of two protobus_proxy instances.
+ *
+ * HA clients (PROTOBUS_HA=1) connect to both proxies. Both proxies keep the
+ * subscription path running, but the standby drops the data frames while the
+ * primary heartbeats. The primary mirrors its subscription set to the
+ * standby, the standby subscribes upstream to the mirrored topics when it
+ * takes over, so the flow of every topic the primary carried is resumed even
+ * if a subscriber has not (re)subscribed at the standby yet. XSUB refcounts
+ * subscriptions, the ones of real subscribers survive the hand back.
+ * The passive standby holds back the last HA_HOLD_MS of data and sends it at
+ * the take over, what the dead primary had not delivered is not lost, the
+ * clients drop the rest as duplicates.
+ */
+class ha_link
+{
+public:
+    struct held_msg
+    {
+        uint64_t ms;
+        zmq::message_t topic;
+        zmq::message_t body;
+    };
+    ha_link(zmq::context_t &context, bool standby, const std::string &endpoint = TCP_HA);
+    inline bool standby() const { return standby_; }
+    /* false while the standby drops data */
+    inline bool forwarding() const { return !standby_ || active_; }
+    /* the heartbeat socket, only polled by the standby */
+    inline zmq::socket_t &socket() { return sock_; }
+
+    /* subscription frame seen on the backend (primary) */
+    void on_subscription(const zmq::message_t &frame);
+    /* message on the heartbeat socket (standby) */
+    void on_message(zmq::socket_t &frontend);
+    /* call at least every HA_HEARTBEAT_MS, true when the standby just took over */
+    bool tick(zmq::socket_t &frontend);
+    /* passive standby: keep a message for the take over */
+    void hold(zmq::message_t &topic, zmq::message_t &body);
+    /* messages held back, to be sent after tick() returned true and cleared */
+    inline std::deque<held_msg> &held() { return held_; }
+
+private:
+    void send_snapshot();
+    void take_over(zmq::socket_t &frontend);
+    void hand_back(zmq::socket_t &frontend);
+    void sync(zmq::socket_t &frontend);
+    void send_upstream(bool subscribe, const std::string &topic, zmq::socket_t &frontend);
+
+    bool standby_;
+    bool active_ = false;
+    zmq::socket_t sock_;
+    uint64_t started_ms = 0;
+    uint64_t last_heartbeat_ms = 0;
+    uint64_t last_snapshot_ms = 0;
+    /* standby: first heartbeat after a take over, 0 while the primary is away */
+    uint64_t primary_back_ms = 0;
+    bool dirty = false;
+    /* primary: its subscriptions (XPUB frames without the first byte), standby: the mirror of them */
+    std::set<std::string> subscriptions;
+    /* standby: plain topics subscribed upstream while active */
+    std::set<std::string> applied;
+    std::deque<held_msg> held_;
+};
+#endif
@@ -3,6 +3,14 @@
 #include "sys_utils.h"
 #include <thread>
 #include <signal.h>
+#include <cstring>
+#include <getopt.h>
+#include <vector>
+#include "filter_router.hpp"
+#include "ha_link.hpp"
+#include "bridge.hpp"
+#include "protobus_trace.hpp"
+#include "protobus_view.hpp"
 #define TCP_SUB "tcp://127.0.0.1:5555"
 #define TCP_PUB "tcp://127.0.0.1:5556"
 zmq::context_t context(2);
@@ -57,6 +65,92 @@ void xpub_task(zmq::socket_t *socket)
     xpub_monitor.monitor(*socket, "inproc://xpub_monitor", ZMQ_EVENT_ALL);
 }
 #endif
+/* forward one multipart message from the publishers, plus the filtered copies */
+static void forward_data(zmq::socket_t &frontend, zmq::socket_t &backend, filter_router &router, ha_link &ha, protobus_bridge &bridge)
+{
+    zmq::message_t topic;
+    if (!frontend.recv(topic, zmq::recv_flags::none).has_value())
+        return;
+    if (!ha.forwarding())
+    {
+        // passive standby, the primary delivers this one, held back in case it dies first
+        if (!topic.more())
+            return;
+        zmq::message_t body;
+        (void)frontend.recv(body, zmq::recv_flags::none);
+        if (!body.more())
+        {
+            ha.hold(topic, body);
+            return;
+        }
+        while (body.more())
+            (void)frontend.recv(body, zmq::recv_flags::none);
+        return;
+    }
+    if (!topic.more())
+    {
+        backend.send(topic, zmq::send_flags::none);
+        return;
+    }
+    zmq::message_t body;
+    (void)frontend.recv(body, zmq::recv_flags::none);
+    bool more = body.more();
+    uint64_t trace_id = 0;
+    if (protobus_trace::enabled())
+    {
+        protobus_wire::field f;
+        if (protobus_wire::find_field(static_cast<const uint8_t *>(body.data()), body.size(), PROTOBUS_TRACE_FIELD, f))
+            trace_id = f.value;
+    }
+    protobus_span span(trace_id, protobus_trace::SPAN_PROXY);
+    std::string topic_str(static_cast<const char *>(topic.data()), topic.size());
+    if (!more && router.size() > 0)
+    {
+        router.route(topic_str, body, backend);
+    }
+    if (!more)
+    {
+        bridge.on_local(topic_str, body);
+    }
+    backend.send(topic, zmq::send_flags::sndmore);
+    backend.send(body, more ? zmq::send_flags::sndmore : zmq::send_flags::none);
+    // protobus sends topic + body, pass anything longer through untouched
+    while (more)
+    {
+        zmq::message_t part;
+        (void)frontend.recv(part, zmq::recv_flags::none);
+        more = part.more();
+        backend.send(part, more ? zmq::send_flags::sndmore : zmq::send_flags::none);
+    }
+}
+/* the standby took over, send what it held back, the clients drop the ones the primary delivered */
+static void release_held(zmq::socket_t &backend, filter_router &router, ha_link &ha)
+{
+    for (ha_link::held_msg &msg : ha.held())
+    {
+        if (router.size() > 0)
+        {
+            std::string topic_str(static_cast<const char *>(msg.topic.data()), msg.topic.size());
+            router.route(topic_str, msg.body, backend);
+        }
+        backend.send(msg.topic, zmq::send_flags::sndmore);
+        backend.send(msg.body, zmq::send_flags::none);
+    }
+    ha.held().clear();
+}
+/* subscriptions from the subscribers, filters are kept here and not forwarded */
+static void forward_subscription(zmq::socket_t &frontend, zmq::socket_t &backend, filter_router &router, ha_link &ha, protobus_bridge &bridge)
+{
+    zmq::message_t frame;
+    if (!backend.recv(frame, zmq::recv_flags::none).has_value())
+        return;
+    ha.on_subscription(frame);
+    bridge.on_local_subscription(frame);
+    if (!router.on_subscription(frame, frontend))
+    {
+        frontend.send(frame, zmq::send_flags::none);
+    }
+}
 void sig_handle(int sig_num)
 {
     switch (sig_num)
@@ -71,38 +165,170 @@ void sig_handle(int sig_num)
         break;
     }
 }
-int main()
+static void usage(const char *prog)
 {
-    std::cout << "Proxy Starting ..." << std::endl;
-    becomeSingle("protobus_proxy");
+    std::cout << "usage: " << prog << " [options]\n"
+              << "  --standby                hot standby on the TCP_*_STANDBY ports, see ha_link\n"
+              << "  --name NAME              single instance name (default protobus_proxy, max 18 chars)\n"
+              << "  --sub EP / --pub EP      bind the publisher / subscriber side here instead of the defaults\n"
+              << "  --ha EP                  primary/standby heartbeat endpoint (default " << TCP_HA << ")\n"
+              << "  --bridge-bind EP         export to other proxies on EP, see protobus_bridge\n"
+              << "  --bridge-connect EP      import from the proxy exporting on EP, repeatable\n"
+              << "  --bridge-relay           pass peer subscriptions and messages on (transit proxy)\n"
+              << "  --bridge-batch-ms N      max batching delay (default " << BRIDGE_BATCH_MS << ")\n"
+              << "  --bridge-zlib            compress batches (built with PROTOBUS_BRIDGE_ZLIB)\n";
+}
+int main(int argc, char *argv[])
+{
+    static const struct option long_options[] = {
+        {"standby", no_argument, nullptr, 's'},
+        {"name", required_argument, nullptr, 'n'},
+        {"sub", required_argument, nullptr, 'S'},
+        {"pub", required_argument, nullptr, 'P'},
+        {"ha", required_argument, nullptr, 'H'},
+        {"bridge-bind", required_argument, nullptr, 'b'},
+        {"bridge-connect", required_argument, nullptr, 'c'},
+        {"bridge-relay", no_argument, nullptr, 'r'},
+        {"bridge-batch-ms", required_argument, nullptr, 't'},
+        {"bridge-zlib", no_argument, nullptr, 'z'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+    bool standby = false;
+    std::string name;
+    std::string sub_ep;
+    std::string pub_ep;
+    std::string ha_ep = TCP_HA;
+    bridge_options bridge_opt;
+    int c;
+    while ((c = getopt_long(argc, argv, "h", long_options, nullptr)) != -1)
+    {
+        switch (c)
+        {
+        case 's':
+            standby = true;
+            break;
+        case 'n':
+            name = optarg;
+            break;
+        case 'S':
+            sub_ep = optarg;
+            break;
+        case 'P':
+            pub_ep = optarg;
+            break;
+        case 'H':
+            ha_ep = optarg;
+            break;
+        case 'b':
+            bridge_opt.bind = optarg;
+            break;
+        case 'c':
+            bridge_opt.connect.push_back(optarg);
+            break;
+        case 'r':
+            bridge_opt.relay = true;
+            break;
+        case 't':
+            bridge_opt.batch_ms = atoi(optarg);
+            break;
+        case 'z':
+            bridge_opt.compress = true;
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    if (name.empty())
+        name = standby ? "protobus_standby" : "protobus_proxy";
+    if (sub_ep.empty())
+        sub_ep = standby ? TCP_SUB_STANDBY : TCP_SUB;
+    if (pub_ep.empty())
+        pub_ep = standby ? TCP_PUB_STANDBY : TCP_PUB;
+    std::cout << "Proxy Starting ..." << (standby ? " (standby)" : "") << std::endl;
+    becomeSingle(name.c_str());
+    protobus_trace::init(name.c_str());
 
     signal(SIGTERM, sig_handle);
     signal(SIGINT, sig_handle);
 
     zmq::socket_t frontend(context, zmq::socket_type::xsub);
 
-    frontend.bind(TCP_SUB);
+    frontend.bind(sub_ep);
 
     zmq::socket_t backend(context, zmq::socket_type::xpub);
 
-    backend.bind(TCP_PUB);
+    backend.bind(pub_ep);
 #ifdef MONITOR_ENABLE
     std::thread tSub(xsub_task, &frontend);
     tSub.detach();
     std::thread tPub(xpub_task, &backend);
     tPub.detach();
 #endif
-    try
+    filter_router router;
+    ha_link ha(context, standby, ha_ep);
+    protobus_bridge bridge(context, bridge_opt);
+    // the primary only sends on the ha socket, the bridge sockets are idle when not configured
+    std::vector<zmq::pollitem_t> items = {
+        {frontend.handle(), 0, ZMQ_POLLIN, 0},
+        {backend.handle(), 0, ZMQ_POLLIN, 0},
+        {ha.socket().handle(), 0, static_cast<short>(standby ? ZMQ_POLLIN : 0), 0},
+        {bridge.export_socket().handle(), 0, static_cast<short>(bridge.exports() ? ZMQ_POLLIN : 0), 0},
+        {bridge.import_socket().handle(), 0, static_cast<short>(bridge.imports() ? ZMQ_POLLIN : 0), 0}};
+    long timeout = HA_HEARTBEAT_MS;
+    while (true)
     {
-        zmq::proxy(frontend, backend);
-    }
-    catch (const std::exception &e)
-    {
-        std::cerr << e.what() << "\n";
+        try
+        {
+            zmq::poll(items, std::chrono::milliseconds(timeout));
+            if (items[0].revents & ZMQ_POLLIN)
+            {
+                forward_data(frontend, backend, router, ha, bridge);
+            }
+            if (items[1].revents & ZMQ_POLLIN)
+            {
+                forward_subscription(frontend, backend, router, ha, bridge);
+            }
+            if (items[2].revents & ZMQ_POLLIN)
+            {
+                ha.on_message(frontend);
+            }
+            if (items[3].revents & ZMQ_POLLIN)
+            {
+                bridge.on_peer_subscription(frontend);
+            }
+            if (items[4].revents & ZMQ_POLLIN)
+            {
+                bridge.on_batch(backend, router);
+            }
+            if (ha.tick(frontend))
+            {
+                release_held(backend, router, ha);
+            }
+            long bridge_timeout = bridge.flush();
+            timeout = bridge_timeout >= 0 && bridge_timeout < HA_HEARTBEAT_MS ? bridge_timeout : HA_HEARTBEAT_MS;
+        }
+        catch (const zmq::error_t &e)
+        {
+            // the signal interrupts poll first, ETERM after context.shutdown() is the normal exit
+            if (e.num() == EINTR)
+                continue;
+            if (e.num() != ETERM)
+                std::cerr << e.what() << "\n";
+            break;
+        }
     }
 
+    bridge.export_socket().close();
+    bridge.import_socket().close();
+    bridge.print_stats();
+    ha.socket().close();
     frontend.close();
     backend.close();
+    if (protobus_trace::enabled())
+    {
+        protobus_trace::dump();
+    }
 
     std::cout << "GoodBye" << std::endl;
 
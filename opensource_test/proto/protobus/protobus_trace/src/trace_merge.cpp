@@ -0,0 +1,220 @@
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include "rapidjson/document.h"
+#include "rapidjson/filereadstream.h"
+#include "rapidjson/filewritestream.h"
+#include "rapidjson/writer.h"
+using namespace std;
+
+/*
+ * Merge the per process dumps of protobus_trace into one Chrome trace.
+ *
+ *   protobus_trace out.json /tmp/protobus_trace.*.json
+ *
+ * Open out.json in chrome://tracing or ui.perfetto.dev. Every span is a
+ * slice on its process/thread, the spans of one message are linked by a flow
+ * arrow (send -> send_msg -> proxy -> recv -> callback).
+ */
+struct span
+{
+    uint64_t trace_id;
+    string point;
+    int pid;
+    uint32_t tid;
+    uint64_t begin;
+    uint64_t end;
+};
+struct process
+{
+    int pid;
+    string name;
+};
+
+static bool load_dump(const char *path, vector<span> &spans, vector<process> &processes)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == nullptr)
+    {
+        perror(path);
+        return false;
+    }
+    char buf[65536];
+    rapidjson::FileReadStream is(fp, buf, sizeof(buf));
+    rapidjson::Document doc;
+    doc.ParseStream(is);
+    fclose(fp);
+    if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("spans") || !doc["spans"].IsArray())
+    {
+        cerr << path << ": not a protobus trace dump" << endl;
+        return false;
+    }
+    process proc;
+    proc.pid = doc.HasMember("pid") ? doc["pid"].GetInt() : 0;
+    proc.name = doc.HasMember("name") ? doc["name"].GetString() : "";
+    processes.push_back(proc);
+    for (const auto &item : doc["spans"].GetArray())
+    {
+        if (!item.IsArray() || item.Size() != 5)
+            continue;
+        span s;
+        s.trace_id = item[0].GetUint64();
+        s.point = item[1].GetString();
+        s.pid = proc.pid;
+        s.tid = item[2].GetUint();
+        s.begin = item[3].GetUint64();
+        s.end = item[4].GetUint64();
+        spans.push_back(s);
+    }
+    return true;
+}
+
+template <typename Writer>
+static void write_flow(Writer &writer, const span &s, const char *phase, const string &id)
+{
+    writer.StartObject();
+    writer.Key("name");
+    writer.String("message");
+    writer.Key("cat");
+    writer.String("protobus");
+    writer.Key("ph");
+    writer.String(phase);
+    writer.Key("id");
+    writer.String(id.c_str());
+    writer.Key("ts");
+    writer.Double(s.begin / 1000.0);
+    writer.Key("pid");
+    writer.Int(s.pid);
+    writer.Key("tid");
+    writer.Uint(s.tid);
+    if (phase[0] == 'f')
+    {
+        writer.Key("bp");
+        writer.String("e");
+    }
+    writer.EndObject();
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        cerr << "usage: " << argv[0] << " <out.json> <dump.json>..." << endl;
+        return 1;
+    }
+    vector<span> spans;
+    vector<process> processes;
+    for (int i = 2; i < argc; i++)
+    {
+        load_dump(argv[i], spans, processes);
+    }
+
+    // spans of one message, in time order (CLOCK_MONOTONIC is shared by the processes)
+    map<uint64_t, vector<const span *>> traces;
+    for (const span &s : spans)
+    {
+        traces[s.trace_id].push_back(&s);
+    }
+    for (auto &it : traces)
+    {
+        sort(it.second.begin(), it.second.end(), [](const span *a, const span *b)
+             { return a->begin < b->begin; });
+    }
+
+    FILE *fp = fopen(argv[1], "w");
+    if (fp == nullptr)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    char buf[65536];
+    rapidjson::FileWriteStream os(fp, buf, sizeof(buf));
+    rapidjson::Writer<rapidjson::FileWriteStream> writer(os);
+    writer.StartObject();
+    writer.Key("traceEvents");
+    writer.StartArray();
+    for (const process &proc : processes)
+    {
+        writer.StartObject();
+        writer.Key("name");
+        writer.String("process_name");
+        writer.Key("ph");
+        writer.String("M");
+        writer.Key("pid");
+        writer.Int(proc.pid);
+        writer.Key("args");
+        writer.StartObject();
+        writer.Key("name");
+        writer.String(proc.name.c_str());
+        writer.EndObject();
+        writer.EndObject();
+    }
+    for (auto &it : traces)
+    {
+        char id[32];
+        snprintf(id, sizeof(id), "0x%llx", static_cast<unsigned long long>(it.first));
+        const vector<const span *> &list = it.second;
+        for (size_t i = 0; i < list.size(); i++)
+        {
+            const span &s = *list[i];
+            writer.StartObject();
+            writer.Key("name");
+            writer.String(s.point.c_str());
+            writer.Key("cat");
+            writer.String("protobus");
+            writer.Key("ph");
+            writer.String("X");
+            writer.Key("ts");
+            writer.Double(s.begin / 1000.0);
+            writer.Key("dur");
+            writer.Double((s.end - s.begin) / 1000.0);
+            writer.Key("pid");
+            writer.Int(s.pid);
+            writer.Key("tid");
+            writer.Uint(s.tid);
+            writer.Key("args");
+            writer.StartObject();
+            writer.Key("trace_id");
+            writer.String(id);
+            writer.EndObject();
+            writer.EndObject();
+            if (list.size() > 1)
+            {
+                write_flow(writer, s, i == 0 ? "s" : (i + 1 == list.size() ? "f" : "t"), id);
+            }
+        }
+    }
+    writer.EndArray();
+    writer.Key("displayTimeUnit");
+    writer.String("ns");
+    writer.EndObject();
+    os.Flush();
+    fclose(fp);
+
+    // average time per hop, a quick answer before opening the viewer
+    map<string, pair<uint64_t, uint64_t>> hops;
+    uint64_t total = 0;
+    for (auto &it : traces)
+    {
+        const vector<const span *> &list = it.second;
+        total += list.back()->end - list.front()->begin;
+        for (const span *s : list)
+        {
+            hops[s->point].first += s->end - s->begin;
+            hops[s->point].second++;
+        }
+    }
+    cout << processes.size() << " processes, " << traces.size() << " traces, " << spans.size() << " spans" << endl;
+    for (auto &it : hops)
+    {
+        cout << "  " << it.first << ": " << it.second.second << " spans, avg " << it.second.first / it.second.second / 1000.0 << " us" << endl;
+    }
+    if (!traces.empty())
+    {
+        cout << "  end to end avg " << total / traces.size() / 1000.0 << " us" << endl;
+    }
+    return 0;
+}
@@ -15,6 +15,7 @@ using namespace std;
 using google::protobuf::Timestamp;
 using google::protobuf::util::TimeUtil;
 // #define TOPIC_MAP
+#define QUEUE_LIMIT 1000
 uint8_t sendBuf[65535];
 struct protobus_handle
 {
@@ -250,15 +251,43 @@ void protobus_cleanup(protobus_handle_t *handle)
 }
 void protobus_send(protobus_handle_t *handle, const MSG::WrapperMessage &msg)
 {
-
+    protobus_send(handle, MSG::WrapperMessage(msg));
+}
+void protobus_send(protobus_handle_t *handle, MSG::WrapperMessage &&msg)
+{
+    auto msgPtr = std::make_shared<MSG::WrapperMessage>(std::move(msg));
     std::unique_lock<std::mutex> lock(handle->queueMutex);
     // Wait until the queue size is below the threshold
     handle->queueCond.wait(lock, [&handle]
-                           { return handle->msgQueue.size() <= 1000; });
-    handle->msgQueue.push(std::make_shared<MSG::WrapperMessage>(msg));
+                           { return handle->msgQueue.size() <= QUEUE_LIMIT; });
+    handle->msgQueue.push(std::move(msgPtr));
     handle->queueCond.notify_one();
     // lock.unlock();
 }
+void protobus_send_batch(protobus_handle_t *handle, MSG::WrapperMessage *msgs, size_t count)
+{
+    std::vector<std::shared_ptr<MSG::WrapperMessage>> batch;
+    batch.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        batch.push_back(std::make_shared<MSG::WrapperMessage>(std::move(msgs[i])));
+    }
+
+    size_t pushed = 0;
+    std::unique_lock<std::mutex> lock(handle->queueMutex);
+    while (pushed < count)
+    {
+        handle->queueCond.wait(lock, [&handle]
+                               { return handle->msgQueue.size() <= QUEUE_LIMIT; });
+        size_t room = QUEUE_LIMIT + 1 - handle->msgQueue.size();
+        size_t end = std::min(count, pushed + room);
+        for (; pushed < end; pushed++)
+        {
+            handle->msgQueue.push(std::move(batch[pushed]));
+        }
+        handle->queueCond.notify_one();
+    }
+}
 void protobus_add_subscriber(protobus_handle_t *handle, const char *topic, protobus_cb cb)
 {
     std::lock_guard<std::mutex> lock(handle->topicMutex);
@@ -9,6 +9,9 @@ protobus_handle_t *protobus_init(const char *node_name);
 protobus_handle_t *protobus_init(const char *node_name, std::vector<std::string> topics, protobus_cb cb);
 void protobus_cleanup(protobus_handle_t *handle);
 void protobus_send(protobus_handle_t *handle, const MSG::WrapperMessage &msg);
+void protobus_send(protobus_handle_t *handle, MSG::WrapperMessage &&msg);
+/* msgs are moved into the queue, one lock and one wakeup per batch */
+void protobus_send_batch(protobus_handle_t *handle, MSG::WrapperMessage *msgs, size_t count);
 void protobus_add_subscriber(protobus_handle_t *handle, const char *topic, protobus_cb cb);
 void protobus_del_subscriber(protobus_handle_t *handle, const char *topic);
 #endif
\ No newline at end of file
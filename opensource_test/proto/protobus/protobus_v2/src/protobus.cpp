@@ -8,6 +8,7 @@
 #include <algorithm>
 #include <unistd.h>
 #include <cstdarg>
+#include <random>
 using namespace std;
 using google::protobuf::Timestamp;
 using google::protobuf::util::TimeUtil;
@@ -20,8 +21,19 @@ protobus::protobus(const char *node_name) : log_level(protobus::LOG_DEBUG)
         this->identify = string(node_name);
     }
     run_status = true;
+    protobus_trace::init(node_name);
 
-    send_buf = std::make_unique<uint8_t[]>(65535);
+    send_buf = std::make_unique<uint8_t[]>(PROTOBUS_SEND_BUF_SIZE);
+    std::random_device rd;
+    transfer_salt = (static_cast<uint64_t>(rd()) << 32);
+    const char *ha_env = getenv("PROTOBUS_HA");
+    ha_mode = ha_env != nullptr && atoi(ha_env) != 0;
+    sender_id = (static_cast<uint64_t>(rd()) << 32) | rd();
+    const char *max_size_env = getenv("PROTOBUS_MAX_MESSAGE_SIZE");
+    if (max_size_env != nullptr)
+    {
+        max_message_size = strtoull(max_size_env, nullptr, 10);
+    }
 
     context = new zmq::context_t(2);
     sub_sock = new zmq::socket_t(*context, zmq::socket_type::sub);
@@ -30,8 +42,23 @@ protobus::protobus(const char *node_name) : log_level(protobus::LOG_DEBUG)
     pub_sock = new zmq::socket_t(*context, zmq::socket_type::pub);
     pub_sock->set(zmq::sockopt::sndhwm, 1500);
     pub_sock->connect(TCP_SUB);
+    if (ha_mode)
+    {
+        // publish to both proxies and receive from both, the standby only forwards when the primary is gone
+        sub_sock->connect(TCP_PUB_STANDBY);
+        pub_sock->connect(TCP_SUB_STANDBY);
+    }
     pub_task = std::thread(&protobus::pub_task_function, this);
     sub_task = std::thread(&protobus::sub_task_function, this);
+
+    const char *metrics_env = getenv("PROTOBUS_METRICS_FILE");
+    const char *stats_env = getenv("PROTOBUS_STATS");
+    bool stats = stats_env != nullptr && atoi(stats_env) != 0;
+    if (metrics_env != nullptr || stats)
+    {
+        const char *interval_env = getenv("PROTOBUS_METRICS_INTERVAL_MS");
+        start_metrics_export(metrics_env, interval_env != nullptr ? atoi(interval_env) : 10000, stats);
+    }
 }
 
 protobus::protobus(const char *node_name, std::vector<std::string> topics, protobus_cb cb) : protobus(node_name)
@@ -77,49 +104,298 @@ protobus::~protobus()
     {
         pub_task.join();
     }
+    {
+        std::lock_guard<std::mutex> lk(qos_mutex);
+        qos_cond.notify_all();
+    }
+    if (qos_task.joinable())
+    {
+        qos_task.join();
+    }
+    {
+        std::lock_guard<std::mutex> lk(metrics_mutex);
+        metrics_cond.notify_all();
+    }
+    if (metrics_task.joinable())
+    {
+        metrics_task.join();
+    }
+    if (protobus_trace::enabled())
+    {
+        protobus_trace::dump();
+    }
     std::cout << "exit" << std::endl;
 }
 
+/* keep a timestamp set by the caller, otherwise the send time in ns */
+static void stamp_msg(MSG::WrapperMessage &msg)
+{
+    if (!msg.has_timestamp())
+    {
+        *msg.mutable_timestamp() = TimeUtil::GetCurrentTime();
+    }
+}
+
+static uint64_t steady_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* timestamp older than the lifespan of the qos */
+static bool expired(const MSG::WrapperMessage &msg, const protobus_qos &qos)
+{
+    if (qos.lifespan_ms == 0 || !msg.has_timestamp())
+        return false;
+    int64_t age_ms = TimeUtil::DurationToMilliseconds(TimeUtil::GetCurrentTime() - msg.timestamp());
+    return age_ms > static_cast<int64_t>(qos.lifespan_ms);
+}
+
 void protobus::send(MSG::WrapperMessage &msg)
 {
+    stamp_msg(msg);
+    send(MSG::WrapperMessage(msg));
+}
+
+void protobus::send(MSG::WrapperMessage &&msg)
+{
+    if (protobus_trace::enabled() && msg.trace_id() == 0)
+    {
+        msg.set_trace_id(protobus_trace::sample());
+    }
+    protobus_span span(msg.trace_id(), protobus_trace::SPAN_SEND);
+    stamp_msg(msg);
+    if (has_pub_qos && !admit_publish(msg))
+    {
+        protobus_counters &counters = metrics_.topic(msg.topic());
+        counters.drops++;
+        counters.hwm_hits++;
+        return;
+    }
+    // same arena, so the move constructor swaps instead of copying
+    auto msgPtr = std::make_shared<MSG::WrapperMessage>(std::move(msg));
 #ifndef THREADSAFE_QUEUE
     std::unique_lock<std::mutex> lk(msg_mutex);
     // Wait until the queue size is below the threshold
     msg_cond.wait(lk, [this]
-                  { return msg_queue.size() <= 1000; });
-    if (!msg.has_timestamp())
+                  { return msg_queue.size() <= PROTOBUS_QUEUE_LIMIT; });
+    msg_queue.push(std::move(msgPtr));
+    metrics_.queue_depth = msg_queue.size();
+    msg_cond.notify_one();
+#else
+    msg_queue.wait_push(std::move(msgPtr));
+#endif
+}
+
+void protobus::send_many(MSG::WrapperMessage *msgs, size_t count)
+{
+    // build the shared_ptrs outside the lock
+    std::vector<std::shared_ptr<MSG::WrapperMessage>> batch;
+    std::vector<uint64_t> trace_ids;
+    uint64_t trace_begin = 0;
+    batch.reserve(count);
+    if (protobus_trace::enabled())
     {
-        Timestamp timestamp;
-        timestamp.set_seconds(time(NULL));
-        timestamp.set_nanos(0);
-        *msg.mutable_timestamp() = timestamp;
+        trace_begin = protobus_trace::now();
+        for (size_t i = 0; i < count; i++)
+        {
+            if (msgs[i].trace_id() == 0)
+                msgs[i].set_trace_id(protobus_trace::sample());
+            if (msgs[i].trace_id() != 0)
+                trace_ids.push_back(msgs[i].trace_id());
+        }
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        stamp_msg(msgs[i]);
+        if (has_pub_qos && !admit_publish(msgs[i]))
+        {
+            protobus_counters &counters = metrics_.topic(msgs[i].topic());
+            counters.drops++;
+            counters.hwm_hits++;
+            continue;
+        }
+        batch.push_back(std::make_shared<MSG::WrapperMessage>(std::move(msgs[i])));
+    }
+    count = batch.size();
+#ifndef THREADSAFE_QUEUE
+    size_t pushed = 0;
+    std::unique_lock<std::mutex> lk(msg_mutex);
+    while (pushed < count)
+    {
+        // wait once per block of free slots, not once per message
+        msg_cond.wait(lk, [this]
+                      { return msg_queue.size() <= PROTOBUS_QUEUE_LIMIT; });
+        size_t room = PROTOBUS_QUEUE_LIMIT + 1 - msg_queue.size();
+        size_t end = std::min(count, pushed + room);
+        for (; pushed < end; pushed++)
+        {
+            msg_queue.push(std::move(batch[pushed]));
+        }
+        metrics_.queue_depth = msg_queue.size();
+        msg_cond.notify_one();
     }
-    msg_queue.push(std::make_shared<MSG::WrapperMessage>(msg));
-    msg_cond.notify_one();
 #else
-    msg_queue.wait_push(std::make_shared<MSG::WrapperMessage>(msg));
+    for (auto &msgPtr : batch)
+    {
+        msg_queue.wait_push(std::move(msgPtr));
+    }
 #endif
+    if (!trace_ids.empty())
+    {
+        uint64_t trace_end = protobus_trace::now();
+        for (uint64_t id : trace_ids)
+        {
+            protobus_trace::record(id, protobus_trace::SPAN_SEND, trace_begin, trace_end);
+        }
+    }
 }
 
-void protobus::add_subscriber(const char *topic, protobus_cb cb)
+protobus::subscriber *protobus::find_or_add_subscriber(const char *topic)
 {
-    std::lock_guard<std::mutex> lk(topic_mutex);
     string topic_str(topic);
 
     // Check if the topic already exists
-    std::vector<std::pair<std::string, protobus_cb>>::iterator it;
+    std::vector<subscriber>::iterator it;
     for (it = topic_vec.begin(); it != topic_vec.end(); it++)
     {
-        if ((*it).first == topic_str)
+        if ((*it).topic == topic_str)
         {
-            break;
+            return &(*it);
         }
     }
-    if (it == topic_vec.end())
+    subscriber sub;
+    sub.topic = topic_str;
+    topic_vec.push_back(std::move(sub));
+    sub_sock->set(zmq::sockopt::subscribe, topic);
+    topic_cond.notify_one();
+    return &topic_vec.back();
+}
+
+void protobus::add_subscriber(const char *topic, protobus_cb cb)
+{
+    std::lock_guard<std::mutex> lk(topic_mutex);
+    subscriber *sub = find_or_add_subscriber(topic);
+    if (sub->cb == nullptr && sub->view_cb == nullptr)
+    {
+        sub->cb = cb;
+    }
+    else
+    {
+        std::cerr << "Topic already exists." << std::endl;
+    }
+}
+
+void protobus::add_subscriber(const char *topic, const char *filter, protobus_cb cb)
+{
+    protobus_filter check;
+    std::string key = filter_topic(topic, filter);
+    if (!check.parse(key))
+    {
+        std::cerr << "Bad filter '" << filter << "': " << check.error() << std::endl;
+        return;
+    }
+    add_subscriber(key.c_str(), cb);
+}
+
+void protobus::add_subscriber(const char *topic, protobus_cb cb, const protobus_qos &qos, protobus_deadline_cb deadline_cb)
+{
+    std::lock_guard<std::mutex> lk(topic_mutex);
+    subscriber *sub = find_or_add_subscriber(topic);
+    if (sub->cb != nullptr || sub->view_cb != nullptr)
+    {
+        std::cerr << "Topic already exists." << std::endl;
+        return;
+    }
+    auto state = std::make_shared<qos_state>();
+    state->topic = topic;
+    state->qos = qos;
+    state->deadline_cb = deadline_cb;
+    state->cb = cb;
+    state->last_ns = steady_ns();
+    sub->cb = cb;
+    sub->qos = state;
+
+    std::lock_guard<std::mutex> qlk(qos_mutex);
+    sub_qos.push_back(state);
+    if (qos.history_depth != 0 || qos.hwm != 0 || qos.deadline_ms != 0)
+    {
+        start_qos_task();
+    }
+}
+
+void protobus::set_publisher_qos(const char *topic, const protobus_qos &qos, protobus_deadline_cb deadline_cb)
+{
+    std::lock_guard<std::mutex> lk(qos_mutex);
+    std::shared_ptr<qos_state> &state = pub_qos[topic];
+    if (state == nullptr)
+    {
+        state = std::make_shared<qos_state>();
+        state->topic = topic;
+        state->last_ns = steady_ns();
+    }
+    state->qos = qos;
+    state->deadline_cb = deadline_cb;
+    has_pub_qos = true;
+    if (qos.deadline_ms != 0)
     {
-        topic_vec.push_back(std::make_pair(topic_str, cb));
-        sub_sock->set(zmq::sockopt::subscribe, topic);
-        topic_cond.notify_one();
+        start_qos_task();
+    }
+}
+
+/* called with qos_mutex held */
+void protobus::start_qos_task()
+{
+    if (!qos_task.joinable())
+    {
+        qos_task = std::thread(&protobus::qos_task_function, this);
+    }
+    qos_cond.notify_one();
+}
+
+/* per topic hwm of the pub queue, false drops msg */
+bool protobus::admit_publish(const MSG::WrapperMessage &msg)
+{
+    std::lock_guard<std::mutex> lk(qos_mutex);
+    auto it = pub_qos.find(msg.topic());
+    if (it == pub_qos.end())
+    {
+        return true;
+    }
+    qos_state &state = *it->second;
+    if (state.qos.hwm != 0 && state.queued >= state.qos.hwm)
+    {
+        return false;
+    }
+    state.queued++;
+    return true;
+}
+
+std::string protobus::filter_topic(const char *topic, const char *filter)
+{
+    return protobus_filter::make_topic(topic, filter);
+}
+
+void protobus::add_stream_subscriber(const char *topic, protobus_stream_cb cb)
+{
+    std::lock_guard<std::mutex> lk(topic_mutex);
+    subscriber *sub = find_or_add_subscriber(topic);
+    if (sub->stream_cb == nullptr)
+    {
+        sub->stream_cb = cb;
+    }
+    else
+    {
+        std::cerr << "Stream topic already exists." << std::endl;
+    }
+}
+
+void protobus::add_view_subscriber(const char *topic, protobus_view_cb cb)
+{
+    std::lock_guard<std::mutex> lk(topic_mutex);
+    subscriber *sub = find_or_add_subscriber(topic);
+    if (sub->cb == nullptr && sub->view_cb == nullptr)
+    {
+        sub->view_cb = cb;
     }
     else
     {
@@ -130,16 +406,21 @@ void protobus::add_subscriber(const char *topic, protobus_cb cb)
 void protobus::del_subscriber(const char *topic)
 {
     std::lock_guard<std::mutex> lk(topic_mutex);
-    std::vector<std::pair<std::string, protobus_cb>>::iterator it;
+    std::vector<subscriber>::iterator it;
     for (it = topic_vec.begin(); it != topic_vec.end(); ++it)
     {
-        if (it->first == topic)
+        if (it->topic == topic)
         {
             break;
         }
     }
     if (it != topic_vec.end())
     {
+        if (it->qos != nullptr)
+        {
+            std::lock_guard<std::mutex> qlk(qos_mutex);
+            sub_qos.erase(std::remove(sub_qos.begin(), sub_qos.end(), it->qos), sub_qos.end());
+        }
         topic_vec.erase(it);
         std::cout << "topic '" << topic << "' removed from vector." << std::endl;
     }
@@ -169,10 +450,21 @@ int32_t protobus::console(protobus_log_level level, const char *func, int32_t li
     {
         log << "[" << lineNum << "]";
     }
-    char buf[65535] = {0};
+    // size the text first, long logs are chunked by the pub thread
+    va_list ap_len;
     va_start(ap, format);
-    std::vsnprintf(buf, size(buf), format, ap);
+    va_copy(ap_len, ap);
+    len = std::vsnprintf(nullptr, 0, format, ap_len);
+    va_end(ap_len);
+    if (len < 0)
+    {
+        va_end(ap);
+        return -1;
+    }
+    std::string buf(len + 1, '\0');
+    std::vsnprintf(&buf[0], buf.size(), format, ap);
     va_end(ap);
+    buf.resize(len);
 
     log << buf;
     std::string log_str = log.str();
@@ -191,12 +483,17 @@ int32_t protobus::console(protobus_log_level level, const char *func, int32_t li
     return 0;
 }
 
-std::shared_ptr<MSG::WrapperMessage> protobus::get_msg()
+std::shared_ptr<MSG::WrapperMessage> protobus::get_msg(bool wait)
 {
 #ifndef THREADSAFE_QUEUE
     std::unique_lock<mutex> lk(msg_mutex);
-    if (!msg_cond.wait_for(lk, std::chrono::milliseconds(500), [this]
-                           { return (!msg_queue.empty() || !run_status); }))
+    if (!wait)
+    {
+        if (msg_queue.empty() || !run_status)
+            return nullptr;
+    }
+    else if (!msg_cond.wait_for(lk, std::chrono::milliseconds(500), [this]
+                                { return (!msg_queue.empty() || !run_status); }))
     {
         return nullptr;
     }
@@ -204,21 +501,36 @@ std::shared_ptr<MSG::WrapperMessage> protobus::get_msg()
         return nullptr;
     auto msgPtr = msg_queue.front();
     msg_queue.pop();
+    metrics_.queue_depth = msg_queue.size();
     lk.unlock();
     msg_cond.notify_one();
     return msgPtr;
 #else
+    if (!wait)
+    {
+        std::shared_ptr<MSG::WrapperMessage> msgPtr;
+        msg_queue.try_pop(msgPtr);
+        return msgPtr;
+    }
     return msg_queue.wait_and_pop();
 #endif
 }
 
 size_t protobus::send_msg(std::shared_ptr<MSG::WrapperMessage> msg)
 {
+    protobus_span span(msg->trace_id(), protobus_trace::SPAN_SEND_MSG);
     std::unique_ptr<uint8_t[]> dataBuf;
     uint8_t *bufPtr;
     bool releaseFlag = false;
+    // stamp before sizing, the timestamp is part of the serialized size
+    stamp_msg(*msg);
+    if (ha_mode)
+    {
+        msg->set_sender_id(sender_id);
+        msg->set_seq(++tx_seq);
+    }
     size_t sendSize = msg->ByteSizeLong();
-    if (sendSize > sizeof(this->send_buf))
+    if (sendSize > PROTOBUS_SEND_BUF_SIZE)
     {
         dataBuf = std::make_unique<uint8_t[]>(sendSize + 1);
         std::fill(dataBuf.get(), dataBuf.get() + sendSize + 1, 0);
@@ -246,18 +558,23 @@ size_t protobus::send_msg(std::shared_ptr<MSG::WrapperMessage> msg)
 
     try
     {
-        Timestamp timestamp;
-        timestamp.set_seconds(time(NULL));
-        timestamp.set_nanos(0);
-        *msg->mutable_timestamp() = timestamp;
-
+        protobus_counters &counters = metrics_.topic(msg->topic());
+        uint64_t begin = steady_ns();
         msg->SerializePartialToArray(bufPtr, sendSize);
+        counters.serialize_ns.observe(steady_ns() - begin);
         zmq::message_t zmq_msg(bufPtr, sendSize);
 
         zmq::send_result_t ret = pub_sock->send(zmq_msg, zmq::send_flags::dontwait);
         if (!ret || ret.value() == 0)
         {
-            std::cout << "message send failed" << std::endl;
+            // refused by zmq (sndhwm)
+            counters.hwm_hits++;
+            counters.drops++;
+        }
+        else
+        {
+            counters.sent_msgs++;
+            counters.sent_bytes += sendSize;
         }
     }
     catch (const std::exception &e)
@@ -268,23 +585,519 @@ size_t protobus::send_msg(std::shared_ptr<MSG::WrapperMessage> msg)
     return sendSize;
 }
 
+void protobus::start_transfer(std::shared_ptr<MSG::WrapperMessage> msg)
+{
+    stamp_msg(*msg);
+
+    tx_transfer transfer;
+    transfer.topic = msg->topic();
+    transfer.id = transfer_salt | (++transfer_count & 0xffffffff);
+    transfer.trace_id = msg->trace_id();
+    transfer.offset = 0;
+    transfer.buf = buf_pool.acquire(msg->ByteSizeLong());
+    msg->SerializePartialToArray(transfer.buf->data(), transfer.buf->size());
+    tx_transfers.push_back(std::move(transfer));
+}
+
+void protobus::send_next_chunk()
+{
+    tx_transfer &transfer = tx_transfers.front();
+    size_t total = transfer.buf->size();
+    size_t len = std::min<size_t>(PROTOBUS_CHUNK_SIZE, total - transfer.offset);
+
+    auto chunk_msg = std::make_shared<MSG::WrapperMessage>();
+    chunk_msg->set_topic(transfer.topic);
+    chunk_msg->set_trace_id(transfer.trace_id);
+    MSG::msg_chunk *chunk = chunk_msg->mutable_chunk();
+    chunk->set_transfer_id(transfer.id);
+    chunk->set_offset(transfer.offset);
+    chunk->set_total_size(total);
+    chunk->set_data(transfer.buf->data() + transfer.offset, len);
+    send_msg(chunk_msg);
+    transfer.offset += len;
+
+    // round robin between the transfers in flight
+    tx_transfer done = std::move(transfer);
+    tx_transfers.pop_front();
+    if (done.offset < total)
+    {
+        tx_transfers.push_back(std::move(done));
+    }
+    else
+    {
+        buf_pool.release(std::move(done.buf));
+    }
+}
+
 void protobus::pub_task_function()
 {
     size_t sendSize = 0;
 
     while (run_status)
     {
-        auto msgPtr = get_msg();
+        // one small message and one chunk per round, so a big transfer never blocks the queue
+        auto msgPtr = get_msg(tx_transfers.empty());
+        tx_qos = nullptr;
+        if (msgPtr != nullptr && has_pub_qos)
+        {
+            std::lock_guard<std::mutex> lk(qos_mutex);
+            auto it = pub_qos.find(msgPtr->topic());
+            if (it != pub_qos.end())
+            {
+                tx_qos = it->second;
+                if (tx_qos->queued > 0)
+                    tx_qos->queued--;
+            }
+        }
+        if (msgPtr != nullptr && tx_qos != nullptr && expired(*msgPtr, tx_qos->qos))
+        {
+            // stale before it reached the socket
+            metrics_.topic(msgPtr->topic()).drops++;
+            msgPtr = nullptr;
+        }
         if (msgPtr != nullptr)
         {
-            sendSize = send_msg(msgPtr);
-            if (sendSize != msgPtr->ByteSizeLong())
+            if (tx_qos != nullptr)
+            {
+                tx_qos->last_ns = steady_ns();
+            }
+            if (msgPtr->ByteSizeLong() > PROTOBUS_CHUNK_SIZE)
+            {
+                start_transfer(msgPtr);
+            }
+            else
+            {
+                sendSize = send_msg(msgPtr);
+                if (sendSize != msgPtr->ByteSizeLong())
+                {
+                    std::cerr << "send msg failed ,ret %d" << sendSize << std::endl;
+                }
+            }
+        }
+        if (!tx_transfers.empty())
+        {
+            send_next_chunk();
+        }
+    }
+}
+
+void protobus::dispatch(subscriber &sub, const MSG::WrapperMessage &msg)
+{
+    if (msg.message_type_case() == MSG::WrapperMessage::kChunk)
+    {
+        on_chunk(sub, msg);
+    }
+    else if (sub.cb != nullptr)
+    {
+        protobus_span span(msg.trace_id(), protobus_trace::SPAN_CALLBACK);
+        uint64_t begin = steady_ns();
+        sub.cb(msg);
+        metrics_.topic(msg.topic()).callback_ns.observe(steady_ns() - begin);
+    }
+}
+
+void protobus::dispatch(subscriber &sub, const std::string &topic, const uint8_t *data, size_t size)
+{
+    uint64_t trace_id = 0;
+    uint64_t recv_begin = 0;
+    if (protobus_trace::enabled())
+    {
+        protobus_wire::field f;
+        if (protobus_wire::find_field(data, size, PROTOBUS_TRACE_FIELD, f))
+        {
+            trace_id = f.value;
+            recv_begin = protobus_trace::now();
+        }
+    }
+    protobus_counters &counters = metrics_.topic(topic);
+    counters.recv_msgs++;
+    counters.recv_bytes += size;
+    if (sub.qos != nullptr)
+    {
+        auto msg = std::make_shared<MSG::WrapperMessage>();
+        uint64_t begin = steady_ns();
+        msg->ParseFromArray(data, size);
+        counters.parse_ns.observe(steady_ns() - begin);
+        if (trace_id != 0)
+            protobus_trace::record(trace_id, protobus_trace::SPAN_RECV, recv_begin, protobus_trace::now());
+        dispatch_qos(sub, std::move(msg));
+        return;
+    }
+    if (sub.view_cb == nullptr)
+    {
+        MSG::WrapperMessage wrapper_msg;
+        uint64_t begin = steady_ns();
+        wrapper_msg.ParseFromArray(data, size);
+        counters.parse_ns.observe(steady_ns() - begin);
+        if (trace_id != 0)
+            protobus_trace::record(trace_id, protobus_trace::SPAN_RECV, recv_begin, protobus_trace::now());
+        dispatch(sub, wrapper_msg);
+        return;
+    }
+    // view mode: only the oneof tag is looked at before the callback
+    protobus_view view(topic, data, size);
+    if (view.message_type_case() == MSG::WrapperMessage::kChunk)
+    {
+        if (trace_id != 0)
+            protobus_trace::record(trace_id, protobus_trace::SPAN_RECV, recv_begin, protobus_trace::now());
+        dispatch(sub, view.message());
+    }
+    else
+    {
+        if (trace_id != 0)
+            protobus_trace::record(trace_id, protobus_trace::SPAN_RECV, recv_begin, protobus_trace::now());
+        protobus_span span(trace_id, protobus_trace::SPAN_CALLBACK);
+        uint64_t begin = steady_ns();
+        sub.view_cb(view);
+        counters.callback_ns.observe(steady_ns() - begin);
+    }
+}
+
+void protobus::dispatch_qos(subscriber &sub, std::shared_ptr<MSG::WrapperMessage> msg)
+{
+    qos_state &state = *sub.qos;
+    if (msg->message_type_case() == MSG::WrapperMessage::kChunk)
+    {
+        // transfers are reassembled first, qos applies to the whole message only
+        dispatch(sub, *msg);
+        return;
+    }
+    state.last_ns = steady_ns();
+    if (expired(*msg, state.qos))
+    {
+        metrics_.topic(msg->topic()).drops++;
+        return;
+    }
+    if (state.qos.history_depth == 0 && state.qos.hwm == 0)
+    {
+        dispatch(sub, *msg);
+        return;
+    }
+    std::lock_guard<std::mutex> lk(qos_mutex);
+    if (state.qos.history_depth != 0)
+    {
+        // keep last N
+        if (state.pending.size() >= state.qos.history_depth)
+        {
+            metrics_.topic(state.pending.front()->topic()).drops++;
+            state.pending.pop_front();
+        }
+    }
+    else if (state.pending.size() >= state.qos.hwm)
+    {
+        // keep all up to hwm
+        protobus_counters &counters = metrics_.topic(msg->topic());
+        counters.drops++;
+        counters.hwm_hits++;
+        return;
+    }
+    state.pending.push_back(std::move(msg));
+    qos_cond.notify_one();
+}
+
+void protobus::on_chunk(subscriber &sub, const MSG::WrapperMessage &msg)
+{
+    const MSG::msg_chunk &chunk = msg.chunk();
+    const std::string &data = chunk.data();
+    uint64_t id = chunk.transfer_id();
+    bool last = chunk.offset() + data.size() >= chunk.total_size();
+
+    // the sender cuts every transfer at PROTOBUS_CHUNK_SIZE, so total_size fixes the chunk count
+    if (chunk.total_size() > max_message_size || chunk.offset() >= chunk.total_size() ||
+        data.size() != std::min<uint64_t>(PROTOBUS_CHUNK_SIZE, chunk.total_size() - chunk.offset()))
+    {
+        std::cerr << "transfer " << id << " dropped, total_size " << chunk.total_size() << " chunk "
+                  << data.size() << " at " << chunk.offset() << std::endl;
+        metrics_.topic(msg.topic()).drops++;
+        auto it = rx_transfers.find(id);
+        if (it != rx_transfers.end())
+        {
+            buf_pool.release(std::move(it->second.buf));
+            rx_transfers.erase(it);
+        }
+        return;
+    }
+    if (sub.stream_cb != nullptr)
+    {
+        protobus_chunk piece{msg.topic(), id, chunk.offset(), chunk.total_size(),
+                             reinterpret_cast<const uint8_t *>(data.data()), data.size(), last};
+        sub.stream_cb(piece);
+    }
+    if (sub.cb == nullptr && sub.view_cb == nullptr)
+    {
+        return;
+    }
+
+    auto it = rx_transfers.find(id);
+    if (chunk.offset() == 0)
+    {
+        if (it != rx_transfers.end())
+        {
+            buf_pool.release(std::move(it->second.buf));
+            rx_transfers.erase(it);
+        }
+        // drop the oldest reassembly when too many publishers stream at once
+        while (rx_transfers.size() >= PROTOBUS_MAX_RX_TRANSFERS && !rx_order.empty())
+        {
+            auto old = rx_transfers.find(rx_order.front());
+            rx_order.pop_front();
+            if (old != rx_transfers.end())
+            {
+                buf_pool.release(std::move(old->second.buf));
+                rx_transfers.erase(old);
+            }
+        }
+        it = rx_transfers.emplace(id, rx_transfer{0, buf_pool.acquire(chunk.total_size())}).first;
+        rx_order.push_back(id);
+    }
+    if (it == rx_transfers.end())
+    {
+        return;
+    }
+    rx_transfer &transfer = it->second;
+    if (chunk.offset() != transfer.received || chunk.offset() + data.size() > transfer.buf->size())
+    {
+        // a chunk was lost (HWM), the transfer can not complete
+        std::cerr << "transfer " << id << " lost chunk at " << transfer.received << std::endl;
+        metrics_.topic(msg.topic()).drops++;
+        buf_pool.release(std::move(transfer.buf));
+        rx_transfers.erase(it);
+        return;
+    }
+    std::copy(data.begin(), data.end(), transfer.buf->begin() + chunk.offset());
+    transfer.received += data.size();
+    if (transfer.received == transfer.buf->size() && sub.qos != nullptr && sub.view_cb == nullptr)
+    {
+        // the whole message goes through lifespan, history and hwm like an unchunked one
+        protobus_counters &counters = metrics_.topic(msg.topic());
+        auto full_msg = std::make_shared<MSG::WrapperMessage>();
+        uint64_t begin = steady_ns();
+        bool parsed = full_msg->ParseFromArray(transfer.buf->data(), transfer.buf->size());
+        counters.parse_ns.observe(steady_ns() - begin);
+        buf_pool.release(std::move(transfer.buf));
+        rx_transfers.erase(it);
+        if (parsed && full_msg->message_type_case() != MSG::WrapperMessage::kChunk)
+        {
+            dispatch_qos(sub, std::move(full_msg));
+        }
+        else
+        {
+            counters.drops++;
+        }
+    }
+    else if (transfer.received == transfer.buf->size())
+    {
+        protobus_span span(msg.trace_id(), protobus_trace::SPAN_CALLBACK);
+        protobus_counters &counters = metrics_.topic(msg.topic());
+        uint64_t begin = steady_ns();
+        if (sub.view_cb != nullptr)
+        {
+            sub.view_cb(protobus_view(msg.topic(), transfer.buf->data(), transfer.buf->size()));
+        }
+        else
+        {
+            MSG::WrapperMessage full_msg;
+            if (full_msg.ParseFromArray(transfer.buf->data(), transfer.buf->size()))
+            {
+                uint64_t parsed = steady_ns();
+                counters.parse_ns.observe(parsed - begin);
+                begin = parsed;
+                sub.cb(full_msg);
+            }
+        }
+        counters.callback_ns.observe(steady_ns() - begin);
+        buf_pool.release(std::move(transfer.buf));
+        rx_transfers.erase(it);
+    }
+}
+/* callbacks of the queued qos subscribers and the deadline checks */
+void protobus::qos_task_function()
+{
+    size_t next = 0;
+    std::unique_lock<std::mutex> lk(qos_mutex);
+    while (run_status)
+    {
+        // one message per round, round robin over the topics
+        std::shared_ptr<qos_state> state;
+        std::shared_ptr<MSG::WrapperMessage> msg;
+        for (size_t i = 0; i < sub_qos.size(); i++)
+        {
+            std::shared_ptr<qos_state> &candidate = sub_qos[(next + i) % sub_qos.size()];
+            if (!candidate->pending.empty())
+            {
+                state = candidate;
+                msg = std::move(candidate->pending.front());
+                candidate->pending.pop_front();
+                next = (next + i + 1) % sub_qos.size();
+                break;
+            }
+        }
+        if (msg != nullptr)
+        {
+            lk.unlock();
+            // it may have gone stale while waiting in the queue
+            protobus_counters &counters = metrics_.topic(msg->topic());
+            if (!expired(*msg, state->qos))
+            {
+                protobus_span span(msg->trace_id(), protobus_trace::SPAN_CALLBACK);
+                uint64_t begin = steady_ns();
+                state->cb(*msg);
+                counters.callback_ns.observe(steady_ns() - begin);
+            }
+            else
+            {
+                counters.drops++;
+            }
+            lk.lock();
+            continue;
+        }
+
+        uint64_t now = steady_ns();
+        uint64_t wake = now + 100 * 1000000ull;
+        std::vector<std::pair<std::shared_ptr<qos_state>, uint64_t>> missed;
+        auto check = [&](const std::shared_ptr<qos_state> &st)
+        {
+            if (st->qos.deadline_ms == 0 || st->deadline_cb == nullptr)
+                return;
+            uint64_t last = st->last_ns;
+            uint64_t period = st->qos.deadline_ms * 1000000ull;
+            uint64_t due = std::max(last, st->missed_ns) + period;
+            if (now >= due)
+            {
+                st->missed_ns = now;
+                missed.emplace_back(st, (now - last) / 1000000);
+                due = now + period;
+            }
+            wake = std::min(wake, due);
+        };
+        for (auto &st : sub_qos)
+            check(st);
+        for (auto &it : pub_qos)
+            check(it.second);
+        if (!missed.empty())
+        {
+            lk.unlock();
+            for (auto &m : missed)
             {
-                std::cerr << "send msg failed ,ret %d" << sendSize << std::endl;
+                m.first->deadline_cb(m.first->topic, m.second);
             }
+            lk.lock();
+            continue;
         }
+        qos_cond.wait_until(lk, std::chrono::steady_clock::time_point(std::chrono::nanoseconds(wake)));
     }
 }
+
+void protobus::start_metrics_export(const char *file, uint32_t interval_ms, bool stats_topic)
+{
+    std::lock_guard<std::mutex> lk(metrics_mutex);
+    metrics_file = file != nullptr ? file : "";
+    metrics_interval_ms = interval_ms > 0 ? interval_ms : 10000;
+    metrics_stats_topic = stats_topic;
+    if (!metrics_task.joinable())
+    {
+        metrics_task = std::thread(&protobus::metrics_task_function, this);
+    }
+    metrics_cond.notify_one();
+}
+
+void protobus::publish_stats()
+{
+    MSG::WrapperMessage msg;
+    msg.set_topic(PROTOBUS_STATS_TOPIC);
+    MSG::msg_stats *stats = msg.mutable_stats();
+    stats->set_node(identify);
+    stats->set_queue_depth(metrics_.queue_depth);
+    auto fill = [](MSG::msg_stats_topic *out, const protobus_counters_snapshot &snap)
+    {
+        out->set_sent_msgs(snap.sent_msgs);
+        out->set_sent_bytes(snap.sent_bytes);
+        out->set_recv_msgs(snap.recv_msgs);
+        out->set_recv_bytes(snap.recv_bytes);
+        out->set_drops(snap.drops);
+        out->set_hwm_hits(snap.hwm_hits);
+        out->set_serialize_ns_sum(snap.serialize_ns);
+        out->set_parse_ns_sum(snap.parse_ns);
+        out->set_callback_ns_sum(snap.callback_ns);
+    };
+    fill(stats->mutable_total(), metrics_.total());
+    metrics_.for_each_topic([&](const char *topic, const protobus_counters &counters)
+                            {
+                                protobus_counters_snapshot snap;
+                                snap.add(counters);
+                                MSG::msg_stats_topic *item = stats->add_topics();
+                                item->set_topic(topic);
+                                fill(item, snap);
+                                item->set_callback_ns_p99(counters.callback_ns.quantile(0.99)); });
+    send(std::move(msg));
+}
+
+void protobus::metrics_task_function()
+{
+    std::unique_lock<std::mutex> lk(metrics_mutex);
+    while (run_status)
+    {
+        metrics_cond.wait_for(lk, std::chrono::milliseconds(metrics_interval_ms));
+        if (!run_status)
+            break;
+        if (!metrics_file.empty())
+        {
+            // write and rename, a scraper never sees half a file
+            std::string tmp = metrics_file + ".tmp";
+            FILE *fp = fopen(tmp.c_str(), "w");
+            if (fp != nullptr)
+            {
+                std::string text = metrics_.prometheus(identify);
+                fwrite(text.data(), 1, text.size(), fp);
+                fclose(fp);
+                rename(tmp.c_str(), metrics_file.c_str());
+            }
+        }
+        if (metrics_stats_topic)
+        {
+            lk.unlock();
+            publish_stats();
+            lk.lock();
+        }
+    }
+}
+
+/* second copy of a message, delivered by both proxies around a failover */
+bool protobus::duplicate(subscriber &sub, const uint8_t *data, size_t size)
+{
+    protobus_wire::field sender;
+    protobus_wire::field seq;
+    if (!protobus_wire::find_field(data, size, PROTOBUS_HA_SENDER_FIELD, sender) ||
+        !protobus_wire::find_field(data, size, PROTOBUS_HA_SEQ_FIELD, seq))
+    {
+        return false;
+    }
+    if (sub.seen.size() >= PROTOBUS_HA_MAX_SENDERS && sub.seen.count(sender.value) == 0)
+    {
+        sub.seen.clear();
+    }
+    seq_window &window = sub.seen[sender.value];
+    if (seq.value > window.top)
+    {
+        uint64_t shift = seq.value - window.top;
+        window.mask = shift >= 64 ? 1 : (window.mask << shift) | 1;
+        window.top = seq.value;
+        return false;
+    }
+    uint64_t age = window.top - seq.value;
+    if (age >= 64)
+    {
+        // too old to tell, the copy of the other proxy is never that late
+        return true;
+    }
+    if (window.mask & (1ull << age))
+    {
+        return true;
+    }
+    window.mask |= 1ull << age;
+    return false;
+}
+
 void protobus::sub_task_function()
 {
     while (run_status)
@@ -302,11 +1115,11 @@ void protobus::sub_task_function()
             {
 
                 std::string topic(static_cast<char *>(zmq_topic.data()), zmq_topic.size());
-                std::vector<std::pair<std::string, protobus_cb>>::iterator it;
+                std::vector<subscriber>::iterator it;
                 for (it = topic_vec.begin(); it != topic_vec.end(); ++it)
                 {
 
-                    if (topic.find(it->first) != std::string::npos)
+                    if (topic.compare(0, it->topic.size(), it->topic) == 0)
                     {
                         break;
                     }
@@ -314,13 +1127,16 @@ void protobus::sub_task_function()
                 if (it != topic_vec.end())
                 {
                     result = sub_sock->recv(zmq_msg, zmq::recv_flags::none);
-                    if (result.has_value())
+                    if (result.has_value() && !(ha_mode && duplicate(*it, static_cast<const uint8_t *>(zmq_msg.data()), zmq_msg.size())))
                     {
-                        MSG::WrapperMessage wrapper_msg;
-                        wrapper_msg.ParseFromArray(zmq_msg.data(), zmq_msg.size());
-                        it->second(wrapper_msg);
+                        dispatch(*it, topic, static_cast<const uint8_t *>(zmq_msg.data()), zmq_msg.size());
                     }
                 }
+                else if (zmq_topic.more())
+                {
+                    // not ours anymore (unsubscribed), drop the body frame
+                    (void)sub_sock->recv(zmq_msg, zmq::recv_flags::none);
+                }
             }
             else
             {
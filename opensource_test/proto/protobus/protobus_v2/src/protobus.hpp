@@ -8,9 +8,36 @@
 #include <mutex>
 #include <condition_variable>
 #include <thread>
+#include <deque>
+#include <unordered_map>
+#include <atomic>
 #include "zmq/zmq.hpp"
+#include "protobus_view.hpp"
+#include "protobus_filter.hpp"
+#include "protobus_trace.hpp"
+#include "protobus_metrics.hpp"
 #define TCP_SUB "tcp://127.0.0.1:5555"
 #define TCP_PUB "tcp://127.0.0.1:5556"
+/* hot standby protobus_proxy (protobus_proxy --standby), used with PROTOBUS_HA=1 */
+#define TCP_SUB_STANDBY "tcp://127.0.0.1:5557"
+#define TCP_PUB_STANDBY "tcp://127.0.0.1:5558"
+/* WrapperMessage sender_id and seq, see message.proto */
+#define PROTOBUS_HA_SENDER_FIELD 11
+#define PROTOBUS_HA_SEQ_FIELD 12
+/* senders remembered per subscriber for the duplicate check, forgotten all at once beyond */
+#define PROTOBUS_HA_MAX_SENDERS 1024
+/* max number of messages waiting for the pub thread */
+#define PROTOBUS_QUEUE_LIMIT 1000
+/* size of the reusable serialize buffer of the pub thread */
+#define PROTOBUS_SEND_BUF_SIZE 65535
+/* messages bigger than this are split into msg_chunk frames */
+#define PROTOBUS_CHUNK_SIZE (32 * 1024)
+/* max number of transfers reassembled at the same time by one subscriber */
+#define PROTOBUS_MAX_RX_TRANSFERS 16
+/* default max size of a reassembled message, see set_max_message_size */
+#define PROTOBUS_MAX_MESSAGE_SIZE (64 * 1024 * 1024)
+/* topic of the msg_stats published by start_metrics_export */
+#define PROTOBUS_STATS_TOPIC "protobus.stats"
 using namespace std;
 // #define THREADSAFE_QUEUE
 #ifdef THREADSAFE_QUEUE
@@ -38,7 +65,7 @@ public:
     {
         std::unique_lock<std::mutex> lk(mut);
         data_cond.wait(lk, [this]
-                       { return (data_queue.size() <= 1000 || stop_flag); });
+                       { return (data_queue.size() <= PROTOBUS_QUEUE_LIMIT || stop_flag); });
         data_queue.push(std::move(new_value));
         // lk.unlock();
         data_cond.notify_one();
@@ -88,6 +115,80 @@ public:
 };
 #endif
 
+/* free list of byte buffers, shared by chunk serialization and reassembly */
+class protobus_buffer_pool
+{
+public:
+    typedef std::unique_ptr<std::vector<uint8_t>> buffer_ptr;
+    explicit protobus_buffer_pool(size_t max_cached = 8) : max_cached(max_cached) {}
+    buffer_ptr acquire(size_t size)
+    {
+        buffer_ptr buf;
+        {
+            std::lock_guard<std::mutex> lk(mut);
+            if (!free_list.empty())
+            {
+                buf = std::move(free_list.back());
+                free_list.pop_back();
+            }
+        }
+        if (!buf)
+        {
+            buf = std::make_unique<std::vector<uint8_t>>();
+        }
+        buf->resize(size);
+        return buf;
+    }
+    void release(buffer_ptr buf)
+    {
+        if (!buf)
+            return;
+        std::lock_guard<std::mutex> lk(mut);
+        if (free_list.size() < max_cached)
+        {
+            free_list.push_back(std::move(buf));
+        }
+    }
+
+private:
+    std::mutex mut;
+    std::vector<buffer_ptr> free_list;
+    size_t max_cached;
+};
+
+/* one piece of a chunked transfer, data is a slice of the serialized WrapperMessage */
+struct protobus_chunk
+{
+    const std::string &topic;
+    uint64_t transfer_id;
+    uint64_t offset;
+    uint64_t total_size;
+    const uint8_t *data;
+    size_t size;
+    bool last;
+};
+
+/*
+ * Per topic QoS, modelled on the DDS policies of the same name.
+ *
+ * Subscriber: messages older than lifespan_ms are dropped before the callback.
+ * With history_depth or hwm set the callback runs on the qos thread from a
+ * per topic queue: history_depth keeps the newest N (drops the oldest), hwm
+ * keeps all up to hwm (drops the newest).
+ * Publisher: hwm limits the messages of the topic waiting in the pub queue
+ * (the newest is dropped, like a zmq PUB at HWM), lifespan_ms drops stale
+ * ones before serialization.
+ * Both: the deadline callback fires every deadline_ms without a message.
+ * 0 turns a policy off.
+ */
+struct protobus_qos
+{
+    uint32_t history_depth = 0;
+    uint32_t deadline_ms = 0;
+    uint32_t lifespan_ms = 0;
+    uint32_t hwm = 0;
+};
+
 class protobus
 {
 public:
@@ -101,6 +202,9 @@ public:
         LOG_MAX
     } protobus_log_level;
     typedef void (*protobus_cb)(const MSG::WrapperMessage &msg);
+    typedef void (*protobus_stream_cb)(const protobus_chunk &chunk);
+    typedef void (*protobus_view_cb)(const protobus_view &view);
+    typedef void (*protobus_deadline_cb)(const std::string &topic, uint64_t elapsed_ms);
     static std::shared_ptr<protobus> get_instance(const char *node_name = nullptr);
     static std::shared_ptr<protobus> get_instance(const char *node_name, std::vector<std::string> topics, protobus_cb cb);
 
@@ -108,17 +212,107 @@ public:
     void operator=(const protobus &) = delete;
     ~protobus();
     void send(MSG::WrapperMessage &msg);
+    /* no deep copy, msg is left empty */
+    void send(MSG::WrapperMessage &&msg);
+    /* enqueue count messages under one lock and one wakeup, the messages are moved from */
+    void send_many(MSG::WrapperMessage *msgs, size_t count);
+    inline void send_many(std::vector<MSG::WrapperMessage> &msgs) { send_many(msgs.data(), msgs.size()); }
     void add_subscriber(const char *topic, protobus_cb cb);
+    /* only messages of topic matching filter (e.g. "people.age>60"), evaluated by protobus_proxy */
+    void add_subscriber(const char *topic, const char *filter, protobus_cb cb);
+    /* zmq topic of a filtered subscription, pass it to del_subscriber to remove it */
+    static std::string filter_topic(const char *topic, const char *filter);
+    void add_subscriber(const char *topic, protobus_cb cb, const protobus_qos &qos, protobus_deadline_cb deadline_cb = nullptr);
+    /* qos of the messages this instance publishes on topic */
+    void set_publisher_qos(const char *topic, const protobus_qos &qos, protobus_deadline_cb deadline_cb = nullptr);
+    /* receive large messages chunk by chunk instead of (or besides) the reassembled message */
+    void add_stream_subscriber(const char *topic, protobus_stream_cb cb);
+    /* receive a protobus_view instead of a parsed message, decoding is left to the callback */
+    void add_view_subscriber(const char *topic, protobus_view_cb cb);
     void del_subscriber(const char *topic);
     int32_t console(protobus_log_level level, const char *func, int32_t lineNum, const char *format, ...);
     inline void set_level(protobus_log_level level) { log_level = level; }
+    /*
+     * transfers announcing a bigger total_size, or with chunks not cut at
+     * PROTOBUS_CHUNK_SIZE, are dropped before any buffer is allocated.
+     * Also set from PROTOBUS_MAX_MESSAGE_SIZE.
+     */
+    inline void set_max_message_size(size_t size) { max_message_size = size; }
+    /* counters of this instance, per topic and in total */
+    inline protobus_metrics &metrics() { return metrics_; }
+    /*
+     * every interval_ms write the metrics in Prometheus text format to file
+     * (nullptr: no file) and, with stats_topic, publish a msg_stats on
+     * PROTOBUS_STATS_TOPIC. Also started from PROTOBUS_METRICS_FILE,
+     * PROTOBUS_METRICS_INTERVAL_MS and PROTOBUS_STATS=1.
+     */
+    void start_metrics_export(const char *file, uint32_t interval_ms, bool stats_topic = false);
     inline protobus_log_level get_level() { return log_level; }
 
 private:
+    /* qos of one topic, shared between the sub (or pub) thread and the qos thread */
+    struct qos_state
+    {
+        string topic;
+        protobus_qos qos;
+        protobus_deadline_cb deadline_cb = nullptr;
+        protobus_cb cb = nullptr;
+        /* subscriber: messages waiting for the callback */
+        std::deque<std::shared_ptr<MSG::WrapperMessage>> pending;
+        /* publisher: messages of the topic in msg_queue */
+        size_t queued = 0;
+        /* last receive / send and last missed deadline, steady clock ns */
+        std::atomic<uint64_t> last_ns{0};
+        uint64_t missed_ns = 0;
+    };
+    /* newest seq of a sender and which of the 64 before it were seen */
+    struct seq_window
+    {
+        uint64_t top = 0;
+        uint64_t mask = 0;
+    };
+    struct subscriber
+    {
+        string topic;
+        protobus_cb cb = nullptr;
+        protobus_stream_cb stream_cb = nullptr;
+        protobus_view_cb view_cb = nullptr;
+        std::shared_ptr<qos_state> qos;
+        /* HA mode: sender_id -> seen seqs, sub thread only */
+        std::unordered_map<uint64_t, seq_window> seen;
+    };
+    /* large message being sent by the pub thread */
+    struct tx_transfer
+    {
+        string topic;
+        uint64_t id;
+        uint64_t trace_id;
+        uint64_t offset;
+        protobus_buffer_pool::buffer_ptr buf;
+    };
+    /* large message being reassembled by the sub thread */
+    struct rx_transfer
+    {
+        uint64_t received;
+        protobus_buffer_pool::buffer_ptr buf;
+    };
     size_t send_msg(std::shared_ptr<MSG::WrapperMessage> msg);
-    std::shared_ptr<MSG::WrapperMessage> get_msg();
+    std::shared_ptr<MSG::WrapperMessage> get_msg(bool wait = true);
+    void start_transfer(std::shared_ptr<MSG::WrapperMessage> msg);
+    void send_next_chunk();
+    void dispatch(subscriber &sub, const MSG::WrapperMessage &msg);
+    void dispatch(subscriber &sub, const std::string &topic, const uint8_t *data, size_t size);
+    subscriber *find_or_add_subscriber(const char *topic);
+    void on_chunk(subscriber &sub, const MSG::WrapperMessage &msg);
+    bool duplicate(subscriber &sub, const uint8_t *data, size_t size);
     void pub_task_function();
     void sub_task_function();
+    void qos_task_function();
+    void metrics_task_function();
+    void publish_stats();
+    void start_qos_task();
+    bool admit_publish(const MSG::WrapperMessage &msg);
+    void dispatch_qos(subscriber &sub, std::shared_ptr<MSG::WrapperMessage> msg);
     std::string format_timestamp();
     std::string format_log_level(protobus_log_level level);
     protobus(const char *node_name);
@@ -141,12 +335,42 @@ private:
     string identify;
     std::thread pub_task;
     std::thread sub_task;
+    /* HA mode: connected to both proxies, messages carry sender_id and seq */
+    bool ha_mode = false;
+    uint64_t sender_id = 0;
+    /* pub thread only */
+    uint64_t tx_seq = 0;
     /* run status */
     std::atomic<bool> run_status = false;
     /* topic vector */
     std::mutex topic_mutex;
     std::condition_variable topic_cond;
-    std::vector<std::pair<string, protobus_cb>> topic_vec;
+    std::vector<subscriber> topic_vec;
+    /* chunked transfers */
+    protobus_buffer_pool buf_pool;
+    uint64_t transfer_salt = 0;
+    uint64_t transfer_count = 0;
+    std::deque<tx_transfer> tx_transfers;
+    std::unordered_map<uint64_t, rx_transfer> rx_transfers;
+    std::deque<uint64_t> rx_order;
+    std::atomic<size_t> max_message_size = PROTOBUS_MAX_MESSAGE_SIZE;
+    /* qos */
+    std::thread qos_task;
+    std::mutex qos_mutex;
+    std::condition_variable qos_cond;
+    std::vector<std::shared_ptr<qos_state>> sub_qos;
+    std::unordered_map<std::string, std::shared_ptr<qos_state>> pub_qos;
+    std::atomic<bool> has_pub_qos = false;
+    /* pub qos of the message get_msg() returned last, pub thread only */
+    std::shared_ptr<qos_state> tx_qos;
+    /* metrics */
+    protobus_metrics metrics_;
+    std::thread metrics_task;
+    std::mutex metrics_mutex;
+    std::condition_variable metrics_cond;
+    std::string metrics_file;
+    uint32_t metrics_interval_ms = 0;
+    bool metrics_stats_topic = false;
     /* protobuf msg */
 #ifndef THREADSAFE_QUEUE
     std::queue<std::shared_ptr<MSG::WrapperMessage>> msg_queue;
@@ -0,0 +1,340 @@
+#include "protobus_filter.hpp"
+#include "protobus_view.hpp"
+#include "message.pb.h"
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+using google::protobuf::Descriptor;
+using google::protobuf::FieldDescriptor;
+
+static std::string trim(const std::string &s)
+{
+    size_t b = s.find_first_not_of(" \t");
+    if (b == std::string::npos)
+        return "";
+    size_t e = s.find_last_not_of(" \t");
+    return s.substr(b, e - b + 1);
+}
+
+static std::vector<std::string> split(const std::string &s, const std::string &sep)
+{
+    std::vector<std::string> out;
+    size_t start = 0;
+    size_t pos;
+    while ((pos = s.find(sep, start)) != std::string::npos)
+    {
+        out.push_back(s.substr(start, pos - start));
+        start = pos + sep.size();
+    }
+    out.push_back(s.substr(start));
+    return out;
+}
+
+enum value_kind
+{
+    KIND_SIGNED,
+    KIND_UNSIGNED,
+    KIND_FLOAT,
+    KIND_STRING
+};
+
+static value_kind kind_of(const FieldDescriptor *field)
+{
+    switch (field->cpp_type())
+    {
+    case FieldDescriptor::CPPTYPE_INT32:
+    case FieldDescriptor::CPPTYPE_INT64:
+    case FieldDescriptor::CPPTYPE_ENUM:
+        return KIND_SIGNED;
+    case FieldDescriptor::CPPTYPE_UINT32:
+    case FieldDescriptor::CPPTYPE_UINT64:
+    case FieldDescriptor::CPPTYPE_BOOL:
+        return KIND_UNSIGNED;
+    case FieldDescriptor::CPPTYPE_FLOAT:
+    case FieldDescriptor::CPPTYPE_DOUBLE:
+        return KIND_FLOAT;
+    default:
+        return KIND_STRING;
+    }
+}
+
+std::string protobus_filter::make_topic(const std::string &topic, const std::string &expression)
+{
+    std::string key(1, PROTOBUS_FILTER_MARK);
+    key += topic;
+    key += PROTOBUS_FILTER_SEP;
+    key += expression;
+    key += PROTOBUS_FILTER_MARK;
+    return key;
+}
+
+bool protobus_filter::is_filter_topic(const void *data, size_t size)
+{
+    return size > 0 && static_cast<const char *>(data)[0] == PROTOBUS_FILTER_MARK;
+}
+
+std::string protobus_filter::plain_topic(const std::string &subscription)
+{
+    if (!is_filter_topic(subscription.data(), subscription.size()))
+        return subscription;
+    size_t sep = subscription.find(PROTOBUS_FILTER_SEP);
+    return sep == std::string::npos ? subscription.substr(1) : subscription.substr(1, sep - 1);
+}
+
+bool protobus_filter::parse(const std::string &filter_topic)
+{
+    predicates_.clear();
+    error_.clear();
+    key_ = filter_topic;
+    if (!is_filter_topic(filter_topic.data(), filter_topic.size()))
+    {
+        error_ = "not a filter topic";
+        return false;
+    }
+    size_t sep = filter_topic.find(PROTOBUS_FILTER_SEP);
+    if (sep == std::string::npos || filter_topic.back() != PROTOBUS_FILTER_MARK || filter_topic.size() < sep + 2)
+    {
+        error_ = "missing expression";
+        return false;
+    }
+    topic_ = filter_topic.substr(1, sep - 1);
+    for (const std::string &text : split(filter_topic.substr(sep + 1, filter_topic.size() - sep - 2), "&&"))
+    {
+        predicate pred;
+        if (!parse_predicate(trim(text), pred))
+        {
+            return false;
+        }
+        predicates_.push_back(pred);
+    }
+    return true;
+}
+
+bool protobus_filter::parse_predicate(const std::string &text, predicate &pred)
+{
+    static const struct
+    {
+        const char *token;
+        op_type op;
+    } ops[] = {{"=[", OP_RANGE}, {"={", OP_SET}, {"==", OP_EQ}, {"!=", OP_NE}, {"<=", OP_LE}, {">=", OP_GE}, {"<", OP_LT}, {">", OP_GT}};
+
+    size_t op_pos = std::string::npos;
+    size_t op_len = 0;
+    for (const auto &op : ops)
+    {
+        size_t pos = text.find(op.token);
+        if (pos != std::string::npos && (pos < op_pos || (pos == op_pos && strlen(op.token) > op_len)))
+        {
+            op_pos = pos;
+            op_len = strlen(op.token);
+            pred.op = op.op;
+        }
+    }
+    if (op_pos == std::string::npos)
+    {
+        error_ = "no operator in '" + text + "'";
+        return false;
+    }
+
+    // resolve the field path with the descriptors of WrapperMessage
+    const Descriptor *desc = MSG::WrapperMessage::descriptor();
+    std::vector<std::string> names = split(trim(text.substr(0, op_pos)), ".");
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        const FieldDescriptor *field = desc == nullptr ? nullptr : desc->FindFieldByName(names[i]);
+        if (field == nullptr || field->is_repeated())
+        {
+            error_ = "unknown field '" + names[i] + "'";
+            return false;
+        }
+        pred.path.push_back(field->number());
+        if (i + 1 < names.size())
+        {
+            desc = field->message_type();
+        }
+        else if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE)
+        {
+            error_ = "'" + names[i] + "' is not a scalar field";
+            return false;
+        }
+        pred.field = field;
+    }
+
+    std::string operand = trim(text.substr(op_pos + op_len));
+    if (pred.op == OP_RANGE || pred.op == OP_SET)
+    {
+        char close = pred.op == OP_RANGE ? ']' : '}';
+        if (operand.empty() || operand.back() != close)
+        {
+            error_ = "unterminated list in '" + text + "'";
+            return false;
+        }
+        operand.pop_back();
+    }
+    std::vector<std::string> items;
+    if (pred.op == OP_RANGE || pred.op == OP_SET)
+        items = split(operand, ",");
+    else
+        items.push_back(operand);
+    if (pred.op == OP_RANGE && items.size() != 2)
+    {
+        error_ = "range needs two bounds in '" + text + "'";
+        return false;
+    }
+    for (const std::string &item : items)
+    {
+        value v;
+        if (!parse_value(pred, trim(item), v))
+        {
+            error_ = "bad value '" + item + "' in '" + text + "'";
+            return false;
+        }
+        pred.operands.push_back(v);
+    }
+    return true;
+}
+
+bool protobus_filter::parse_value(const predicate &pred, const std::string &text, value &out)
+{
+    char *end = nullptr;
+    errno = 0;
+    switch (kind_of(pred.field))
+    {
+    case KIND_SIGNED:
+        if (pred.field->cpp_type() == FieldDescriptor::CPPTYPE_ENUM)
+        {
+            const google::protobuf::EnumValueDescriptor *ev = pred.field->enum_type()->FindValueByName(text);
+            if (ev != nullptr)
+            {
+                out.i = ev->number();
+                return true;
+            }
+        }
+        out.i = strtoll(text.c_str(), &end, 0);
+        break;
+    case KIND_UNSIGNED:
+        if (pred.field->cpp_type() == FieldDescriptor::CPPTYPE_BOOL && (text == "true" || text == "false"))
+        {
+            out.u = text == "true";
+            return true;
+        }
+        out.u = strtoull(text.c_str(), &end, 0);
+        break;
+    case KIND_FLOAT:
+        out.d = strtod(text.c_str(), &end);
+        break;
+    case KIND_STRING:
+        out.s = text;
+        if (out.s.size() >= 2 && out.s.front() == '"' && out.s.back() == '"')
+            out.s = out.s.substr(1, out.s.size() - 2);
+        return true;
+    }
+    return !text.empty() && errno == 0 && end != nullptr && *end == '\0';
+}
+
+bool protobus_filter::match(const uint8_t *data, size_t size) const
+{
+    for (const predicate &pred : predicates_)
+    {
+        if (!eval(pred, data, size))
+            return false;
+    }
+    return true;
+}
+
+bool protobus_filter::eval(const predicate &pred, const uint8_t *data, size_t size) const
+{
+    // walk down the submessages, only the bytes on the path are looked at
+    const uint8_t *buf = data;
+    size_t len = size;
+    for (size_t i = 0; i + 1 < pred.path.size(); i++)
+    {
+        protobus_wire::field f;
+        if (!protobus_wire::find_field(buf, len, pred.path[i], f) || f.type != protobus_wire::WireFormatLite::WIRETYPE_LENGTH_DELIMITED)
+            return false;
+        buf = f.data;
+        len = f.size;
+    }
+
+    // an absent scalar has its default value (proto3)
+    value field_value;
+    protobus_wire::field f;
+    if (protobus_wire::find_field(buf, len, pred.path.back(), f))
+    {
+        switch (pred.field->type())
+        {
+        case FieldDescriptor::TYPE_SINT32:
+        case FieldDescriptor::TYPE_SINT64:
+            field_value.i = protobus_wire::WireFormatLite::ZigZagDecode64(f.value);
+            break;
+        case FieldDescriptor::TYPE_SFIXED32:
+            field_value.i = static_cast<int32_t>(f.value);
+            break;
+        case FieldDescriptor::TYPE_INT32:
+        case FieldDescriptor::TYPE_ENUM:
+            field_value.i = static_cast<int32_t>(f.value);
+            break;
+        case FieldDescriptor::TYPE_FLOAT:
+        {
+            uint32_t bits = static_cast<uint32_t>(f.value);
+            float v;
+            memcpy(&v, &bits, sizeof(v));
+            field_value.d = v;
+        }
+        break;
+        case FieldDescriptor::TYPE_DOUBLE:
+            memcpy(&field_value.d, &f.value, sizeof(field_value.d));
+            break;
+        case FieldDescriptor::TYPE_STRING:
+        case FieldDescriptor::TYPE_BYTES:
+            field_value.s.assign(reinterpret_cast<const char *>(f.data), f.size);
+            break;
+        default:
+            field_value.i = static_cast<int64_t>(f.value);
+            field_value.u = f.value;
+            break;
+        }
+    }
+
+    switch (pred.op)
+    {
+    case OP_EQ:
+        return compare(pred, field_value, pred.operands[0]) == 0;
+    case OP_NE:
+        return compare(pred, field_value, pred.operands[0]) != 0;
+    case OP_LT:
+        return compare(pred, field_value, pred.operands[0]) < 0;
+    case OP_LE:
+        return compare(pred, field_value, pred.operands[0]) <= 0;
+    case OP_GT:
+        return compare(pred, field_value, pred.operands[0]) > 0;
+    case OP_GE:
+        return compare(pred, field_value, pred.operands[0]) >= 0;
+    case OP_RANGE:
+        return compare(pred, field_value, pred.operands[0]) >= 0 && compare(pred, field_value, pred.operands[1]) <= 0;
+    case OP_SET:
+        for (const value &operand : pred.operands)
+        {
+            if (compare(pred, field_value, operand) == 0)
+                return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+int protobus_filter::compare(const predicate &pred, const value &field_value, const value &operand) const
+{
+    switch (kind_of(pred.field))
+    {
+    case KIND_SIGNED:
+        return field_value.i < operand.i ? -1 : (field_value.i > operand.i ? 1 : 0);
+    case KIND_UNSIGNED:
+        return field_value.u < operand.u ? -1 : (field_value.u > operand.u ? 1 : 0);
+    case KIND_FLOAT:
+        return field_value.d < operand.d ? -1 : (field_value.d > operand.d ? 1 : 0);
+    default:
+        return field_value.s.compare(operand.s);
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef __PROTOBUS_FILTER_H
+#define __PROTOBUS_FILTER_H
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "google/protobuf/descriptor.h"
+
+/*
+ * Content filter evaluated by protobus_proxy.
+ *
+ * A filtered subscription is a normal zmq subscription whose topic is
+ * PROTOBUS_FILTER_MARK + topic + PROTOBUS_FILTER_SEP + expression + PROTOBUS_FILTER_MARK,
+ * e.g. "\x1fpeople?people.age>60\x1f". The proxy forwards a copy of every
+ * matching message with that string as topic frame, so only that subscriber
+ * gets it. The trailing mark keeps one filter from being a zmq prefix of another.
+ *
+ * expression := predicate ('&&' predicate)*
+ * predicate  := path op value
+ *   path     := field names from WrapperMessage, e.g. people.age
+ *   op value := ==v | !=v | <v | <=v | >v | >=v   compare
+ *             | =[lo,hi]                          inclusive range
+ *             | ={a,b,c}                          set membership
+ */
+#define PROTOBUS_FILTER_MARK '\x1f'
+#define PROTOBUS_FILTER_SEP '?'
+
+class protobus_filter
+{
+public:
+    /* build the subscription topic for topic + expression */
+    static std::string make_topic(const std::string &topic, const std::string &expression);
+    static bool is_filter_topic(const void *data, size_t size);
+    /* the zmq topic a subscription needs upstream: topic of a filter topic, the subscription itself otherwise */
+    static std::string plain_topic(const std::string &subscription);
+
+    /* parse a subscription topic, false (with error()) on a bad expression */
+    bool parse(const std::string &filter_topic);
+    /* evaluate on a serialized WrapperMessage */
+    bool match(const uint8_t *data, size_t size) const;
+
+    inline const std::string &key() const { return key_; }
+    inline const std::string &topic() const { return topic_; }
+    inline const std::string &error() const { return error_; }
+
+private:
+    enum op_type
+    {
+        OP_EQ,
+        OP_NE,
+        OP_LT,
+        OP_LE,
+        OP_GT,
+        OP_GE,
+        OP_RANGE,
+        OP_SET
+    };
+    struct value
+    {
+        int64_t i = 0;
+        uint64_t u = 0;
+        double d = 0;
+        std::string s;
+    };
+    struct predicate
+    {
+        std::vector<uint32_t> path;
+        const google::protobuf::FieldDescriptor *field = nullptr;
+        op_type op = OP_EQ;
+        std::vector<value> operands;
+    };
+
+    bool parse_predicate(const std::string &text, predicate &pred);
+    bool parse_value(const predicate &pred, const std::string &text, value &out);
+    bool eval(const predicate &pred, const uint8_t *data, size_t size) const;
+    int compare(const predicate &pred, const value &field_value, const value &operand) const;
+
+    std::string key_;
+    std::string topic_;
+    std::string error_;
+    std::vector<predicate> predicates_;
+};
+#endif
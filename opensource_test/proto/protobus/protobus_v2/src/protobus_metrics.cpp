@@ -0,0 +1,177 @@
+#include "protobus_metrics.hpp"
+#include <cstring>
+#include <cstdio>
+#include <sstream>
+#include <algorithm>
+
+#define SLOT_FREE 0
+#define SLOT_BUSY 1
+
+uint64_t protobus_histogram::quantile(double q) const
+{
+    uint64_t total = count.load(std::memory_order_relaxed);
+    if (total == 0)
+        return 0;
+    uint64_t rank = static_cast<uint64_t>(q * total);
+    uint64_t seen = 0;
+    for (int i = 0; i < PROTOBUS_METRICS_BUCKETS; i++)
+    {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen > rank)
+            return bound(i) != 0 ? bound(i) : (1ull << (PROTOBUS_METRICS_BUCKETS - 1));
+    }
+    return 1ull << (PROTOBUS_METRICS_BUCKETS - 1);
+}
+
+void protobus_counters_snapshot::add(const protobus_counters &c)
+{
+    sent_msgs += c.sent_msgs.load(std::memory_order_relaxed);
+    sent_bytes += c.sent_bytes.load(std::memory_order_relaxed);
+    recv_msgs += c.recv_msgs.load(std::memory_order_relaxed);
+    recv_bytes += c.recv_bytes.load(std::memory_order_relaxed);
+    drops += c.drops.load(std::memory_order_relaxed);
+    hwm_hits += c.hwm_hits.load(std::memory_order_relaxed);
+    serialize_ns += c.serialize_ns.sum.load(std::memory_order_relaxed);
+    parse_ns += c.parse_ns.sum.load(std::memory_order_relaxed);
+    callback_ns += c.callback_ns.sum.load(std::memory_order_relaxed);
+    callbacks += c.callback_ns.count.load(std::memory_order_relaxed);
+}
+
+protobus_counters_snapshot protobus_metrics::total() const
+{
+    protobus_counters_snapshot snap;
+    for_each_topic([&](const char *, const protobus_counters &c)
+                   { snap.add(c); });
+    return snap;
+}
+
+protobus_metrics::protobus_metrics()
+{
+    strncpy(other_.name, PROTOBUS_METRICS_OTHER, sizeof(other_.name) - 1);
+    other_.hash = SLOT_BUSY + 1;
+}
+
+static uint64_t topic_hash(const std::string &topic)
+{
+    // FNV-1a, SLOT_FREE and SLOT_BUSY are reserved
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < topic.size() && i < PROTOBUS_METRICS_TOPIC_LEN - 1; i++)
+    {
+        h ^= static_cast<uint8_t>(topic[i]);
+        h *= 1099511628211ull;
+    }
+    return h <= SLOT_BUSY ? h + 2 : h;
+}
+
+protobus_counters &protobus_metrics::topic(const std::string &topic)
+{
+    uint64_t h = topic_hash(topic);
+    size_t len = std::min(topic.size(), static_cast<size_t>(PROTOBUS_METRICS_TOPIC_LEN - 1));
+    for (size_t i = 0; i < PROTOBUS_METRICS_TOPICS; i++)
+    {
+        slot &s = slots_[(h + i) % PROTOBUS_METRICS_TOPICS];
+        uint64_t cur = s.hash.load(std::memory_order_acquire);
+        if (cur == SLOT_FREE)
+        {
+            uint64_t expected = SLOT_FREE;
+            if (s.hash.compare_exchange_strong(expected, SLOT_BUSY, std::memory_order_acquire))
+            {
+                memcpy(s.name, topic.data(), len);
+                s.name[len] = '\0';
+                s.hash.store(h, std::memory_order_release);
+                return s.counters;
+            }
+            cur = expected;
+        }
+        while (cur == SLOT_BUSY)
+        {
+            // another thread is writing the name, a few instructions away
+            cur = s.hash.load(std::memory_order_acquire);
+        }
+        if (cur == h && strncmp(s.name, topic.data(), len) == 0 && s.name[len] == '\0')
+        {
+            return s.counters;
+        }
+    }
+    return other_.counters;
+}
+
+void protobus_metrics::for_each_topic(const std::function<void(const char *topic, const protobus_counters &counters)> &fn) const
+{
+    for (const slot &s : slots_)
+    {
+        if (s.hash.load(std::memory_order_acquire) > SLOT_BUSY)
+            fn(s.name, s.counters);
+    }
+    const protobus_counters &o = other_.counters;
+    if (o.sent_msgs.load() != 0 || o.recv_msgs.load() != 0 || o.drops.load() != 0 || o.hwm_hits.load() != 0)
+        fn(other_.name, o);
+}
+
+/* label value escaping of the text format */
+static std::string escape(const char *value)
+{
+    std::string out;
+    for (const char *p = value; *p != '\0'; p++)
+    {
+        if (*p == '\\' || *p == '"')
+            out += '\\';
+        if (*p == '\n')
+        {
+            out += "\\n";
+            continue;
+        }
+        out += *p;
+    }
+    return out;
+}
+
+static void write_counter(std::ostringstream &os, const char *name, const char *help, const std::string &node,
+                          const protobus_metrics &metrics, std::atomic<uint64_t> protobus_counters::*field)
+{
+    os << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n";
+    metrics.for_each_topic([&](const char *topic, const protobus_counters &c)
+                           { os << name << "{node=\"" << node << "\",topic=\"" << escape(topic) << "\"} " << (c.*field).load() << "\n"; });
+}
+
+static void write_histogram(std::ostringstream &os, const char *name, const char *help, const std::string &node,
+                            const protobus_metrics &metrics, protobus_histogram protobus_counters::*field)
+{
+    os << "# HELP " << name << " " << help << "\n# TYPE " << name << " histogram\n";
+    metrics.for_each_topic([&](const char *topic, const protobus_counters &c)
+                           {
+                               const protobus_histogram &h = c.*field;
+                               if (h.count.load() == 0)
+                                   return;
+                               uint64_t cumulative = 0;
+                               char le[32];
+                               for (int i = 0; i < PROTOBUS_METRICS_BUCKETS; i++)
+                               {
+                                   cumulative += h.buckets[i].load();
+                                   if (protobus_histogram::bound(i) != 0)
+                                       snprintf(le, sizeof(le), "%g", protobus_histogram::bound(i) / 1e9);
+                                   else
+                                       snprintf(le, sizeof(le), "+Inf");
+                                   os << name << "_bucket{node=\"" << node << "\",topic=\"" << escape(topic) << "\",le=\"" << le << "\"} " << cumulative << "\n";
+                               }
+                               os << name << "_sum{node=\"" << node << "\",topic=\"" << escape(topic) << "\"} " << h.sum.load() / 1e9 << "\n";
+                               os << name << "_count{node=\"" << node << "\",topic=\"" << escape(topic) << "\"} " << h.count.load() << "\n"; });
+}
+
+std::string protobus_metrics::prometheus(const std::string &node) const
+{
+    std::ostringstream os;
+    std::string label = escape(node.c_str());
+    write_counter(os, "protobus_sent_messages_total", "Messages sent.", label, *this, &protobus_counters::sent_msgs);
+    write_counter(os, "protobus_sent_bytes_total", "Serialized bytes sent.", label, *this, &protobus_counters::sent_bytes);
+    write_counter(os, "protobus_received_messages_total", "Messages received.", label, *this, &protobus_counters::recv_msgs);
+    write_counter(os, "protobus_received_bytes_total", "Serialized bytes received.", label, *this, &protobus_counters::recv_bytes);
+    write_counter(os, "protobus_dropped_messages_total", "Messages discarded by protobus (qos, lost chunks).", label, *this, &protobus_counters::drops);
+    write_counter(os, "protobus_hwm_hits_total", "Sends refused by a socket or topic high water mark.", label, *this, &protobus_counters::hwm_hits);
+    os << "# HELP protobus_queue_depth Messages waiting in the pub queue.\n# TYPE protobus_queue_depth gauge\n";
+    os << "protobus_queue_depth{node=\"" << label << "\"} " << queue_depth.load() << "\n";
+    write_histogram(os, "protobus_serialize_seconds", "Time to serialize a message.", label, *this, &protobus_counters::serialize_ns);
+    write_histogram(os, "protobus_parse_seconds", "Time to parse a message.", label, *this, &protobus_counters::parse_ns);
+    write_histogram(os, "protobus_callback_seconds", "Time spent in subscriber callbacks.", label, *this, &protobus_counters::callback_ns);
+    return os.str();
+}
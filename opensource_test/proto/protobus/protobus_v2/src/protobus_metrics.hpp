@@ -0,0 +1,100 @@
+#ifndef __PROTOBUS_METRICS_H
+#define __PROTOBUS_METRICS_H
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <functional>
+
+/* topics with their own counters, later topics are counted under PROTOBUS_METRICS_OTHER */
+#define PROTOBUS_METRICS_TOPICS 64
+#define PROTOBUS_METRICS_TOPIC_LEN 64
+#define PROTOBUS_METRICS_OTHER "_other"
+/* log2 buckets in ns, bucket i holds values below 2^i ns, the last one everything else */
+#define PROTOBUS_METRICS_BUCKETS 32
+
+class protobus_histogram
+{
+public:
+    inline void observe(uint64_t ns)
+    {
+        int idx = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+        if (idx >= PROTOBUS_METRICS_BUCKETS)
+            idx = PROTOBUS_METRICS_BUCKETS - 1;
+        buckets[idx].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(ns, std::memory_order_relaxed);
+    }
+    /* upper bound of bucket idx in ns, 0 for the last (+Inf) */
+    static inline uint64_t bound(int idx) { return idx + 1 < PROTOBUS_METRICS_BUCKETS ? (1ull << idx) : 0; }
+    /* approximate quantile, q in [0,1] */
+    uint64_t quantile(double q) const;
+
+    std::atomic<uint64_t> buckets[PROTOBUS_METRICS_BUCKETS] = {};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+};
+
+struct protobus_counters
+{
+    std::atomic<uint64_t> sent_msgs{0};
+    std::atomic<uint64_t> sent_bytes{0};
+    std::atomic<uint64_t> recv_msgs{0};
+    std::atomic<uint64_t> recv_bytes{0};
+    /* discarded by protobus: qos lifespan/history/hwm, lost chunks */
+    std::atomic<uint64_t> drops{0};
+    /* a socket or topic high water mark was reached */
+    std::atomic<uint64_t> hwm_hits{0};
+    protobus_histogram serialize_ns;
+    protobus_histogram parse_ns;
+    protobus_histogram callback_ns;
+};
+
+/* plain copy of counters, summed over topics for the instance totals */
+struct protobus_counters_snapshot
+{
+    uint64_t sent_msgs = 0;
+    uint64_t sent_bytes = 0;
+    uint64_t recv_msgs = 0;
+    uint64_t recv_bytes = 0;
+    uint64_t drops = 0;
+    uint64_t hwm_hits = 0;
+    /* sums in ns, divide by the message counts for the mean */
+    uint64_t serialize_ns = 0;
+    uint64_t parse_ns = 0;
+    uint64_t callback_ns = 0;
+    uint64_t callbacks = 0;
+    void add(const protobus_counters &c);
+};
+
+/*
+ * Metrics of one protobus instance, the counters are kept per topic in a
+ * fixed table and summed for the instance totals. Updates and lookups take
+ * no lock, a topic claims its slot with a CAS the first time it is seen.
+ */
+class protobus_metrics
+{
+public:
+    protobus_metrics();
+    protobus_counters_snapshot total() const;
+    /* counters of topic, the overflow slot when the table is full */
+    protobus_counters &topic(const std::string &topic);
+    void for_each_topic(const std::function<void(const char *topic, const protobus_counters &counters)> &fn) const;
+
+    /* messages waiting in the pub queue */
+    std::atomic<int64_t> queue_depth{0};
+
+    /* Prometheus text exposition format */
+    std::string prometheus(const std::string &node) const;
+
+private:
+    struct slot
+    {
+        /* 0 free, 1 being claimed, otherwise hash of name */
+        std::atomic<uint64_t> hash{0};
+        char name[PROTOBUS_METRICS_TOPIC_LEN];
+        protobus_counters counters;
+    };
+    slot slots_[PROTOBUS_METRICS_TOPICS];
+    slot other_;
+};
+#endif
@@ -0,0 +1,159 @@
+#include "protobus_trace.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace
+{
+    struct span_record
+    {
+        uint64_t trace_id;
+        uint64_t begin;
+        uint64_t end;
+        uint32_t point;
+    };
+
+    /* written only by its thread, head is published with release for dump() */
+    struct thread_buffer
+    {
+        uint32_t tid;
+        std::atomic<uint64_t> head{0};
+        span_record spans[PROTOBUS_TRACE_SPANS];
+    };
+
+    /* never freed, spans of finished threads are still dumped */
+    struct trace_state
+    {
+        std::mutex mutex;
+        std::vector<thread_buffer *> buffers;
+        std::string process_name;
+        std::string dir = "/tmp";
+        bool initialized = false;
+    };
+
+    trace_state &state()
+    {
+        static trace_state *s = new trace_state();
+        return *s;
+    }
+
+    thread_local thread_buffer *local_buffer = nullptr;
+
+    thread_buffer *get_buffer()
+    {
+        if (local_buffer == nullptr)
+        {
+            thread_buffer *buf = new thread_buffer();
+            buf->tid = static_cast<uint32_t>(syscall(SYS_gettid));
+            trace_state &s = state();
+            std::lock_guard<std::mutex> lk(s.mutex);
+            s.buffers.push_back(buf);
+            local_buffer = buf;
+        }
+        return local_buffer;
+    }
+}
+
+std::atomic<uint32_t> protobus_trace::sampling{0};
+
+void protobus_trace::init(const char *process_name)
+{
+    trace_state &s = state();
+    std::lock_guard<std::mutex> lk(s.mutex);
+    if (s.initialized)
+        return;
+    s.initialized = true;
+    if (process_name != nullptr)
+        s.process_name = process_name;
+    const char *dir = getenv("PROTOBUS_TRACE_DIR");
+    if (dir != nullptr && dir[0] != '\0')
+        s.dir = dir;
+    const char *one_in = getenv("PROTOBUS_TRACE");
+    if (one_in != nullptr)
+        sampling = static_cast<uint32_t>(strtoul(one_in, nullptr, 10));
+}
+
+void protobus_trace::set_sampling(uint32_t one_in)
+{
+    sampling = one_in;
+}
+
+uint64_t protobus_trace::sample()
+{
+    uint32_t one_in = sampling.load(std::memory_order_relaxed);
+    if (one_in == 0)
+        return 0;
+    thread_local uint64_t count = 0;
+    thread_local uint64_t salt = 0;
+    if (++count % one_in != 0)
+        return 0;
+    if (salt == 0)
+    {
+        // ids only have to be unique among the processes of one trace
+        std::random_device rd;
+        salt = (static_cast<uint64_t>(rd()) << 32 | rd()) & ~0xffffffull;
+        salt |= 1ull << 63;
+    }
+    return salt | (count / one_in & 0xffffff);
+}
+
+void protobus_trace::record(uint64_t trace_id, span_point point, uint64_t begin_ns, uint64_t end_ns)
+{
+    thread_buffer *buf = get_buffer();
+    uint64_t head = buf->head.load(std::memory_order_relaxed);
+    span_record &rec = buf->spans[head % PROTOBUS_TRACE_SPANS];
+    rec.trace_id = trace_id;
+    rec.begin = begin_ns;
+    rec.end = end_ns;
+    rec.point = point;
+    buf->head.store(head + 1, std::memory_order_release);
+}
+
+const char *protobus_trace::point_name(span_point point)
+{
+    static const char *names[SPAN_MAX] = {"send", "send_msg", "proxy", "recv", "callback"};
+    return point < SPAN_MAX ? names[point] : "unknown";
+}
+
+bool protobus_trace::dump(const char *path)
+{
+    trace_state &s = state();
+    std::lock_guard<std::mutex> lk(s.mutex);
+    std::string file;
+    if (path != nullptr)
+        file = path;
+    else
+        file = s.dir + "/protobus_trace." + std::to_string(getpid()) + ".json";
+
+    FILE *fp = fopen(file.c_str(), "w");
+    if (fp == nullptr)
+    {
+        perror(file.c_str());
+        return false;
+    }
+    // one line per span: [trace_id, point, tid, begin_ns, end_ns]
+    fprintf(fp, "{\"pid\":%d,\"name\":\"%s\",\"spans\":[", getpid(), s.process_name.c_str());
+    bool first = true;
+    for (thread_buffer *buf : s.buffers)
+    {
+        // a thread still recording may overwrite the oldest entries while we read
+        uint64_t head = buf->head.load(std::memory_order_acquire);
+        uint64_t begin = head > PROTOBUS_TRACE_SPANS ? head - PROTOBUS_TRACE_SPANS : 0;
+        for (uint64_t i = begin; i < head; i++)
+        {
+            const span_record &rec = buf->spans[i % PROTOBUS_TRACE_SPANS];
+            fprintf(fp, "%s\n[%llu,\"%s\",%u,%llu,%llu]", first ? "" : ",",
+                    static_cast<unsigned long long>(rec.trace_id), point_name(static_cast<span_point>(rec.point)),
+                    buf->tid, static_cast<unsigned long long>(rec.begin), static_cast<unsigned long long>(rec.end));
+            first = false;
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    return true;
+}
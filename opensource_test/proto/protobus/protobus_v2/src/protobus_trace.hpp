@@ -0,0 +1,80 @@
+#ifndef __PROTOBUS_TRACE_H
+#define __PROTOBUS_TRACE_H
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <time.h>
+
+/*
+ * Per message tracing.
+ *
+ * A sampled message carries WrapperMessage.trace_id, every process that
+ * handles it records spans (send, send_msg, proxy, recv, callback) into a
+ * buffer owned by the recording thread, so recording takes no lock. Each
+ * process dumps its spans to <dir>/protobus_trace.<pid>.json and the
+ * protobus_trace tool merges the dumps into one Chrome/Perfetto trace.
+ *
+ * Environment:
+ *   PROTOBUS_TRACE=N       trace 1 in N messages (recording on), 0 or unset off
+ *   PROTOBUS_TRACE_DIR=d   dump directory, default /tmp
+ */
+/* spans kept per thread, the oldest ones are overwritten */
+#define PROTOBUS_TRACE_SPANS 8192
+/* WrapperMessage field number of trace_id, for code that only scans the wire */
+#define PROTOBUS_TRACE_FIELD 10
+
+class protobus_trace
+{
+public:
+    typedef enum
+    {
+        SPAN_SEND,
+        SPAN_SEND_MSG,
+        SPAN_PROXY,
+        SPAN_RECV,
+        SPAN_CALLBACK,
+        SPAN_MAX
+    } span_point;
+
+    /* read PROTOBUS_TRACE / PROTOBUS_TRACE_DIR, done once */
+    static void init(const char *process_name);
+    /* 1 in one_in messages get a trace id, 0 turns tracing off */
+    static void set_sampling(uint32_t one_in);
+    static inline bool enabled() { return sampling.load(std::memory_order_relaxed) != 0; }
+    /* new trace id for a message being sent, 0 if it is not sampled */
+    static uint64_t sample();
+    static inline uint64_t now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+    }
+    static void record(uint64_t trace_id, span_point point, uint64_t begin_ns, uint64_t end_ns);
+    /* write the spans of all threads, path nullptr means the default file */
+    static bool dump(const char *path = nullptr);
+    static const char *point_name(span_point point);
+
+private:
+    static std::atomic<uint32_t> sampling;
+};
+
+/* records one span for the scope, nothing when trace_id is 0 */
+class protobus_span
+{
+public:
+    protobus_span(uint64_t trace_id, protobus_trace::span_point point)
+        : trace_id(trace_id), point(point), begin(trace_id != 0 ? protobus_trace::now() : 0) {}
+    ~protobus_span()
+    {
+        if (trace_id != 0)
+            protobus_trace::record(trace_id, point, begin, protobus_trace::now());
+    }
+    protobus_span(const protobus_span &) = delete;
+    void operator=(const protobus_span &) = delete;
+
+private:
+    uint64_t trace_id;
+    protobus_trace::span_point point;
+    uint64_t begin;
+};
+#endif
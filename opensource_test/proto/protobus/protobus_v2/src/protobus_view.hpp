@@ -0,0 +1,216 @@
+#ifndef __PROTOBUS_VIEW_H
+#define __PROTOBUS_VIEW_H
+#include "message.pb.h"
+#include <memory>
+#include <string>
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/wire_format_lite.h"
+
+/* scan serialized protobuf without building the message */
+namespace protobus_wire
+{
+    using google::protobuf::internal::WireFormatLite;
+
+    struct field
+    {
+        uint32_t number = 0;
+        WireFormatLite::WireType type = WireFormatLite::WIRETYPE_VARINT;
+        /* varint / fixed32 / fixed64 value */
+        uint64_t value = 0;
+        /* length delimited value */
+        const uint8_t *data = nullptr;
+        size_t size = 0;
+    };
+
+    /* visit every top level field of buf, stop when fn returns false */
+    template <typename Fn>
+    inline bool for_each_field(const uint8_t *buf, size_t len, Fn fn)
+    {
+        google::protobuf::io::CodedInputStream in(buf, static_cast<int>(len));
+        for (uint32_t tag = in.ReadTag(); tag != 0; tag = in.ReadTag())
+        {
+            field f;
+            f.number = WireFormatLite::GetTagFieldNumber(tag);
+            f.type = WireFormatLite::GetTagWireType(tag);
+            switch (f.type)
+            {
+            case WireFormatLite::WIRETYPE_VARINT:
+                if (!in.ReadVarint64(&f.value))
+                    return false;
+                break;
+            case WireFormatLite::WIRETYPE_FIXED64:
+                if (!in.ReadLittleEndian64(&f.value))
+                    return false;
+                break;
+            case WireFormatLite::WIRETYPE_FIXED32:
+            {
+                uint32_t v;
+                if (!in.ReadLittleEndian32(&v))
+                    return false;
+                f.value = v;
+            }
+            break;
+            case WireFormatLite::WIRETYPE_LENGTH_DELIMITED:
+            {
+                uint32_t n;
+                if (!in.ReadVarint32(&n))
+                    return false;
+                size_t pos = static_cast<size_t>(in.CurrentPosition());
+                if (n > len - pos)
+                    return false;
+                f.data = buf + pos;
+                f.size = n;
+                in.Skip(static_cast<int>(n));
+            }
+            break;
+            default:
+                if (!WireFormatLite::SkipField(&in, tag))
+                    return false;
+                continue;
+            }
+            if (!fn(f))
+                break;
+        }
+        return true;
+    }
+
+    /* last occurrence wins, like the proto3 parser does for scalars */
+    inline bool find_field(const uint8_t *buf, size_t len, uint32_t number, field &out)
+    {
+        bool found = false;
+        for_each_field(buf, len, [&](const field &f)
+                       {
+                           if (f.number == number)
+                           {
+                               out = f;
+                               found = true;
+                           }
+                           return true; });
+        return found;
+    }
+}
+
+/*
+ * Lightweight view on a received WrapperMessage: topic, oneof case and the raw
+ * payload bytes. Nothing is decoded until the callback asks for it, either one
+ * payload field at a time or the whole message.
+ */
+class protobus_view
+{
+public:
+    protobus_view(const std::string &topic, const uint8_t *data, size_t size)
+        : topic_(topic), data_(data), size_(size) {}
+
+    inline const std::string &topic() const { return topic_; }
+    inline const uint8_t *data() const { return data_; }
+    inline size_t size() const { return size_; }
+
+    /* oneof field number, same values as WrapperMessage::MessageTypeCase */
+    MSG::WrapperMessage::MessageTypeCase message_type_case() const
+    {
+        scan();
+        return static_cast<MSG::WrapperMessage::MessageTypeCase>(payload_field_);
+    }
+    /* serialized oneof submessage (msg_people, msg_address, ...) */
+    inline const uint8_t *payload_data() const
+    {
+        scan();
+        return payload_data_;
+    }
+    inline size_t payload_size() const
+    {
+        scan();
+        return payload_size_;
+    }
+
+    /* decode a single scalar field of the payload, false if it is not set */
+    bool get_uint64(uint32_t field_number, uint64_t &value) const
+    {
+        protobus_wire::field f;
+        if (!find_payload_field(field_number, f) || f.type == protobus_wire::WireFormatLite::WIRETYPE_LENGTH_DELIMITED)
+            return false;
+        value = f.value;
+        return true;
+    }
+    bool get_int64(uint32_t field_number, int64_t &value) const
+    {
+        uint64_t v;
+        if (!get_uint64(field_number, v))
+            return false;
+        value = static_cast<int64_t>(v);
+        return true;
+    }
+    bool get_int32(uint32_t field_number, int32_t &value) const
+    {
+        uint64_t v;
+        if (!get_uint64(field_number, v))
+            return false;
+        value = static_cast<int32_t>(v);
+        return true;
+    }
+    bool get_string(uint32_t field_number, std::string &value) const
+    {
+        protobus_wire::field f;
+        if (!find_payload_field(field_number, f) || f.type != protobus_wire::WireFormatLite::WIRETYPE_LENGTH_DELIMITED)
+            return false;
+        value.assign(reinterpret_cast<const char *>(f.data), f.size);
+        return true;
+    }
+
+    /* decode only the payload submessage, e.g. parse_payload(msg_people) */
+    template <typename T>
+    bool parse_payload(T &msg) const
+    {
+        scan();
+        return msg.ParseFromArray(payload_data_, static_cast<int>(payload_size_));
+    }
+
+    /* full decode, done once and cached */
+    const MSG::WrapperMessage &message() const
+    {
+        if (!full_)
+        {
+            full_ = std::make_unique<MSG::WrapperMessage>();
+            full_->ParseFromArray(data_, static_cast<int>(size_));
+        }
+        return *full_;
+    }
+
+private:
+    bool find_payload_field(uint32_t field_number, protobus_wire::field &f) const
+    {
+        scan();
+        if (payload_data_ == nullptr)
+            return false;
+        return protobus_wire::find_field(payload_data_, payload_size_, field_number, f);
+    }
+    void scan() const
+    {
+        if (scanned_)
+            return;
+        scanned_ = true;
+        static const google::protobuf::OneofDescriptor *oneof =
+            MSG::WrapperMessage::descriptor()->FindOneofByName("message_type");
+        protobus_wire::for_each_field(data_, size_, [this](const protobus_wire::field &f)
+                                      {
+                                          const google::protobuf::FieldDescriptor *fd =
+                                              MSG::WrapperMessage::descriptor()->FindFieldByNumber(f.number);
+                                          if (fd != nullptr && fd->containing_oneof() == oneof)
+                                          {
+                                              payload_field_ = f.number;
+                                              payload_data_ = f.data;
+                                              payload_size_ = f.size;
+                                          }
+                                          return true; });
+    }
+
+    const std::string &topic_;
+    const uint8_t *data_;
+    size_t size_;
+    mutable bool scanned_ = false;
+    mutable uint32_t payload_field_ = 0;
+    mutable const uint8_t *payload_data_ = nullptr;
+    mutable size_t payload_size_ = 0;
+    mutable std::unique_ptr<MSG::WrapperMessage> full_;
+};
+#endif